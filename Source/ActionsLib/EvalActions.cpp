@@ -73,6 +73,11 @@ static void DoEvalBase(const ConfigParameters& config, IDataReader& reader)
                            config(L"traceNodeNamesCategory", ConfigParameters::Array(stringargvector())),
                            config(L"traceNodeNamesSparse",   ConfigParameters::Array(stringargvector())));
 
+    // multiply from 16-bit copies of the weights ("float16" or "bfloat16"; CPU only), e.g. for a model saved with saveModelElementType
+    wstring weightElementType = config(L"weightElementType", L"");
+    if (!weightElementType.empty())
+        net->EnableFloat16Weights(true, Float16FormatFromName(weightElementType));
+
     SimpleEvaluator<ElemType> eval(net, MPIWrapper::GetInstance(), enableDistributedMBReading, numMBsToShowResult, 
                                    firstMBsToShowResult, traceLevel, maxSamplesInRAM, numSubminiBatches);
     eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
@@ -235,7 +240,14 @@ void DoWriteOutput(const ConfigParameters& config)
                            config(L"traceNodeNamesCategory", ConfigParameters::Array(stringargvector())),
                            config(L"traceNodeNamesSparse",   ConfigParameters::Array(stringargvector())));
 
-    SimpleOutputWriter<ElemType> writer(net, 1);
+    // multiply from 16-bit copies of the weights (see DoEvalBase())
+    wstring weightElementType = config(L"weightElementType", L"");
+    if (!weightElementType.empty())
+        net->EnableFloat16Weights(true, Float16FormatFromName(weightElementType));
+
+    // with distributedMBReading, each MPI rank writes the output for its share of the data to its own shard
+    bool enableDistributedMBReading = config(L"distributedMBReading", false);
+    SimpleOutputWriter<ElemType> writer(net, 1, enableDistributedMBReading ? MPIWrapper::GetInstance() : nullptr);
 
     if (config.Exists("writer"))
     {
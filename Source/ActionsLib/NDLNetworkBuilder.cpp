@@ -11,6 +11,7 @@
 #include "NDLNetworkBuilder.h"
 #include "LinearAlgebraNodes.h"
 #include "RecurrentNodes.h"
+#include "RNNNodes.h"
 #include "ConvolutionalNodes.h"
 #include "NonlinearityNodes.h"
 #include "ReshapingNodes.h"
@@ -521,6 +522,51 @@ void NDLNodeEvaluatorImpl<ElemType>::Evaluate(NDLNode<ElemType>* node, const wst
             nodePtr = builder.BatchNormalization(nullptr, nullptr, nullptr, nullptr, nullptr, spatial, normTimeConst, blendTimeConst, epsilon, useCntkEngine, imageLayoutKind, name);
         }
     }
+    else if (cnNodeType == OperationNameOf(SampledCrossEntropyWithSoftmaxNode))
+    {
+        if (parameter.size() != 4)
+            RuntimeError("%ls should have 4 fixed parameters [labels, hidden, weights, bias] and the parameters numSamples and samplingDistribution = [\"logUniform\"|\"uniform\"].", cnNodeType.c_str());
+
+        // setup the parameter position of children so we can hook them up later
+        nodeParamCount = 4;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            size_t numSamples = node->GetOptionalParameter("numSamples", "0");
+            std::wstring samplingDistribution = node->GetOptionalParameter("samplingDistribution", "logUniform");
+            if (numSamples == 0)
+                RuntimeError("%ls requires the parameter numSamples.", cnNodeType.c_str());
+            nodePtr = builder.SampledCrossEntropyWithSoftmax(nullptr, nullptr, nullptr, nullptr, numSamples, samplingDistribution, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(LSTMNode) ||
+             cnNodeType == OperationNameOf(GRUNode))
+    {
+        if (parameter.size() != 3)
+            RuntimeError("%ls should have 3 fixed parameters [weightNodeName, inputValueNodeName, hiddenDim] and two optional parameters [numLayers = [1|yourvalue], bidirectional = [false|yourvalue]].", cnNodeType.c_str());
+
+        // setup the parameter position of children so we can hook them up later
+        nodeParamCount = 2;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            int id = 2; // skip weightNodeName and inputValueNodeName
+            // evaluate only scalar parameters
+            vector<void*> params = EvaluateParameters(node, baseName, id, parameter.size() - id, pass);
+            size_t hiddenDim = ((NDLNode<ElemType>*) params[0])->GetScalar();
+
+            // Optional parameters
+            size_t numLayers = node->GetOptionalParameter("numLayers", "1");
+            bool bidirectional = node->GetOptionalParameter("bidirectional", "false");
+
+            if (cnNodeType == OperationNameOf(LSTMNode))
+                nodePtr = builder.LSTM(nullptr, nullptr, hiddenDim, numLayers, bidirectional, name);
+            else
+                nodePtr = builder.GRU(nullptr, nullptr, hiddenDim, numLayers, bidirectional, name);
+        }
+    }
     else
     {
 
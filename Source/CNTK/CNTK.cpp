@@ -22,6 +22,7 @@
 #include "NDLNetworkBuilder.h"
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
+#include "CPUMemAllocator.h"
 #include "GPUMatrix.h" // used for SyncGuard::EnableSync()
 #include "CommonMatrix.h"
 #include "SGD.h"
@@ -172,6 +173,15 @@ static void DisableLegacyUsage(const ConfigParameters& TopLevelConfig, const Con
     }
 }
 
+// configure the reuse of freed CPU matrix buffers, and huge pages for large ones
+template <class ConfigRecordType>
+static void SetCPUMemoryOptions(const ConfigRecordType& config)
+{
+    size_t cacheSizeMB = config(L"cpuMemoryCacheSizeMB", (size_t) 256);
+    bool useHugePages = config(L"cpuHugePages", false);
+    CPUMemAllocator::Instance().SetOptions(cacheSizeMB * 1024 * 1024, useHugePages);
+}
+
 // When running in parallel with MPI, only commands in 'commandstoRunOnAllRanks' should
 // be run in parallel across multiple ranks. Others should only run on rank 0
 const std::set<std::string> commandstoRunOnAllRanks = { "train", "trainRNN", "adapt", "test", "eval", "cv", "devtest" };
@@ -189,6 +199,7 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
     {
         LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
     }
+    SetCPUMemoryOptions(config);
 
     bool progressTracing = config(L"progressTracing", false);
 
@@ -537,6 +548,9 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
+    // random initialization from a counter-based generator, which gives the same values for any number of threads
+    CPUMatrix<float /*any will do*/>::SetUseCounterBasedRNG(config(L"counterBasedCPURNG", false));
+
     bool synchronizeCUDAKernelExecutions = config(L"synchronizeCUDAKernelExecutions", false);
     if (synchronizeCUDAKernelExecutions)
         SyncGuard::EnableSync();
@@ -567,6 +581,7 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreads(numCPUThreads);
     if (numCPUThreads > 0)
         LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
+    SetCPUMemoryOptions(config);
 
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
@@ -601,6 +616,7 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         fprintf(fp, "successfully finished at %s on %s\n", TimeDateStamp().c_str(), GetHostName().c_str());
         fcloseOrDie(fp);
     }
+    CPUMemAllocator::Instance().PrintStatistics(stderr);
     // TODO: change this back to COMPLETED, double underscores don't look good in output
     LOGPRINTF(stderr, "__COMPLETED__\n");
     fflush(stderr);
@@ -652,6 +668,8 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
+    CPUMatrix<float /*any will do*/>::SetUseCounterBasedRNG(config(L"counterBasedCPURNG", false));
+
     if (logpath != L"")
     {
         for (int i = 0; i < command.size(); i++)
@@ -733,6 +751,7 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
         fprintf(fp, "successfully finished at %s on %s\n", TimeDateStamp().c_str(), GetHostName().c_str());
         fcloseOrDie(fp);
     }
+    CPUMemAllocator::Instance().PrintStatistics(stderr);
     // TODO: Change back to COMPLETED (no underscores)
     LOGPRINTF(stderr, "__COMPLETED__\n");
     fflush(stderr);
@@ -192,7 +192,7 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
 
         // validate the network before we save it out
         ProcessNDLScript(m_netNdlDefault, ndlPassAll, true);
-        cn->SaveEdited(fileName);
+        cn->SaveEdited(fileName, GetModelFileOptions(modelFormat));
     }
     else if (EqualInsensitive(name, "SaveModel"))
     {
@@ -211,7 +211,7 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
 
         // validate and finish the second pass through NDL if any in-line NDL was defined
         ProcessNDLScript(netNdl, ndlPassAll, true);
-        netNdl->cn->SaveEdited(fileName);
+        netNdl->cn->SaveEdited(fileName, GetModelFileOptions(modelFormat));
     }
     else if (EqualInsensitive(name, "SetDefaultModel"))
     {
@@ -456,9 +456,17 @@ public:
                     {
                         modelFormat = L"cntk_legacy_no_tensorlib";
                     }
+                    else if (EqualInsensitive(value, "cntk_float16")) // (when saving) dense matrices with IEEE half-precision elements
+                    {
+                        modelFormat = L"cntk_float16";
+                    }
+                    else if (EqualInsensitive(value, "cntk_bfloat16")) // (when saving) dense matrices with bfloat16 elements
+                    {
+                        modelFormat = L"cntk_bfloat16";
+                    }
                     else
                     {
-                        RuntimeError("Invalid optional parameter value %s, valid values are: format=(cntk)", value.c_str());
+                        RuntimeError("Invalid optional parameter value %s, valid values are: format=(cntk|cntk_float16|cntk_bfloat16)", value.c_str());
                     }
                 }
                 else
@@ -471,6 +479,17 @@ public:
         return modelFormat;
     }
 
+    // options for writing a model file in the given format
+    static FileOptions GetModelFileOptions(const std::wstring& modelFormat)
+    {
+        if (modelFormat == L"cntk_float16")
+            return (FileOptions) (fileOptionsBinary | Float16FileOption(Float16Format::Half));
+        else if (modelFormat == L"cntk_bfloat16")
+            return (FileOptions) (fileOptionsBinary | Float16FileOption(Float16Format::BFloat16));
+        else
+            return fileOptionsBinary;
+    }
+
     std::string GetOptionalSnippetSection(const ConfigParamList& params, const size_t numFixedParams)
     {
         // process optional parameter if it exists
@@ -242,9 +242,57 @@ namespace CNTK
         return false;
     }
 
+    // Attempts to perform preprocessing, update and postprocessing in a single sweep via Matrix::FusedUpdateWeights().
+    // Returns false if this is not supported for the learner or the gradient (e.g. sparse or GPU gradients, noise injection).
+    // Sparse gradients are excluded since the fused sparse update defers the updates of untouched columns (see
+    // SparseUpdateHistory), and learners have no point at which such columns could be brought up to date.
+    template <typename ElementType>
+    bool LearnerBase::FusedUpdate(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const
+    {
+        if (m_additionalOptions.gaussianNoiseInjectionStdDev > 0)
+            return false;
+
+        FusedWeightUpdateParams params;
+        if (!GetFusedUpdateParams(parameter, trainingSampleCount, params))
+            return false;
+
+        const auto& gradientMatrix = GetWritableMatrix<ElementType>(gradientValue);
+        const auto& parameterMatrix = GetWritableMatrix<ElementType>(parameter.Value());
+        if (!Matrix<ElementType>::IsFusedWeightUpdateSupported(*gradientMatrix, *parameterMatrix))
+            return false;
+
+        if (gradientMatrix->GetMatrixType() == MatrixType::SPARSE)
+            return false;
+
+        // multiply by actualMBSize so that regularization is invariant to minibatch size since learning rate is per sample
+        params.learnRatePerSample = ParameterDependentLearningRate(parameter);
+        params.l2Weight = m_additionalOptions.l2RegularizationWeight > 0 ? m_additionalOptions.l2RegularizationWeight * trainingSampleCount : 0;
+        params.l1Threshold = params.learnRatePerSample * m_additionalOptions.l1RegularizationWeight * trainingSampleCount;
+
+        // same as ClipGradient()
+        if (m_additionalOptions.gradientClippingThresholdPerSample != numeric_limits<double>::infinity())
+        {
+            double maxGradientPerMB = m_additionalOptions.gradientClippingThresholdPerSample * trainingSampleCount;
+            if (m_additionalOptions.gradientClippingWithTruncation)
+                params.truncationThreshold = maxGradientPerMB;
+            else
+            {
+                double gradientNorm = gradientMatrix->FrobeniusNorm();
+                if (gradientNorm > maxGradientPerMB)
+                    params.gradientScale = maxGradientPerMB / gradientNorm;
+            }
+        }
+
+        GetWritableMatrix<ElementType>(smoothedGradientValue)->FusedUpdateWeights(*gradientMatrix, *parameterMatrix, params);
+        return true;
+    }
+
     template <typename ElementType>
     void LearnerBase::Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const
     {
+        if (FusedUpdate<ElementType>(parameter, gradientValue, smoothedGradientValue, trainingSampleCount))
+            return;
+
         const auto& parameterValue = parameter.Value();
         PreProcess<ElementType>(parameterValue, gradientValue, trainingSampleCount);
         Update(parameter, gradientValue, smoothedGradientValue, trainingSampleCount);
@@ -328,6 +376,13 @@ namespace CNTK
                                             learningRate, ElementType(m_momentumPerSample), m_useNesterovAcceleration);
     }
 
+    /*virtual*/ bool LearnerSGD::GetFusedUpdateParams(const Parameter& /*parameter*/, size_t /*trainingSampleCount*/, FusedWeightUpdateParams& params) const /*override*/
+    {
+        params.type = m_useNesterovAcceleration ? FusedWeightUpdateType::Nesterov : FusedWeightUpdateType::Momentum;
+        params.momentum = m_momentumPerSample;
+        return true;
+    }
+
     LearnerAdaGrad::LearnerAdaGrad(const unordered_set<Parameter>& parameters, bool needAveMultiplier)
         : LearnerBase(parameters), m_needAveMultiplier(needAveMultiplier)
     {
@@ -354,6 +409,13 @@ namespace CNTK
         Matrix<ElementType>::ScaleAndAdd(ElementType(-learningRate / aveMultiplier), *gradientMatrix, *parameterMatrix);
     }
 
+    /*virtual*/ bool LearnerAdaGrad::GetFusedUpdateParams(const Parameter& /*parameter*/, size_t /*trainingSampleCount*/, FusedWeightUpdateParams& params) const /*override*/
+    {
+        params.type = FusedWeightUpdateType::AdaGrad;
+        params.needAveMultiplier = m_needAveMultiplier;
+        return true;
+    }
+
     LearnerFSAdaGrad::LearnerFSAdaGrad(const unordered_set<Parameter>& parameters)
         : LearnerMomentumSGD(parameters)
     {
@@ -382,6 +444,14 @@ namespace CNTK
                                             learningRate, ElementType(m_momentumPerSample));
     }
 
+    /*virtual*/ bool LearnerFSAdaGrad::GetFusedUpdateParams(const Parameter& /*parameter*/, size_t trainingSampleCount, FusedWeightUpdateParams& params) const /*override*/
+    {
+        params.type = FusedWeightUpdateType::FSAdaGrad;
+        params.momentum = m_momentumPerSample;
+        params.mbSize = trainingSampleCount;
+        return true;
+    }
+
     LearnerRMSProp::LearnerRMSProp(const unordered_set<Parameter>& parameters,
                                     double gamma, double inc, double dec, double max, double min, bool needAveMultiplier)
                                     : LearnerBase(parameters),
@@ -414,6 +484,18 @@ namespace CNTK
         Matrix<ElementType>::ScaleAndAdd(ElementType(-learningRate / aveMultiplier), *gradientMatrix, *parameterMatrix);
     }
 
+    /*virtual*/ bool LearnerRMSProp::GetFusedUpdateParams(const Parameter& /*parameter*/, size_t /*trainingSampleCount*/, FusedWeightUpdateParams& params) const /*override*/
+    {
+        params.type = FusedWeightUpdateType::RmsProp;
+        params.rmsGamma = m_gamma;
+        params.rmsWeightInc = m_inc;
+        params.rmsWeightMax = m_max;
+        params.rmsWeightDec = m_dec;
+        params.rmsWeightMin = m_min;
+        params.needAveMultiplier = m_needAveMultiplier;
+        return true;
+    }
+
     // Explicit template instantiations
     template shared_ptr<Matrix<float>> LearnerBase::GetWritableMatrix<float>(const NDArrayViewPtr& arrayView);
     template shared_ptr<Matrix<double>> LearnerBase::GetWritableMatrix<double>(const NDArrayViewPtr& arrayView);
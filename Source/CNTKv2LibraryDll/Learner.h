@@ -7,6 +7,10 @@
 #include "CNTKLibrary.h"
 #include <numeric>
 
+namespace Microsoft { namespace MSR { namespace CNTK {
+    struct FusedWeightUpdateParams;
+}}}
+
 namespace CNTK 
 {
     // A collection of additional options that are applicable for all standard learners 
@@ -51,6 +55,14 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const = 0;
 
+        // Describes the learner-specific part of the update (type, momentum, etc.) for the single-pass
+        // Matrix::FusedUpdateWeights(), which replaces PreProcess(), Update() and PostProcess() where supported.
+        // Returns false if the learner has no fused equivalent.
+        virtual bool GetFusedUpdateParams(const Parameter& /*parameter*/, size_t /*trainingSampleCount*/, Microsoft::MSR::CNTK::FusedWeightUpdateParams& /*params*/) const
+        {
+            return false;
+        }
+
         double ParameterDependentLearningRate(const Parameter& parameter) const
         {
             return m_learningRatePerSample * m_additionalOptions.learningRateMultipliers.at(parameter);
@@ -97,6 +109,10 @@ namespace CNTK
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
 
+        // Single-pass replacement for the above (see GetFusedUpdateParams()); returns false if not applicable.
+        template <typename ElementType>
+        bool FusedUpdate(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
+
         // TODO: make these functions friends of NDViewArray and move to Utils?
         static bool HasNan(const NDArrayViewPtr& value, const char* name);
         static void Print(const NDArrayViewPtr& value, const char* msg);
@@ -118,6 +134,8 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
 
+        virtual bool GetFusedUpdateParams(const Parameter& parameter, size_t trainingSampleCount, Microsoft::MSR::CNTK::FusedWeightUpdateParams& params) const override;
+
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
 
@@ -159,6 +177,8 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
 
+        virtual bool GetFusedUpdateParams(const Parameter& parameter, size_t trainingSampleCount, Microsoft::MSR::CNTK::FusedWeightUpdateParams& params) const override;
+
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
     };
@@ -173,6 +193,8 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
 
+        virtual bool GetFusedUpdateParams(const Parameter& parameter, size_t trainingSampleCount, Microsoft::MSR::CNTK::FusedWeightUpdateParams& params) const override;
+
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
     };
@@ -195,6 +217,8 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
 
+        virtual bool GetFusedUpdateParams(const Parameter& parameter, size_t trainingSampleCount, Microsoft::MSR::CNTK::FusedWeightUpdateParams& params) const override;
+
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
     };
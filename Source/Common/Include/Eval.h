@@ -340,6 +340,28 @@ public:
     // (e.g. when vectors are manages by .net)
     // 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) = 0;
+
+    //
+    // ForwardPassStreaming - Evaluate the next chunk of each of a number of sequences (sessions) in one forward pass,
+    // e.g. for online recognition with a recurrent model. The history of the PastValue nodes of each session is kept
+    // from one call to the next, so that each call only computes the frames of the new chunks.
+    // A session id that is not in use starts a new sequence. Models with other recurrences (e.g. FutureValue) are not supported.
+    // Call StartForwardEvaluation() first.
+    // sessionIds - the sessions to evaluate, one entry per session
+    // inputs - for every session, the input buffers of its chunk as for ForwardPass(); all inputs must have the same number of samples
+    // outputs - for every session, the output buffers as for ForwardPass(), which receive the outputs for the samples of its chunk
+    //
+    virtual void ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) = 0;
+
+    //
+    // Same as above, but takes references to static arrays instead of std::vector
+    //
+    virtual void ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) = 0;
+
+    //
+    // EndStreamingSession - release the history of a session. Its id starts a new sequence when used again.
+    //
+    virtual void EndStreamingSession(size_t sessionId) = 0;
 };
 
 template <typename ElemType>
@@ -35,6 +35,8 @@ enum FileOptions
     fileOptionsWrite = 16,                                      // open in write mode
     fileOptionsSequential = 32,                                 // optimize for sequential reads (allocates big buffer)
     fileOptionsReadWrite = fileOptionsRead | fileOptionsWrite,  // read/write mode
+    fileOptionsFloat16 = 64,                                    // write dense matrices with IEEE half-precision elements (binary files only)
+    fileOptionsBFloat16 = 128,                                  // write dense matrices with bfloat16 elements (binary files only)
 };
 
 // markers used for text files
@@ -116,6 +118,7 @@ public:
     void SkipToDelimiter(int delim);
 
     bool IsTextBased();
+    int GetOptions() const { return m_options; }
 
     bool IsUnicodeBOM(bool skip = false);
     bool IsEOF();
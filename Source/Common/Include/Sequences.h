@@ -11,6 +11,7 @@
 #include "Matrix.h"
 #include <vector>
 #include <memory> // for shared_ptr
+#include <mutex>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -292,6 +293,10 @@ public:
 
     const Matrix<char>& GetColumnsValidityMask(DEVICEID_TYPE deviceId) const;
 
+    // the frame-mode layout of the valid frames of this layout, without the gaps, on which PackFramesNode and the nodes
+    // after it compute. It is created by the first call, and is brought up to date with this layout by every call.
+    const MBLayoutPtr& GetPackedLayout() const;
+
     // compare whether two layouts are the same
     bool operator==(const MBLayout& other) const
     {
@@ -561,6 +566,10 @@ private:
     // Meant to guard in lazy creation of m_columnsValidityMask.
     mutable bool m_writable;
 
+    // the gap-free layout returned by GetPackedLayout(), which may be requested by concurrently executed nodes
+    mutable MBLayoutPtr m_packedLayout;
+    mutable std::mutex m_packedLayoutMutex;
+
     // The axis this MBLayout represents.
     // For now only a string meant for debugging.
     std::wstring m_axisName;
@@ -875,6 +884,17 @@ inline const Matrix<char>& MBLayout::GetColumnsValidityMask(DEVICEID_TYPE device
     return m_columnsValidityMask;
 }
 
+inline const MBLayoutPtr& MBLayout::GetPackedLayout() const
+{
+    std::lock_guard<std::mutex> lock(m_packedLayoutMutex);
+    if (!m_packedLayout)
+        m_packedLayout = std::make_shared<MBLayout>(1, 0, m_axisName + L".packed");
+    // only the number of frames matters; the layout must not change while nodes that use it are computed
+    if (m_packedLayout->GetNumCols() != GetActualNumSamples())
+        m_packedLayout->InitAsFrameMode(GetActualNumSamples());
+    return m_packedLayout;
+}
+
 // class for defining an iteration over a sequence, forward and backward
 // One day, we may also have nested structures. For those, FrameRangeIterations will be able to be instantiated from FrameRange objects to loop over their nested dimension.
 class FrameRangeIteration
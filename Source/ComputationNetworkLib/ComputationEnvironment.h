@@ -22,6 +22,20 @@ enum class NetworkOperationMode
     preComputing // precomputation is a part of training where most nodes should behave like they are inferring
 };
 
+class ComputationNodeBase;
+
+// interface to receive the execution of every node, for profiling (see Profiler in SGDLib)
+// Nodes may be executed concurrently on multiple threads (see SetNumParallelTraversalThreads()), so implementations must be thread-safe.
+struct IComputationNodeProfiler
+{
+    virtual ~IComputationNodeProfiler() { }
+    // current time in seconds, in the time base of RecordNodeExecution()
+    virtual double GetTime() const = 0;
+    // a ForwardProp() or Backprop() call of 'node' from 'beginTime' to 'endTime', which grew its matrices by 'numBytesAllocated'
+    // Within recurrent loops, this is called once per time step.
+    virtual void RecordNodeExecution(const ComputationNodeBase& node, bool isBackprop, double beginTime, double endTime, size_t numBytesAllocated) = 0;
+};
+
 // class to store global properties of the network that are of interest to the nodes
 // For example, a network can be in 'training' or 'inference' mode, which affects what nodes like Dropout and BN do,
 // or what the seq-2-seq decoder feedback signal is.
@@ -40,6 +54,9 @@ struct ComputationEnvironment
         m_networkOperationMode = mode;
         return oldMode;
     }
+    // if set, all node executions are reported to this profiler (not owned)
+    IComputationNodeProfiler* m_profiler = nullptr;
+
     // more properties should be added here as needed
 };
 typedef std::shared_ptr<ComputationEnvironment> ComputationEnvironmentPtr;
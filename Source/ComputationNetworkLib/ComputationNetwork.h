@@ -8,11 +8,13 @@
 #include "Basics.h"
 #include "File.h"
 #include "Matrix.h"
+#include "Half.h"
 #include "Config.h"
 
 #include "ComputationNode.h"
 #include "ScriptableObjects.h"
 #include "ComputationEnvironment.h"
+#include "WorkStealingScheduler.h"
 
 #include <map>
 #include <string>
@@ -52,6 +54,9 @@ public:
         m_randomSeedOffset(0),
         m_isCompiled(false),
         m_areMatricesAllocated(false),
+        m_fuseElementwiseOperations(false),
+        m_hoistLoopInvariantComputations(false),
+        m_packFramesOutsideLoops(false),
         m_pMBLayoutOfNetwork(make_shared<MBLayout>(1, 0, L"*")),
         m_environment(make_shared<ComputationEnvironment>())
     {
@@ -171,7 +176,31 @@ public:
 
     void CompileNetwork(); // call this after creation, Load(), and any modification
 
+    // let CompileNetwork() replace chains of elementwise operations on the CPU by FusedElementwiseNodes (takes effect at the next CompileNetwork())
+    void EnableElementwiseFusion(bool enable) { m_fuseElementwiseOperations = enable; }
+
+    // let CompileNetwork() move the loop-invariant part of products with stacked inputs out of recurrent loops (takes effect at the next CompileNetwork())
+    void EnableLoopInvariantHoisting(bool enable) { m_hoistLoopInvariantComputations = enable; }
+
+    // let CompileNetwork() compute the nodes outside of recurrent loops on the valid frames only, without the gaps (takes effect at the next CompileNetwork())
+    void EnablePackedExecution(bool enable) { m_packFramesOutsideLoops = enable; }
+
+    // let ForwardProp() and Backprop() execute independent nodes concurrently on this many CPU threads (0 or 1: sequential traversal)
+    void SetNumParallelTraversalThreads(size_t numThreads);
+
+    // rewrite the network for evaluation: fold BatchNormalization and PerDimMeanVarNormalization into the weights and biases of
+    // the preceding (following) products, remove Dropout, and pre-transpose the weights of TransposeTimes
+    // Call this on a compiled network before AllocateAllMatrices(), and CompileNetwork() again if it returns true. The result cannot be trained.
+    bool OptimizeForInference();
+
+    // let the products with fixed weights (TimesNode, TransposeTimesNode) multiply from 16-bit copies of the weights when inferring on the CPU (takes effect immediately)
+    // The copies are made at the first use and refreshed when the weights' time stamp or storage changes.
+    void EnableFloat16Weights(bool enable, Float16Format format = Float16Format::Half);
+
 private:
+    bool FuseElementwiseOperations();
+    bool HoistLoopInvariantComputations();
+    bool PackFramesOutsideLoops();
     void ValidateNetwork();
     size_t ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass);
     bool ValidateNode(ComputationNodeBasePtr node, bool isFinalValidationPass) const;
@@ -1030,6 +1059,14 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        // execute independent nodes concurrently using this scheduler (null: sequential traversal)
+        void SetScheduler(const shared_ptr<WorkStealingScheduler>& scheduler) { m_scheduler = scheduler; }
+
+    private:
+        std::vector<std::vector<size_t>> DetermineDependencies(bool forBackprop) const;
+
+        shared_ptr<WorkStealingScheduler> m_scheduler;
     };
 
 public:
@@ -1087,6 +1124,10 @@ private:
     // cache for evaluation ordering:
     bool m_isCompiled; // CompileNetwork has been called
     bool m_areMatricesAllocated; // AllocateAllMatrices has been called
+    bool m_fuseElementwiseOperations; // CompileNetwork() runs FuseElementwiseOperations()
+    bool m_hoistLoopInvariantComputations; // CompileNetwork() runs HoistLoopInvariantComputations()
+    bool m_packFramesOutsideLoops; // CompileNetwork() runs PackFramesOutsideLoops()
+    shared_ptr<WorkStealingScheduler> m_parallelTraversalScheduler; // if not null, nested networks execute independent nodes concurrently
 
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
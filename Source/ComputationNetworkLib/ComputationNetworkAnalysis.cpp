@@ -9,6 +9,13 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "ReshapingNodes.h"
+#include "InputAndParamNodes.h"
+#include "NonlinearityNodes.h"
+#include "ConvolutionalNodes.h"
+#include "TrainingNodes.h"
+#include "EvaluationNodes.h"
 #include <string>
 #include <set>
 
@@ -446,6 +453,287 @@ void ComputationNetwork::ReorderLoops(list<ComputationNodeBasePtr>& nodes,
     nodes = newList;
 }
 
+// -----------------------------------------------------------------------
+// hoisting of loop-invariant computation (called from CompileNetwork())
+// -----------------------------------------------------------------------
+
+// Nodes that do not depend on the recurrence are never members of a loop, since loops are strongly connected
+// components; they are already evaluated once over the whole minibatch. What remains per frame inside a loop
+// is loop-invariant input that is combined with recurrent input inside one node. The common case is the
+// product of a weight matrix with stacked input, W * RowStack(x, PastValue(h)), which computes the x part
+// as one small product per frame. Such a product is split along the columns of W:
+//    W * RowStack(x, h)  ->  Slice(W, 0, dx, axis=2) * x  +  Slice(W, dx, dx+dh, axis=2) * h
+// The first product no longer depends on the loop, so it becomes a single large product before the loop,
+// and its gradients are computed once after the loop. Consecutive inputs of the same kind stay stacked.
+
+// splits one such product; returns the node that replaces it
+template <class ElemType>
+static ComputationNodeBasePtr SplitLoopInvariantTimes(ComputationNetwork& net, const ComputationNodeBasePtr& times)
+{
+    const auto deviceId = times->GetDeviceId();
+    const auto& weights = times->Input(0);
+    const auto& stack = times->Input(1);
+    auto uniqueName = [&](const wstring& suffix)
+    {
+        wstring name = times->NodeName() + L"." + suffix;
+        for (size_t k = 1; net.NodeNameExists(name); k++)
+            name = times->NodeName() + L"." + suffix + msra::strfun::wstrprintf(L"%d", (int) k);
+        return name;
+    };
+
+    // one product per run of consecutive inputs that are all outside or all inside the loop
+    vector<ComputationNodeBasePtr> invariantTerms, recurrentTerms;
+    size_t firstRow = 0;
+    for (size_t i = 0; i < stack->GetNumInputs();)
+    {
+        const bool isInvariant = !stack->Input(i)->IsPartOfLoop();
+        vector<ComputationNodeBasePtr> run;
+        size_t numRows = 0;
+        for (; i < stack->GetNumInputs() && !stack->Input(i)->IsPartOfLoop() == isInvariant; i++)
+        {
+            run.push_back(stack->Input(i));
+            numRows += stack->Input(i)->GetSampleLayout().GetNumElements();
+        }
+        const size_t termIndex = invariantTerms.size() + recurrentTerms.size();
+        auto slice = net.AddNodeToNet(New<SliceNode<ElemType>>(deviceId, uniqueName(msra::strfun::wstrprintf(L"W%d", (int) termIndex)), (int) firstRow, (int) (firstRow + numRows), /*axis=*/2));
+        slice->AttachInputs({ weights });
+        ComputationNodeBasePtr operand = run.front();
+        if (run.size() > 1)
+        {
+            operand = net.AddNodeToNet(New<RowStackNode<ElemType>>(deviceId, uniqueName(msra::strfun::wstrprintf(L"x%d", (int) termIndex))));
+            operand->AttachInputs(run);
+        }
+        auto term = net.AddNodeToNet(New<TimesNode<ElemType>>(deviceId, uniqueName(msra::strfun::wstrprintf(L"t%d", (int) termIndex))));
+        term->AttachInputs({ slice, operand });
+        (isInvariant ? invariantTerms : recurrentTerms).push_back(term);
+        firstRow += numRows;
+    }
+
+    // sum up, invariant terms first so that their sum is computed outside the loop as well
+    // The last sum takes over the name of the product; it is added to the network once the product has been removed.
+    vector<ComputationNodeBasePtr> terms(invariantTerms);
+    terms.insert(terms.end(), recurrentTerms.begin(), recurrentTerms.end());
+    ComputationNodeBasePtr sum = terms.front();
+    for (size_t k = 1; k < terms.size(); k++)
+    {
+        auto plus = New<PlusNode<ElemType>>(deviceId, k + 1 < terms.size() ? uniqueName(msra::strfun::wstrprintf(L"sum%d", (int) k)) : times->NodeName());
+        plus->AttachInputs({ sum, terms[k] });
+        sum = plus;
+        if (k + 1 < terms.size())
+            net.AddNodeToNet(sum);
+    }
+    return sum;
+}
+
+// Returns true if the network was modified. Called from CompileNetwork() once loops are formed and dimensions are inferred.
+bool ComputationNetwork::HoistLoopInvariantComputations()
+{
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    set<ComputationNodeBasePtr> pinnedNodes(m_allRoots.begin(), m_allRoots.end());
+    for (auto group : GetAllNodeGroups())
+        pinnedNodes.insert(group->begin(), group->end());
+
+    // W * RowStack(...) inside a loop, where W is outside, and some stacked vectors are outside and some inside the loop
+    auto isSplittable = [](const ComputationNodeBasePtr& node) -> bool
+    {
+        if (node->OperationName() != OperationNameOf(TimesNode) || !node->IsPartOfLoop())
+            return false;
+        const auto& weights = node->Input(0);
+        const auto& stack = node->Input(1);
+        if (weights->IsPartOfLoop() || weights->HasMBLayout() || weights->GetSampleLayout().GetRank() != 2 ||
+            stack->OperationName() != OperationNameOf(RowStackNode) || stack->GetSampleLayout().GetRank() != 1 ||
+            node->GetSampleLayout().GetRank() != 1)
+            return false;
+        size_t numInvariantInputs = 0;
+        for (const auto& input : stack->GetInputs())
+        {
+            if (input->GetSampleLayout().GetRank() != 1 || input->GetMBLayout() != stack->GetMBLayout())
+                return false;
+            if (!input->IsPartOfLoop())
+                numInvariantInputs++;
+        }
+        return numInvariantInputs > 0 && weights->GetSampleLayout()[1] == stack->GetSampleLayout()[0];
+    };
+
+    vector<ComputationNodeBasePtr> candidates;
+    for (const auto& loop : m_allSEQNodes)
+        for (const auto& node : loop->m_nestedNodes)
+            if (isSplittable(node))
+                candidates.push_back(node);
+
+    for (const auto& times : candidates)
+    {
+        const auto stack = times->Input(1);
+        ComputationNodeBasePtr sum;
+        if (times->Is<ComputationNode<float>>())
+            sum = SplitLoopInvariantTimes<float>(*this, times);
+        else if (times->Is<ComputationNode<double>>())
+            sum = SplitLoopInvariantTimes<double>(*this, times);
+        else
+            LogicError("HoistLoopInvariantComputations: Unexpected node type.");
+
+        // replace the product by the sum, which takes over its name
+        ChangeNodeInputs(times, sum);
+        for (auto group : GetAllNodeGroups())
+            replace(group->begin(), group->end(), times, sum);
+        times->DetachInputs();
+        RemoveNodeFromNet(times);
+        AddNodeToNet(sum);
+        if (--numConsumers[stack] == 0 && pinnedNodes.find(stack) == pinnedNodes.end())
+        {
+            stack->DetachInputs();
+            RemoveNodeFromNet(stack);
+        }
+
+        fprintf(stderr, "HoistLoopInvariantComputations: %ls: the product with loop-invariant inputs of %ls is now computed outside the loop.\n",
+                sum->NodeName().c_str(), stack->NodeName().c_str());
+    }
+
+    if (!candidates.empty())
+        InvalidateCompiledNetwork();
+    return !candidates.empty();
+}
+
+// -----------------------------------------------------------------------
+// packing of frames outside of recurrent loops (called from CompileNetwork())
+// -----------------------------------------------------------------------
+
+// Minibatches of sequences of different lengths are padded with gaps. Nodes outside of recurrent loops compute over
+// all columns of the minibatch, including the gaps, although most of them compute each frame independently.
+// Such nodes are moved onto the packed valid frames, in the gap-free frame-mode layout MBLayout::GetPackedLayout():
+//    f(x)  ->  UnpackFrames(layoutData, f(PackFrames(x)))
+// where PackFrames is inserted once for each input of the packed region, and UnpackFrames once for each of its
+// outputs that is consumed by a node that is not packed, e.g. inside a loop. Criteria and reductions are computed on
+// the packed frames directly; these need no masking since the packed layout has no gaps.
+
+// operations that compute each frame independently, or reduce over all frames
+static const set<wstring>& GetPackableOperations()
+{
+    static const set<wstring> packableOperations =
+    {
+        // elementwise
+        OperationNameOf(AbsNode), OperationNameOf(CosineNode), OperationNameOf(ExpNode), OperationNameOf(FloorNode), OperationNameOf(LogNode),
+        OperationNameOf(NegateNode), OperationNameOf(PassNode), OperationNameOf(ReciprocalNode), OperationNameOf(RectifiedLinearNode),
+        OperationNameOf(SigmoidNode), OperationNameOf(SinNode), OperationNameOf(SqrtNode), OperationNameOf(TanhNode), OperationNameOf(DropoutNode),
+        OperationNameOf(PlusNode), OperationNameOf(LogPlusNode), OperationNameOf(MinusNode), OperationNameOf(ElementTimesNode),
+        // per frame
+        OperationNameOf(SoftmaxNode), OperationNameOf(LogSoftmaxNode), OperationNameOf(HardmaxNode),
+        OperationNameOf(TimesNode), OperationNameOf(TransposeTimesNode), OperationNameOf(DiagTimesNode),
+        OperationNameOf(RowStackNode), OperationNameOf(ReshapeNode),
+        OperationNameOf(ConvolutionNode), OperationNameOf(PoolingNode), OperationNameOf(MaxPoolingNode), OperationNameOf(AveragePoolingNode),
+        // criteria and reductions over all frames
+        OperationNameOf(CrossEntropyWithSoftmaxNode), OperationNameOf(CrossEntropyNode), OperationNameOf(SquareErrorNode),
+        OperationNameOf(LogisticNode), OperationNameOf(ErrorPredictionNode), OperationNameOf(SumElementsNode)
+    };
+    return packableOperations;
+}
+
+template <class ElemType>
+static ComputationNodeBasePtr CreateFramePackingNode(DEVICEID_TYPE deviceId, const wstring& name, bool unpack)
+{
+    if (unpack)
+        return New<UnpackFramesNode<ElemType>>(deviceId, name);
+    else
+        return New<PackFramesNode<ElemType>>(deviceId, name);
+}
+
+// Returns true if the network was modified. Called from CompileNetwork() once loops are formed and dimensions are inferred.
+bool ComputationNetwork::PackFramesOutsideLoops()
+{
+    // only minibatch data in the layout of the network is packed
+    const auto& layout = m_pMBLayoutOfNetwork;
+    ComputationNodeBasePtr layoutNode; // UnpackFramesNodes take the layout from this
+    for (const auto& iter : m_nameToNodeMap)
+        if (iter.second->GetMBLayout() == layout && (iter.second->OperationName() == OperationNameOf(InputValue) || iter.second->OperationName() == OperationNameOf(SparseInputValue)))
+            layoutNode = iter.second;
+    if (!layoutNode)
+        return false;
+
+    set<ComputationNodeBasePtr> pinnedNodes(m_allRoots.begin(), m_allRoots.end());
+    for (auto group : GetAllNodeGroups())
+        pinnedNodes.insert(group->begin(), group->end());
+
+    // Pinned nodes with layout are read by the outside world in the layout of the network, so they are not packed.
+    // Sparse inputs are not packed since gathering sparse columns is not implemented on the GPU.
+    const auto& packableOperations = GetPackableOperations();
+    auto isPackable = [&](const ComputationNodeBasePtr& node) -> bool
+    {
+        if (packableOperations.find(node->OperationName()) == packableOperations.end() || node->IsPartOfLoop() ||
+            (node->HasMBLayout() && pinnedNodes.find(node) != pinnedNodes.end()))
+            return false;
+        bool hasPackableInput = false;
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->HasMBLayout() && (input->GetMBLayout() != layout || input->OperationName() == OperationNameOf(SparseInputValue)))
+                return false;
+            hasPackableInput |= input->HasMBLayout();
+        }
+        return hasPackableInput;
+    };
+
+    set<ComputationNodeBasePtr> packedNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        if (isPackable(iter.second))
+            packedNodes.insert(iter.second);
+    if (packedNodes.empty())
+        return false;
+
+    auto newNode = [&](const ComputationNodeBasePtr& node, const wstring& suffix, bool unpack)
+    {
+        wstring name = node->NodeName() + suffix;
+        for (size_t k = 1; NodeNameExists(name); k++)
+            name = node->NodeName() + suffix + msra::strfun::wstrprintf(L"%d", (int) k);
+        ComputationNodeBasePtr newNode;
+        if (node->Is<ComputationNode<float>>())
+            newNode = CreateFramePackingNode<float>(node->GetDeviceId(), name, unpack);
+        else if (node->Is<ComputationNode<double>>())
+            newNode = CreateFramePackingNode<double>(node->GetDeviceId(), name, unpack);
+        else
+            LogicError("PackFramesOutsideLoops: Unexpected node type.");
+        return AddNodeToNet(newNode);
+    };
+
+    // pack the inputs of the packed nodes that are not packed themselves, and unpack their outputs for the other nodes
+    // Iterate over a copy of the nodes, since new nodes are added.
+    map<ComputationNodeBasePtr, ComputationNodeBasePtr> packedInputs, unpackedOutputs;
+    vector<ComputationNodeBasePtr> nodes;
+    for (const auto& iter : m_nameToNodeMap)
+        nodes.push_back(iter.second);
+    for (const auto& node : nodes)
+    {
+        const bool isPacked = packedNodes.find(node) != packedNodes.end();
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            const auto input = node->Input(i);
+            if (!input->HasMBLayout() || isPacked == (packedNodes.find(input) != packedNodes.end()))
+                continue;
+            auto& replacement = (isPacked ? packedInputs : unpackedOutputs)[input];
+            if (!replacement)
+            {
+                if (isPacked)
+                {
+                    replacement = newNode(input, L".packed", /*unpack=*/false);
+                    replacement->AttachInputs({ input });
+                }
+                else
+                {
+                    replacement = newNode(input, L".unpacked", /*unpack=*/true);
+                    replacement->AttachInputs({ layoutNode, input });
+                }
+            }
+            node->SetInput(i, replacement);
+        }
+    }
+
+    fprintf(stderr, "PackFramesOutsideLoops: %d nodes now compute on the valid frames only, with %d inputs packed and %d outputs unpacked.\n",
+            (int) packedNodes.size(), (int) packedInputs.size(), (int) unpackedOutputs.size());
+    InvalidateCompiledNetwork();
+    return true;
+}
+
 // set m_steppingDirection for all loops
 // TODO: Move this up to where it is used (in a separate commit since git cannot track moving and changing at the same time).
 // BUGBUG: Need to extend to multi-dimensional loop directions. Use a vector<int>.
@@ -10,9 +10,14 @@
 #include "ComputationNetwork.h"
 #include "InputAndParamNodes.h"
 #include "TrainingNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "ConvolutionalNodes.h"
+#include "DeprecatedNodes.h"
+#include "FusedNodes.h"
 #include <string>
 #include <vector>
 #include <list>
+#include <functional>
 
 using namespace std;
 
@@ -361,4 +366,485 @@ void ComputationNetwork::SetLearnableNodesBelowLearningRateMultiplier(const floa
     }
 }
 
+// -----------------------------------------------------------------------
+// elementwise fusion (called from CompileNetwork())
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+static ComputationNodeBasePtr NewFusedElementwiseNode(DEVICEID_TYPE deviceId, const wstring& name, const vector<FusedElementwiseInstruction>& program)
+{
+    return New<FusedElementwiseNode<ElemType>>(deviceId, name, program);
+}
+
+// Replace trees of elementwise operations (Plus, Minus, ElementTimes, and unary nonlinearities) whose intermediate
+// results have a single consumer by FusedElementwiseNodes, which compute the tree in one pass without storing the
+// intermediate results. Only operations on the CPU, outside of recurrent loops, without broadcasting and without
+// sparse inputs are fused. The root of a tree keeps its name; the intermediate nodes disappear from the network.
+// Returns true if the network was modified. Called by CompileNetwork() after validation, which provides the eval order and the dimensions.
+bool ComputationNetwork::FuseElementwiseOperations()
+{
+    if (GetDeviceId() != CPUDEVICE)
+        return false;
+
+    // nodes that are visible outside of the tree they belong to must not be fused away
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    set<ComputationNodeBasePtr> pinnedNodes(m_allRoots.begin(), m_allRoots.end());
+    for (auto group : GetAllNodeGroups())
+        pinnedNodes.insert(group->begin(), group->end());
+
+    // a node can be computed by a FusedElementwiseNode if its inputs are dense and of its own shape
+    auto isFusible = [](const ComputationNodeBasePtr& node, FusedElementwiseOp& op) -> bool
+    {
+        if (!TryGetFusedElementwiseOp(node->OperationName(), op) || node->IsPartOfLoop() || node->GetDeviceId() != CPUDEVICE)
+            return false;
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->GetSampleLayout() != node->GetSampleLayout() || input->GetMBLayout() != node->GetMBLayout() ||
+                (input->ValuePtr() && input->ValuePtr()->GetMatrixType() == SPARSE)) // (computed nodes may have no matrix yet; their values are dense)
+                return false;
+        }
+        return true;
+    };
+
+    bool modified = false;
+    set<ComputationNodeBasePtr> fusedNodes; // nodes that are now computed by a FusedElementwiseNode
+    const auto evalOrder = GetEvalOrder(nullptr);
+    for (auto iter = evalOrder.rbegin(); iter != evalOrder.rend(); iter++) // (consumers first)
+    {
+        const auto root = *iter;
+        FusedElementwiseOp op;
+        if (fusedNodes.find(root) != fusedNodes.end() || !isFusible(root, op))
+            continue;
+
+        // gather the tree as a program; arguments refer to leaves (isLeaf) or to earlier instructions
+        struct Argument { bool isLeaf; size_t index; };
+        vector<ComputationNodeBasePtr> leaves;
+        vector<ComputationNodeBasePtr> treeNodes;
+        vector<pair<FusedElementwiseOp, vector<Argument>>> instructions;
+        function<Argument(const ComputationNodeBasePtr&)> emit = [&](const ComputationNodeBasePtr& node) -> Argument
+        {
+            FusedElementwiseOp nodeOp;
+            bool absorb = node == root ||
+                          (isFusible(node, nodeOp) && numConsumers[node] == 1 && pinnedNodes.find(node) == pinnedNodes.end() &&
+                           fusedNodes.find(node) == fusedNodes.end() && node->GetSampleLayout() == root->GetSampleLayout());
+            if (!absorb)
+            {
+                auto leaf = find(leaves.begin(), leaves.end(), node);
+                if (leaf != leaves.end())
+                    return Argument{ true, (size_t) (leaf - leaves.begin()) };
+                leaves.push_back(node);
+                return Argument{ true, leaves.size() - 1 };
+            }
+            TryGetFusedElementwiseOp(node->OperationName(), nodeOp);
+            vector<Argument> args;
+            for (const auto& input : node->GetInputs())
+                args.push_back(emit(input));
+            treeNodes.push_back(node);
+            instructions.push_back(make_pair(nodeOp, args));
+            return Argument{ false, instructions.size() - 1 };
+        };
+        emit(root);
+        if (instructions.size() < 2 || leaves.size() + instructions.size() > FusedElementwiseNode<float>::MaxRegisters)
+            continue; // nothing to gain, or too large
+
+        vector<FusedElementwiseInstruction> program;
+        for (const auto& instruction : instructions)
+        {
+            auto registerOf = [&](const Argument& arg) { return arg.isLeaf ? arg.index : leaves.size() + arg.index; };
+            const auto& args = instruction.second;
+            program.push_back(FusedElementwiseInstruction{ instruction.first, registerOf(args[0]), args.size() > 1 ? registerOf(args[1]) : 0 });
+        }
+
+        // create the fused node in place of the root
+        ComputationNodeBasePtr fusedNode;
+        if (root->Is<ComputationNode<float>>())
+            fusedNode = NewFusedElementwiseNode<float>(root->GetDeviceId(), root->NodeName(), program);
+        else if (root->Is<ComputationNode<double>>())
+            fusedNode = NewFusedElementwiseNode<double>(root->GetDeviceId(), root->NodeName(), program);
+        else
+            LogicError("FuseElementwiseOperations: Unexpected node type.");
+        fusedNode->AttachInputs(leaves);
+        ChangeNodeInputs(root, fusedNode);
+        for (auto group : GetAllNodeGroups())
+            replace(group->begin(), group->end(), root, fusedNode);
+        for (const auto& node : treeNodes)
+        {
+            node->DetachInputs();
+            RemoveNodeFromNet(node);
+            fusedNodes.insert(node);
+        }
+        AddNodeToNet(fusedNode);
+        modified = true;
+
+        fprintf(stderr, "FuseElementwiseOperations: %ls = %ls() computes %d operations on %d inputs in one pass.\n",
+                fusedNode->NodeName().c_str(), fusedNode->OperationName().c_str(), (int) program.size(), (int) leaves.size());
+    }
+
+    if (modified)
+        InvalidateCompiledNetwork();
+    return modified;
+}
+
+// -----------------------------------------------------------------------
+// inference optimization
+// -----------------------------------------------------------------------
+
+// create a node of the element type of 'like'
+template <template <class> class NodeType, class... Args>
+static ComputationNodeBasePtr NewNodeLike(const ComputationNodeBasePtr& like, const wstring& name, Args&&... args)
+{
+    if (like->Is<ComputationNode<float>>())
+        return New<NodeType<float>>(like->GetDeviceId(), name, forward<Args>(args)...);
+    else if (like->Is<ComputationNode<double>>())
+        return New<NodeType<double>>(like->GetDeviceId(), name, forward<Args>(args)...);
+    else
+        LogicError("OptimizeForInference: Unexpected node type.");
+}
+
+// get and set the value of a node as a flat vector in column-major order
+template <class ElemType>
+static vector<double> GetNodeValues(const ComputationNode<ElemType>& node)
+{
+    const auto& value = node.Value();
+    unique_ptr<ElemType[]> values(value.CopyToArray());
+    return vector<double>(values.get(), values.get() + value.GetNumElements());
+}
+
+static vector<double> GetNodeValues(const ComputationNodeBasePtr& node)
+{
+    if (node->Is<ComputationNode<float>>())
+        return GetNodeValues(*node->As<ComputationNode<float>>());
+    else
+        return GetNodeValues(*node->As<ComputationNode<double>>());
+}
+
+template <class ElemType>
+static void SetNodeValues(ComputationNode<ElemType>& node, const vector<double>& values)
+{
+    auto& value = node.Value();
+    if (values.size() != value.GetNumElements())
+        LogicError("SetNodeValues: Expected %d values, got %d.", (int) value.GetNumElements(), (int) values.size());
+    vector<ElemType> typedValues(values.begin(), values.end());
+    value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), typedValues.data());
+}
+
+static void SetNodeValues(const ComputationNodeBasePtr& node, const vector<double>& values)
+{
+    if (node->Is<ComputationNode<float>>())
+        SetNodeValues(*node->As<ComputationNode<float>>(), values);
+    else
+        SetNodeValues(*node->As<ComputationNode<double>>(), values);
+}
+
+// returns the outputRank of a TimesNode, or 0 if 'node' is not a TimesNode
+static size_t TimesOutputRank(const ComputationNodeBasePtr& node)
+{
+    if (auto times = dynamic_pointer_cast<TimesNode<float>>(node))
+        return times->OutputRank();
+    if (auto times = dynamic_pointer_cast<TimesNode<double>>(node))
+        return times->OutputRank();
+    return 0;
+}
+
+// a ConvolutionNode with weights laid out as one contiguous block per output channel, and the channel as the last output dimension
+static bool IsCHWConvolution(const ComputationNodeBasePtr& node)
+{
+    if (auto conv = dynamic_pointer_cast<ConvolutionNode<float>>(node))
+        return !conv->Transpose() && conv->ImageLayout() == ImageLayoutKind::CHW;
+    if (auto conv = dynamic_pointer_cast<ConvolutionNode<double>>(node))
+        return !conv->Transpose() && conv->ImageLayout() == ImageLayoutKind::CHW;
+    return false;
+}
+
+static void GetBatchNormalizationScaleAndShift(const ComputationNodeBasePtr& node, vector<double>& scale, vector<double>& shift)
+{
+    if (auto bn = dynamic_pointer_cast<BatchNormalizationNode<float>>(node))
+        bn->GetInferenceScaleAndShift(scale, shift);
+    else
+        node->As<BatchNormalizationNode<double>>()->GetInferenceScaleAndShift(scale, shift);
+}
+
+// Rewrite the network for evaluation, where BatchNormalization and Dropout are fixed functions:
+//  - Dropout is removed.
+//  - TransposeTimes(W, x) with a parameter W becomes Times(W', x) with a transposed copy of W, which is the layout that the GEMM expects.
+//  - PerDimMeanVarNormalization(x) whose consumers are all products W * (.) is folded into them: W' = W Diag(invStdDev), with a bias -W' mean.
+//  - BatchNormalization(W * x [+ b]) and BatchNormalization(Convolution(W, x) [+ b]) are folded into the weights W' = Diag(s) W and the bias
+//    b' = s .* b + shift, where s and shift are the per-channel scale and shift that BatchNormalization computes in inference mode.
+// Parameters are modified in place and must only be used by the rewritten node. Nodes that are outputs keep their names.
+// Returns true if the network was modified.
+bool ComputationNetwork::OptimizeForInference()
+{
+    VerifyIsCompiled("OptimizeForInference");
+    if (AreMatricesAllocated())
+        LogicError("OptimizeForInference: This must be called before AllocateAllMatrices().");
+
+    const size_t numNodesBefore = m_nameToNodeMap.size();
+    set<ComputationNodeBasePtr> pinnedNodes(m_allRoots.begin(), m_allRoots.end());
+    for (auto group : GetAllNodeGroups())
+        pinnedNodes.insert(group->begin(), group->end());
+    auto isPinned = [&](const ComputationNodeBasePtr& node) { return pinnedNodes.find(node) != pinnedNodes.end(); };
+    auto getConsumers = [&](const ComputationNodeBasePtr& node)
+    {
+        vector<ComputationNodeBasePtr> consumers;
+        for (const auto& iter : m_nameToNodeMap)
+            if (find(iter.second->GetInputs().begin(), iter.second->GetInputs().end(), node) != iter.second->GetInputs().end())
+                consumers.push_back(iter.second);
+        return consumers;
+    };
+    auto isInNetwork = [&](const ComputationNodeBasePtr& node)
+    {
+        auto iter = m_nameToNodeMap.find(node->NodeName());
+        return iter != m_nameToNodeMap.end() && iter->second == node;
+    };
+    // a parameter that only 'consumer' uses, and thus can be modified
+    auto isOwnParameter = [&](const ComputationNodeBasePtr& node, const ComputationNodeBasePtr& consumer)
+    {
+        if (node->OperationName() != OperationNameOf(LearnableParameter) || isPinned(node))
+            return false;
+        auto consumers = getConsumers(node);
+        return consumers.size() == 1 && consumers[0] == consumer;
+    };
+    // a parameter that 'plus' adds to 'linear' as one value per channel (the last dimension of 'linear')
+    auto isChannelBias = [&](const ComputationNodeBasePtr& bias, const ComputationNodeBasePtr& plus, const ComputationNodeBasePtr& linear)
+    {
+        if (!isOwnParameter(bias, plus) || plus->GetSampleLayout() != linear->GetSampleLayout())
+            return false;
+        const auto& outputShape = linear->GetSampleLayout();
+        const auto& biasShape = bias->GetSampleLayout();
+        for (size_t k = 0; k < max(outputShape.GetRank(), biasShape.GetRank()); k++)
+        {
+            size_t expectedDim = k + 1 == outputShape.GetRank() ? outputShape[k] : 1;
+            if ((k < biasShape.GetRank() ? biasShape[k] : 1) != expectedDim)
+                return false;
+        }
+        return true;
+    };
+
+    bool modified = false;
+    set<ComputationNodeBasePtr> orphanCandidates; // nodes that lost a consumer
+    auto replaceNode = [&](const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode)
+    {
+        ChangeNodeInputs(oldNode, newNode);
+        for (auto group : GetAllNodeGroups())
+            replace(group->begin(), group->end(), oldNode, newNode);
+        if (isPinned(oldNode))
+            pinnedNodes.insert(newNode);
+    };
+    auto removeNode = [&](const ComputationNodeBasePtr& node)
+    {
+        orphanCandidates.insert(node->GetInputs().begin(), node->GetInputs().end());
+        node->DetachInputs();
+        RemoveNodeFromNet(node);
+        orphanCandidates.erase(node);
+        modified = true;
+    };
+    // add one value per channel to the output of 'linear', either to the bias that it is followed by, or with a new Plus node that takes its name
+    auto addBias = [&](const ComputationNodeBasePtr& linear, const vector<double>& delta)
+    {
+        auto consumers = getConsumers(linear);
+        if (consumers.size() == 1 && !isPinned(linear) && consumers[0]->OperationName() == OperationNameOf(PlusNode))
+        {
+            const auto& plus = consumers[0];
+            const auto& bias = plus->GetInputs()[plus->GetInputs()[0] == linear ? 1 : 0];
+            if (isChannelBias(bias, plus, linear))
+            {
+                auto values = GetNodeValues(bias);
+                for (size_t c = 0; c < values.size(); c++)
+                    values[c] += delta[c];
+                SetNodeValues(bias, values);
+                return;
+            }
+        }
+        const wstring name = linear->NodeName();
+        RenameNode(linear, name + L".unbiased");
+        SmallVector<size_t> biasDims(linear->GetSampleLayout().GetRank(), 1);
+        biasDims.back() = delta.size();
+        auto bias = NewNodeLike<LearnableParameter>(linear, name + L".bias", TensorShape(biasDims));
+        SetNodeValues(bias, delta);
+        auto plus = NewNodeLike<PlusNode>(linear, name);
+        replaceNode(linear, plus);
+        plus->AttachInputs({ linear, bias });
+        AddNodeToNet(bias);
+        AddNodeToNet(plus);
+        bias->Validate(/*isFinalValidationPass=*/true);
+        plus->Validate(/*isFinalValidationPass=*/true);
+    };
+    auto getNodesOfType = [&](const wstring& operationName)
+    {
+        vector<ComputationNodeBasePtr> nodes;
+        for (const auto& iter : m_nameToNodeMap)
+            if (iter.second->OperationName() == operationName)
+                nodes.push_back(iter.second);
+        return nodes;
+    };
+
+    // Dropout is the identity in inference
+    for (const auto& node : getNodesOfType(OperationNameOf(DropoutNode)))
+    {
+        if (isPinned(node))
+            continue;
+        replaceNode(node, node->GetInputs()[0]);
+        removeNode(node);
+        fprintf(stderr, "OptimizeForInference: Removed %ls %ls operation.\n", node->NodeName().c_str(), node->OperationName().c_str());
+    }
+
+    // TransposeTimes(W, x) = Times(W', x) with W' = W^T precomputed
+    for (const auto& node : getNodesOfType(OperationNameOf(TransposeTimesNode)))
+    {
+        const auto& weights = node->GetInputs()[0];
+        const auto& input = node->GetInputs()[1];
+        const auto& weightsShape = weights->GetSampleLayout();
+        if (!isOwnParameter(weights, node) || weightsShape.GetRank() != 2 || input->GetSampleLayout().GetRank() == 0 || input->GetSampleLayout()[0] != weightsShape[0])
+            continue;
+        const size_t rows = weightsShape[0], cols = weightsShape[1];
+        const auto values = GetNodeValues(weights);
+        vector<double> transposedValues(values.size());
+        for (size_t j = 0; j < cols; j++)
+            for (size_t i = 0; i < rows; i++)
+                transposedValues[j + i * cols] = values[i + j * rows];
+        auto transposedWeights = NewNodeLike<LearnableParameter>(weights, weights->NodeName() + L".transposed", TensorShape(cols, rows));
+        SetNodeValues(transposedWeights, transposedValues);
+        auto times = NewNodeLike<TimesNode>(node, node->NodeName(), (size_t) 1);
+        replaceNode(node, times);
+        removeNode(node);
+        times->AttachInputs({ transposedWeights, input });
+        AddNodeToNet(transposedWeights);
+        AddNodeToNet(times);
+        transposedWeights->Validate(/*isFinalValidationPass=*/true);
+        times->Validate(/*isFinalValidationPass=*/true);
+        fprintf(stderr, "OptimizeForInference: Replaced %ls %ls operation by %ls operation with transposed weights %ls.\n", node->NodeName().c_str(), node->OperationName().c_str(),
+                times->OperationName().c_str(), transposedWeights->NodeName().c_str());
+    }
+
+    // fold PerDimMeanVarNormalization(x, mean, invStdDev) into the products that consume it
+    for (const auto& node : getNodesOfType(OperationNameOf(PerDimMeanVarNormalizationNode)))
+    {
+        const auto& input = node->GetInputs()[0];
+        const size_t dim = input->GetSampleLayout().GetNumElements();
+        const auto mean = GetNodeValues(node->GetInputs()[1]);
+        const auto invStdDev = GetNodeValues(node->GetInputs()[2]);
+        const auto consumers = getConsumers(node);
+        if (isPinned(node) || consumers.empty() || node->GetInputs()[1]->HasMBLayout() || node->GetInputs()[2]->HasMBLayout() ||
+            mean.size() != dim || invStdDev.size() != dim)
+            continue;
+        bool isFoldable = true;
+        for (const auto& consumer : consumers)
+        {
+            const auto& weights = consumer->GetInputs()[0];
+            isFoldable &= TimesOutputRank(consumer) == 1 && !consumer->IsPartOfLoop() && consumer->GetInputs()[1] == node && weights != node &&
+                          isOwnParameter(weights, consumer) && consumer->GetSampleLayout().GetRank() == 1 &&
+                          weights->GetSampleLayout().GetNumElements() == consumer->GetSampleLayout()[0] * dim;
+        }
+        if (!isFoldable)
+            continue;
+
+        for (const auto& consumer : consumers)
+        {
+            const auto& weights = consumer->GetInputs()[0];
+            const size_t outputDim = consumer->GetSampleLayout()[0];
+            auto values = GetNodeValues(weights);
+            vector<double> bias(outputDim, 0);
+            for (size_t j = 0; j < dim; j++)
+            {
+                for (size_t i = 0; i < outputDim; i++)
+                {
+                    values[i + j * outputDim] *= invStdDev[j];
+                    bias[i] -= values[i + j * outputDim] * mean[j];
+                }
+            }
+            SetNodeValues(weights, values);
+            consumer->SetInput(1, input);
+            addBias(consumer, bias);
+        }
+        removeNode(node);
+        fprintf(stderr, "OptimizeForInference: Folded %ls %ls operation into %d products.\n", node->NodeName().c_str(), node->OperationName().c_str(), (int) consumers.size());
+    }
+
+    // fold BatchNormalization(L [+ b]) into the weights of L = Times(W, x) or Convolution(W, x) and the bias b
+    for (const auto& node : getNodesOfType(OperationNameOf(BatchNormalizationNode)))
+    {
+        const auto& input = node->GetInputs()[0];
+        if (isPinned(input) || getConsumers(input).size() != 1 || input->GetSampleLayout() != node->GetSampleLayout())
+            continue;
+        ComputationNodeBasePtr linear = input;
+        ComputationNodeBasePtr bias;
+        if (input->OperationName() == OperationNameOf(PlusNode))
+        {
+            for (size_t i = 0; i < 2 && !bias; i++)
+            {
+                if (isChannelBias(input->GetInputs()[1 - i], input, input->GetInputs()[i]))
+                {
+                    linear = input->GetInputs()[i];
+                    bias = input->GetInputs()[1 - i];
+                }
+            }
+            if (!bias || isPinned(linear) || getConsumers(linear).size() != 1)
+                continue;
+        }
+        const bool isConvolution = IsCHWConvolution(linear);
+        if ((!isConvolution && (TimesOutputRank(linear) != 1 || linear->GetSampleLayout().GetRank() != 1)) || !isOwnParameter(linear->GetInputs()[0], linear))
+            continue;
+        const auto& weights = linear->GetInputs()[0];
+        const size_t numChannels = linear->GetSampleLayout()[linear->GetSampleLayout().GetRank() - 1];
+        vector<double> scale, shift;
+        GetBatchNormalizationScaleAndShift(node, scale, shift);
+        auto weightValues = GetNodeValues(weights);
+        if (scale.size() != numChannels || weightValues.size() % numChannels != 0)
+            continue;
+
+        // convolution kernels are stored as one block per output channel, while the rows of a product's weight matrix are the output channels
+        const size_t kernelSize = weightValues.size() / numChannels;
+        for (size_t k = 0; k < weightValues.size(); k++)
+            weightValues[k] *= scale[isConvolution ? k / kernelSize : k % numChannels];
+        SetNodeValues(weights, weightValues);
+        if (bias)
+        {
+            auto biasValues = GetNodeValues(bias);
+            for (size_t c = 0; c < numChannels; c++)
+                biasValues[c] *= scale[c];
+            SetNodeValues(bias, biasValues);
+        }
+
+        const wstring name = node->NodeName();
+        replaceNode(node, input);
+        removeNode(node);
+        RenameNode(input, name);
+        addBias(linear, shift);
+        fprintf(stderr, "OptimizeForInference: Folded %ls %ls operation into %ls %ls operation.\n", name.c_str(), node->OperationName().c_str(), linear->NodeName().c_str(), linear->OperationName().c_str());
+    }
+
+    // remove what is no longer used, e.g. the parameters of BatchNormalization
+    while (!orphanCandidates.empty())
+    {
+        auto node = *orphanCandidates.begin();
+        orphanCandidates.erase(orphanCandidates.begin());
+        if (isInNetwork(node) && !isPinned(node) && getConsumers(node).empty())
+            removeNode(node);
+    }
+
+    if (!modified)
+        return false;
+    fprintf(stderr, "OptimizeForInference: %d nodes before, %d nodes after optimization.\n", (int) numNodesBefore, (int) m_nameToNodeMap.size());
+    InvalidateCompiledNetwork();
+    return true;
+}
+
+void ComputationNetwork::EnableFloat16Weights(bool enable, Float16Format format)
+{
+    size_t numNodes = 0;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (auto node = dynamic_pointer_cast<IFloat16WeightsNode>(iter.second))
+        {
+            node->EnableFloat16Weights(enable, format);
+            numNodes++;
+        }
+    }
+    if (enable)
+        fprintf(stderr, "EnableFloat16Weights: %d products multiply from %s weights when inferring on the CPU.\n", (int) numNodes, format == Float16Format::BFloat16 ? "bfloat16" : "float16");
+}
+
 }}}
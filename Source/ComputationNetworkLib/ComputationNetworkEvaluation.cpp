@@ -84,7 +84,9 @@ void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNod
     if (m_nestedNetworks.find(rootNode) != m_nestedNetworks.end())
         fprintf(stderr, "FormNestedNetwork: WARNING: Was called twice for %ls %ls operation\n", rootNode->NodeName().c_str(), rootNode->OperationName().c_str());
 
-    m_nestedNetworks[rootNode] = make_shared<PARTraversalFlowControlNode>(m_allSEQNodes, GetEvalOrder(rootNode));
+    auto nestedNetwork = make_shared<PARTraversalFlowControlNode>(m_allSEQNodes, GetEvalOrder(rootNode));
+    nestedNetwork->SetScheduler(m_parallelTraversalScheduler);
+    m_nestedNetworks[rootNode] = nestedNetwork;
 }
 
 ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -94,12 +96,58 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
     return m_nestedNetworks[rootNode];
 }
 
+void ComputationNetwork::SetNumParallelTraversalThreads(size_t numThreads)
+{
+    if (numThreads > 1 && m_deviceId != CPUDEVICE)
+    {
+        fprintf(stderr, "SetNumParallelTraversalThreads: Parallel traversal is only supported on the CPU; nodes will be executed sequentially.\n");
+        numThreads = 1;
+    }
+    if (numThreads <= 1)
+        m_parallelTraversalScheduler.reset();
+    else if (!m_parallelTraversalScheduler || m_parallelTraversalScheduler->GetNumThreads() != numThreads)
+        m_parallelTraversalScheduler = make_shared<WorkStealingScheduler>(numThreads);
+
+    for (auto& iter : m_nestedNetworks)
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(iter.second)->SetScheduler(m_parallelTraversalScheduler);
+}
+
+// execute a ForwardProp() or Backprop() call of 'node', and report it to the profiler set in its environment, if any
+template <class F>
+static void ExecuteAndProfile(const ComputationNodeBasePtr& node, bool isBackprop, const F& execute)
+{
+    IComputationNodeProfiler* profiler = node->GetEnvironmentPtr() ? node->Environment().m_profiler : nullptr; // (traversal nodes have no environment)
+    if (!profiler)
+        return execute();
+
+    // Backprop() allocates the gradients of the inputs as well
+    auto getNumBytesAllocated = [&]()
+    {
+        size_t numBytes = node->GetNumBytesAllocated();
+        if (isBackprop)
+        {
+            for (const auto& input : node->GetInputs())
+                numBytes += input->GetNumBytesAllocated();
+        }
+        return numBytes;
+    };
+    const size_t numBytesBefore = getNumBytesAllocated();
+    const double beginTime = profiler->GetTime();
+    execute();
+    const double endTime = profiler->GetTime();
+    const size_t numBytesAfter = getNumBytesAllocated();
+    profiler->RecordNodeExecution(*node, isBackprop, beginTime, endTime, numBytesAfter > numBytesBefore ? numBytesAfter - numBytesBefore : 0);
+}
+
 // -----------------------------------------------------------------------
 // PARTraversalFlowControlNode methods -- implements PAR traversal
 //
 // This implements an outer loop over non-recurrent nodes, where each node can be
 // executed in PAR mode; that is, all samples are independent and allow for
 // concurrent computation in bulk CUDA launches.
+//
+// If a scheduler is set, nodes that do not depend on each other are in
+// addition executed concurrently on multiple CPU threads.
 // -----------------------------------------------------------------------
 
 ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
@@ -131,7 +179,7 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
-    for (auto& node : m_nestedNodes)
+    auto forwardProp = [&fr](const ComputationNodeBasePtr& node)
     {
 #if 0
         if (dynamic_pointer_cast<LearnableParameter<float>>(node))
@@ -139,27 +187,148 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 #endif
         if (node->IsOutOfDateWrtInputs())
         {
-            node->BeginForwardProp();
-            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
-            node->EndForwardProp();
+            ExecuteAndProfile(node, /*isBackprop=*/false, [&]()
+            {
+                node->BeginForwardProp();
+                node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+                node->EndForwardProp();
+            });
 
             node->BumpEvalTimeStamp();
         }
+    };
+
+    if (m_scheduler)
+    {
+        m_scheduler->Run(DetermineDependencies(/*forBackprop=*/false), [&](size_t k) { forwardProp(m_nestedNodes[k]); });
+        return;
     }
+    for (auto& node : m_nestedNodes)
+        forwardProp(node);
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
+    auto backprop = [&fr](const ComputationNodeBasePtr& node)
+    {
+        ExecuteAndProfile(node, /*isBackprop=*/true, [&]()
+        {
+            node->BeginBackprop();
+            node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+            node->EndBackprop();
+        });
+    };
+
+    if (m_scheduler)
+    {
+        // task k is the k-th node in backwards evaluation order
+        m_scheduler->Run(DetermineDependencies(/*forBackprop=*/true), [&](size_t k) { backprop(m_nestedNodes[m_nestedNodes.size() - 1 - k]); });
+        return;
+    }
     // process nodes in pre-determined order
     for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+        backprop(*pnode);
+}
+
+// Determine which nodes must complete before which others can start, for executing ForwardProp() or Backprop() with the scheduler.
+// Task k is the k-th node of the traversal (backwards for Backprop()); a recurrent loop is a single task.
+// Besides the data flow between inputs and outputs, the MatrixPool may have given the same matrix to several nodes.
+// Hence all accesses to each matrix are ordered as in the sequential traversal: a node that writes a matrix waits
+// for all earlier readers and writers of it, and a node that reads it waits for the last earlier writer.
+// This is recomputed for every call since matrices may be reallocated; its cost is small compared to executing the nodes.
+std::vector<std::vector<size_t>> ComputationNetwork::PARTraversalFlowControlNode::DetermineDependencies(bool forBackprop) const
+{
+    const size_t numTasks = m_nestedNodes.size();
+
+    // the nodes executed by each task (all nodes of a loop, or a single node)
+    std::vector<std::vector<ComputationNodeBasePtr>> nodesOfTask(numTasks);
+    std::unordered_map<const ComputationNodeBase*, size_t> taskOfNode;
+    for (size_t k = 0; k < numTasks; k++)
     {
-        auto& node = *pnode;
+        const auto& node = m_nestedNodes[forBackprop ? numTasks - 1 - k : k];
+        auto loop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+        nodesOfTask[k] = loop ? loop->m_nestedNodes : std::vector<ComputationNodeBasePtr>{ node };
+        for (const auto& nestedNode : nodesOfTask[k])
+            taskOfNode[nestedNode.get()] = k;
+    }
 
-        node->BeginBackprop();
-        node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
-        node->EndBackprop();
+    std::vector<std::vector<size_t>> successors(numTasks);
+    auto addDependency = [&](size_t from, size_t to)
+    {
+        if (from != to)
+            successors[min(from, to)].push_back(max(from, to));
+    };
+
+    struct MatrixAccesses
+    {
+        size_t lastWriter = SIZE_MAX;
+        std::vector<size_t> readers; // since the last writer
+    };
+    std::unordered_map<const MatrixBase*, MatrixAccesses> accesses;
+    std::vector<const MatrixBase*> reads, writes;
+    for (size_t k = 0; k < numTasks; k++)
+    {
+        reads.clear();
+        writes.clear();
+        auto collectAccesses = [&](const ComputationNodeBasePtr& node)
+        {
+            const MatrixBase* value = node->ValuePtr().get();
+            const MatrixBase* gradient = node->GradientPtr().get();
+            for (const auto& input : node->GetInputs())
+            {
+                auto iter = taskOfNode.find(input.get());
+                if (iter != taskOfNode.end())
+                    addDependency(iter->second, k);
+                reads.push_back(input->ValuePtr().get());
+                if (forBackprop && input->NeedsGradient())
+                    writes.push_back(input->GradientPtr().get());
+            }
+            if (forBackprop)
+            {
+                reads.push_back(value);
+                writes.push_back(gradient); // (Backprop() may zero-initialize it)
+            }
+            else
+                writes.push_back(value);
+            for (const MatrixBase* temp : node->GetMatricesFromPool()) // temporaries
+            {
+                if (temp != value && temp != gradient)
+                    writes.push_back(temp);
+            }
+        };
+        for (const auto& node : nodesOfTask[k])
+            collectAccesses(node);
+
+        for (const MatrixBase* matrix : reads)
+        {
+            if (!matrix)
+                continue;
+            auto& access = accesses[matrix];
+            if (access.lastWriter != SIZE_MAX)
+                addDependency(access.lastWriter, k);
+            access.readers.push_back(k);
+        }
+        for (const MatrixBase* matrix : writes)
+        {
+            if (!matrix)
+                continue;
+            auto& access = accesses[matrix];
+            if (access.lastWriter != SIZE_MAX)
+                addDependency(access.lastWriter, k);
+            for (size_t reader : access.readers)
+                addDependency(reader, k);
+            access.readers.clear();
+            access.lastWriter = k;
+        }
     }
+
+    for (auto& taskSuccessors : successors)
+    {
+        sort(taskSuccessors.begin(), taskSuccessors.end());
+        taskSuccessors.erase(unique(taskSuccessors.begin(), taskSuccessors.end()), taskSuccessors.end());
+    }
+    return successors;
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
@@ -220,7 +389,7 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     {
         for (auto& node : m_nestedNodes)
         {
-            node->ForwardProp(t);
+            ExecuteAndProfile(node, /*isBackprop=*/false, [&]() { node->ForwardProp(t); });
             node->BumpEvalTimeStamp();
         }
     }
@@ -251,7 +420,7 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
         {
             auto& node2 = *nodeIter2;
-            node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+            ExecuteAndProfile(node2, /*isBackprop=*/true, [&]() { node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/); });
             // The above flags tell Backprop() to skip back-propagation from inside a node into
             // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
         }
@@ -266,7 +435,7 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     for (auto nodeIter2 = m_nestedNodes.rbegin(); nodeIter2 != m_nestedNodes.rend(); ++nodeIter2)
     {
         auto& node2 = *nodeIter2;
-        node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+        ExecuteAndProfile(node2, /*isBackprop=*/true, [&]() { node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/); });
     }
 
     // tell all nodes we are done for this iteraTion
@@ -450,7 +619,16 @@ void ComputationNetwork::CompileNetwork()
     ValidateNetwork();
 
     // STEP: Optimize the network.
-    // :)
+    // If this changes the graph, we compile the modified network from scratch. (The modified network offers nothing more to hoist, pack, or fuse, so this ends.)
+    // Hoisting comes first since it changes the loops; packing then includes the hoisted products, and fusion operates on the result.
+    if ((m_hoistLoopInvariantComputations && HoistLoopInvariantComputations()) ||
+        (m_packFramesOutsideLoops && PackFramesOutsideLoops()) ||
+        (m_fuseElementwiseOperations && FuseElementwiseOperations()))
+    {
+        fprintf(stderr, "\nNetwork was modified by the optimization, post-processing again.\n");
+        CompileNetwork();
+        return;
+    }
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
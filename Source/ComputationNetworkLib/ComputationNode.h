@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <mutex>
 
 #define DEFAULT_HIDDEN_ACTIVATION 0.1
 
@@ -610,6 +611,21 @@ public:
     // helper to access to element(0,0) without having to type-cast
     virtual double Get00Element() const = 0;
     virtual MatrixBasePtr ValuePtr() const = 0; // for use in readers that pass the agnostic object around
+    virtual MatrixBasePtr GradientPtr() const = 0;
+
+    // matrices this node obtained from the MatrixPool, including temporaries; a matrix may be shared with other nodes
+    // (used to determine which nodes may be executed concurrently)
+    const std::vector<const MatrixBase*>& GetMatricesFromPool() const { return m_matricesFromPool; }
+
+    // number of bytes currently allocated for the value, gradient and temporaries of this node (for profiling)
+    virtual size_t GetNumBytesAllocated() const = 0;
+
+    // rough number of floating-point operations of one ForwardProp() over the whole minibatch (for profiling)
+    // By default one per output element; nodes dominated by products override this.
+    virtual double GetEstimatedNumFLOPs() const { return GetNumElementsOfMinibatch(); }
+
+    // number of elements of the value over the whole minibatch
+    double GetNumElementsOfMinibatch() const { return (double) GetSampleLayout().GetNumElements() * (HasMBLayout() ? GetMBLayout()->GetNumCols() : 1); }
 
     // TODO: two sets of functions, choose one
     const std::wstring& NodeName() const { return m_nodeName; }
@@ -887,6 +903,8 @@ protected:
     float m_learningRateMultiplier;    // update parameters? Only used for LearnableParameters.    --TODO: Should we make this a member of LearnableParameters actually? And require a type cast? Currently it is read out for all leaves.
     bool m_gradientInitialized;        // indicates whether the gradient matrix has been resized and initialized to 0
     bool m_outputNeededDuringBackprop; // indicates whether the output value of the node is needed during backprop
+
+    std::vector<const MatrixBase*> m_matricesFromPool; // see GetMatricesFromPool()
 };
 typedef ComputationNodeBase::ComputationNodeBasePtr ComputationNodeBasePtr;
 
@@ -1177,7 +1195,7 @@ public:
     const Matrix<ElemType>& Gradient() const { return *m_gradient; }
     Matrix<ElemType>&       Gradient()       { return *m_gradient; }
 
-    MatrixBasePtr GradientPtr() const { return m_gradient; }
+    MatrixBasePtr GradientPtr() const override final { return m_gradient; }
     // TODO: This is only used for testing whether a gradient has been allocated. Maybe reduce to bool HasGradient()?
 
 private:
@@ -1467,6 +1485,23 @@ public:
 
     // helper function for formatting memory sharing information
     // TODO: customize this function for all nodes that uses temp internal matrices.
+    virtual size_t GetNumBytesAllocated() const override
+    {
+        size_t numBytes = 0;
+        std::set<const MatrixBase*> counted;
+        auto add = [&](const MatrixBase* matrix)
+        {
+            auto typedMatrix = dynamic_cast<const Matrix<ElemType>*>(matrix);
+            if (typedMatrix && counted.insert(matrix).second)
+                numBytes += typedMatrix->BufferSize();
+        };
+        add(m_value.get());
+        add(m_gradient.get());
+        for (const MatrixBase* matrix : m_matricesFromPool)
+            add(matrix);
+        return numBytes;
+    }
+
     virtual std::set<std::pair<const MatrixBase*, std::wstring>> GetMatrixInfo() const override
     {
         std::set<std::pair<const MatrixBase*, std::wstring>> matrixInfo;
@@ -1555,6 +1590,7 @@ protected:
         if (matrixPtr == nullptr)
         {
             matrixPtr = matrixPool.Request<ElemType>(m_deviceId);
+            m_matricesFromPool.push_back(matrixPtr.get());
         }
     }
 
@@ -1577,6 +1613,12 @@ public:
                                       const std::string& sequencePrologue, const std::string& sequenceEpilogue, const std::string& elementSeparator,
                                       const std::string& sampleSeparator, std::string valueFormatString,
                                       bool outputGradient = false) const;
+    // same for a copy of the data, e.g. to format a minibatch while the network computes the next one (matData is modified in-place)
+    static void WriteMinibatchWithFormatting(FILE* f, ElemType* matData, size_t matRows, const TensorShape& sampleLayout, MBLayoutPtr pMBLayout,
+                                             const FrameRange& fr, size_t onlyUpToRow, size_t onlyUpToT, bool transpose, bool isCategoryLabel, bool isSparse,
+                                             const std::vector<std::string>& labelMapping, const std::string& sequenceSeparator,
+                                             const std::string& sequencePrologue, const std::string& sequenceEpilogue, const std::string& elementSeparator,
+                                             const std::string& sampleSeparator, std::string valueFormatString);
 
     // simple helper to log the content of a minibatch
     void DebugLogMinibatch(bool outputGradient = false) const
@@ -1724,6 +1766,8 @@ public:
     // When using the TensorView interface, one could instead just use a 1x1 matrix with a view that broadcasts its columns (stride 0).
     static const Matrix<ElemType>& ConstOnes(const size_t rows, const size_t cols, const DEVICEID_TYPE deviceId)
     {
+        static std::mutex s_constOnesMutex; // nodes may run concurrently (see WorkStealingScheduler)
+        std::lock_guard<std::mutex> lock(s_constOnesMutex);
         if (s_constOnes.find(rows) == s_constOnes.end() ||
             s_constOnes[rows].find(cols) == s_constOnes[rows].end()) // not found
         {
@@ -1857,6 +1901,7 @@ public:
     virtual ComputationNodeBasePtr Duplicate(const std::wstring& newName, const CopyNodeFlags flags) const override { NOT_IMPLEMENTED; }
     virtual double Get00Element() const override { NOT_IMPLEMENTED; }
     virtual MatrixBasePtr ValuePtr() const override { NOT_IMPLEMENTED; }
+    virtual MatrixBasePtr GradientPtr() const override { NOT_IMPLEMENTED; }
     virtual void UpdateFunctionMBSize() override { NOT_IMPLEMENTED; }
     virtual void AttachInputs(const std::vector<ComputationNodeBasePtr>& inputs) override { NOT_IMPLEMENTED; }
     virtual void PrintSelf(bool) const override { NOT_IMPLEMENTED; }
@@ -1873,6 +1918,7 @@ public:
     virtual std::string FormatOperationPrototype(const std::string& extraArgs) const override { return ""; }
     virtual void DumpNodeInfo(const bool /*printValues*/, const bool /*printMetadata*/, File& fstream) const override {}
     virtual std::set<std::pair<const MatrixBase*, std::wstring>> GetMatrixInfo() const override { NOT_IMPLEMENTED; }
+    virtual size_t GetNumBytesAllocated() const override { NOT_IMPLEMENTED; }
 
 protected: public:                                     // needed in ComputationNetwork::FindInRecurrentLoops(), which really should be part of SEQTraversalFlowControlNode
     std::vector<ComputationNodeBasePtr> m_nestedNodes; // nodes tucked away in this node, in evaluation order
@@ -1975,6 +2021,7 @@ protected:
     using Base::GetInputsFromConfig;                                                                                                                     \
     using Base::GetMBLayout;                                                                                                                             \
     using Base::GetMBLayoutAxisString;                                                                                                                   \
+    using Base::GetNumElementsOfMinibatch;                                                                                                               \
     using Base::GetNumInputs;                                                                                                                            \
     using Base::GetNumParallelSequences;                                                                                                                 \
     using Base::GetNumTimeSteps;                                                                                                                         \
@@ -148,6 +148,7 @@ public:
     bool Transpose() const { return m_transpose; }
     size_t MaxTempMemSizeInSamples() const { return m_maxTempMemSizeInSamples; }
     PoolKind PoolingKind() const { return m_poolKind; }
+    ImageLayoutKind ImageLayout() const { return m_imageLayout; }
 
 private:
     // bottomlessly expand shape to filterRank, then expand to inputRank using defaults or given 'from' values
@@ -313,6 +314,12 @@ public:
         }
     }
 
+    // each output element (each input element if transposed) is an inner product with the kernel
+    virtual double GetEstimatedNumFLOPs() const override
+    {
+        return 2 * (double) m_kernelShape.GetNumElements() * (m_transpose ? Input(1)->GetNumElementsOfMinibatch() : GetNumElementsOfMinibatch());
+    }
+
     void ForwardProp(const FrameRange& fr) override
     {
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
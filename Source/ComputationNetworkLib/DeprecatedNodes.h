@@ -7,6 +7,7 @@
 #include "Basics.h"
 #include "ComputationNode.h"
 #include "Matrix.h"
+#include "MatrixExpression.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -100,8 +101,7 @@ public:
         auto mean      = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         auto invStdDev = Input(2)->ValueTensorFor(rank, fr.AllowBroadcast());
 
-        output.AssignDifferenceOf(input, mean);               // output = input - mean
-        output.AssignElementwiseProductOf(output, invStdDev); // output *= invStdDev
+        AssignExpression(output, (Expr(input) - Expr(mean)) * Expr(invStdDev));
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
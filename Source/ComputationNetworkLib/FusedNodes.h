@@ -0,0 +1,273 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// FusedNodes.h -- nodes that replace a subgraph of other nodes and compute the same function in fewer passes.
+// These are created by ComputationNetwork::CompileNetwork() (see ComputationNetwork::FuseElementwiseOperations()), not by users.
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "Matrix.h"
+#include "TensorOps.h"
+
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// FusedElementwiseNode (input0, input1, ...) -- a tree of elementwise operations over same-shaped inputs,
+// evaluated in a single pass over the elements.
+//
+// The tree is stored as a small program. Registers [0, numInputs) hold the input values of the current element;
+// instruction k computes register numInputs + k from one or two registers. The last register is the result.
+// Backprop recomputes the registers of each element and propagates the gradient back through the program
+// (reverse mode), so no intermediate values are kept between forward and backward. The gradients of all
+// inputs are computed in this one pass.
+// Only dense CPU matrices are supported; the fusion pass does not create this node for other devices.
+// -----------------------------------------------------------------------
+
+enum class FusedElementwiseOp : int
+{
+    Plus,
+    Minus,
+    ElementTimes,
+    Negate,
+    Sigmoid,
+    Tanh,
+    RectifiedLinear,
+    Exp,
+    Log,
+};
+
+// map the operation name of a standard node to the op; returns false if the node type cannot be fused
+static inline bool TryGetFusedElementwiseOp(const std::wstring& operationName, FusedElementwiseOp& op)
+{
+    if      (operationName == L"Plus")            op = FusedElementwiseOp::Plus;
+    else if (operationName == L"Minus")           op = FusedElementwiseOp::Minus;
+    else if (operationName == L"ElementTimes")    op = FusedElementwiseOp::ElementTimes;
+    else if (operationName == L"Negate")          op = FusedElementwiseOp::Negate;
+    else if (operationName == L"Sigmoid")         op = FusedElementwiseOp::Sigmoid;
+    else if (operationName == L"Tanh")            op = FusedElementwiseOp::Tanh;
+    else if (operationName == L"RectifiedLinear") op = FusedElementwiseOp::RectifiedLinear;
+    else if (operationName == L"Exp")             op = FusedElementwiseOp::Exp;
+    else if (operationName == L"Log")             op = FusedElementwiseOp::Log;
+    else return false;
+    return true;
+}
+
+struct FusedElementwiseInstruction
+{
+    FusedElementwiseOp op;
+    size_t arg0;
+    size_t arg1; // (unused for unary ops)
+};
+
+template <class ElemType>
+class FusedElementwiseNode : public ComputationNode<ElemType> // note: variable number of inputs
+{
+    typedef ComputationNode<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"FusedElementwise"; }
+
+public:
+    static const size_t MaxRegisters = 32; // bounds the size of a fused tree; registers live on the stack
+
+    DeclareConstructorFromConfig(FusedElementwiseNode);
+    FusedElementwiseNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    FusedElementwiseNode(DEVICEID_TYPE deviceId, const wstring& name, const std::vector<FusedElementwiseInstruction>& program)
+        : Base(deviceId, name), m_program(program)
+    {
+    }
+
+    const std::vector<FusedElementwiseInstruction>& GetProgram() const { return m_program; }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        auto node = dynamic_pointer_cast<FusedElementwiseNode<ElemType>>(nodeP);
+        node->m_program = m_program; // (the program is part of the node's definition, so it is always copied)
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_program.size();
+        for (const auto& instruction : m_program)
+            fstream << (int) instruction.op << instruction.arg0 << instruction.arg1;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        size_t size;
+        fstream >> size;
+        m_program.resize(size);
+        for (auto& instruction : m_program)
+        {
+            int op;
+            fstream >> op >> instruction.arg0 >> instruction.arg1;
+            instruction.op = (FusedElementwiseOp) op;
+        }
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        auto result = ValueFor(fr);
+        std::vector<const ElemType*> inputs = InputDataFor(fr, result);
+        ElemType* resultData = result.Data();
+        const size_t numInputs = inputs.size();
+        const size_t resultRegister = numInputs + m_program.size() - 1;
+        const long n = (long) result.GetNumElements();
+#pragma omp parallel for if (n > 4096)
+        for (long i = 0; i < n; i++)
+        {
+            ElemType registers[MaxRegisters];
+            for (size_t k = 0; k < numInputs; k++)
+                registers[k] = inputs[k][i];
+            Run(registers, numInputs);
+            resultData[i] = registers[resultRegister];
+        }
+    }
+
+    // The call for the first input that needs a gradient updates the gradients of all inputs; the other calls find nothing left to do.
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        for (size_t i = 0; i < inputIndex; i++)
+        {
+            if (Input(i)->NeedsGradient())
+                return;
+        }
+
+        auto gradient = GradientFor(fr);
+        std::vector<const ElemType*> inputs = InputDataFor(fr, gradient);
+        const ElemType* gradientData = gradient.Data();
+        std::vector<ElemType*> inputGradients(inputs.size(), nullptr); // (null for inputs that need no gradient)
+        for (size_t i = inputIndex; i < inputs.size(); i++)
+        {
+            if (!Input(i)->NeedsGradient())
+                continue;
+            Input(i)->LazyZeroGradient(); // (the network does this only right before the call for input i)
+            auto inputGradient = Input(i)->GradientFor(fr);
+            if (inputGradient.GetMatrixType() != MatrixType::DENSE || inputGradient.GetNumElements() != gradient.GetNumElements())
+                LogicError("%ls: The gradient of input %d must be dense and have %d elements.", NodeDescription().c_str(), (int) i, (int) gradient.GetNumElements());
+            inputGradients[i] = inputGradient.Data();
+        }
+        const size_t numInputs = inputs.size();
+        const size_t numRegisters = numInputs + m_program.size();
+        const long n = (long) gradient.GetNumElements();
+#pragma omp parallel for if (n > 4096)
+        for (long i = 0; i < n; i++)
+        {
+            ElemType registers[MaxRegisters];
+            ElemType adjoints[MaxRegisters];
+            for (size_t k = 0; k < numInputs; k++)
+                registers[k] = inputs[k][i];
+            Run(registers, numInputs);
+            for (size_t k = 0; k < numRegisters; k++)
+                adjoints[k] = 0;
+            adjoints[numRegisters - 1] = gradientData[i];
+            for (size_t k = m_program.size(); k-- > 0;)
+            {
+                const auto& instruction = m_program[k];
+                const ElemType a = adjoints[numInputs + k];
+                const ElemType out = registers[numInputs + k];
+                const ElemType x = registers[instruction.arg0];
+                switch (instruction.op)
+                {
+                case FusedElementwiseOp::Plus:            adjoints[instruction.arg0] += a; adjoints[instruction.arg1] += a; break;
+                case FusedElementwiseOp::Minus:           adjoints[instruction.arg0] += a; adjoints[instruction.arg1] -= a; break;
+                case FusedElementwiseOp::ElementTimes:    adjoints[instruction.arg0] += a * registers[instruction.arg1]; adjoints[instruction.arg1] += a * x; break;
+                case FusedElementwiseOp::Negate:          adjoints[instruction.arg0] -= a; break;
+                case FusedElementwiseOp::Sigmoid:         adjoints[instruction.arg0] += OpElementwiseProductWithSigmoidDerivativeFromOutput(a, out); break;
+                case FusedElementwiseOp::Tanh:            adjoints[instruction.arg0] += OpElementwiseProductWithTanhDerivativeFromOutput(a, out); break;
+                case FusedElementwiseOp::RectifiedLinear: adjoints[instruction.arg0] += OpElementwiseProductWithLinearRectifierDerivativeFromOutput(a, out); break;
+                case FusedElementwiseOp::Exp:             adjoints[instruction.arg0] += a * out; break;
+                case FusedElementwiseOp::Log:             adjoints[instruction.arg0] += OpElementwiseProductWithLogDerivativeFromOutput(a, out); break;
+                }
+            }
+            for (size_t k = 0; k < numInputs; k++)
+            {
+                if (inputGradients[k])
+                    inputGradients[k][i] += adjoints[k];
+            }
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return true; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        ValidateNaryZip(isFinalValidationPass, /*allowBroadcast=*/false, GetNumInputs());
+        if (isFinalValidationPass)
+        {
+            if (m_program.empty() || GetNumInputs() + m_program.size() > MaxRegisters)
+                InvalidArgument("%ls: Invalid program of %d instructions for %d inputs.", NodeDescription().c_str(), (int) m_program.size(), (int) GetNumInputs());
+            for (size_t k = 0; k < m_program.size(); k++)
+            {
+                if (m_program[k].arg0 >= GetNumInputs() + k || m_program[k].arg1 >= GetNumInputs() + k)
+                    InvalidArgument("%ls: Instruction %d refers to a register that is not computed yet.", NodeDescription().c_str(), (int) k);
+            }
+            for (size_t i = 0; i < GetNumInputs(); i++)
+            {
+                if (GetInputSampleLayout(i) != GetSampleLayout())
+                    InvalidArgument("%ls: All inputs must have the same dimensions.", NodeDescription().c_str());
+            }
+            if (m_deviceId != CPUDEVICE)
+                InvalidArgument("%ls: Only supported on the CPU.", NodeDescription().c_str());
+        }
+    }
+
+private:
+    // the inputs' data for the frame range; all must be dense and of the same size as 'result'
+    std::vector<const ElemType*> InputDataFor(const FrameRange& fr, const Matrix<ElemType>& result)
+    {
+        std::vector<const ElemType*> inputs;
+        for (size_t i = 0; i < GetNumInputs(); i++)
+        {
+            auto input = Input(i)->ValueFor(fr);
+            if (input.GetMatrixType() != MatrixType::DENSE || input.GetCurrentMatrixLocation() != CurrentDataLocation::CPU)
+                LogicError("%ls: Input %d must be a dense CPU matrix.", NodeDescription().c_str(), (int) i);
+            if (input.GetNumElements() != result.GetNumElements())
+                LogicError("%ls: Input %d has %d elements, but %d are expected.", NodeDescription().c_str(), (int) i, (int) input.GetNumElements(), (int) result.GetNumElements());
+            inputs.push_back(input.Data());
+        }
+        return inputs;
+    }
+
+    // compute the instructions' registers for one element
+    void Run(ElemType* registers, size_t numInputs) const
+    {
+        ElemType* out = registers + numInputs;
+        for (const auto& instruction : m_program)
+        {
+            const ElemType x = registers[instruction.arg0];
+            switch (instruction.op)
+            {
+            case FusedElementwiseOp::Plus:            *out = OpSum(x, registers[instruction.arg1]); break;
+            case FusedElementwiseOp::Minus:           *out = OpDifference(x, registers[instruction.arg1]); break;
+            case FusedElementwiseOp::ElementTimes:    *out = OpElementwiseProduct(x, registers[instruction.arg1]); break;
+            case FusedElementwiseOp::Negate:          *out = OpNegate(x); break;
+            case FusedElementwiseOp::Sigmoid:         *out = OpSigmoid(x); break;
+            case FusedElementwiseOp::Tanh:            *out = OpTanh(x); break;
+            case FusedElementwiseOp::RectifiedLinear: *out = OpLinearRectifier(x); break;
+            case FusedElementwiseOp::Exp:             *out = OpExp(x); break;
+            case FusedElementwiseOp::Log:             *out = OpLog(x); break;
+            }
+            out++;
+        }
+    }
+
+    std::vector<FusedElementwiseInstruction> m_program;
+};
+
+template class FusedElementwiseNode<float>;
+template class FusedElementwiseNode<double>;
+
+}}}
@@ -8,6 +8,8 @@
 #include "ComputationNode.h"
 #include "Matrix.h"
 #include "TensorView.h"
+#include "CPUPackedMatrix.h"
+#include "CPUHalfMatrix.h"
 
 #include <unordered_set>
 #include <map>
@@ -221,6 +223,13 @@ public:
 template class ElementTimesNode<float>;
 template class ElementTimesNode<double>;
 
+// -----------------------------------------------------------------------
+// IFloat16WeightsNode -- nodes that can multiply from 16-bit copies of their fixed weights when inferring
+// (see ComputationNetwork::EnableFloat16Weights())
+// -----------------------------------------------------------------------
+
+struct IFloat16WeightsNode { virtual void EnableFloat16Weights(bool enable, Float16Format format) = 0; };
+
 // -----------------------------------------------------------------------
 // TimesNodeBase (A, B, outputRank=1)
 // shared code of TimesNode and TransposeTimesNode (which transposes A)
@@ -233,13 +242,13 @@ template class ElementTimesNode<double>;
 // -----------------------------------------------------------------------
 
 template <class ElemType, bool m_transpose>
-class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>
+class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>, public IFloat16WeightsNode
 {
     typedef ComputationNode<ElemType> Base; UsingComputationNodeMembers; using Base::OperationName;                                                                                                                           \
 
 public:
     TimesNodeBase(DEVICEID_TYPE deviceId, const wstring& name, size_t outputRank = 1)
-        : Base(deviceId, name), m_outputRank(outputRank)
+        : Base(deviceId, name), m_outputRank(outputRank), m_packedInput0TimeStamp(0), m_packedInput0Data(nullptr), m_useFloat16Input0(false)
     {
     }
 
@@ -250,6 +259,7 @@ public:
         {
             auto node = dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeP);
             node->m_outputRank = m_outputRank;
+            node->EnableFloat16Weights(m_useFloat16Input0, m_float16Input0.GetFormat());
         }
     }
 
@@ -268,6 +278,15 @@ public:
             m_outputRank = 1;
     }
 
+    // [m x k] * [k x n] takes 2mkn operations, and m*k * k*n * m*n = (mkn)^2
+    virtual double GetEstimatedNumFLOPs() const override
+    {
+        if (!Input(0)->HasMBLayout())
+            return 2 * sqrt(Input(0)->GetNumElementsOfMinibatch() * Input(1)->GetNumElementsOfMinibatch() * GetNumElementsOfMinibatch());
+        // one product per sample
+        return 2 * sqrt((double) Input(0)->GetSampleLayout().GetNumElements() * Input(1)->GetSampleLayout().GetNumElements() * GetSampleLayout().GetNumElements()) * GetMBLayout()->GetNumCols();
+    }
+
 private:
     // if the left argument of the matrix product (A) has a time axis, it can only be applied sample by sample
     // where each sample is treated as a separate matrix object (as a consequence, it then also applies to B and the result as well)
@@ -306,7 +325,32 @@ public:
         auto input0 = OneSampleTensorFor(0,  /*gradient=*/false, fr.AllowBroadcast());
         auto input1 = OneSampleTensorFor(1,  /*gradient=*/false, fr.AllowBroadcast());
         auto output = OneSampleTensorFor(-1, /*gradient=*/false, fr);
-        output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/);
+        // Fixed weights (a leaf without MBLayout) are multiplied from a packed copy where it gets reused: one time step at a time
+        // inside a recurrent loop, or across minibatches if they are not trained. (This only applies to products with few columns on the CPU.)
+        // If enabled, they are multiplied from a 16-bit copy instead when inferring (CPU only).
+        if (m_useFloat16Input0 && Input(0)->IsLeaf() && !Input(0)->HasMBLayout() && Environment().IsInferring())
+            output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/, m_float16Input0);
+        else if (Input(0)->IsLeaf() && !Input(0)->HasMBLayout() && (!fr.IsAllFrames() || !Input(0)->IsParameterUpdateRequired()))
+            output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/, m_packedInput0);
+        else
+            output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/);
+    }
+
+    virtual void /*IComputationNode::*/ BeginForwardProp() override
+    {
+        Base::BeginForwardProp();
+        // drop the packed weights if they may have changed since they were packed: parameters that are being trained
+        // are updated in place, and not every update bumps their time stamp, so they are packed again for each minibatch
+        // The 16-bit weights are only used for inference, where the weights do not change unless they are reloaded or edited.
+        const auto& input0 = Input(0);
+        if (!input0->IsLeaf() || input0->HasMBLayout()) // (not used)
+            return;
+        if (input0->IsParameterUpdateRequired() || input0->GetEvalTimeStamp() != m_packedInput0TimeStamp || input0->Value().Data() != m_packedInput0Data)
+            m_packedInput0.Clear();
+        if (input0->GetEvalTimeStamp() != m_packedInput0TimeStamp || input0->Value().Data() != m_packedInput0Data)
+            m_float16Input0.Clear();
+        m_packedInput0TimeStamp = input0->GetEvalTimeStamp();
+        m_packedInput0Data = input0->Value().Data();
     }
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
@@ -476,8 +520,24 @@ public:
 
     size_t OutputRank() const { return m_outputRank; }
 
+    // multiply from a 16-bit copy of fixed weights when inferring on the CPU; the products are accumulated in ElemType
+    virtual void EnableFloat16Weights(bool enable, Float16Format format) override
+    {
+        m_useFloat16Input0 = enable;
+        m_float16Input0 = CPUHalfMatrix(format);
+    }
+    const CPUPackedMatrix<ElemType>& PackedInput0() const { return m_packedInput0; } // (empty unless ForwardProp() used it)
+    const CPUHalfMatrix& Float16Input0() const { return m_float16Input0; } // (empty until ForwardProp() uses it)
+
 private:
     size_t m_outputRank;
+
+    // packed and 16-bit copies of Input(0) for ForwardProp(), and the time stamp and storage of Input(0) they were made from
+    CPUPackedMatrix<ElemType> m_packedInput0;
+    int64_t m_packedInput0TimeStamp;
+    const ElemType* m_packedInput0Data;
+    bool m_useFloat16Input0;
+    CPUHalfMatrix m_float16Input0;
 };
 
 // -----------------------------------------------------------------------
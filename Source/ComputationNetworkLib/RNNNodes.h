@@ -0,0 +1,590 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// RNNNodes.h -- nodes that compute a whole stack of recurrent layers over the minibatch in a single node
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "Matrix.h"
+#include "TensorOps.h"
+
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// RNNStackNodeBase (weights, input) -- a stack of 'numLayers' recurrent layers with 'hiddenDim' cells each,
+// optionally bidirectional, computed over all sequences of the minibatch at once.
+//
+// This computes what a network of PastValue, Times, Sigmoid, ElementTimes, ... nodes computes, without evaluating
+// those nodes frame by frame in a loop. For each layer and direction, the input projections of all frames are one
+// matrix product before the recurrence, and the gradients of the input weights and of the input are one matrix
+// product each after it. Per time step, what remains is the product with the recurrent weights, followed by a
+// single pass over the cells that applies the gate nonlinearities and the state update (forward) or their
+// derivatives (backward).
+//
+// 'weights' has G * hiddenDim rows, where G is the number of gates (LSTM: 4, GRU: 3). Its columns hold, for each
+// layer and for each direction, the input weights [G * hiddenDim x layer input dim], the recurrent weights
+// [G * hiddenDim x hiddenDim], and the bias [G * hiddenDim x 1]. The first layer's input is 'input'; the other
+// layers' input is the output of the layer below, of dimension hiddenDim times the number of directions.
+// The number of columns can be specified as 0 to be inferred.
+// The output are the hidden states of the top layer. For bidirectional layers, the forward direction's states
+// are stacked on top of the backward direction's.
+//
+// Every sequence starts from a zero state. State is not carried over between minibatches, so truncated BPTT is
+// not supported: a minibatch with a sequence that starts before it or ends after it is rejected.
+// Only dense CPU matrices are supported.
+// -----------------------------------------------------------------------
+
+enum class RNNCellKind : int
+{
+    LSTM, // gates i, f, o, and candidate g:  c = f .* c' + i .* g,  h = o .* tanh(c)
+    GRU,  // gates r, z, and candidate n:     n = tanh(Wn x + b + r .* (Un h')),  h = (1 - z) .* n + z .* h'
+};
+
+template <class ElemType, RNNCellKind cellKind>
+class RNNStackNodeBase : public ComputationNodeNonLooping<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembers;
+
+    static const size_t NumGates = cellKind == RNNCellKind::LSTM ? 4 : 3;
+
+public:
+    RNNStackNodeBase(DEVICEID_TYPE deviceId, const wstring& name, size_t hiddenDim = 0, size_t numLayers = 1, bool bidirectional = false)
+        : Base(deviceId, name), m_hiddenDim(hiddenDim), m_numLayers(numLayers), m_bidirectional(bidirectional), m_backpropDone(false)
+    {
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<RNNStackNodeBase<ElemType, cellKind>>(nodeP);
+            node->m_hiddenDim = m_hiddenDim;
+            node->m_numLayers = m_numLayers;
+            node->m_bidirectional = m_bidirectional;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_hiddenDim << m_numLayers << m_bidirectional;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_hiddenDim >> m_numLayers >> m_bidirectional;
+    }
+
+    size_t GetHiddenDim() const { return m_hiddenDim; }
+    size_t GetNumLayers() const { return m_numLayers; }
+    bool IsBidirectional() const { return m_bidirectional; }
+
+    // number of columns of the weights for a given input dimension
+    size_t GetNumWeightColumns(size_t inputDim) const
+    {
+        return GetWeightsColumn(m_numLayers, 0, inputDim);
+    }
+
+    // every sample is multiplied with the weights of each layer and direction (the cell functions are comparably cheap)
+    virtual double GetEstimatedNumFLOPs() const override
+    {
+        return 2 * Input(0)->GetNumElementsOfMinibatch() * GetMBLayout()->GetNumCols();
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        const size_t S = GetMBLayout()->GetNumParallelSequences();
+        const size_t T = GetMBLayout()->GetNumTimeSteps();
+        DetermineSequenceBoundaries();
+        Input(1)->MaskMissingValueColumnsToZero(FrameRange(Input(1)->GetMBLayout()));
+
+        const auto& weights = Input(0)->Value();
+        for (size_t layer = 0; layer < m_numLayers; layer++)
+        {
+            const auto& layerInput = LayerInput(layer);
+            auto& layerOutput = LayerOutput(layer);
+            layerOutput.Resize(m_hiddenDim * NumDirections(), S * T);
+            for (size_t dir = 0; dir < NumDirections(); dir++)
+            {
+                const size_t col = GetWeightsColumn(layer, dir, Input(1)->GetSampleMatrixNumRows());
+                const size_t layerInputDim = layerInput.GetNumRows();
+                auto inputWeights = weights.ColumnSlice(col, layerInputDim);
+                auto recurrentWeights = weights.ColumnSlice(col + layerInputDim, m_hiddenDim);
+                const ElemType* bias = weights.ColumnSlice(col + layerInputDim + m_hiddenDim, 1).Data();
+                auto& gates = *m_gates[layer * NumDirections() + dir];
+                auto& states = *m_states[layer * NumDirections() + dir];
+                gates.Resize(NumGates * m_hiddenDim, S * T);
+                states.Resize(m_hiddenDim, S * T);
+
+                // input projections of all frames at once
+                Matrix<ElemType>::MultiplyAndWeightedAdd(1, inputWeights, false, layerInput, false, 0, *m_inputProjections);
+
+                m_prevHidden->Resize(m_hiddenDim, S);
+                for (size_t k = 0; k < T; k++)
+                {
+                    const size_t t = dir == 0 ? k : T - 1 - k;
+                    GatherPrevHidden(layerOutput, dir, t, m_prevHidden->Data());
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, recurrentWeights, false, *m_prevHidden, false, 0, *m_recurrentProjections);
+                    ForwardStep(dir, t, bias, *m_prevHidden, gates, states, layerOutput);
+                }
+            }
+        }
+        m_backpropDone = false;
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t inputIndex) override
+    {
+        // The recurrence is backpropagated once, by the first call. It computes the gradient of the weights, if needed,
+        // and leaves the first layer's gate gradients for the gradient of the input.
+        if (!m_backpropDone)
+        {
+            BackpropThroughTime(/*computeWeightsGradient=*/Input(0)->NeedsGradient());
+            m_backpropDone = true;
+        }
+        if (inputIndex == 1)
+        {
+            const auto& weights = Input(0)->Value();
+            const size_t inputDim = Input(1)->GetSampleMatrixNumRows();
+            for (size_t dir = 0; dir < NumDirections(); dir++)
+            {
+                auto inputWeights = weights.ColumnSlice(GetWeightsColumn(0, dir, inputDim), inputDim);
+                Matrix<ElemType>::MultiplyAndWeightedAdd(1, inputWeights, true, *m_gateGradients[dir], false, 1, Input(1)->Gradient());
+            }
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return true; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return true; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        const size_t inputDim = Input(1)->GetSampleLayout().GetNumElements();
+        if (inputDim != 0 && m_hiddenDim != 0)
+            Input(0)->ValidateInferInputDimsFrom(TensorShape(NumGates * m_hiddenDim, GetNumWeightColumns(inputDim)));
+
+        if (isFinalValidationPass)
+        {
+            if (m_hiddenDim == 0 || m_numLayers == 0)
+                InvalidArgument("%ls: hiddenDim and numLayers must be positive.", NodeDescription().c_str());
+            if (!HasMBLayout() || Input(0)->HasMBLayout())
+                InvalidArgument("%ls: The input must be a sequence, and the weights must not be.", NodeDescription().c_str());
+            const auto& weightsShape = Input(0)->GetSampleLayout();
+            if (weightsShape.GetRank() != 2 || weightsShape[0] != NumGates * m_hiddenDim || weightsShape[1] != GetNumWeightColumns(inputDim))
+                InvalidArgument("%ls: The weights have dimensions [%s], but [%d x %d] are expected for hiddenDim=%d, numLayers=%d, bidirectional=%d, and an input of dimension %d.",
+                                NodeDescription().c_str(), string(weightsShape).c_str(), (int) (NumGates * m_hiddenDim), (int) GetNumWeightColumns(inputDim),
+                                (int) m_hiddenDim, (int) m_numLayers, (int) m_bidirectional, (int) inputDim);
+            if (m_deviceId != CPUDEVICE)
+                InvalidArgument("%ls: Only supported on the CPU.", NodeDescription().c_str());
+        }
+
+        SetDims(TensorShape(m_hiddenDim * NumDirections()), HasMBLayout());
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        m_gates.resize(m_numLayers * NumDirections());
+        m_states.resize(m_numLayers * NumDirections());
+        m_layerOutputs.resize(m_numLayers - 1);
+        m_layerOutputGradients.resize(m_numLayers - 1);
+        m_gateGradients.resize(NumDirections());
+        for (auto* matrices : { &m_gates, &m_states, &m_layerOutputs, &m_layerOutputGradients, &m_gateGradients })
+            for (auto& matrix : *matrices)
+                RequestMatrixFromPool(matrix, matrixPool);
+        for (auto* matrix : { &m_inputProjections, &m_recurrentProjections, &m_prevHidden, &m_recurrentGateGradients, &m_nextHiddenGradient, &m_nextCellGradient })
+            RequestMatrixFromPool(*matrix, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        for (auto* matrices : { &m_gates, &m_states, &m_layerOutputs, &m_layerOutputGradients, &m_gateGradients })
+            for (auto& matrix : *matrices)
+                ReleaseMatrixToPool(matrix, matrixPool);
+        for (auto* matrix : { &m_inputProjections, &m_recurrentProjections, &m_prevHidden, &m_recurrentGateGradients, &m_nextHiddenGradient, &m_nextCellGradient })
+            ReleaseMatrixToPool(*matrix, matrixPool);
+    }
+
+private:
+    size_t NumDirections() const { return m_bidirectional ? 2 : 1; }
+
+    // first column of the weights of a layer and direction
+    size_t GetWeightsColumn(size_t layer, size_t dir, size_t inputDim) const
+    {
+        size_t col = 0;
+        for (size_t l = 0; l <= layer && l < m_numLayers; l++)
+        {
+            const size_t layerInputDim = l == 0 ? inputDim : m_hiddenDim * NumDirections();
+            col += (l < layer ? NumDirections() : dir) * (layerInputDim + m_hiddenDim + 1);
+        }
+        return col;
+    }
+
+    const Matrix<ElemType>& LayerInput(size_t layer) { return layer == 0 ? Input(1)->Value() : *m_layerOutputs[layer - 1]; }
+    Matrix<ElemType>& LayerOutput(size_t layer) { return layer + 1 == m_numLayers ? Value() : *m_layerOutputs[layer]; }
+    Matrix<ElemType>& LayerOutputGradient(size_t layer) { return layer + 1 == m_numLayers ? Gradient() : *m_layerOutputGradients[layer]; }
+
+    // Which frames are gaps, and which are the first frame of their sequence in forward resp. backward direction.
+    // Frames are columns t * S + s, for S parallel sequences.
+    void DetermineSequenceBoundaries()
+    {
+        const auto& pMBLayout = GetMBLayout();
+        const size_t T = pMBLayout->GetNumTimeSteps();
+        m_isGap.assign(pMBLayout->GetNumCols(), true);
+        m_isFirst[0].assign(pMBLayout->GetNumCols(), false);
+        m_isFirst[1].assign(pMBLayout->GetNumCols(), false);
+        for (const auto& seq : pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            // a sequence that started in a previous minibatch or continues in the next one would need the state carried over
+            if (seq.tBegin < 0 || seq.tEnd > T)
+                InvalidArgument("%ls: Sequence %d extends beyond the minibatch (time steps %d..%d of %d). Truncated BPTT is not supported.",
+                                NodeDescription().c_str(), (int) seq.seqId, (int) seq.tBegin, (int) seq.tEnd, (int) T);
+            const size_t tBegin = (size_t) seq.tBegin;
+            const size_t tEnd = seq.tEnd;
+            for (size_t t = tBegin; t < tEnd; t++)
+                m_isGap[t * pMBLayout->GetNumParallelSequences() + seq.s] = false;
+            m_isFirst[0][tBegin * pMBLayout->GetNumParallelSequences() + seq.s] = true;
+            m_isFirst[1][(tEnd - 1) * pMBLayout->GetNumParallelSequences() + seq.s] = true;
+        }
+    }
+
+    // the frame before frame j in direction 'dir', or SIZE_MAX if there is none
+    size_t PrevFrame(size_t dir, size_t t, size_t s) const
+    {
+        const size_t S = GetMBLayout()->GetNumParallelSequences();
+        const size_t j = t * S + s;
+        if (m_isGap[j] || m_isFirst[dir][j])
+            return SIZE_MAX;
+        return dir == 0 ? j - S : j + S;
+    }
+
+    // copy the previous hidden state of each sequence at time t into a [hiddenDim x S] matrix (zero at sequence starts)
+    void GatherPrevHidden(const Matrix<ElemType>& layerOutput, size_t dir, size_t t, ElemType* prevHidden) const
+    {
+        const size_t S = GetMBLayout()->GetNumParallelSequences();
+        const size_t H = m_hiddenDim;
+        const size_t outputDim = layerOutput.GetNumRows();
+        const ElemType* hidden = layerOutput.Data() + dir * H;
+        for (size_t s = 0; s < S; s++)
+        {
+            const size_t prev = PrevFrame(dir, t, s);
+            for (size_t i = 0; i < H; i++)
+                prevHidden[s * H + i] = prev == SIZE_MAX ? 0 : hidden[prev * outputDim + i];
+        }
+    }
+
+    // The fused cell update of time step t for all parallel sequences: gate nonlinearities, state, and output.
+    // The recurrent projections of the step are in m_recurrentProjections.
+    void ForwardStep(size_t dir, size_t t, const ElemType* bias, const Matrix<ElemType>& prevHiddenMatrix,
+                     Matrix<ElemType>& gatesMatrix, Matrix<ElemType>& statesMatrix, Matrix<ElemType>& layerOutput)
+    {
+        const long S = (long) GetMBLayout()->GetNumParallelSequences();
+        const size_t H = m_hiddenDim;
+        const size_t G = NumGates * H;
+        const size_t outputDim = layerOutput.GetNumRows();
+        const ElemType* inputProjections = m_inputProjections->Data();
+        const ElemType* recurrentProjections = m_recurrentProjections->Data();
+        const ElemType* prevHiddenData = prevHiddenMatrix.Data();
+        ElemType* gatesData = gatesMatrix.Data();
+        ElemType* statesData = statesMatrix.Data();
+        ElemType* outputData = layerOutput.Data() + dir * H;
+#pragma omp parallel for if (S * H > 4096)
+        for (long s = 0; s < S; s++)
+        {
+            const size_t j = t * S + s;
+            ElemType* gates = gatesData + j * G;
+            ElemType* state = statesData + j * H;
+            ElemType* h = outputData + j * outputDim;
+            if (m_isGap[j])
+            {
+                fill(gates, gates + G, (ElemType) 0);
+                fill(state, state + H, (ElemType) 0);
+                fill(h, h + H, (ElemType) 0);
+                continue;
+            }
+            const ElemType* x = inputProjections + j * G;
+            const ElemType* r = recurrentProjections + s * G;
+            const ElemType* hPrev = prevHiddenData + s * H;
+            const size_t prev = PrevFrame(dir, t, s);
+            if (cellKind == RNNCellKind::LSTM)
+            {
+                const ElemType* cPrev = prev == SIZE_MAX ? nullptr : statesData + prev * H;
+                for (size_t i = 0; i < H; i++)
+                {
+                    const ElemType gi = OpSigmoid(x[i]         + r[i]         + bias[i]);
+                    const ElemType gf = OpSigmoid(x[H + i]     + r[H + i]     + bias[H + i]);
+                    const ElemType go = OpSigmoid(x[2 * H + i] + r[2 * H + i] + bias[2 * H + i]);
+                    const ElemType gg = OpTanh   (x[3 * H + i] + r[3 * H + i] + bias[3 * H + i]);
+                    const ElemType c = (cPrev ? gf * cPrev[i] : 0) + gi * gg;
+                    gates[i] = gi; gates[H + i] = gf; gates[2 * H + i] = go; gates[3 * H + i] = gg;
+                    state[i] = c;
+                    h[i] = go * OpTanh(c);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < H; i++)
+                {
+                    const ElemType gr = OpSigmoid(x[i]     + r[i]     + bias[i]);
+                    const ElemType gz = OpSigmoid(x[H + i] + r[H + i] + bias[H + i]);
+                    const ElemType un = r[2 * H + i];
+                    const ElemType gn = OpTanh(x[2 * H + i] + bias[2 * H + i] + gr * un);
+                    gates[i] = gr; gates[H + i] = gz; gates[2 * H + i] = gn;
+                    state[i] = un; // (kept for backprop)
+                    h[i] = (1 - gz) * gn + gz * hPrev[i];
+                }
+            }
+        }
+    }
+
+    // The fused cell derivative of time step t for all parallel sequences. Computes the gradients of the gates' inputs
+    // from the output gradient and the gradients from step t+1 (in direction order), and replaces the latter by the
+    // parts of the gradients for step t-1 that do not go through the recurrent weights.
+    void BackwardStep(size_t dir, size_t t, const Matrix<ElemType>& layerOutput, const Matrix<ElemType>& layerOutputGradient,
+                      const Matrix<ElemType>& gatesMatrix, const Matrix<ElemType>& statesMatrix, Matrix<ElemType>& gateGradients)
+    {
+        const long S = (long) GetMBLayout()->GetNumParallelSequences();
+        const size_t H = m_hiddenDim;
+        const size_t G = NumGates * H;
+        const size_t outputDim = layerOutput.GetNumRows();
+        const ElemType* outputData = layerOutput.Data() + dir * H;
+        const ElemType* outputGradientData = layerOutputGradient.Data() + dir * H;
+        const ElemType* gatesData = gatesMatrix.Data();
+        const ElemType* statesData = statesMatrix.Data();
+        ElemType* gateGradientsData = gateGradients.Data();
+        ElemType* recurrentGateGradientsData = m_recurrentGateGradients->Data();
+        ElemType* nextHiddenGradientData = m_nextHiddenGradient->Data();
+        ElemType* nextCellGradientData = m_nextCellGradient->Data();
+#pragma omp parallel for if (S * H > 4096)
+        for (long s = 0; s < S; s++)
+        {
+            const size_t j = t * S + s;
+            ElemType* dGates = gateGradientsData + j * G;
+            ElemType* dRecurrentGates = recurrentGateGradientsData + j * G;
+            ElemType* dhNext = nextHiddenGradientData + s * H;
+            ElemType* dcNext = nextCellGradientData + s * H;
+            if (m_isGap[j])
+            {
+                fill(dGates, dGates + G, (ElemType) 0);
+                if (cellKind == RNNCellKind::GRU)
+                    fill(dRecurrentGates, dRecurrentGates + G, (ElemType) 0);
+                fill(dhNext, dhNext + H, (ElemType) 0);
+                fill(dcNext, dcNext + H, (ElemType) 0);
+                continue;
+            }
+            const ElemType* gates = gatesData + j * G;
+            const ElemType* state = statesData + j * H;
+            const ElemType* dOutput = outputGradientData + j * outputDim;
+            const size_t prev = PrevFrame(dir, t, s);
+            if (cellKind == RNNCellKind::LSTM)
+            {
+                const ElemType* cPrev = prev == SIZE_MAX ? nullptr : statesData + prev * H;
+                for (size_t i = 0; i < H; i++)
+                {
+                    const ElemType gi = gates[i], gf = gates[H + i], go = gates[2 * H + i], gg = gates[3 * H + i];
+                    const ElemType dh = dOutput[i] + dhNext[i];
+                    const ElemType tanhC = OpTanh(state[i]);
+                    const ElemType dc = dcNext[i] + dh * go * (1 - tanhC * tanhC);
+                    dGates[i]         = dc * gg * gi * (1 - gi);
+                    dGates[H + i]     = (cPrev ? dc * cPrev[i] : 0) * gf * (1 - gf);
+                    dGates[2 * H + i] = dh * tanhC * go * (1 - go);
+                    dGates[3 * H + i] = dc * gi * (1 - gg * gg);
+                    dcNext[i] = dc * gf;
+                    dhNext[i] = 0;
+                }
+            }
+            else
+            {
+                const ElemType* hPrev = prev == SIZE_MAX ? nullptr : outputData + prev * outputDim;
+                for (size_t i = 0; i < H; i++)
+                {
+                    const ElemType gr = gates[i], gz = gates[H + i], gn = gates[2 * H + i];
+                    const ElemType dh = dOutput[i] + dhNext[i];
+                    const ElemType dn = dh * (1 - gz) * (1 - gn * gn);
+                    dGates[i]         = dn * state[i] * gr * (1 - gr);
+                    dGates[H + i]     = dh * ((hPrev ? hPrev[i] : 0) - gn) * gz * (1 - gz);
+                    dGates[2 * H + i] = dn;
+                    dRecurrentGates[i]         = dGates[i];
+                    dRecurrentGates[H + i]     = dGates[H + i];
+                    dRecurrentGates[2 * H + i] = dn * gr;
+                    dhNext[i] = dh * gz;
+                    dcNext[i] = 0;
+                }
+            }
+        }
+    }
+
+    // propagate the output gradient through all layers and time steps
+    void BackpropThroughTime(bool computeWeightsGradient)
+    {
+        const size_t S = GetMBLayout()->GetNumParallelSequences();
+        const size_t T = GetMBLayout()->GetNumTimeSteps();
+        const size_t H = m_hiddenDim;
+        const size_t inputDim = Input(1)->GetSampleMatrixNumRows();
+        const auto& weights = Input(0)->Value();
+
+        for (size_t layer = m_numLayers; layer-- > 0;)
+        {
+            const auto& layerInput = LayerInput(layer);
+            const auto& layerOutput = LayerOutput(layer);
+            const auto& layerOutputGradient = LayerOutputGradient(layer);
+            for (size_t dir = 0; dir < NumDirections(); dir++)
+            {
+                const size_t col = GetWeightsColumn(layer, dir, inputDim);
+                const size_t layerInputDim = layerInput.GetNumRows();
+                auto inputWeights = weights.ColumnSlice(col, layerInputDim);
+                auto recurrentWeights = weights.ColumnSlice(col + layerInputDim, H);
+                const auto& gates = *m_gates[layer * NumDirections() + dir];
+                const auto& states = *m_states[layer * NumDirections() + dir];
+                auto& gateGradients = *m_gateGradients[dir];
+                gateGradients.Resize(NumGates * H, S * T);
+                // the gradients of the gates' recurrent contributions; for LSTM, these are the same as those of the input contributions
+                auto& recurrentGateGradients = cellKind == RNNCellKind::LSTM ? gateGradients : *m_recurrentGateGradients;
+                if (cellKind == RNNCellKind::GRU)
+                    m_recurrentGateGradients->Resize(NumGates * H, S * T);
+                m_nextHiddenGradient->Resize(H, S);
+                m_nextCellGradient->Resize(H, S);
+                m_nextHiddenGradient->SetValue(0);
+                m_nextCellGradient->SetValue(0);
+
+                for (size_t k = 0; k < T; k++)
+                {
+                    const size_t t = dir == 0 ? T - 1 - k : k;
+                    BackwardStep(dir, t, layerOutput, layerOutputGradient, gates, states, gateGradients);
+                    auto stepRecurrentGateGradients = recurrentGateGradients.ColumnSlice(t * S, S);
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, recurrentWeights, true, stepRecurrentGateGradients, false, 1, *m_nextHiddenGradient);
+                    // nothing flows into the zero state before the first frame of a sequence
+                    for (size_t s = 0; s < S; s++)
+                    {
+                        if (PrevFrame(dir, t, s) == SIZE_MAX)
+                        {
+                            m_nextHiddenGradient->ColumnSlice(s, 1).SetValue(0);
+                            m_nextCellGradient->ColumnSlice(s, 1).SetValue(0);
+                        }
+                    }
+                }
+
+                if (computeWeightsGradient)
+                {
+                    auto& weightsGradient = Input(0)->Gradient();
+                    auto inputWeightsGradient = weightsGradient.ColumnSlice(col, layerInputDim);
+                    auto recurrentWeightsGradient = weightsGradient.ColumnSlice(col + layerInputDim, H);
+                    auto biasGradient = weightsGradient.ColumnSlice(col + layerInputDim + H, 1);
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, gateGradients, false, layerInput, true, 1, inputWeightsGradient);
+                    // the previous hidden state of every frame, as a matrix; this lives in m_inputProjections, which is no longer needed
+                    m_inputProjections->Resize(H, S * T);
+                    for (size_t t = 0; t < T; t++)
+                        GatherPrevHidden(layerOutput, dir, t, m_inputProjections->Data() + t * S * H);
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, recurrentGateGradients, false, *m_inputProjections, true, 1, recurrentWeightsGradient);
+                    const long G = (long) (NumGates * H);
+                    const ElemType* gateGradientsData = gateGradients.Data();
+                    ElemType* biasGradientData = biasGradient.Data();
+#pragma omp parallel for if (G * S * T > 65536)
+                    for (long i = 0; i < G; i++)
+                    {
+                        ElemType sum = 0;
+                        for (size_t j = 0; j < S * T; j++)
+                            sum += gateGradientsData[j * G + i];
+                        biasGradientData[i] += sum;
+                    }
+                }
+
+                // gradient of the layer below; that of the first layer's input is computed by BackpropToNonLooping(1)
+                if (layer > 0)
+                {
+                    auto& layerInputGradient = LayerOutputGradient(layer - 1);
+                    if (dir == 0)
+                        layerInputGradient.Resize(layerInputDim, S * T);
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, inputWeights, true, gateGradients, false, dir == 0 ? 0 : 1, layerInputGradient);
+                }
+            }
+        }
+    }
+
+    size_t m_hiddenDim;
+    size_t m_numLayers;
+    bool m_bidirectional;
+
+    // sequence boundaries of the current minibatch
+    std::vector<bool> m_isGap;      // [t * S + s]
+    std::vector<bool> m_isFirst[2]; // [dir][t * S + s] first frame of a sequence in the direction of the recurrence
+
+    // kept from ForwardProp for Backprop
+    std::vector<shared_ptr<Matrix<ElemType>>> m_gates;                // [layer * numDirections + dir] gate values (after the nonlinearity) of all frames
+    std::vector<shared_ptr<Matrix<ElemType>>> m_states;               // [layer * numDirections + dir] LSTM: cell state; GRU: recurrent projection of the candidate
+    std::vector<shared_ptr<Matrix<ElemType>>> m_layerOutputs;         // [layer] outputs of all layers but the top one
+    std::vector<shared_ptr<Matrix<ElemType>>> m_layerOutputGradients; // [layer] their gradients
+    std::vector<shared_ptr<Matrix<ElemType>>> m_gateGradients;        // [dir] gradients of the gates' inputs of the layer being processed
+    shared_ptr<Matrix<ElemType>> m_inputProjections;       // [G * hiddenDim x S * T]
+    shared_ptr<Matrix<ElemType>> m_recurrentProjections;   // [G * hiddenDim x S] of the current time step
+    shared_ptr<Matrix<ElemType>> m_prevHidden;             // [hiddenDim x S] of the current time step
+    shared_ptr<Matrix<ElemType>> m_recurrentGateGradients; // (GRU only) gradients of the gates' recurrent contributions
+    shared_ptr<Matrix<ElemType>> m_nextHiddenGradient;     // [hiddenDim x S] gradient that flows into the hidden state from the next step
+    shared_ptr<Matrix<ElemType>> m_nextCellGradient;       // [hiddenDim x S] (LSTM only) same for the cell state
+    bool m_backpropDone;
+};
+
+// -----------------------------------------------------------------------
+// LSTMNode (weights, input) -- stack of LSTM layers, see RNNStackNodeBase
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class LSTMNode : public RNNStackNodeBase<ElemType, RNNCellKind::LSTM>
+{
+    typedef RNNStackNodeBase<ElemType, RNNCellKind::LSTM> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"LSTM"; }
+
+public:
+    LSTMNode(DEVICEID_TYPE deviceId, const wstring& name, size_t hiddenDim = 0, size_t numLayers = 1, bool bidirectional = false)
+        : Base(deviceId, name, hiddenDim, numLayers, bidirectional)
+    {
+    }
+    LSTMNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : LSTMNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"hiddenDim"), configp->Get(L"numLayers"), configp->Get(L"bidirectional"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+};
+
+template class LSTMNode<float>;
+template class LSTMNode<double>;
+
+// -----------------------------------------------------------------------
+// GRUNode (weights, input) -- stack of GRU layers, see RNNStackNodeBase
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class GRUNode : public RNNStackNodeBase<ElemType, RNNCellKind::GRU>
+{
+    typedef RNNStackNodeBase<ElemType, RNNCellKind::GRU> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"GRU"; }
+
+public:
+    GRUNode(DEVICEID_TYPE deviceId, const wstring& name, size_t hiddenDim = 0, size_t numLayers = 1, bool bidirectional = false)
+        : Base(deviceId, name, hiddenDim, numLayers, bidirectional)
+    {
+    }
+    GRUNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : GRUNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"hiddenDim"), configp->Get(L"numLayers"), configp->Get(L"bidirectional"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+};
+
+template class GRUNode<float>;
+template class GRUNode<double>;
+
+}}}
@@ -467,6 +467,19 @@ public:
     int TimeStep() const { return m_timeStep; }
     ElemType InitialActivationValue() const { return m_initialActivationValue; }
 
+    // the values carried over into the next minibatch, laid out as the minibatch that produced them
+    // This is used for streaming evaluation (CNTKEvalExtended), which replaces them with the history of the sequences of the next minibatch.
+    const Matrix<ElemType>& GetDelayedValue() const { return m_delayedValue; }
+    void SetDelayedValue(const Matrix<ElemType>& value, const MBLayoutPtr& pMBLayout)
+    {
+        if (value.GetNumCols() != pMBLayout->GetNumCols())
+            LogicError("SetDelayedValue: %d columns given for a layout of %d columns.", (int) value.GetNumCols(), (int) pMBLayout->GetNumCols());
+        m_delayedValue.SetValue(value);
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        m_delayedActivationMBLayout->CopyFrom(pMBLayout);
+    }
+
 protected:
     ElemType m_initialActivationValue;       // starting value for hidden activation vector at boundary
     Matrix<ElemType> m_delayedValue;         // saves the activation of the previous step that this node points to
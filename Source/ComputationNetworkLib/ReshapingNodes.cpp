@@ -471,4 +471,110 @@ template <class ElemType>
 template class ScatterPackedNode<float>;
 template class ScatterPackedNode<double>;
 
+// -----------------------------------------------------------------------
+// PackFramesNode(sourceData) -- copy the valid frames of a minibatch without the gaps
+// UnpackFramesNode(layoutData, sourceData) -- copy them back into the layout of 'layoutData'
+// -----------------------------------------------------------------------
+
+// determine the columns of the valid frames of a layout, in column order, which is the order of the packed frames,
+// and load them into a row vector as needed by DoGatherColumnsOf() and DoScatterColumnsOf()
+template <class ElemType>
+static void GetValidColumnIndices(const MBLayout& layout, std::vector<ElemType>& buffer, shared_ptr<Matrix<ElemType>>& columnIndices, DEVICEID_TYPE deviceId)
+{
+    const size_t numParallelSequences = layout.GetNumParallelSequences();
+    std::vector<bool> isValid(layout.GetNumCols(), false);
+    for (const auto& seq : layout.GetAllSequences())
+    {
+        if (seq.seqId == GAP_SEQUENCE_ID)
+            continue;
+        size_t tBegin = (size_t) max(seq.tBegin, (ptrdiff_t) 0);
+        size_t tEnd   = min(seq.tEnd, layout.GetNumTimeSteps());
+        for (size_t t = tBegin; t < tEnd; t++)
+            isValid[t * numParallelSequences + seq.s] = true;
+    }
+    buffer.clear();
+    for (size_t j = 0; j < isValid.size(); j++)
+        if (isValid[j])
+            buffer.push_back((ElemType) j);
+    if (buffer.size() != layout.GetActualNumSamples())
+        LogicError("GetValidColumnIndices: Found %d valid frames in a minibatch of %d samples.", (int) buffer.size(), (int) layout.GetActualNumSamples());
+
+    if (!columnIndices)
+        columnIndices = make_shared<Matrix<ElemType>>(deviceId);
+    columnIndices->SetValue(1, buffer.size(), deviceId, buffer.data());
+}
+
+template <class ElemType>
+/*virtual*/ void PackFramesNode<ElemType>::BeginForwardProp() /*override*/
+{
+    // bring the packed layout up to date with the layout of this minibatch before our output is resized to it
+    Input(0)->GetMBLayout()->GetPackedLayout();
+    Base::BeginForwardProp();
+}
+
+template <class ElemType>
+/*virtual*/ void PackFramesNode<ElemType>::ForwardPropNonLooping() /*override*/
+{
+    GetValidColumnIndices(*Input(0)->GetMBLayout(), m_columnIndexBuffer, m_columnIndices, ValuePtr()->GetDeviceId());
+    Value().DoGatherColumnsOf(/*beta=*/0, *m_columnIndices, Input(0)->Value(), /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void PackFramesNode<ElemType>::BackpropToNonLooping(size_t /*inputIndex*/) /*override*/
+{
+    // the gaps receive no gradient
+    Input(0)->Gradient().DoScatterColumnsOf(/*beta=*/1, *m_columnIndices, Gradient(), /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void PackFramesNode<ElemType>::Validate(bool isFinalValidationPass) /*override*/
+{
+    ComputationNodeBase::Validate(isFinalValidationPass);
+
+    if (Input(0)->HasMBLayout())
+        m_pMBLayout = Input(0)->GetMBLayout()->GetPackedLayout();
+    else if (isFinalValidationPass)
+        LogicError("%ls %ls operation requires its input to be minibatch data (must have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+
+    SetDims(Input(0)->GetSampleLayout(), HasMBLayout());
+}
+
+template class PackFramesNode<float>;
+template class PackFramesNode<double>;
+
+template <class ElemType>
+/*virtual*/ void UnpackFramesNode<ElemType>::ForwardPropNonLooping() /*override*/
+{
+    let& layout = *Input(LAYOUTDATA)->GetMBLayout();
+    if (Input(SOURCEDATA)->GetMBLayout() != layout.GetPackedLayout())
+        InvalidArgument("%ls %ls operation requires the source data to be packed from the layout of the layout data.", NodeName().c_str(), OperationName().c_str());
+    GetValidColumnIndices(layout, m_columnIndexBuffer, m_columnIndices, ValuePtr()->GetDeviceId());
+    Value().DoScatterColumnsOf(/*beta=*/0, *m_columnIndices, Input(SOURCEDATA)->Value(), /*alpha=*/1); // (gaps become 0)
+}
+
+template <class ElemType>
+/*virtual*/ void UnpackFramesNode<ElemType>::BackpropToNonLooping(size_t inputIndex) /*override*/
+{
+    if (inputIndex == SOURCEDATA)
+        Input(SOURCEDATA)->Gradient().DoGatherColumnsOf(/*beta=*/1, *m_columnIndices, Gradient(), /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void UnpackFramesNode<ElemType>::Validate(bool isFinalValidationPass) /*override*/
+{
+    ComputationNodeBase::Validate(isFinalValidationPass);
+
+    // inherit MBLayout from layoutData (that's the only thing we use it for)
+    m_pMBLayout = Input(LAYOUTDATA)->GetMBLayout();
+    if (isFinalValidationPass && (!Input(LAYOUTDATA)->HasMBLayout() || !Input(SOURCEDATA)->HasMBLayout()))
+        LogicError("%ls %ls operation requires all inputs to be minibatch data (must have MBLayouts).", NodeName().c_str(), OperationName().c_str());
+
+    // inherit tensor dimension from sourceData
+    SetDims(Input(SOURCEDATA)->GetSampleLayout(), HasMBLayout());
+}
+
+template class UnpackFramesNode<float>;
+template class UnpackFramesNode<double>;
+
 }}}
+
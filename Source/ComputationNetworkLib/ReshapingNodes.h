@@ -773,6 +773,67 @@ public:
     virtual void Validate(bool isFinalValidationPass) override;
 };
 
+// -----------------------------------------------------------------------
+// PackFramesNode(sourceData) -- copy the valid frames of a minibatch without the gaps
+// UnpackFramesNode(layoutData, sourceData) -- the reverse: copy them back into the layout of 'layoutData'
+// These are inserted by ComputationNetwork::PackFramesOutsideLoops() around the nodes outside of recurrent loops that
+// compute each frame independently, so that these only compute on the valid frames. The packed frames are in
+// frame mode (MBLayout::GetPackedLayout()), so reductions over them need no masking either.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class PackFramesNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"PackFrames"; }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(PackFramesNode);
+    PackFramesNode(DEVICEID_TYPE deviceId, const wstring& name) :
+        Base(deviceId, name)
+    {
+    }
+
+    virtual void BeginForwardProp() override;
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t inputIndex) override;
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual void Validate(bool isFinalValidationPass) override;
+
+private:
+    std::vector<ElemType> m_columnIndexBuffer;
+    shared_ptr<Matrix<ElemType>> m_columnIndices; // [0, j] index of the j-th valid column of the input
+};
+
+template <class ElemType>
+class UnpackFramesNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"UnpackFrames"; }
+
+    // our inputs
+    static const size_t LAYOUTDATA = 0;
+    static const size_t SOURCEDATA = 1;
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(UnpackFramesNode);
+    UnpackFramesNode(DEVICEID_TYPE deviceId, const wstring& name) :
+        Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t inputIndex) override;
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual void Validate(bool isFinalValidationPass) override;
+
+private:
+    std::vector<ElemType> m_columnIndexBuffer;
+    shared_ptr<Matrix<ElemType>> m_columnIndices; // [0, j] column of the output that receives the j-th packed frame
+};
+
 // -----------------------------------------------------------------------
 // DiagonalNode -- extract diagonal elements of a square matrix into a row vector
 // -----------------------------------------------------------------------
@@ -7,6 +7,7 @@
 #include "Basics.h"
 #include "ComputationNode.h"
 #include "gammacalculation.h"
+#include "MatrixExpression.h"
 
 #include <map>
 #include <string>
@@ -195,8 +196,7 @@ public:
         size_t numComponent = posterior.GetNumRows();
         size_t numSamples = posterior.GetNumCols();
 
-        temp.AssignDifferenceOf(normedDeviation, (ElemType) numComponent);
-        temp.ElementMultiplyWith(posterior);
+        AssignExpression(temp, (Expr(normedDeviation) - (ElemType) numComponent) * Expr(posterior));
         temp.RowElementMultiplyWith(gradientValues);
         if (logStddevGradientValues.GetNumCols() == numSamples)
             logStddevGradientValues += temp;
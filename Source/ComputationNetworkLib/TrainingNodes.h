@@ -8,7 +8,10 @@
 #include "ComputationNode.h"
 #include "BatchNormalizationEngine.h"
 #include "RNGHandle.h"
+#include "CPURNGHandle.h"
+#include "MatrixExpression.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -128,6 +131,12 @@ public:
         // left input is scalar
         if (inputIndex == 0) // left derivative
         {
+            // the fused CPU forward pass does not keep the log softmax; it is only needed here, which is rare (labels are normally not learned)
+            if (m_deviceId == CPUDEVICE)
+            {
+                m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
+                MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
+            }
 #if DUMPOUTPUT
             m_logSoftmaxOfRight->Print("CrossEntropyWithSoftmax Partial-logSoftmaxOfRight");
             Gradient().Print("CrossEntropyWithSoftmax Partial-gradientValues");
@@ -144,14 +153,25 @@ public:
         else if (inputIndex == 1) // right derivative
         {
 #if DUMPOUTPUT
-            m_softmaxOfRight->Print("CrossEntropyWithSoftmax Partial-softmaxOfRight");
+            if (m_deviceId == CPUDEVICE)
+                m_logSumExpOfRight->Print("CrossEntropyWithSoftmax Partial-logSumExpOfRight");
+            else
+                m_softmaxOfRight->Print("CrossEntropyWithSoftmax Partial-softmaxOfRight");
             Input(0)->ValueFor(fr).Print("CrossEntropyWithSoftmax Partial-inputFunctionValues");
             Gradient().Print("CrossEntropyWithSoftmax Partial-gradientValues");
             Input(1)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right-in");
 #endif
 
             auto gradient = Input(1)->GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
+            if (m_deviceId == CPUDEVICE)
+            {
+                // gradient += Gradient() * (softmax(right) - left), with the softmax recomputed from the log-sum-exp of the forward pass
+                Matrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(Gradient(), Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExpOfRight, gradient);
+                // the softmax of the gaps is not 0, so they must be cleared
+                Input(1)->MaskMissingGradientColumnsToZero(fr);
+            }
+            else
+                Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
 #if DUMPOUTPUT
             Input(1)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right");
 #endif
@@ -168,24 +188,38 @@ public:
 
     virtual void UpdateFunctionMBSize() override
     {
-        m_logSoftmaxOfRight->Resize(Input(1)->Value());
-        m_softmaxOfRight->Resize(*m_logSoftmaxOfRight);
+        if (m_deviceId == CPUDEVICE)
+            m_logSumExpOfRight->Resize(1, Input(1)->Value().GetNumCols());
+        else
+        {
+            m_logSoftmaxOfRight->Resize(Input(1)->Value());
+            m_softmaxOfRight->Resize(*m_logSoftmaxOfRight);
+        }
     }
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override // -sum(left_i * log(softmax_i(right)))
     {
         FrameRange fr(Input(0)->GetMBLayout());
-        // first compute the softmax (column-wise)
-        // Note that we need both log and non-log for gradient computation.
-        m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
-        // BUGBUG: No need to compute m_softmaxOfRight in ForwardProp, should be moved to BackpropTo().
-        m_softmaxOfRight->SetValue(*m_logSoftmaxOfRight);
-        m_softmaxOfRight->InplaceExp();
-        // flatten all gaps to zero, such that gaps will contribute zero to the sum
-        MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
-        // reduce over all frames
-        Value().AssignInnerProductOfMatrices(Input(0)->MaskedValueFor(fr), *m_logSoftmaxOfRight);
-        Value() *= -1;
+        if (m_deviceId == CPUDEVICE)
+        {
+            // Softmax and cross entropy are fused: per column, only the log-sum-exp of the right input is kept (for the gradient),
+            // and the criterion is reduced over all frames directly. Gaps are flattened to zero, such that they contribute zero to the sum.
+            Value().AssignCrossEntropyWithSoftmaxOf(Input(0)->MaskedValueFor(fr), Input(1)->MaskedValueFor(fr), *m_logSumExpOfRight);
+        }
+        else
+        {
+            // first compute the softmax (column-wise)
+            // Note that we need both log and non-log for gradient computation.
+            m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
+            // BUGBUG: No need to compute m_softmaxOfRight in ForwardProp, should be moved to BackpropTo().
+            m_softmaxOfRight->SetValue(*m_logSoftmaxOfRight);
+            m_softmaxOfRight->InplaceExp();
+            // flatten all gaps to zero, such that gaps will contribute zero to the sum
+            MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
+            // reduce over all frames
+            Value().AssignInnerProductOfMatrices(Input(0)->MaskedValueFor(fr), *m_logSoftmaxOfRight);
+            Value() *= -1;
+        }
 #if NANCHECK
         Value().HasNan("CrossEntropyWithSoftmax");
 #endif
@@ -207,6 +241,7 @@ public:
             auto node = dynamic_pointer_cast<CrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
             node->m_logSoftmaxOfRight->SetValue(*m_logSoftmaxOfRight);
             node->m_softmaxOfRight->SetValue(*m_softmaxOfRight);
+            node->m_logSumExpOfRight->SetValue(*m_logSumExpOfRight);
         }
     }
 
@@ -216,11 +251,13 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool);
         RequestMatrixFromPool(m_softmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_logSumExpOfRight, matrixPool);
     }
 
 protected:
-    shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight;
-    shared_ptr<Matrix<ElemType>> m_softmaxOfRight;
+    shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight; // (on the CPU, only computed if the left input needs a gradient)
+    shared_ptr<Matrix<ElemType>> m_softmaxOfRight;    // (not used on the CPU)
+    shared_ptr<Matrix<ElemType>> m_logSumExpOfRight;  // [1 x T] log sum_i exp(right(i,t)), from which the softmax is recomputed in BackpropTo() (CPU only)
 };
 
 template class CrossEntropyWithSoftmaxNode<float>;
@@ -941,6 +978,377 @@ protected:
 template class ClassBasedCrossEntropyWithSoftmaxNode<float>;
 template class ClassBasedCrossEntropyWithSoftmaxNode<double>;
 
+// -----------------------------------------------------------------------
+// SampledCrossEntropyWithSoftmaxNode (labels, hidden, weights, bias, numSamples=..., samplingDistribution='logUniform')
+// Cross entropy with softmax over a large output vocabulary, where in training the softmax only runs over a
+// sampled subset of the classes ("sampled softmax", Jean et al., 2015):
+//  - Input(0) [V x T] labels, one-hot (normally sparse)
+//  - Input(1) [H x T] hidden layer activation
+//  - Input(2) [H x V] output weights, one column per class
+//  - Input(3) [V x 1] output bias
+// Per minibatch, 'numSamples' classes are drawn (with replacement) from the proposal distribution, and shared by all frames.
+// The softmax runs over the union of the sampled classes and the labels of the minibatch, with each logit corrected
+// by the log of the probability that its class is among these candidates: 1 for the labels, which are always added,
+// and 1 - (1 - P(k))^numSamples for the other classes. Only the weight columns of these candidates are gathered
+// (product with a sparse selection matrix), and the gradient of the weights is a sparse block-column matrix of these columns,
+// so that the cost per minibatch depends on the number of samples rather than on V.
+// The proposal distributions are
+//  - 'logUniform': P(k) = log((k+2)/(k+1)) / log(V+1), a Zipfian approximation of the unigram distribution of a vocabulary sorted by frequency
+//  - 'uniform': P(k) = 1/V
+// When not training (or if numSamples >= V), the exact criterion with the full softmax is computed.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class SampledCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping /*ComputationNode*/<ElemType>, public NumInputs<4>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"SampledCrossEntropyWithSoftmax";
+    }
+
+    // our inputs
+    static const size_t LABELS = 0;
+    static const size_t HIDDEN = 1;
+    static const size_t WEIGHTS = 2;
+    static const size_t BIAS = 3;
+
+public:
+    SampledCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name, size_t numSamples = 0, const wstring& samplingDistribution = L"logUniform")
+        : Base(deviceId, name),
+          m_numSamples(numSamples),
+          m_samplingDistribution(samplingDistribution),
+          m_sampleCounter(0),
+          m_classIndices(make_shared<Matrix<ElemType>>(deviceId)),
+          m_labelIndices(make_shared<Matrix<ElemType>>(deviceId)),
+          m_candidateSelector(make_shared<Matrix<ElemType>>(0, 0, deviceId, SPARSE, matrixFormatSparseCSC)),
+          m_sparseLabelsOfCandidates(make_shared<Matrix<ElemType>>(0, 0, deviceId, SPARSE, matrixFormatSparseCSC)),
+          m_biasOfCandidates(make_shared<Matrix<ElemType>>(deviceId)),
+          m_candidatesSampled(false)
+    {
+        m_randomSeed = (unsigned long) CreateUniqId();
+        if (!EqualCI(m_samplingDistribution, L"logUniform") && !EqualCI(m_samplingDistribution, L"uniform"))
+            InvalidArgument("SampledCrossEntropyWithSoftmax: samplingDistribution must be 'logUniform' or 'uniform'.");
+    }
+    SampledCrossEntropyWithSoftmaxNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : SampledCrossEntropyWithSoftmaxNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"numSamples"), configp->Get(L"samplingDistribution"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_numSamples << m_samplingDistribution;
+        fstream << (size_t) m_randomSeed << (size_t) m_sampleCounter; // (so that training resumed from a checkpoint continues the same samples)
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_numSamples >> m_samplingDistribution;
+        size_t randomSeed, sampleCounter;
+        fstream >> randomSeed >> sampleCounter;
+        m_randomSeed = (unsigned long) randomSeed;
+        m_sampleCounter = sampleCounter;
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        if (inputIndex == LABELS)
+            InvalidArgument("%ls %ls operation cannot compute the gradient with respect to the labels.", NodeName().c_str(), OperationName().c_str());
+        if (!m_candidatesSampled)
+            LogicError("%ls %ls operation: BackpropTo() called without a ForwardProp() in training mode.", NodeName().c_str(), OperationName().c_str());
+
+        FrameRange fr(Input(LABELS)->GetMBLayout());
+        if (m_needRecomputeGradientOfLogits)
+        {
+            // gradient of the criterion w.r.t. the corrected logits of the candidates: softmax - labels, zero for gaps
+            m_gradientOfLogits->AssignDifferenceOf(*m_softmaxOfCandidates, *m_labelsOfCandidates);
+            MaskMissingColumnsToZero(*m_gradientOfLogits, Input(HIDDEN)->GetMBLayout(), fr);
+            Matrix<ElemType>::Scale(Gradient() /*1x1*/, *m_gradientOfLogits);
+            m_needRecomputeGradientOfLogits = false;
+        }
+
+        if (inputIndex == HIDDEN)
+        {
+            auto gradient = Input(HIDDEN)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(*m_weightsOfCandidates, false, *m_gradientOfLogits, false, gradient);
+        }
+        else if (inputIndex == WEIGHTS)
+        {
+            // gradient of the gathered columns, scattered to the columns of the candidates
+            // BUGBUG: Like in TimesNode, a sparse gradient is assigned rather than added to, so the weights must not be shared with another node.
+            m_gradientOfCandidates->AssignProductOf(Input(HIDDEN)->ValueFor(fr), false, *m_gradientOfLogits, true);
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, *m_gradientOfCandidates, false, *m_candidateSelector, true, 1, Input(WEIGHTS)->GradientAsMatrix());
+        }
+        else if (inputIndex == BIAS)
+        {
+            Matrix<ElemType>::VectorSum(*m_gradientOfLogits, *m_gradientOfCandidates, /*isColWise=*/false);
+            auto gradient = Input(BIAS)->GradientAsMatrix().Reshaped(1, GetNumClasses());
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, *m_gradientOfCandidates, true, *m_candidateSelector, true, 1, gradient);
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex == HIDDEN; }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(Input(LABELS)->GetMBLayout());
+        const size_t numClasses = GetNumClasses();
+        GetLabelIndices(fr);
+
+        m_candidatesSampled = Environment().IsTraining();
+        auto& logits = *m_logSoftmaxOfCandidates;
+        if (m_candidatesSampled)
+        {
+            SampleCandidates();
+
+            // gather the weight columns and the biases of the candidates; the correction is added to the biases
+            m_weightsOfCandidates->AssignProductOf(Input(WEIGHTS)->ValueAsMatrix(), false, *m_candidateSelector, false);
+            auto biasRow = m_biasOfCandidates->Reshaped(1, m_candidates.size());
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, Input(BIAS)->ValueAsMatrix(), true, *m_candidateSelector, false, 1, biasRow);
+            logits.AssignProductOf(*m_weightsOfCandidates, true, Input(HIDDEN)->ValueFor(fr), false);
+            logits += *m_biasOfCandidates; // (column vector: added to all columns)
+        }
+        else // full softmax: the candidates are all classes, in order
+        {
+            m_candidates.clear();
+            logits.AssignProductOf(Input(WEIGHTS)->ValueAsMatrix(), true, Input(HIDDEN)->ValueFor(fr), false);
+            logits += Input(BIAS)->ValueAsMatrix();
+        }
+        const size_t numCandidates = m_candidatesSampled ? m_candidates.size() : numClasses;
+
+        // one-hot labels w.r.t. the candidates (built sparse on the host, expanded on the device)
+        m_labelPositions.assign(1, 0);
+        m_labelRows.clear();
+        for (size_t j = 0; j < m_hostLabelIndices.size(); j++)
+        {
+            const size_t label = m_hostLabelIndices[j];
+            if (label != SIZE_MAX)
+                m_labelRows.push_back((CPUSPARSE_INDEX_TYPE) (m_candidatesSampled ? lower_bound(m_candidates.begin(), m_candidates.end(), label) - m_candidates.begin() : label));
+            m_labelPositions.push_back((CPUSPARSE_INDEX_TYPE) m_labelRows.size());
+        }
+        m_labelValues.assign(m_labelRows.size(), 1);
+        m_sparseLabelsOfCandidates->SetMatrixFromCSCFormat(m_labelPositions.data(), m_labelRows.data(), m_labelValues.data(), m_labelRows.size(), numCandidates, m_hostLabelIndices.size());
+        m_labelsOfCandidates->Resize(numCandidates, m_hostLabelIndices.size());
+        m_labelsOfCandidates->SetValue(0);
+        Matrix<ElemType>::ScaleAndAdd(1, *m_sparseLabelsOfCandidates, *m_labelsOfCandidates);
+
+        // criterion = -sum_t log softmax(logits)[label_t, t], like CrossEntropyWithSoftmaxNode
+        logits.InplaceLogSoftmax(true);
+        m_softmaxOfCandidates->SetValue(logits);
+        m_softmaxOfCandidates->InplaceExp();
+        MaskMissingColumnsToZero(logits, Input(HIDDEN)->GetMBLayout(), fr);
+        Value().AssignInnerProductOfMatrices(*m_labelsOfCandidates, logits);
+        Value() *= -1;
+        m_needRecomputeGradientOfLogits = true;
+#if NANCHECK
+        Value().HasNan("SampledCrossEntropyWithSoftmax");
+#endif
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node does not hold mini-batch data
+
+        if (isFinalValidationPass)
+        {
+            const size_t numClasses = Input(WEIGHTS)->GetAsMatrixNumCols();
+            if (Input(LABELS)->GetSampleMatrixNumRows() != numClasses || Input(BIAS)->GetSampleLayout().GetNumElements() != numClasses)
+                LogicError("%ls: The label dimension, the number of columns of the weights, and the bias dimension must match.", NodeDescription().c_str());
+            if (Input(HIDDEN)->GetSampleMatrixNumRows() != Input(WEIGHTS)->GetAsMatrixNumRows())
+                LogicError("%ls: The hidden dimension and the number of rows of the weights must match.", NodeDescription().c_str());
+            if (!Input(LABELS)->HasMBLayout() || Input(LABELS)->GetMBLayout() != Input(HIDDEN)->GetMBLayout() || Input(WEIGHTS)->HasMBLayout() || Input(BIAS)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires inputs 0 (labels) and 1 (hidden) to be minibatches with the same layout, and inputs 2 (weights) and 3 (bias) to be parameters.", NodeName().c_str(), OperationName().c_str());
+            if (m_numSamples == 0)
+                InvalidArgument("%ls: numSamples must be positive.", NodeDescription().c_str());
+            if (sizeof(ElemType) == sizeof(float) && numClasses > (1 << 24))
+                InvalidArgument("%ls: Class indices above 2^24 are not exact in single precision.", NodeDescription().c_str());
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<SampledCrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
+            node->m_numSamples = m_numSamples;
+            node->m_samplingDistribution = m_samplingDistribution;
+            node->m_randomSeed = m_randomSeed;
+            node->m_sampleCounter = m_sampleCounter;
+        }
+    }
+
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // the gradient of the weights only has the columns of the candidates (allocated directly, since the pool only has dense matrices)
+        if (Input(WEIGHTS)->NeedsGradient())
+        {
+            Input(WEIGHTS)->CreateGradientMatrixIfNull();
+            Input(WEIGHTS)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_weightsOfCandidates, matrixPool);
+        RequestMatrixFromPool(m_logSoftmaxOfCandidates, matrixPool);
+        RequestMatrixFromPool(m_softmaxOfCandidates, matrixPool);
+        RequestMatrixFromPool(m_labelsOfCandidates, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gradientOfLogits, matrixPool);
+        RequestMatrixFromPool(m_gradientOfCandidates, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gradientOfLogits, matrixPool);
+        ReleaseMatrixToPool(m_gradientOfCandidates, matrixPool);
+    }
+
+    void SetRandomSeed(const unsigned long val)
+    {
+        m_randomSeed = val;
+        m_sampleCounter = 0;
+    }
+
+    size_t GetNumSamples() const { return m_numSamples; }
+    const std::vector<size_t>& GetCandidates() const { return m_candidates; } // sorted classes of the last sampled softmax
+
+private:
+    size_t GetNumClasses() const { return Input(WEIGHTS)->GetAsMatrixNumCols(); }
+
+    // get the class index of each column of the labels into m_hostLabelIndices (SIZE_MAX for gaps),
+    // as the product of the row [0, 1, ..., V-1] with the labels, which works for sparse and dense labels on any device
+    void GetLabelIndices(const FrameRange& fr)
+    {
+        const size_t numClasses = GetNumClasses();
+        if (m_classIndices->GetNumCols() != numClasses)
+        {
+            std::vector<ElemType> indices(numClasses);
+            for (size_t k = 0; k < numClasses; k++)
+                indices[k] = (ElemType) k;
+            m_classIndices->SetValue(1, numClasses, m_deviceId, indices.data());
+        }
+        m_labelIndices->AssignProductOf(*m_classIndices, false, Input(LABELS)->ValueFor(fr), false);
+
+        const size_t numCols = m_labelIndices->GetNumCols();
+        std::unique_ptr<ElemType[]> labelIndices(m_labelIndices->CopyToArray());
+        const auto& pMBLayout = Input(LABELS)->GetMBLayout();
+        const size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
+        m_hostLabelIndices.resize(numCols);
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (pMBLayout->HasGaps() && pMBLayout->IsGap(FrameRange(pMBLayout, j / numParallelSequences).Sequence(j % numParallelSequences)))
+                m_hostLabelIndices[j] = SIZE_MAX;
+            else
+                m_hostLabelIndices[j] = (size_t) (labelIndices[j] + (ElemType) 0.5);
+        }
+    }
+
+    // probability of class k under the proposal distribution
+    double ProposalProbability(size_t k, size_t numClasses) const
+    {
+        if (EqualCI(m_samplingDistribution, L"uniform"))
+            return 1.0 / numClasses;
+        return log1p(1.0 / (k + 1)) / log(numClasses + 1.0);
+    }
+
+    // draw m_numSamples classes, form the sorted candidates (samples and labels), and build the selection matrix
+    // and the correction -log P(k is a candidate) of their logits, which is 0 for the labels, since they are always added,
+    // and -log(1 - (1 - P(k))^numSamples) for the other sampled classes
+    void SampleCandidates()
+    {
+        const size_t numClasses = GetNumClasses();
+        m_candidates.clear();
+        if (m_numSamples >= numClasses) // all classes: no need to sample
+        {
+            for (size_t k = 0; k < numClasses; k++)
+                m_candidates.push_back(k);
+        }
+        else
+        {
+            const bool uniform = EqualCI(m_samplingDistribution, L"uniform");
+            const double logNumClassesPlus1 = log(numClasses + 1.0);
+            uint32_t words[4];
+            for (size_t i = 0; i < m_numSamples; i++)
+            {
+                if (i % 2 == 0)
+                    Philox4x32::Generate(m_randomSeed, m_sampleCounter++, words);
+                const uint64_t word = ((uint64_t) words[2 * (i % 2)] << 32) | words[2 * (i % 2) + 1];
+                const double u = (word >> 11) * (1.0 / 9007199254740992.0); // [0,1) with 53 bits
+                size_t k = uniform ? (size_t) (u * numClasses) : (size_t) exp(u * logNumClassesPlus1) - 1;
+                m_candidates.push_back(min(k, numClasses - 1));
+            }
+            for (size_t label : m_hostLabelIndices)
+                if (label != SIZE_MAX)
+                    m_candidates.push_back(label);
+            sort(m_candidates.begin(), m_candidates.end());
+            m_candidates.erase(unique(m_candidates.begin(), m_candidates.end()), m_candidates.end());
+        }
+        std::vector<size_t> labels;
+        for (size_t label : m_hostLabelIndices)
+            if (label != SIZE_MAX)
+                labels.push_back(label);
+        sort(labels.begin(), labels.end());
+
+        const size_t numCandidates = m_candidates.size();
+        std::vector<CPUSPARSE_INDEX_TYPE> columnStarts(numCandidates + 1), rows(numCandidates);
+        std::vector<ElemType> ones(numCandidates, 1), corrections(numCandidates, 0);
+        for (size_t i = 0; i < numCandidates; i++)
+        {
+            columnStarts[i] = (CPUSPARSE_INDEX_TYPE) i;
+            rows[i] = (CPUSPARSE_INDEX_TYPE) m_candidates[i];
+            if (m_numSamples < numClasses && !binary_search(labels.begin(), labels.end(), m_candidates[i]))
+                corrections[i] = (ElemType) -log(-expm1(m_numSamples * log1p(-ProposalProbability(m_candidates[i], numClasses))));
+        }
+        columnStarts[numCandidates] = (CPUSPARSE_INDEX_TYPE) numCandidates;
+        m_candidateSelector->SetMatrixFromCSCFormat(columnStarts.data(), rows.data(), ones.data(), numCandidates, numClasses, numCandidates);
+        m_biasOfCandidates->SetValue(numCandidates, 1, m_deviceId, corrections.data());
+    }
+
+    size_t m_numSamples;
+    wstring m_samplingDistribution;
+    unsigned long m_randomSeed;
+    uint64_t m_sampleCounter; // next Philox counter for drawing samples
+
+    shared_ptr<Matrix<ElemType>> m_classIndices;             // [1 x V] row [0, 1, ..., V-1]
+    shared_ptr<Matrix<ElemType>> m_labelIndices;             // [1 x T] class index of each label
+    shared_ptr<Matrix<ElemType>> m_candidateSelector;        // [V x M] sparse: column i selects class m_candidates[i]
+    shared_ptr<Matrix<ElemType>> m_sparseLabelsOfCandidates; // [M x T] sparse one-hot labels w.r.t. the candidates
+    shared_ptr<Matrix<ElemType>> m_biasOfCandidates;         // [M x 1] gathered bias plus correction
+    shared_ptr<Matrix<ElemType>> m_weightsOfCandidates;      // [H x M] gathered weight columns
+    shared_ptr<Matrix<ElemType>> m_logSoftmaxOfCandidates;   // [M x T]
+    shared_ptr<Matrix<ElemType>> m_softmaxOfCandidates;      // [M x T]
+    shared_ptr<Matrix<ElemType>> m_labelsOfCandidates;       // [M x T] dense one-hot labels w.r.t. the candidates
+    shared_ptr<Matrix<ElemType>> m_gradientOfLogits;         // [M x T]
+    shared_ptr<Matrix<ElemType>> m_gradientOfCandidates;     // [H x M] or [M x 1]
+
+    std::vector<size_t> m_hostLabelIndices;
+    std::vector<size_t> m_candidates;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_labelPositions, m_labelRows;
+    std::vector<ElemType> m_labelValues;
+    bool m_candidatesSampled;
+    bool m_needRecomputeGradientOfLogits;
+};
+
+template class SampledCrossEntropyWithSoftmaxNode<float>;
+template class SampledCrossEntropyWithSoftmaxNode<double>;
+
 #ifdef COMING_SOON
 
 // -----------------------------------------------------------------------
@@ -1272,16 +1680,12 @@ public:
         if (inputIndex != 1)
             InvalidArgument("%ls %ls operation cannot compute the gradient for its first inpute.", NodeName().c_str(), OperationName().c_str());
 
-        // BackpropToRight(m_temp, Input(0)->Value(), Input(2)->Value(), Input(inputIndex)->Gradient(), Gradient(), m_classZeroLabels, m_result);
-        // Create vector with 1 for class 1, and -1 for class 0
-        m_temp->AssignDifferenceOf(Input(0)->ValueFor(fr), *m_classZeroLabels); // TODO: need a slice for m_classZeroLabels?
-
-        // Multiply the vector by the Input(2)->Value()
-        if (m_inputs.size() == 3)                                            // with weight
-            m_temp->AssignElementProductOf(*m_temp, Input(2)->ValueFor(fr)); // TODO: is Input(2) minibatch data? Confirm
-
-        // divide class by p (class 1) or (1-p) (class 0)
-        m_temp->AssignElementDivisionOf(*m_temp, *m_result); // TODO: this is in-place--does this function allow that?
+        // 1 for class 1 and -1 for class 0 (2*y-1), multiplied by the weight, divided by p (class 1) or (1-p) (class 0), in one pass
+        const Matrix<ElemType>& classOneLabels = Input(0)->ValueFor(fr);
+        if (m_inputs.size() == 3) // with weight
+            AssignExpression(*m_temp, (2 * Expr(classOneLabels) - 1) * Expr(Input(2)->ValueFor(fr)) / Expr(*m_result)); // TODO: is Input(2) minibatch data? Confirm
+        else
+            AssignExpression(*m_temp, (2 * Expr(classOneLabels) - 1) / Expr(*m_result));
 
         auto gradient = Input(inputIndex)->GradientFor(fr);
         Matrix<ElemType>::Multiply1x1AndWeightedAdd(-1.0f, Gradient() /*1x1*/, *m_temp, 1.0f, gradient);
@@ -1294,7 +1698,6 @@ public:
 
     virtual void UpdateFunctionMBSize() override
     {
-        m_classZeroLabels->Resize(Input(0)->Value());
         m_result->Resize(Input(0)->Value());
         m_temp->Resize(Input(0)->Value());
     }
@@ -1306,27 +1709,9 @@ public:
 
         const Matrix<ElemType>& classOneLabels = Input(0)->ValueFor(fr);
         const Matrix<ElemType>& classOneProbabilities = Input(1)->ValueFor(fr);
-        Matrix<ElemType>& classZeroLabels = *m_classZeroLabels;
-
-        Matrix<ElemType> ones = ConstOnes(classOneLabels.GetNumRows(), classOneLabels.GetNumCols(), classOneLabels.GetDeviceId()).DeepClone();
-
-        // compute the indices for the class 0 indices
-        classZeroLabels.AssignDifferenceOf(ones, classOneLabels);
 
-        /* We're computing result = weight*(y*p + (1-y)*(1-p) = 2*y*p + (1-y) - p) */
-
-        /* First compute result = y*p */
-        m_result->AssignElementProductOf(classOneLabels, classOneProbabilities);
-
-        // TODO: verify that all these operations on m_result really can do in-place (or use different methods instead)
-        /* Now compute result = 2*y*p */
-        m_result->AssignProductOf((ElemType) 2.0, *m_result);
-
-        /* Now compute result = 2*y*p + (1-y) */
-        m_result->AssignSumOf(*m_result, classZeroLabels);
-
-        /* Finally compute result = 2*y*p + (1-y) - p */
-        m_result->AssignDifferenceOf(*m_result, classOneProbabilities);
+        // result = y*p + (1-y)*(1-p) = 2*y*p + (1-y) - p, in one pass
+        AssignExpression(*m_result, 2 * Expr(classOneLabels) * Expr(classOneProbabilities) + 1 - Expr(classOneLabels) - Expr(classOneProbabilities));
 
         // compute the log, resulting in y*log(p) + (1-y)*log(1-p)
         m_temp->AssignLogOf(*m_result);
@@ -1367,7 +1752,6 @@ public:
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
     {
         Base::RequestMatricesBeforeForwardProp(matrixPool);
-        RequestMatrixFromPool(m_classZeroLabels, matrixPool);
         RequestMatrixFromPool(m_result, matrixPool);
         RequestMatrixFromPool(m_temp, matrixPool);
     }
@@ -1376,7 +1760,6 @@ public:
     virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
     {
         Base::ReleaseMatricesAfterBackprop(matrixPool);
-        ReleaseMatrixToPool(m_classZeroLabels, matrixPool);
         ReleaseMatrixToPool(m_result, matrixPool);
         ReleaseMatrixToPool(m_temp, matrixPool);
     }
@@ -1387,14 +1770,12 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<LogisticNode<ElemType>>(nodeP);
-            node->m_classZeroLabels->SetValue(*m_classZeroLabels);
             node->m_result->SetValue(*m_result);
             node->m_temp->SetValue(*m_temp);
         }
     }
 
 private:
-    shared_ptr<Matrix<ElemType>> m_classZeroLabels;
     shared_ptr<Matrix<ElemType>> m_result;
     shared_ptr<Matrix<ElemType>> m_temp;
 };
@@ -1937,6 +2318,30 @@ public:
     double Epsilon() const { return m_epsilon; }
     bool UseCNTKEngine() const { return m_useCntkEngine; }
 
+    // In inference mode, this node computes scale .* input + shift, with one element per parameter element.
+    // This allows to fold it into a preceding product (see ComputationNetwork::OptimizeForInference()).
+    void GetInferenceScaleAndShift(std::vector<double>& scale, std::vector<double>& shift) const
+    {
+        auto getValues = [](const Matrix<ElemType>& matrix)
+        {
+            std::unique_ptr<ElemType[]> values(matrix.CopyToArray());
+            return std::vector<double>(values.get(), values.get() + matrix.GetNumElements());
+        };
+        const auto gamma     = getValues(Input(1)->Value());
+        const auto beta      = getValues(Input(2)->Value());
+        const auto runMean   = getValues(Input(3)->Value());
+        const auto runInvStd = getValues(Input(4)->Value());
+        scale.resize(gamma.size());
+        shift.resize(gamma.size());
+        for (size_t i = 0; i < gamma.size(); i++)
+        {
+            // the cuDNN engine keeps the running variance instead of the inverse standard deviation
+            const double invStdDev = m_useCntkEngine ? runInvStd[i] : 1 / sqrt(runInvStd[i] + m_epsilon);
+            scale[i] = gamma[i] * invStdDev;
+            shift[i] = beta[i] - scale[i] * runMean[i];
+        }
+    }
+
 private:
     // Old versioning - do not use. Do not remove until we're sure there are no old models around.
     struct VersionInfo
@@ -0,0 +1,237 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// WorkStealingScheduler.h -- runs the tasks of a dependency graph concurrently on a fixed set of CPU threads
+//
+#pragma once
+
+#include "Basics.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// WorkStealingScheduler -- executes a DAG of tasks with a given number of threads
+//
+// Tasks are numbered 0..N-1 in a valid sequential order, i.e. every dependency
+// goes from a lower to a higher task index. A task becomes ready once all of its
+// predecessors have completed.
+//
+// Every thread has its own queue of ready tasks. A thread pushes the tasks that
+// it makes ready onto its own queue and takes from it last-in-first-out, so that
+// a consumer tends to run right after its producer, on the same core. A thread
+// whose queue is empty steals the oldest task of another thread.
+// Tasks are expected to be coarse (entire nodes), so all queues share one lock.
+//
+// The thread that calls Run() participates as thread 0; the other threads are
+// created once and kept alive between runs. Each thread's OpenMP team is reduced
+// so that the threads together do not oversubscribe the machine.
+// If a task throws, the tasks not yet started are skipped, and Run() rethrows the first exception.
+// -----------------------------------------------------------------------
+
+class WorkStealingScheduler
+{
+public:
+    WorkStealingScheduler(size_t numThreads)
+        : m_queues(numThreads), m_successors(nullptr), m_task(nullptr), m_numRemaining(0), m_numBusyThreads(0), m_running(false), m_stop(false)
+    {
+        if (numThreads == 0)
+            InvalidArgument("WorkStealingScheduler: The number of threads must be at least 1.");
+#ifdef _OPENMP
+        m_numOmpThreadsPerThread = std::max(1, omp_get_max_threads() / (int) numThreads);
+#else
+        m_numOmpThreadsPerThread = 1;
+#endif
+        for (size_t i = 1; i < numThreads; i++)
+            m_threads.push_back(std::thread([this, i]() { ThreadProc(i); }));
+    }
+
+    ~WorkStealingScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    size_t GetNumThreads() const { return m_queues.size(); }
+
+    // run all tasks; task(i) is called for i = 0..N-1, where N = successors.size(), and successors[i] lists the tasks that depend on task i
+    void Run(const std::vector<std::vector<size_t>>& successors, const std::function<void(size_t)>& task)
+    {
+        const size_t numTasks = successors.size();
+        if (numTasks == 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_numPredecessors.assign(numTasks, 0);
+        for (size_t i = 0; i < numTasks; i++)
+        {
+            for (size_t j : successors[i])
+            {
+                if (j <= i || j >= numTasks)
+                    LogicError("WorkStealingScheduler: Task %d cannot depend on task %d.", (int) j, (int) i);
+                m_numPredecessors[j]++;
+            }
+        }
+        m_successors = &successors;
+        m_task = &task;
+        m_numRemaining = numTasks;
+        m_error = nullptr;
+
+        // distribute the initially ready tasks over all threads
+        size_t numReady = 0;
+        for (size_t i = 0; i < numTasks; i++)
+        {
+            if (m_numPredecessors[i] == 0)
+                m_queues[numReady++ % m_queues.size()].push_back(i);
+        }
+        m_running = true;
+        m_wakeUp.notify_all();
+
+#ifdef _OPENMP
+        const int numOmpThreads = omp_get_max_threads();
+        omp_set_num_threads(m_numOmpThreadsPerThread);
+#endif
+        ProcessTasks(0, lock);
+#ifdef _OPENMP
+        omp_set_num_threads(numOmpThreads);
+#endif
+
+        // wait for the other threads to let go of this run's state
+        m_running = false;
+        m_allIdle.wait(lock, [this]() { return m_numBusyThreads == 0; });
+        m_successors = nullptr;
+        m_task = nullptr;
+
+        if (m_error)
+        {
+            auto error = m_error;
+            m_error = nullptr;
+            lock.unlock();
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void ThreadProc(size_t threadIndex)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(m_numOmpThreadsPerThread);
+#endif
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wakeUp.wait(lock, [this]() { return m_stop || (m_running && m_numRemaining > 0); });
+            if (m_stop)
+                return;
+            m_numBusyThreads++;
+            ProcessTasks(threadIndex, lock);
+            if (--m_numBusyThreads == 0)
+                m_allIdle.notify_all();
+        }
+    }
+
+    // execute ready tasks until all tasks of the current run have completed; called with the lock held
+    void ProcessTasks(size_t threadIndex, std::unique_lock<std::mutex>& lock)
+    {
+        while (m_numRemaining > 0)
+        {
+            size_t task;
+            if (!TryGetTask(threadIndex, task))
+            {
+                m_wakeUp.wait(lock);
+                continue;
+            }
+
+            const bool skip = (bool) m_error;
+            lock.unlock();
+            std::exception_ptr error;
+            if (!skip)
+            {
+                try
+                {
+                    (*m_task)(task);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }
+            lock.lock();
+
+            if (error && !m_error)
+                m_error = error;
+            size_t numReady = 0;
+            for (size_t successor : (*m_successors)[task])
+            {
+                if (--m_numPredecessors[successor] == 0)
+                {
+                    m_queues[threadIndex].push_back(successor);
+                    numReady++;
+                }
+            }
+            // this thread takes one of the new tasks itself; other threads are woken up for the rest, or to let them finish
+            if (--m_numRemaining == 0 || numReady > 1)
+                m_wakeUp.notify_all();
+        }
+    }
+
+    // take the newest task from our own queue, or else steal the oldest one from another thread
+    bool TryGetTask(size_t threadIndex, size_t& task)
+    {
+        auto& ownQueue = m_queues[threadIndex];
+        if (!ownQueue.empty())
+        {
+            task = ownQueue.back();
+            ownQueue.pop_back();
+            return true;
+        }
+        for (size_t k = 1; k < m_queues.size(); k++)
+        {
+            auto& queue = m_queues[(threadIndex + k) % m_queues.size()];
+            if (!queue.empty())
+            {
+                task = queue.front();
+                queue.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::deque<size_t>> m_queues; // [threadIndex] ready tasks
+    std::vector<std::thread> m_threads;       // threads 1..N-1 (thread 0 is the caller of Run())
+    int m_numOmpThreadsPerThread;
+
+    // state of the current run
+    const std::vector<std::vector<size_t>>* m_successors;
+    const std::function<void(size_t)>* m_task;
+    std::vector<size_t> m_numPredecessors; // [task] number of predecessors that have not completed yet
+    size_t m_numRemaining;                 // number of tasks that have not completed yet
+    size_t m_numBusyThreads;
+    std::exception_ptr m_error;
+    bool m_running;
+    bool m_stop;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_allIdle;
+};
+
+}}}
@@ -27,7 +27,10 @@
 #include "NoRandomizer.h"
 #include "HeapMemoryProvider.h"
 #include "InputAndParamNodes.h"
+#include "RecurrentNodes.h"
+#include "RNNNodes.h"
 #include "latticearchive.h"
+#include <chrono>
 
 // TODO: Temporary mechanism to enable memory sharing for
 // node output value matrices. This will go away when the
@@ -47,6 +50,61 @@ void CNTKEvalBase<ElemType>::Init(const std::string& config)
 }
 
 
+// TimeForwardPass - time one forward pass of the output nodes over a single sequence of 'numTimeSteps' frames of random input
+// (one column for inputs without a dynamic axis), after an untimed pass that allocates the matrices (so 'net' must not be used otherwise). Returns seconds.
+template <typename ElemType>
+static double TimeForwardPass(const ComputationNetworkPtr& net, const std::vector<wstring>& outputNodeNames, size_t numTimeSteps)
+{
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::inferring);
+    auto outputNodes = net->OutputNodesByName(outputNodeNames);
+    auto inputNodes = net->InputNodesForOutputs(outputNodeNames);
+    net->AllocateAllMatrices({}, outputNodes, nullptr);
+    net->StartEvaluateMinibatchLoop(outputNodes);
+
+    unsigned long seed = 1;
+    for (auto& inputNode : inputNodes)
+    {
+        size_t numCols = 1;
+        if (inputNode->HasMBLayout())
+        {
+            numCols = numTimeSteps;
+            inputNode->GetMBLayout()->Init(1, numTimeSteps);
+            inputNode->GetMBLayout()->AddSequence(0, 0, 0, numTimeSteps);
+        }
+        auto& matrix = inputNode->As<ComputationNode<ElemType>>()->Value();
+        const size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+        if (matrix.GetMatrixType() == MatrixType::DENSE)
+        {
+            matrix.Resize(numRows, numCols);
+            matrix.SetUniformRandomValue(-1, 1, seed++);
+        }
+        else // one-hot columns
+        {
+            std::vector<CPUSPARSE_INDEX_TYPE> colStarts(numCols + 1), rows(numCols);
+            std::vector<ElemType> values(numCols, 1);
+            for (size_t j = 0; j < numCols; j++)
+            {
+                colStarts[j + 1] = (CPUSPARSE_INDEX_TYPE) (j + 1);
+                rows[j] = (CPUSPARSE_INDEX_TYPE) ((j * 7919) % numRows);
+            }
+            matrix.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), values.data(), numCols, numRows, numCols);
+        }
+    }
+
+    double elapsed = 0;
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& node : outputNodes)
+            net->ForwardProp(node);
+        for (const auto& node : outputNodes) // (wait for the GPU)
+            node->As<ComputationNode<ElemType>>()->Value().Get00Element();
+        elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    return elapsed;
+}
+
 // CreateNetwork - create a network based on the network description
 // networkDescription - network description
 template <typename ElemType>
@@ -62,6 +120,46 @@ void CNTKEvalBase<ElemType>::CreateNetwork(const std::string& networkDescription
     {
         LogicError("Unable to construct network from description");
     }
+
+    // fold BatchNormalization etc. into the weights (the network is only evaluated)
+    if (config(L"optimizeForInference", false))
+    {
+        // With traceLevel > 0, report the size of the network before and after. With reportInferenceOptimization, also time
+        // one forward pass before and after. The passes run on two more instances of the model, since they allocate the
+        // matrices, which the optimization must precede; hence this is off by default.
+        const int traceLevel = config(L"traceLevel", 0);
+        const bool reportTimes = config(L"reportInferenceOptimization", false);
+        const size_t numTimeSteps = 32;
+        const size_t numNodesBefore = this->m_net->GetTotalNumberOfNodes();
+        double timeBefore = 0;
+        if (reportTimes)
+        {
+            std::vector<wstring> unusedOutputNodeNames;
+            timeBefore = TimeForwardPass<ElemType>(GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", unusedOutputNodeNames), outputNodeNames, numTimeSteps);
+        }
+
+        if (this->m_net->OptimizeForInference())
+            this->m_net->CompileNetwork();
+
+        if (reportTimes)
+        {
+            std::vector<wstring> unusedOutputNodeNames;
+            auto optimized = GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", unusedOutputNodeNames);
+            if (optimized->OptimizeForInference())
+                optimized->CompileNetwork();
+            const double timeAfter = TimeForwardPass<ElemType>(optimized, outputNodeNames, numTimeSteps);
+            fprintf(stderr, "OptimizeForInference: %d nodes, %.3f ms per forward pass of %d samples before; %d nodes, %.3f ms after optimization (%.2fx).\n",
+                    (int) numNodesBefore, 1e3 * timeBefore, (int) numTimeSteps, (int) this->m_net->GetTotalNumberOfNodes(), 1e3 * timeAfter, timeBefore / timeAfter);
+        }
+        else if (traceLevel > 0)
+            fprintf(stderr, "OptimizeForInference: %d nodes before, %d nodes after optimization.\n",
+                    (int) numNodesBefore, (int) this->m_net->GetTotalNumberOfNodes());
+    }
+
+    // multiply from 16-bit copies of the weights ("float16" or "bfloat16"; CPU only)
+    wstring weightElementType = config(L"weightElementType", L"");
+    if (!weightElementType.empty())
+        this->m_net->EnableFloat16Weights(true, Float16FormatFromName(weightElementType));
 }
 
 
@@ -307,6 +405,44 @@ VariableSchema CNTKEvalExtended<ElemType>::GetInputSchema() const
     return inputLayouts;
 }
 
+// validate an input buffer against the schema of its input node, and return its number of samples
+template<typename ElemType>
+template<template<typename> class ValueContainer>
+size_t CNTKEvalExtended<ElemType>::GetNumSamples(const ValueBuffer<ElemType, ValueContainer>& buffer, const ComputationNodeBasePtr& inputNode)
+{
+    auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+    auto type = matrix->GetMatrixType();
+    size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+
+    if (buffer.m_buffer.data() == nullptr)
+        RuntimeError("Input %ls: Buffer is not allocated.", inputNode->GetName().c_str());
+    if (type == MatrixType::DENSE)
+    {
+        if (buffer.m_buffer.size() % numRows != 0)
+            RuntimeError("Input %ls: Expected input data to be a multiple of %" PRIu64 ", but it is %" PRIu64 ".", 
+                         inputNode->GetName().c_str(), numRows, buffer.m_buffer.size());
+        if (buffer.m_buffer.size() == 0)
+            RuntimeError("Input %ls: Expected at least one element.", inputNode->GetName().c_str());
+    }
+    else if (type == MatrixType::SPARSE)
+    {
+        if (buffer.m_colIndices.data() == nullptr)
+            RuntimeError("Input %ls: Due to sparse input format, expected colIndices array, but was nullptr.", inputNode->GetName().c_str());
+        if (buffer.m_indices.data() == nullptr)
+            RuntimeError("Input %ls: Due to sparse input format, expected Indices array, but was nullptr.", inputNode->GetName().c_str());
+        if (buffer.m_colIndices.size() < 2)
+            RuntimeError("Input %ls: Expected at least one element (2 entries in colIndices array).", inputNode->GetName().c_str());
+        if (buffer.m_colIndices[0] != 0)
+            RuntimeError("Input %ls: First element of column indices must be 0", inputNode->GetName().c_str());
+        if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
+            RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
+                         inputNode->GetName().c_str(), buffer.m_indices.size(), 
+                         buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
+    }
+
+    return type == MatrixType::DENSE ? buffer.m_buffer.size() / numRows : buffer.m_colIndices.size() - 1;
+}
+
 template<typename ElemType>
 template<template<typename> class ValueContainer>
 void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer> >& inputs, std::vector<ValueBuffer<ElemType, ValueContainer> >& outputs)
@@ -330,33 +466,7 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
         auto type = matrix->GetMatrixType();
         size_t numRows = inputNode->GetSampleLayout().GetNumElements();
 
-        if (buffer.m_buffer.data() == nullptr)
-            RuntimeError("Input %ls: Buffer is not allocated.", m_inputNodes[i]->GetName().c_str());
-        if (type == MatrixType::DENSE)
-        {
-            if (buffer.m_buffer.size() % numRows != 0)
-                RuntimeError("Input %ls: Expected input data to be a multiple of %" PRIu64 ", but it is %" PRIu64 ".", 
-                             m_inputNodes[i]->GetName().c_str(), numRows, buffer.m_buffer.size());
-            if (buffer.m_buffer.size() == 0)
-                RuntimeError("Input %ls: Expected at least one element.", m_inputNodes[i]->GetName().c_str());
-        }
-        else if (type == MatrixType::SPARSE)
-        {
-            if (buffer.m_colIndices.data() == nullptr)
-                RuntimeError("Input %ls: Due to sparse input format, expected colIndices array, but was nullptr.", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_indices.data() == nullptr)
-                RuntimeError("Input %ls: Due to sparse input format, expected Indices array, but was nullptr.", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices.size() < 2)
-                RuntimeError("Input %ls: Expected at least one element (2 entries in colIndices array).", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[0] != 0)
-                RuntimeError("Input %ls: First element of column indices must be 0", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
-                RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
-                             m_inputNodes[i]->GetName().c_str(), buffer.m_indices.size(), 
-                             buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
-        }
-
-        int numCols = type == MatrixType::DENSE ? buffer.m_buffer.size() / numRows : buffer.m_colIndices.size() - 1;
+        int numCols = (int) GetNumSamples(buffer, inputNode);
         assert(numCols >= 1);
         inputNode->GetMBLayout()->Init(1, numCols);
         inputNode->GetMBLayout()->AddSequence(0, 0, 0, numCols);
@@ -420,6 +530,218 @@ void CNTKEvalExtended<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs,
     ForwardPassT(inputs, outputs);
 }
 
+// find the PastValue nodes whose history must be carried from one ForwardPassStreaming() call to the next
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::PrepareStreaming()
+{
+    if (m_streamingPrepared)
+        return;
+
+    std::set<ComputationNodeBasePtr> visited;
+    for (const auto& output : m_outputNodes)
+    {
+        for (const auto& node : this->m_net->GetAllNodesForRoot(output))
+        {
+            if (!visited.insert(node).second)
+                continue;
+            if (node->OperationName() == OperationNameOf(PastValueNode))
+                m_pastValueNodes.push_back(node);
+            else if (dynamic_pointer_cast<IRecurrentNode>(node) || node->OperationName() == OperationNameOf(LSTMNode) || node->OperationName() == OperationNameOf(GRUNode))
+                RuntimeError("ForwardPassStreaming: Node '%ls' (%ls operation) cannot carry its state across chunks; only PastValue recurrences are supported.",
+                             node->NodeName().c_str(), node->OperationName().c_str());
+        }
+    }
+    m_streamingPrepared = true;
+}
+
+// Evaluate the next chunk of a number of sessions in one minibatch, with one parallel sequence per session.
+// The sequence of each session begins before the minibatch (at minus the number of samples seen so far), so that
+// the PastValue nodes read the frames before the chunk from their delayed value, which is replaced by the history of the sessions.
+template<typename ElemType>
+template<template<typename> class ValueContainer>
+void CNTKEvalExtended<ElemType>::ForwardPassStreamingT(const std::vector<size_t>& sessionIds,
+                                                       const std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& inputs,
+                                                       std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& outputs)
+{
+    if (!m_started)
+        RuntimeError("ForwardPassStreaming() called before StartForwardEvaluation()");
+
+    const size_t numSessions = sessionIds.size();
+    if (inputs.size() != numSessions || outputs.size() != numSessions)
+        RuntimeError("ForwardPassStreaming: Expected inputs and outputs for %d sessions, but got %d and %d.", (int) numSessions, (int) inputs.size(), (int) outputs.size());
+    if (std::set<size_t>(sessionIds.begin(), sessionIds.end()).size() != numSessions)
+        RuntimeError("ForwardPassStreaming: Each session can only be evaluated once per call.");
+    if (numSessions == 0)
+        return;
+
+    PrepareStreaming();
+
+    // validate the inputs and determine the length of the chunk of each session
+    std::vector<size_t> lengths(numSessions);
+    std::vector<StreamingSession*> sessions(numSessions);
+    size_t numTimeSteps = 0;
+    for (size_t j = 0; j < numSessions; j++)
+    {
+        if (inputs[j].size() != m_inputNodes.size())
+            RuntimeError("Expected %d inputs, but got %d.", (int) m_inputNodes.size(), (int) inputs[j].size());
+        if (outputs[j].size() != m_outputNodes.size())
+            RuntimeError("Expected %d outputs, but got %d.", (int) m_outputNodes.size(), (int) outputs[j].size());
+        for (size_t i = 0; i < m_inputNodes.size(); i++)
+        {
+            size_t numSamples = GetNumSamples(inputs[j][i], m_inputNodes[i]);
+            if (i > 0 && numSamples != lengths[j])
+                RuntimeError("Input %ls: Expected %d samples for session %d as for the other inputs, but got %d.",
+                             m_inputNodes[i]->GetName().c_str(), (int) lengths[j], (int) sessionIds[j], (int) numSamples);
+            lengths[j] = numSamples;
+        }
+        numTimeSteps = max(numTimeSteps, lengths[j]);
+        sessions[j] = &m_streamingSessions[sessionIds[j]];
+    }
+
+    // fill the inputs, one parallel sequence per session, padded with gaps
+    for (auto& inputNode : m_inputNodes)
+    {
+        auto pMBLayout = inputNode->GetMBLayout();
+        pMBLayout->Init(numSessions, numTimeSteps);
+        for (size_t j = 0; j < numSessions; j++)
+        {
+            pMBLayout->AddSequence(NEW_SEQUENCE_ID, j, -(ptrdiff_t) sessions[j]->m_numSamplesSeen, lengths[j]);
+            if (lengths[j] < numTimeSteps)
+                pMBLayout->AddGap(j, lengths[j], numTimeSteps);
+        }
+    }
+    for (size_t i = 0; i < m_inputNodes.size(); i++)
+    {
+        auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(m_inputNodes[i]->ValuePtr());
+        size_t numRows = m_inputNodes[i]->GetSampleLayout().GetNumElements();
+        if (matrix->GetMatrixType() == MatrixType::DENSE)
+        {
+            std::vector<ElemType> data(numRows * numSessions * numTimeSteps, 0);
+            for (size_t j = 0; j < numSessions; j++)
+                for (size_t t = 0; t < lengths[j]; t++)
+                    std::copy(inputs[j][i].m_buffer.data() + t * numRows, inputs[j][i].m_buffer.data() + (t + 1) * numRows, data.begin() + (t * numSessions + j) * numRows);
+            matrix->SetValue(numRows, numSessions * numTimeSteps, matrix->GetDeviceId(), data.data(), matrixFlagNormal);
+        }
+        else
+        {
+            // interleave the columns of the sessions (gaps have no elements)
+            std::vector<int> colIndices(1, 0), indices;
+            std::vector<ElemType> values;
+            for (size_t t = 0; t < numTimeSteps; t++)
+            {
+                for (size_t j = 0; j < numSessions; j++)
+                {
+                    if (t < lengths[j])
+                    {
+                        const auto& buffer = inputs[j][i];
+                        for (int k = buffer.m_colIndices[t]; k < buffer.m_colIndices[t + 1]; k++)
+                        {
+                            indices.push_back(buffer.m_indices[k]);
+                            values.push_back(buffer.m_buffer[k]);
+                        }
+                    }
+                    colIndices.push_back((int) indices.size());
+                }
+            }
+            matrix->SetMatrixFromCSCFormat(colIndices.data(), indices.data(), values.data(), values.size(), numRows, numSessions * numTimeSteps);
+        }
+    }
+
+    // restore the history of the sessions into the PastValue nodes
+    for (size_t k = 0; k < m_pastValueNodes.size(); k++)
+    {
+        auto node = m_pastValueNodes[k]->As<PastValueNode<ElemType>>();
+        size_t timeStep = node->TimeStep();
+        size_t numRows = m_pastValueNodes[k]->GetSampleLayout().GetNumElements();
+        Matrix<ElemType> history(numRows, timeStep * numSessions, CPUDEVICE);
+        history.SetValue(0);
+        auto pHistoryLayout = make_shared<MBLayout>(numSessions, timeStep, L"");
+        for (size_t j = 0; j < numSessions; j++)
+        {
+            pHistoryLayout->AddSequence(NEW_SEQUENCE_ID, j, 0, timeStep);
+            if (k < sessions[j]->m_history.size())
+                for (size_t t = 0; t < timeStep; t++)
+                    history.SetColumnSlice(sessions[j]->m_history[k]->ColumnSlice(t, 1), t * numSessions + j, 1);
+        }
+        history.TransferToDeviceIfNotThere(m_pastValueNodes[k]->GetDeviceId(), /*isBeingMoved=*/true);
+        node->SetDelayedValue(history, pHistoryLayout);
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+
+    for (size_t i = 0; i < m_outputNodes.size(); ++i)
+    {
+        auto node = m_outputNodes[i];
+        this->m_net->ForwardProp(node);
+        auto pMBLayout = node->GetMBLayout();
+        if (!pMBLayout || pMBLayout->GetNumParallelSequences() != numSessions || pMBLayout->GetNumTimeSteps() != numTimeSteps)
+            RuntimeError("ForwardPassStreaming: Output '%ls' must have the layout of the inputs.", node->GetName().c_str());
+
+        shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr());
+        size_t numRows = outputMatrix->GetNumRows();
+        std::unique_ptr<ElemType[]> data(outputMatrix->CopyToArray());
+        for (size_t j = 0; j < numSessions; j++)
+        {
+            ValueContainer<ElemType>& vec = outputs[j][i].m_buffer;
+            size_t numElements = lengths[j] * numRows;
+            if (vec.capacity() < numElements)
+                RuntimeError("Not enough space in output buffer for output '%ls'.", node->GetName().c_str());
+            vec.resize(numElements);
+            for (size_t t = 0; t < lengths[j]; t++)
+                std::copy(data.get() + (t * numSessions + j) * numRows, data.get() + (t * numSessions + j + 1) * numRows, vec.data() + t * numRows);
+        }
+    }
+
+    // keep the last TimeStep() values of the inputs of the PastValue nodes for the next chunk of each session
+    for (size_t j = 0; j < numSessions; j++)
+    {
+        auto& session = *sessions[j];
+        std::vector<std::shared_ptr<Matrix<ElemType>>> history(m_pastValueNodes.size());
+        for (size_t k = 0; k < m_pastValueNodes.size(); k++)
+        {
+            auto node = m_pastValueNodes[k]->As<PastValueNode<ElemType>>();
+            size_t timeStep = node->TimeStep();
+            size_t numRows = m_pastValueNodes[k]->GetSampleLayout().GetNumElements();
+            const Matrix<ElemType>& values = node->GetDelayedValue();
+            history[k] = make_shared<Matrix<ElemType>>(numRows, timeStep, CPUDEVICE);
+            history[k]->SetValue(0);
+            for (size_t t = 0; t < timeStep; t++)
+            {
+                // position of this history frame relative to the chunk; before it, it comes from the previous history
+                ptrdiff_t tChunk = (ptrdiff_t) lengths[j] - (ptrdiff_t) timeStep + (ptrdiff_t) t;
+                if (tChunk >= 0)
+                {
+                    Matrix<ElemType> column = values.ColumnSlice(tChunk * numSessions + j, 1).DeepClone();
+                    column.TransferToDeviceIfNotThere(CPUDEVICE, /*isBeingMoved=*/true);
+                    history[k]->SetColumnSlice(column, t, 1);
+                }
+                else if (k < session.m_history.size())
+                    history[k]->SetColumnSlice(session.m_history[k]->ColumnSlice(t + lengths[j], 1), t, 1);
+            }
+        }
+        session.m_history = std::move(history);
+        session.m_numSamplesSeen += lengths[j];
+    }
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs)
+{
+    ForwardPassStreamingT(sessionIds, inputs, outputs);
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs)
+{
+    ForwardPassStreamingT(sessionIds, inputs, outputs);
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::EndStreamingSession(size_t sessionId)
+{
+    m_streamingSessions.erase(sessionId);
+}
+
 template <typename ElemType>
 void CNTKEvalExtended<ElemType>::Destroy()
 {
@@ -90,7 +90,7 @@ template <typename ElemType>
 class CNTKEvalExtended : public CNTKEvalBase<ElemType>, public IEvaluateModelExtended<ElemType>
 {
 public:
-    CNTKEvalExtended() : CNTKEvalBase<ElemType>(), m_started(false) {}
+    CNTKEvalExtended() : CNTKEvalBase<ElemType>(), m_started(false), m_streamingPrepared(false) {}
 
     virtual VariableSchema GetOutputSchema() const override;
 
@@ -102,6 +102,12 @@ public:
 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) override;
 
+    virtual void ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) override;
+
+    virtual void ForwardPassStreaming(const std::vector<size_t>& sessionIds, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) override;
+
+    virtual void EndStreamingSession(size_t sessionId) override;
+
     virtual void Destroy() override;
 
     virtual void CreateNetwork(const std::string& networkDescription) override
@@ -124,5 +130,25 @@ private:
     template<template<typename> class ValueContainer> 
     void ForwardPassT(const std::vector < ValueBuffer<ElemType, ValueContainer> >& inputs,
                       std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs);
+
+    template<template<typename> class ValueContainer>
+    static size_t GetNumSamples(const ValueBuffer<ElemType, ValueContainer>& buffer, const ComputationNodeBasePtr& inputNode);
+
+    // streaming evaluation: the history of the PastValue nodes for each session
+    struct StreamingSession
+    {
+        size_t m_numSamplesSeen = 0;
+        std::vector<std::shared_ptr<Matrix<ElemType>>> m_history; // the last TimeStep() input values of each of m_pastValueNodes
+    };
+    std::map<size_t, StreamingSession> m_streamingSessions;
+    std::vector<ComputationNodeBasePtr> m_pastValueNodes;
+    bool m_streamingPrepared;
+
+    void PrepareStreaming();
+
+    template<template<typename> class ValueContainer>
+    void ForwardPassStreamingT(const std::vector<size_t>& sessionIds,
+                               const std::vector < std::vector < ValueBuffer<ElemType, ValueContainer> > >& inputs,
+                               std::vector < std::vector < ValueBuffer<ElemType, ValueContainer> > >& outputs);
 };
 } } }
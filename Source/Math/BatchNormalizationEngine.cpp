@@ -105,6 +105,371 @@ protected:
 template class CntkBatchNormEngine<float>;
 template class CntkBatchNormEngine<double>;
 
+// -----------------------------------------------------------------------
+// CpuBatchNormEngine -- batch normalization on the CPU, for training and inference
+// The statistics take one pass over the data: per activation, a Welford update of a block of rows for
+// each column; spatial, shifted sums over each contiguous feature map, merged across the columns (Chan et al.).
+// A second pass applies y = a * x + b per channel, with a = scale * invStdDev and b = bias - a * mean,
+// optionally followed by the ReLU. The inner loops run over contiguous rows, so that the compiler can vectorize them.
+// The running statistics are kept like the CNTK GPU engine does (running inverse standard deviation, not variance).
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class CpuBatchNormEngine : public BatchNormEngine<ElemType>
+{
+public:
+    using Base = BatchNormEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    CpuBatchNormEngine(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
+                       bool spatial, ImageLayoutKind imageLayout, bool fusedRelu)
+                       : Base(deviceId, inOutT, spatial, imageLayout, fusedRelu)
+    {
+    }
+
+protected:
+    using Base::m_deviceId;
+    using Base::m_fusedRelu;
+    using Base::m_imageLayout;
+    using Base::m_inOutT;
+    using Base::m_spatial;
+
+    static const size_t RowBlockSize = 64; // rows per thread for the per-activation statistics
+
+    void EnsureCompatible() override
+    {
+        if (m_deviceId != CPUDEVICE)
+            InvalidArgument("CPU batch normalization engine supports only the CPU.");
+        if (m_spatial && m_imageLayout == ImageLayoutKind::HWC)
+            InvalidArgument("CPU batch normalization supports only cudnn(CHW) layout.");
+    }
+
+    void ForwardCore(const Mat& in, const Mat& scale, const Mat& bias, double expAvgFactor, double blendFactor, Mat& runMean, Mat& runInvStdDev,
+                     Mat& out, double epsilon, Mat& saveMean, Mat& saveInvStdDev) override
+    {
+        if (in.GetMatrixType() != DENSE || out.GetMatrixType() != DENSE)
+            LogicError("CPU batch normalization supports only dense matrices.");
+        const size_t numChannels = scale.GetNumRows();
+        const size_t spatialSize = in.GetNumRows() / numChannels;
+        const size_t batchSize = in.GetNumCols();
+
+        // If expAvgFactor == 0 && blendFactor == 1 then we don't need to compute current minibatch statistics.
+        if (expAvgFactor > 0 || blendFactor < 1)
+        {
+            std::vector<double> mean(numChannels), variance(numChannels);
+            if (m_spatial)
+                ComputeSpatialStatistics(in.Data(), numChannels, spatialSize, batchSize, mean, variance);
+            else
+                ComputeStatistics(in.Data(), numChannels, batchSize, mean, variance);
+
+            saveMean.Resize(numChannels, 1);
+            saveInvStdDev.Resize(numChannels, 1);
+            ElemType* pSaveMean = saveMean.Data();
+            ElemType* pSaveInvStdDev = saveInvStdDev.Data();
+            ElemType* pRunMean = runMean.Data();
+            ElemType* pRunInvStdDev = runInvStdDev.Data();
+            for (size_t c = 0; c < numChannels; c++)
+            {
+                const double invStdDev = 1 / sqrt(variance[c] + epsilon);
+                // accumulate the running statistics (expAvgFactor == 1: nothing from history)
+                if (expAvgFactor == 1)
+                {
+                    pRunMean[c] = (ElemType) mean[c];
+                    pRunInvStdDev[c] = (ElemType) invStdDev;
+                }
+                else if (expAvgFactor > 0)
+                {
+                    pRunMean[c] = (ElemType) (expAvgFactor * mean[c] + (1 - expAvgFactor) * pRunMean[c]);
+                    pRunInvStdDev[c] = (ElemType) (expAvgFactor * invStdDev + (1 - expAvgFactor) * pRunInvStdDev[c]);
+                }
+                // interpolate the minibatch statistics with the (updated) running statistics
+                pSaveMean[c] = (ElemType) ((1 - blendFactor) * mean[c] + blendFactor * pRunMean[c]);
+                pSaveInvStdDev[c] = (ElemType) ((1 - blendFactor) * invStdDev + blendFactor * pRunInvStdDev[c]);
+            }
+        }
+
+        // blendFactor == 1: use the running statistics only, and return saveMean/saveInvStdDev empty, like the CNTK engine
+        const bool useRunningStatistics = blendFactor == 1;
+        if (useRunningStatistics)
+        {
+            saveMean.Resize(0, 0);
+            saveInvStdDev.Resize(0, 0);
+        }
+        const Mat& actualMean = useRunningStatistics ? runMean : saveMean;
+        const Mat& actualInvStdDev = useRunningStatistics ? runInvStdDev : saveInvStdDev;
+
+        if (m_fusedRelu) // (Backward() recomputes the ReLU mask, for which it needs the bias)
+            m_reluBias.assign(bias.Data(), bias.Data() + numChannels);
+        std::vector<ElemType> a, b;
+        ComputeScaleAndShift(scale.Data(), bias.Data(), actualMean.Data(), actualInvStdDev.Data(), numChannels, a, b);
+
+        const ElemType* x = in.Data();
+        ElemType* y = out.Data();
+        const size_t vectorSize = in.GetNumRows();
+        const bool relu = m_fusedRelu;
+        if (m_spatial)
+        {
+#pragma omp parallel for
+            for (long t = 0; t < (long) (batchSize * numChannels); t++)
+            {
+                const size_t c = t % numChannels;
+                const size_t offset = (t / numChannels) * vectorSize + c * spatialSize;
+                const ElemType ac = a[c];
+                const ElemType bc = b[c];
+                const ElemType* px = x + offset;
+                ElemType* py = y + offset;
+                if (relu)
+                {
+                    for (size_t k = 0; k < spatialSize; k++)
+                        py[k] = std::max<ElemType>(ac * px[k] + bc, 0);
+                }
+                else
+                {
+                    for (size_t k = 0; k < spatialSize; k++)
+                        py[k] = ac * px[k] + bc;
+                }
+            }
+        }
+        else
+        {
+            const ElemType* pa = a.data();
+            const ElemType* pb = b.data();
+#pragma omp parallel for
+            for (long n = 0; n < (long) batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize;
+                ElemType* py = y + n * vectorSize;
+                if (relu)
+                {
+                    for (size_t k = 0; k < vectorSize; k++)
+                        py[k] = std::max<ElemType>(pa[k] * px[k] + pb[k], 0);
+                }
+                else
+                {
+                    for (size_t k = 0; k < vectorSize; k++)
+                        py[k] = pa[k] * px[k] + pb[k];
+                }
+            }
+        }
+    }
+
+    void BackwardCore(const Mat& in, const Mat& srcGrad, Mat& grad, const Mat& scale, double blendFactor, const Mat& saveMean, const Mat& saveInvStdDev,
+                      Mat& scaleGrad, Mat& biasGrad) override
+    {
+        if (in.GetMatrixType() != DENSE || srcGrad.GetMatrixType() != DENSE || grad.GetMatrixType() != DENSE)
+            LogicError("CPU batch normalization supports only dense matrices.");
+        const size_t numChannels = scale.GetNumRows();
+        const size_t vectorSize = in.GetNumRows();
+        const size_t spatialSize = vectorSize / numChannels;
+        const size_t batchSize = in.GetNumCols();
+        const ElemType* x = in.Data();
+        const ElemType* dy = srcGrad.Data();
+        ElemType* dx = grad.Data();
+        const ElemType* pScale = scale.Data();
+        const ElemType* pMean = saveMean.Data();
+        const ElemType* pInvStdDev = saveInvStdDev.Data();
+
+        // the ReLU passes the gradient where y = a * x + b > 0, with a and b as in ForwardCore()
+        const bool relu = m_fusedRelu;
+        std::vector<ElemType> a, b;
+        if (relu)
+        {
+            if (m_reluBias.size() != numChannels)
+                LogicError("CPU batch normalization: Backward() must follow Forward().");
+            ComputeScaleAndShift(pScale, m_reluBias.data(), pMean, pInvStdDev, numChannels, a, b);
+        }
+
+        // --- first pass: dBias = sum(dy), dScale = sum(dy * xHat), with xHat = (x - mean) * invStdDev
+        std::vector<double> dScale(numChannels, 0), dBias(numChannels, 0);
+        if (m_spatial)
+        {
+#pragma omp parallel for
+            for (long c = 0; c < (long) numChannels; c++)
+            {
+                const ElemType mean = pMean[c];
+                const ElemType invStdDev = pInvStdDev[c];
+                double ds = 0, db = 0;
+                for (size_t n = 0; n < batchSize; n++)
+                {
+                    const size_t offset = n * vectorSize + c * spatialSize;
+                    const ElemType* px = x + offset;
+                    const ElemType* pdy = dy + offset;
+                    ElemType sumDy = 0, sumDyXHat = 0; // (per feature map, then accumulated in double)
+                    for (size_t k = 0; k < spatialSize; k++)
+                    {
+                        const ElemType g = relu && a[c] * px[k] + b[c] <= 0 ? 0 : pdy[k];
+                        sumDy += g;
+                        sumDyXHat += g * (px[k] - mean) * invStdDev;
+                    }
+                    db += sumDy;
+                    ds += sumDyXHat;
+                }
+                dScale[c] = ds;
+                dBias[c] = db;
+            }
+        }
+        else
+        {
+#pragma omp parallel for
+            for (long block = 0; block < (long) ((numChannels + RowBlockSize - 1) / RowBlockSize); block++)
+            {
+                const size_t begin = block * RowBlockSize;
+                const size_t end = std::min(begin + RowBlockSize, numChannels);
+                for (size_t n = 0; n < batchSize; n++)
+                {
+                    const ElemType* px = x + n * vectorSize;
+                    const ElemType* pdy = dy + n * vectorSize;
+                    for (size_t k = begin; k < end; k++)
+                    {
+                        const ElemType g = relu && a[k] * px[k] + b[k] <= 0 ? 0 : pdy[k];
+                        dBias[k] += g;
+                        dScale[k] += g * (px[k] - pMean[k]) * pInvStdDev[k];
+                    }
+                }
+            }
+        }
+
+        scaleGrad.Resize(numChannels, 1);
+        biasGrad.Resize(numChannels, 1);
+        ElemType* pScaleGrad = scaleGrad.Data();
+        ElemType* pBiasGrad = biasGrad.Data();
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            pScaleGrad[c] = (ElemType) dScale[c];
+            pBiasGrad[c] = (ElemType) dBias[c];
+        }
+
+        // --- second pass: dx += scale * invStdDev * (dy - mbStatsWeight * (xHat * dScale + dBias) / m)
+        // mbStatsWeight is the weight of the minibatch statistics (0 if none, e.g. locked BN node)
+        const double mbStatsWeight = 1 - blendFactor;
+        const double m = (double) batchSize * spatialSize;
+        std::vector<ElemType> k1(numChannels), k2(numChannels), k3(numChannels);
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            // dx += k1 * dy - k2 * x - k3
+            const double scaleInvStdDev = (double) pScale[c] * pInvStdDev[c];
+            const double xHatCoef = mbStatsWeight * pScaleGrad[c] / m * pInvStdDev[c];
+            k1[c] = (ElemType) scaleInvStdDev;
+            k2[c] = (ElemType) (scaleInvStdDev * xHatCoef);
+            k3[c] = (ElemType) (scaleInvStdDev * (mbStatsWeight * pBiasGrad[c] / m - xHatCoef * pMean[c]));
+        }
+        if (m_spatial)
+        {
+#pragma omp parallel for
+            for (long t = 0; t < (long) (batchSize * numChannels); t++)
+            {
+                const size_t c = t % numChannels;
+                const size_t offset = (t / numChannels) * vectorSize + c * spatialSize;
+                const ElemType* px = x + offset;
+                const ElemType* pdy = dy + offset;
+                ElemType* pdx = dx + offset;
+                for (size_t k = 0; k < spatialSize; k++)
+                {
+                    const ElemType g = relu && a[c] * px[k] + b[c] <= 0 ? 0 : pdy[k];
+                    pdx[k] += k1[c] * g - k2[c] * px[k] - k3[c];
+                }
+            }
+        }
+        else
+        {
+#pragma omp parallel for
+            for (long n = 0; n < (long) batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize;
+                const ElemType* pdy = dy + n * vectorSize;
+                ElemType* pdx = dx + n * vectorSize;
+                for (size_t k = 0; k < vectorSize; k++)
+                {
+                    const ElemType g = relu && a[k] * px[k] + b[k] <= 0 ? 0 : pdy[k];
+                    pdx[k] += k1[k] * g - k2[k] * px[k] - k3[k];
+                }
+            }
+        }
+    }
+
+private:
+    // a = scale * invStdDev, b = bias - a * mean
+    static void ComputeScaleAndShift(const ElemType* scale, const ElemType* bias, const ElemType* mean, const ElemType* invStdDev, size_t numChannels,
+                                     std::vector<ElemType>& a, std::vector<ElemType>& b)
+    {
+        a.resize(numChannels);
+        b.resize(numChannels);
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            a[c] = scale[c] * invStdDev[c];
+            b[c] = bias[c] - a[c] * mean[c];
+        }
+    }
+
+    // per activation: Welford's update of each row, one column at a time
+    static void ComputeStatistics(const ElemType* x, size_t vectorSize, size_t batchSize, std::vector<double>& mean, std::vector<double>& variance)
+    {
+#pragma omp parallel for
+        for (long block = 0; block < (long) ((vectorSize + RowBlockSize - 1) / RowBlockSize); block++)
+        {
+            const size_t begin = block * RowBlockSize;
+            const size_t end = std::min(begin + RowBlockSize, vectorSize);
+            double blockMean[RowBlockSize] = {}, blockM2[RowBlockSize] = {};
+            for (size_t n = 0; n < batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize + begin;
+                const double invCount = 1.0 / (n + 1);
+                for (size_t k = 0; k < end - begin; k++)
+                {
+                    const double d = px[k] - blockMean[k];
+                    blockMean[k] += d * invCount;
+                    blockM2[k] += d * (px[k] - blockMean[k]);
+                }
+            }
+            for (size_t k = begin; k < end; k++)
+            {
+                mean[k] = blockMean[k - begin];
+                variance[k] = blockM2[k - begin] / batchSize;
+            }
+        }
+    }
+
+    // spatial: the sums over each feature map are shifted by its first value (against cancellation),
+    // and the maps of a channel are merged with the parallel variant of Welford's algorithm (Chan et al.)
+    static void ComputeSpatialStatistics(const ElemType* x, size_t numChannels, size_t spatialSize, size_t batchSize,
+                                         std::vector<double>& mean, std::vector<double>& variance)
+    {
+        const size_t vectorSize = numChannels * spatialSize;
+#pragma omp parallel for
+        for (long c = 0; c < (long) numChannels; c++)
+        {
+            double channelMean = 0, channelM2 = 0, count = 0;
+            for (size_t n = 0; n < batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize + c * spatialSize;
+                const ElemType shift = px[0];
+                ElemType sum = 0, sumSquares = 0;
+                for (size_t k = 0; k < spatialSize; k++)
+                {
+                    const ElemType d = px[k] - shift;
+                    sum += d;
+                    sumSquares += d * d;
+                }
+                const double mapMean = shift + (double) sum / spatialSize;
+                const double mapM2 = std::max(0.0, sumSquares - (double) sum * sum / spatialSize);
+                const double delta = mapMean - channelMean;
+                const double newCount = count + spatialSize;
+                channelMean += delta * spatialSize / newCount;
+                channelM2 += mapM2 + delta * delta * count * spatialSize / newCount;
+                count = newCount;
+            }
+            mean[c] = channelMean;
+            variance[c] = channelM2 / count;
+        }
+    }
+
+    std::vector<ElemType> m_reluBias; // bias of the last Forward(), for the ReLU mask in Backward()
+};
+
+template class CpuBatchNormEngine<float>;
+template class CpuBatchNormEngine<double>;
+
 template <typename T>
 bool HasFlag(T src, T testFlag)
 {
@@ -114,8 +479,18 @@ bool HasFlag(T src, T testFlag)
 template <class ElemType>
 std::unique_ptr<BatchNormEngine<ElemType>> BatchNormEngine<ElemType>::Create(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
                                                                              bool spatial, ImageLayoutKind imageLayout,
-                                                                             BatchNormEngineKind enabledEngines)
+                                                                             BatchNormEngineKind enabledEngines, bool fusedRelu)
 {
+    // On the CPU, the CNTK engine is the CPU engine (CPUMatrix only implements inference).
+    if (deviceId == CPUDEVICE && (HasFlag(enabledEngines, BatchNormEngineKind::Cpu) || HasFlag(enabledEngines, BatchNormEngineKind::Cntk)))
+    {
+        fprintf(stderr, "\nUsing CPU batch normalization engine.\n");
+        return std::make_unique<CpuBatchNormEngine<ElemType>>(deviceId, inOutT, spatial, imageLayout, fusedRelu);
+    }
+
+    if (fusedRelu)
+        RuntimeError("Batch normalization with fused ReLU is only implemented on the CPU.");
+
     // Use CNTK as default batch norm engine.
     if (HasFlag(enabledEngines, BatchNormEngineKind::Cntk))
     {
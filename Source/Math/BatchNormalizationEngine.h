@@ -18,8 +18,9 @@ enum class BatchNormEngineKind
     None  = 0,
     Cntk  = 1,
     CuDnn = 1 << 1,
+    Cpu   = 1 << 2, // Blocked, multithreaded CPU implementation, also for training. On the CPU, it implements Cntk as well.
 
-    All  = Cntk  | CuDnn
+    All  = Cntk  | CuDnn | Cpu
 };
 
 #pragma warning(push)
@@ -34,22 +35,26 @@ public:
 public:
     virtual ~BatchNormEngine() = default;
 
+    // If the engine was created with fusedRelu, out = max(0, BN(in)), and Backward() propagates through the ReLU.
     void Forward(const Mat& in, const Mat& scale, const Mat& bias, double expAvgFactor, double blendFactor, Mat& runMean, Mat& runInvStdDev,
                  Mat& out, double epsilon, Mat& saveMean, Mat& saveInvStdDev);
 
+    // Must follow the Forward() of the same minibatch.
     void Backward(const Mat& in, const Mat& srcGrad, Mat& grad, const Mat& scale, double blendFactor, const Mat& saveMean, const Mat& saveInvStdDev,
                   Mat& scaleGrad, Mat& biasGrad);
 
+    // fusedRelu is only supported by the CPU engine.
     static std::unique_ptr<BatchNormEngine<ElemType>> Create(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
                                                              bool spatial, ImageLayoutKind imageLayout,
-                                                             BatchNormEngineKind enabledEngines = BatchNormEngineKind::All);
+                                                             BatchNormEngineKind enabledEngines = BatchNormEngineKind::All,
+                                                             bool fusedRelu = false);
 
     DISABLE_COPY_AND_MOVE(BatchNormEngine);
 
 protected:
     BatchNormEngine(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
-                    bool spatial, ImageLayoutKind imageLayout)
-                    : m_deviceId(deviceId), m_inOutT(inOutT), m_spatial(spatial), m_imageLayout(imageLayout)
+                    bool spatial, ImageLayoutKind imageLayout, bool fusedRelu = false)
+                    : m_deviceId(deviceId), m_inOutT(inOutT), m_spatial(spatial), m_imageLayout(imageLayout), m_fusedRelu(fusedRelu)
     {
     }
 
@@ -67,6 +72,7 @@ protected:
     TensorShape m_inOutT;
     bool m_spatial;
     ImageLayoutKind m_imageLayout;
+    bool m_fusedRelu;
 };
 
 #pragma warning(pop)
@@ -0,0 +1,94 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUHalfMatrix.h -- dense column-major matrix with 16-bit elements (IEEE half or bfloat16) on the CPU
+//
+#pragma once
+
+#include "Half.h"
+#include "CPUMatrix.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// CPUHalfMatrix -- storage-only matrix with 16-bit elements, e.g. for frozen weights at inference time
+// There is no arithmetic on it. It is converted to full precision block by block where it is used,
+// e.g. by CPUMatrix<ElemType>::MultiplyAndWeightedAdd(), which accumulates in ElemType.
+// For mixed-precision training, keep the full-precision parameters as the master copy and
+// re-assign the 16-bit copy from them after each update.
+// -----------------------------------------------------------------------
+
+class CPUHalfMatrix
+{
+public:
+    CPUHalfMatrix(Float16Format format = Float16Format::Half)
+        : m_numRows(0), m_numCols(0), m_format(format)
+    {
+    }
+    template <class ElemType>
+    explicit CPUHalfMatrix(const CPUMatrix<ElemType>& a, Float16Format format = Float16Format::Half)
+        : m_numRows(0), m_numCols(0), m_format(format)
+    {
+        AssignValuesOf(a);
+    }
+
+    size_t GetNumRows() const { return m_numRows; }
+    size_t GetNumCols() const { return m_numCols; }
+    size_t GetNumElements() const { return m_numRows * m_numCols; }
+    bool IsEmpty() const { return GetNumElements() == 0; }
+    Float16Format GetFormat() const { return m_format; }
+    const uint16_t* Data() const { return m_data.data(); }
+
+    // (re-)quantize from a full-precision matrix, keeping the format
+    template <class ElemType>
+    void AssignValuesOf(const CPUMatrix<ElemType>& a)
+    {
+        AssignValuesOf(a.Data(), a.GetNumRows(), a.GetNumCols()); // (a may be a column slice, which is contiguous)
+    }
+
+    // same from the column-major [numRows x numCols] matrix 'a' (e.g. Matrix::Data() of a CPU matrix)
+    template <class ElemType>
+    void AssignValuesOf(const ElemType* a, size_t numRows, size_t numCols)
+    {
+        m_numRows = numRows;
+        m_numCols = numCols;
+        m_data.resize(GetNumElements());
+#pragma omp parallel for
+        for (long j = 0; j < (long) m_numCols; j++)
+            ConvertToFloat16(a + j * m_numRows, m_data.data() + j * m_numRows, m_numRows, m_format);
+    }
+
+    void Clear()
+    {
+        m_numRows = m_numCols = 0;
+        m_data.clear();
+    }
+
+    template <class ElemType>
+    void CopyTo(CPUMatrix<ElemType>& a) const
+    {
+        a.RequireSize(m_numRows, m_numCols);
+        ConvertBlockTo(0, m_numRows, 0, m_numCols, a.Data(), m_numRows);
+    }
+
+    // convert the block [firstRow, firstRow + numRows) x [firstCol, firstCol + numCols) into the column-major buffer 'dst' with leading dimension 'ld'
+    template <class ElemType>
+    void ConvertBlockTo(size_t firstRow, size_t numRows, size_t firstCol, size_t numCols, ElemType* dst, size_t ld) const
+    {
+        if (firstRow + numRows > m_numRows || firstCol + numCols > m_numCols || ld < numRows)
+            InvalidArgument("CPUHalfMatrix::ConvertBlockTo: Block out of bounds.");
+#pragma omp parallel for if (numRows * numCols > 65536)
+        for (long j = 0; j < (long) numCols; j++)
+            ConvertFromFloat16(m_data.data() + (firstCol + j) * m_numRows + firstRow, dst + j * ld, numRows, m_format);
+    }
+
+private:
+    size_t m_numRows;
+    size_t m_numCols;
+    Float16Format m_format;
+    std::vector<uint16_t> m_data;
+};
+
+}}}
@@ -10,6 +10,8 @@
 #include "File.h"
 
 #include "CPUMatrix.h"
+#include "CPUHalfMatrix.h"
+#include "CPUPackedMatrix.h"
 #include "TensorOps.h"
 #include <assert.h>
 #include <stdexcept>
@@ -121,12 +123,13 @@ CPUMatrix<ElemType>::CPUMatrix()
     ZeroInit();
 }
 
-// helper to allocate an array of ElemType
+// helper to allocate the buffer of a matrix (aligned, and reused from previously freed buffers); free it with CPUMemAllocator::Delete()
 // Use this instead of new[] to get NaN initialization for debugging.
+// Pass zero = false if the caller overwrites all elements anyway.
 template <class ElemType>
-static ElemType* NewArray(size_t n)
+static ElemType* NewArray(size_t n, bool zero = true)
 {
-    ElemType* p = new ElemType[n]();
+    ElemType* p = CPUMemAllocator::New<ElemType>(n, zero);
 #if 0 // _DEBUG
         ElemType nan = Matrix<ElemType>::MakeNan(__LINE__);
         for (size_t i = 0; i < n; i++)
@@ -888,7 +891,8 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-		delete[] Buffer();
+        if (OwnBuffer())
+            CPUMemAllocator::Delete(Buffer());
 
         m_numRows = numRows;
         m_numCols = numCols;
@@ -1021,12 +1025,116 @@ void CPUMatrix<ElemType>::SetDiagonalValue(const CPUMatrix<ElemType>& vector)
     }
 }
 
+// -----------------------------------------------------------------------
+// random fills
+// By default, these draw sequentially from a std engine, as they always did, so that existing setups reproduce.
+// With SetUseCounterBasedRNG(true), element i of a fill instead takes word (i % 4) of Philox4x32(seed, firstCounter + i / 4).
+// Since each element is then a function of its index only, the fill is split across threads without changing the result.
+// -----------------------------------------------------------------------
+
+static bool s_useCounterBasedRNG = false;
+
+// note: this function does not depend on the <ElemType> parameter
+template <class ElemType>
+void CPUMatrix<ElemType>::SetUseCounterBasedRNG(bool useCounterBasedRNG)
+{
+    s_useCounterBasedRNG = useCounterBasedRNG;
+}
+
+template <class ElemType>
+bool CPUMatrix<ElemType>::UseCounterBasedRNG()
+{
+    return s_useCounterBasedRNG;
+}
+
+static const size_t RandomFillMinParallelSize = 16384;
+
+static unsigned long GetRandomSeed(unsigned long seed)
+{
+    return seed == USE_TIME_BASED_SEED ? (unsigned long) time(NULL) : seed;
+}
+
+// uniform in [0, 1), with as many random bits as the type can represent exactly
+template <class ElemType>
+static inline ElemType RandomWordToUnitInterval(uint32_t word);
+template <>
+inline float RandomWordToUnitInterval<float>(uint32_t word)
+{
+    return (word >> 8) * (1.0f / 16777216.0f);
+}
+template <>
+inline double RandomWordToUnitInterval<double>(uint32_t word)
+{
+    return word * (1.0 / 4294967296.0);
+}
+
+// data[i] = transform(4 random words of block i / 4, counter of that block)[i % 4]
+template <class ElemType, class TransformFn>
+static void RandomFill(ElemType* data, size_t n, uint64_t seed, uint64_t firstCounter, const TransformFn& transform)
+{
+    const long numBlocks = (long) ((n + 3) / 4);
+#pragma omp parallel for if (n >= RandomFillMinParallelSize)
+    for (long block = 0; block < numBlocks; block++)
+    {
+        uint32_t words[4];
+        ElemType values[4];
+        Philox4x32::Generate(seed, firstCounter + block, words);
+        transform(words, firstCounter + block, values);
+        const size_t first = (size_t) block * 4;
+        const size_t count = min((size_t) 4, n - first);
+        for (size_t k = 0; k < count; k++)
+            data[first + k] = values[k];
+    }
+}
+
+// 4 normally distributed values from the 4 random words of a block, in pairs by the Marsaglia polar method,
+// which needs no sin/cos. A pair whose point falls outside the unit circle (about 21% of them) is computed by
+// Box-Muller from the same block of an independent substream instead, since reusing the rejected words would bias it.
+template <class ElemType>
+static inline void RandomWordsToGaussian(const uint32_t words[4], uint64_t seed, uint64_t counter, ElemType mean, ElemType sigma, ElemType values[4])
+{
+    const ElemType twoPi = (ElemType) 6.28318530717958647692;
+    for (size_t k = 0; k < 4; k += 2)
+    {
+        const ElemType u = (ElemType) (int32_t) words[k] * (ElemType) (1.0 / 2147483648.0); // [-1, 1)
+        const ElemType v = (ElemType) (int32_t) words[k + 1] * (ElemType) (1.0 / 2147483648.0);
+        const ElemType s = u * u + v * v;
+        if (s < 1 && s > 0)
+        {
+            const ElemType factor = sigma * sqrt(-2 * log(s) / s);
+            values[k]     = mean + u * factor;
+            values[k + 1] = mean + v * factor;
+        }
+        else
+        {
+            uint32_t fallbackWords[4];
+            Philox4x32::Generate(seed, counter, fallbackWords, /*substream=*/1);
+            const ElemType u1 = 1 - RandomWordToUnitInterval<ElemType>(fallbackWords[k]); // (0, 1], so that the log is finite
+            const ElemType u2 = RandomWordToUnitInterval<ElemType>(fallbackWords[k + 1]);
+            const ElemType radius = sigma * sqrt(-2 * log(u1));
+            values[k]     = mean + radius * cos(twoPi * u2);
+            values[k + 1] = mean + radius * sin(twoPi * u2);
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
 {
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_useCounterBasedRNG)
+    {
+        const ElemType range = high - low;
+        RandomFill(Data(), GetNumElements(), GetRandomSeed(seed), 0, [=](const uint32_t words[4], uint64_t, ElemType values[4])
+        {
+            for (size_t k = 0; k < 4; k++)
+                values[k] = low + range * RandomWordToUnitInterval<ElemType>(words[k]);
+        });
+        return;
+    }
+
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
     generator.seed(seed == USE_TIME_BASED_SEED ? (unsigned long) time(NULL) : seed);
@@ -1061,6 +1169,16 @@ void CPUMatrix<ElemType>::SetGaussianRandomValue(const ElemType mean, const Elem
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_useCounterBasedRNG)
+    {
+        const uint64_t key = GetRandomSeed(seed);
+        RandomFill(Data(), GetNumElements(), key, 0, [=](const uint32_t words[4], uint64_t counter, ElemType values[4])
+        {
+            RandomWordsToGaussian(words, key, counter, mean, sigma, values);
+        });
+        return;
+    }
+
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1076,6 +1194,7 @@ void CPUMatrix<ElemType>::SetGaussianRandomValue(const ElemType mean, const Elem
     }
 }
 
+// BUGBUG: Despite its name, this sets the values (as it always did), rather than adding to them.
 template <class ElemType>
 void CPUMatrix<ElemType>::AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
 {
@@ -1085,6 +1204,16 @@ void CPUMatrix<ElemType>::AddGaussianRandomValue(const ElemType mean, const Elem
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_useCounterBasedRNG)
+    {
+        const uint64_t key = GetRandomSeed(seed);
+        RandomFill(Data(), GetNumElements(), key, 0, [=](const uint32_t words[4], uint64_t counter, ElemType values[4])
+        {
+            RandomWordsToGaussian(words, key, counter, mean, sigma, values);
+        });
+        return;
+    }
+
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1124,6 +1253,22 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     CPURNGHandle* cpuRNGHandle = dynamic_cast<CPURNGHandle*>(&rngHandle);
     assert(cpuRNGHandle != nullptr);
 
+    if (s_useCounterBasedRNG)
+    {
+        // each mask continues the stream of the handle where the previous one stopped
+        const size_t n = GetNumElements();
+        const uint64_t firstCounter = cpuRNGHandle->SkipAhead((n + 3) / 4);
+        // An element is kept if its uniform value u = (word >> 8) / 2^24 is >= maskRate, i.e. (word >> 8) >= threshold.
+        // This is computed from the sign of the difference, since compilers turn a comparison into a branch, which mispredicts on random data.
+        const uint32_t threshold = (uint32_t) ceil(max(0.0, min(1.0, (double) maskRate)) * 16777216.0);
+        RandomFill(Data(), n, cpuRNGHandle->Seed(), firstCounter, [=](const uint32_t words[4], uint64_t, ElemType values[4])
+        {
+            for (size_t k = 0; k < 4; k++)
+                values[k] = scaleValue * (ElemType) (int) (1 - (((words[k] >> 8) - threshold) >> 31));
+        });
+        return;
+    }
+
     auto& us = *this;
     std::uniform_real_distribution<ElemType> r(0, 1);
 
@@ -1363,6 +1508,214 @@ ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
         return 1;
 }
 
+// second sweep of AdaGrad/RmsProp with average multiplier: val -= stepSize * normalizedGrad, followed by L1
+template <class ElemType>
+static void ApplyNormalizedGradient(const ElemType* normalizedGrad, ElemType* val, long n, ElemType stepSize, bool applyL1, ElemType l1Threshold)
+{
+#pragma omp parallel for
+    for (long i = 0; i < n; i++)
+    {
+        ElemType w = val[i] - stepSize * normalizedGrad[i];
+        val[i] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+    }
+}
+
+// Performs a complete SGD step for one parameter: gradient clipping, L2 regularization, the optimizer update
+// of 'this' (the smoothed gradient) and of the parameter values, and L1 soft-thresholding.
+// Instead of one pass over the data per step, everything is done while each element is in registers, in a single
+// multi-threaded loop whose body is branch-free enough to be vectorized by the compiler.
+// AdaGrad and RmsProp with needAveMultiplier need the average multiplier over all elements before any parameter can be
+// updated. In that case the first sweep leaves the normalized gradient in 'gradients' and a second one applies it.
+// Otherwise 'gradients' is left untouched (unlike the individual steps, which modify it in place).
+// adaWeight and adaMul are the FSAdaGrad statistics (see Matrix::FSAdagrad()); ignored by all other update types.
+template <class ElemType>
+void CPUMatrix<ElemType>::FusedUpdateWeights(CPUMatrix<ElemType>& gradients,
+                                             CPUMatrix<ElemType>& functionValues,
+                                             const FusedWeightUpdateParams& params,
+                                             ElemType adaWeight,
+                                             ElemType adaMul)
+{
+    if (gradients.GetNumRows() != functionValues.GetNumRows() || gradients.GetNumCols() != functionValues.GetNumCols())
+        LogicError("FusedUpdateWeights: The gradient dimensions [%d x %d] do not match the parameter dimensions [%d x %d].",
+                   (int) gradients.GetNumRows(), (int) gradients.GetNumCols(), (int) functionValues.GetNumRows(), (int) functionValues.GetNumCols());
+
+    const long n = (long) gradients.GetNumElements();
+    ElemType* grad = gradients.Data();
+    ElemType* val = functionValues.Data();
+
+    const ElemType scale = (ElemType) params.gradientScale;
+    const ElemType threshold = (ElemType) params.truncationThreshold; // infinity if truncation is disabled
+    const ElemType l2Weight = (ElemType) params.l2Weight;
+    const ElemType l1Threshold = (ElemType) params.l1Threshold;
+    const bool applyL1 = l1Threshold > 0;
+    const ElemType learnRatePerSample = (ElemType) params.learnRatePerSample;
+    const ElemType momentum = (ElemType) params.momentum;
+    const bool needAveMultiplier = params.needAveMultiplier;
+
+    switch (params.type)
+    {
+    case FusedWeightUpdateType::Momentum:
+    case FusedWeightUpdateType::Nesterov:
+    {
+        // same as NormalGrad(): smoothed = momentum * smoothed + (1 - momentum) * learnRatePerSample * gradient
+        if (IsEmpty() || GetNumRows() != gradients.GetNumRows() || GetNumCols() != gradients.GetNumCols())
+        {
+            RequireSize(gradients.GetNumRows(), gradients.GetNumCols());
+            SetValue(0.0);
+        }
+
+        const bool useNesterovMomentum = params.type == FusedWeightUpdateType::Nesterov;
+        const ElemType gradientWeight = (1 - momentum) * learnRatePerSample;
+        ElemType* smoothed = Data();
+#pragma omp parallel for
+        for (long i = 0; i < n; i++)
+        {
+            ElemType w = val[i];
+            const ElemType step = gradientWeight * PreprocessGradientElement(grad[i], w, scale, threshold, l2Weight);
+            const ElemType s = momentum * smoothed[i] + step;
+            smoothed[i] = s;
+            // w_t = w_{t-1} - momentum * v_t - (1-momentum) * learnRatePerSample * gradient for Nesterov
+            w -= useNesterovMomentum ? momentum * s + step : s;
+            val[i] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+        }
+        break;
+    }
+    case FusedWeightUpdateType::AdaGrad:
+    {
+        if (IsEmpty() || GetNumRows() != gradients.GetNumRows() || GetNumCols() != gradients.GetNumCols())
+        {
+            RequireSize(gradients.GetNumRows(), gradients.GetNumCols());
+            SetValue(0.0);
+        }
+
+        const ElemType floor = 1e-16f;
+        ElemType* accumulated = Data();
+        double aveMultiplier = 0;
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long i = 0; i < n; i++)
+        {
+            ElemType w = val[i];
+            const ElemType g = PreprocessGradientElement(grad[i], w, scale, threshold, l2Weight);
+            const ElemType a = accumulated[i] + g * g;
+            accumulated[i] = a;
+            const ElemType denom = sqrt(a + floor);
+            if (needAveMultiplier)
+            {
+                grad[i] = g / denom;
+                aveMultiplier += 1 / denom;
+            }
+            else
+            {
+                w -= learnRatePerSample * g / denom;
+                val[i] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+            }
+        }
+
+        if (needAveMultiplier && n > 0)
+            ApplyNormalizedGradient(grad, val, n, (ElemType) (learnRatePerSample / (aveMultiplier / n)), applyL1, l1Threshold);
+        break;
+    }
+    case FusedWeightUpdateType::FSAdaGrad:
+    {
+        size_t numColsNeeded = 2 * gradients.GetNumCols();
+        if (IsEmpty() || (GetNumCols() < numColsNeeded))
+        {
+            RequireSize(gradients.GetNumRows(), numColsNeeded);
+            SetValue(0.0);
+        }
+
+        ElemType* smoothAda = Data();
+        ElemType* smoothMom = Data() + n;
+#pragma omp parallel for
+        for (long i = 0; i < n; i++)
+        {
+            ElemType w = val[i];
+            ElemType g = PreprocessGradientElement(grad[i], w, scale, threshold, l2Weight);
+            const ElemType adaSqr = adaWeight * smoothAda[i] + (1.0f - adaWeight) * g * g;
+            smoothAda[i] = adaSqr;
+            if (adaSqr != 0.0f)
+            {
+                ElemType ada = adaMul * ((ElemType) 1.0 / sqrt(adaSqr));
+                if (ada > 10.0f)
+                    ada = 10.0f;
+                g *= ada;
+            }
+
+            if (momentum > 0.0f)
+            {
+                g = momentum * smoothMom[i] + (1.0f - momentum) * g;
+                smoothMom[i] = g;
+            }
+
+            w -= learnRatePerSample * g;
+            val[i] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+        }
+        break;
+    }
+    case FusedWeightUpdateType::RmsProp:
+    {
+        // on first use, the state is initialized from the (preprocessed) gradient inside the loop, see RmsProp()
+        const bool initialize = IsEmpty() || GetNumCols() < gradients.GetNumCols() * 3;
+        if (initialize)
+            RequireSize(gradients.GetNumRows(), gradients.GetNumCols() * 3);
+
+        const ElemType floor = 1e-6f;
+        const ElemType gamma = (ElemType) params.rmsGamma;
+        const ElemType oneMinusGamma = ElemType(1.0) - gamma;
+        const ElemType weightInc = (ElemType) params.rmsWeightInc;
+        const ElemType weightMax = (ElemType) params.rmsWeightMax;
+        const ElemType weightDec = (ElemType) params.rmsWeightDec;
+        const ElemType weightMin = (ElemType) params.rmsWeightMin;
+        ElemType* avars = Data();         // accumulated variances for RMS scaling
+        ElemType* signs = Data() + n;     // sign of previous gradient
+        ElemType* steps = Data() + 2 * n; // current step size
+        double aveMultiplier = 0;
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long i = 0; i < n; i++)
+        {
+            ElemType w = val[i];
+            const ElemType g = PreprocessGradientElement(grad[i], w, scale, threshold, l2Weight);
+            if (initialize)
+            {
+                avars[i] = g * g;
+                signs[i] = 0;
+                steps[i] = ElemType(0.02);
+            }
+
+            const ElemType avar = gamma * avars[i] + oneMinusGamma * (g * g);
+            avars[i] = avar;
+            const int gradSign = (ElemType(0) < g) - (g < ElemType(0));
+
+            ElemType step = steps[i];
+            if (signs[i] * gradSign > 0)
+                step = std::min(step * weightInc, weightMax);
+            else
+                step = std::max(step * weightDec, weightMin);
+            steps[i] = step;
+            signs[i] = (ElemType) gradSign;
+
+            const ElemType a = step / sqrt(avar + floor);
+            if (needAveMultiplier)
+            {
+                grad[i] = g * a;
+                aveMultiplier += a;
+            }
+            else
+            {
+                w -= learnRatePerSample * g * a;
+                val[i] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+            }
+        }
+
+        if (needAveMultiplier && n > 0)
+            ApplyNormalizedGradient(grad, val, n, (ElemType) (learnRatePerSample / (aveMultiplier / n)), applyL1, l1Threshold);
+        break;
+    }
+    default:
+        InvalidArgument("FusedUpdateWeights: Unknown update type %d.", (int) params.type);
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1406,7 +1759,7 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
             pArray = NewArray<ElemType>(numElements);
         }
         // success: update the object
-        delete[] Buffer();
+        CPUMemAllocator::Delete(Buffer());
 
         SetBuffer(pArray, numElements * sizeof(ElemType));
         SetSizeAllocated(numElements);
@@ -1426,7 +1779,7 @@ ElemType* CPUMatrix<ElemType>::CopyToArray() const
     size_t numElements = GetNumElements();
     if (numElements != 0)
     {
-        ElemType* arrayCopyTo = NewArray<ElemType>(numElements);
+        ElemType* arrayCopyTo = new ElemType[numElements]; // (deleted by the caller with delete[])
         memcpy(arrayCopyTo, Data(), sizeof(ElemType) * numElements);
         return arrayCopyTo;
     }
@@ -1445,8 +1798,8 @@ size_t CPUMatrix<ElemType>::CopyToArray(ElemType*& arrayCopyTo, size_t& currentA
 
     if (numElements > currentArraySize)
     {
-        delete arrayCopyTo;
-        arrayCopyTo = NewArray<ElemType>(numElements);
+        delete[] arrayCopyTo;
+        arrayCopyTo = new ElemType[numElements];
         currentArraySize = numElements;
     }
 
@@ -2304,6 +2657,80 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
     return *this;
 }
 
+// fused softmax and cross entropy (column-wise): one pass over each column computes its log-sum-exp and its contribution
+// to the criterion, so that neither the softmax nor the log softmax is written out
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignCrossEntropyWithSoftmaxOf(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z, CPUMatrix<ElemType>& logSumExp)
+{
+    if (z.IsEmpty())
+        LogicError("AssignCrossEntropyWithSoftmaxOf: Matrix z is empty.");
+    const bool hasLabels = !labels.IsEmpty();
+    if (hasLabels && (labels.GetNumRows() != z.GetNumRows() || labels.GetNumCols() != z.GetNumCols()))
+        InvalidArgument("AssignCrossEntropyWithSoftmaxOf: The dimensions of labels and z must match.");
+
+    logSumExp.RequireSize(1, z.GetNumCols());
+    double criterion = 0; // (accumulated in double over the whole minibatch)
+#pragma omp parallel for reduction(+ : criterion)
+    foreach_column (j, z)
+    {
+        // we need to extract max before applying exp to avoid overflow
+        ElemType maxV = z(0, j);
+        foreach_row (i, z)
+            maxV = std::max(maxV, z(i, j));
+
+        ElemType sum = 0;
+        foreach_row (i, z)
+            sum += exp(z(i, j) - maxV);
+        const ElemType lse = maxV + log(sum);
+        logSumExp(0, j) = lse;
+
+        if (hasLabels)
+        {
+            foreach_row (i, z)
+            {
+                const ElemType label = labels(i, j);
+                if (label != 0)
+                    criterion += label * (lse - z(i, j));
+            }
+        }
+    }
+
+    RequireSize(1, 1);
+    (*this)(0, 0) = (ElemType) criterion;
+    return *this;
+}
+
+// c += alpha * (softmax(z) - labels), where softmax(z)(i,j) = exp(z(i,j) - logSumExp(0,j)) is recomputed on the fly
+template <class ElemType>
+void CPUMatrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z,
+                                                             const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& c)
+{
+    if (alpha.GetNumElements() != 1)
+        InvalidArgument("AddCrossEntropyWithSoftmaxGradient: alpha must be a 1X1 matrix.");
+    if (logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != z.GetNumCols() || c.GetNumRows() != z.GetNumRows() || c.GetNumCols() != z.GetNumCols())
+        InvalidArgument("AddCrossEntropyWithSoftmaxGradient: The dimensions of z, logSumExp, and c do not match.");
+    const bool hasLabels = !labels.IsEmpty();
+    if (hasLabels && (labels.GetNumRows() != z.GetNumRows() || labels.GetNumCols() != z.GetNumCols()))
+        InvalidArgument("AddCrossEntropyWithSoftmaxGradient: The dimensions of labels and z must match.");
+
+    const ElemType a = alpha(0, 0);
+#pragma omp parallel for
+    foreach_column (j, z)
+    {
+        const ElemType lse = logSumExp(0, j);
+        if (hasLabels)
+        {
+            foreach_row (i, z)
+                c(i, j) += a * (exp(z(i, j) - lse) - labels(i, j));
+        }
+        else
+        {
+            foreach_row (i, z)
+                c(i, j) += a * exp(z(i, j) - lse);
+        }
+    }
+}
+
 //[this]=hardmax([this])
 //the max element is 1 else is 0
 template <class ElemType>
@@ -4570,6 +4997,166 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
     }
 }
 
+/// <summary>Matrix-matrix multiply with a 16-bit matrix a: c = alpha * op(a) * op(b) + beta*c</summary>
+/// The columns of op(a) are converted to ElemType a panel at a time, into a buffer that stays in the cache, and each panel
+/// is multiplied with the corresponding rows of op(b) by GEMM. So a is read from memory once with half the bandwidth,
+/// and all products are accumulated in ElemType.
+template <class ElemType>
+void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUHalfMatrix& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB,
+                                                 ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (a.IsEmpty() || b.IsEmpty())
+        return;
+
+    const size_t m = transposeA ? a.GetNumCols() : a.GetNumRows();
+    const size_t k = transposeA ? a.GetNumRows() : a.GetNumCols();
+    const size_t l = transposeB ? b.GetNumCols() : b.GetNumRows();
+    const size_t n = transposeB ? b.GetNumRows() : b.GetNumCols();
+    if (k != l)
+        InvalidArgument("CPUMatrix<ElemType>::MultiplyAndWeightedAdd : The inner dimensions of a and b must match.");
+
+    if (beta == 0)
+        c.RequireSize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    // panels of about 64k elements (256 KB for float), but at least 64 columns of op(a) for GEMM efficiency
+    const size_t panelCols = min(k, max((size_t) 64, (size_t) 65536 / m));
+    std::vector<ElemType> panel(m * panelCols);
+    for (size_t k0 = 0; k0 < k; k0 += panelCols)
+    {
+        const size_t kb = min(panelCols, k - k0);
+        // panel = op(a)[:, k0:k0+kb], stored as a column slice of a (m x kb), or, if transposed, as a row slice of a (kb x m)
+        int lda;
+        if (transposeA)
+        {
+            a.ConvertBlockTo(k0, kb, 0, m, panel.data(), kb);
+            lda = (int) kb;
+        }
+        else
+        {
+            a.ConvertBlockTo(0, m, k0, kb, panel.data(), m);
+            lda = (int) m;
+        }
+        // rows k0:k0+kb of op(b)
+        const ElemType* bPanel = transposeB ? b.Data() + k0 * n : b.Data() + k0;
+        const int ldb = (int) b.GetNumRows();
+        const ElemType panelBeta = k0 == 0 ? beta : 1; // (later panels accumulate)
+        const int ldc = (int) c.GetNumRows();
+#ifdef USE_ACML
+        const char transA = transposeA ? (char) MatrixTranspose::Trans : (char) MatrixTranspose::NoTrans;
+        const char transB = transposeB ? (char) MatrixTranspose::Trans : (char) MatrixTranspose::NoTrans;
+        if (sizeof(ElemType) == sizeof(double))
+            dgemm(transA, transB, (int) m, (int) n, (int) kb, alpha, reinterpret_cast<double*>(panel.data()), lda, reinterpret_cast<double*>(const_cast<ElemType*>(bPanel)), ldb, panelBeta, reinterpret_cast<double*>(c.Data()), ldc);
+        else
+            sgemm(transA, transB, (int) m, (int) n, (int) kb, alpha, reinterpret_cast<float*>(panel.data()), lda, reinterpret_cast<float*>(const_cast<ElemType*>(bPanel)), ldb, panelBeta, reinterpret_cast<float*>(c.Data()), ldc);
+#else
+        const CBLAS_TRANSPOSE mklTransA = transposeA ? CBLAS_TRANSPOSE::CblasTrans : CBLAS_TRANSPOSE::CblasNoTrans;
+        const CBLAS_TRANSPOSE mklTransB = transposeB ? CBLAS_TRANSPOSE::CblasTrans : CBLAS_TRANSPOSE::CblasNoTrans;
+        if (sizeof(ElemType) == sizeof(double))
+            cblas_dgemm((CBLAS_ORDER) BLAS_COLMAJOR mklTransA, mklTransB, (int) m, (int) n, (int) kb, alpha, reinterpret_cast<const double*>(panel.data()), lda, reinterpret_cast<const double*>(bPanel), ldb, panelBeta, reinterpret_cast<double*>(c.Data()), ldc);
+        else
+#pragma warning(suppress : 4244)
+            cblas_sgemm((CBLAS_ORDER) BLAS_COLMAJOR mklTransA, mklTransB, (int) m, (int) n, (int) kb, alpha, reinterpret_cast<const float*>(panel.data()), lda, reinterpret_cast<const float*>(bPanel), ldb, panelBeta, reinterpret_cast<float*>(c.Data()), ldc);
+#endif
+    }
+}
+
+// c[0:rows, j0:j0+NumCols] = alpha * panel * op(b)[:, j0:j0+NumCols] + beta * c[0:rows, j0:j0+NumCols], for one panel of a CPUPackedMatrix
+// The sums of all NumCols x PanelRows products are kept in registers while the panel is read once.
+template <class ElemType, size_t NumCols>
+static void MultiplyPackedPanel(ElemType alpha, const ElemType* panel, size_t k, const ElemType* b, size_t ldb, bool transposeB, size_t j0,
+                                ElemType beta, ElemType* c, size_t ldc, size_t rows)
+{
+    const size_t panelRows = CPUPackedMatrix<ElemType>::PanelRows;
+    ElemType sum[NumCols][panelRows] = {};
+    if (!transposeB) // op(b)(kk, j) = b[kk + j * ldb]
+    {
+        const ElemType* bCol[NumCols];
+        for (size_t j = 0; j < NumCols; j++)
+            bCol[j] = b + (j0 + j) * ldb;
+        for (size_t kk = 0; kk < k; kk++, panel += panelRows)
+        {
+            for (size_t j = 0; j < NumCols; j++)
+            {
+                const ElemType bValue = bCol[j][kk];
+#ifdef __GNUC__ // (vectorize along the panel rows; otherwise GCC vectorizes the loop over kk, with strided loads)
+#pragma omp simd
+#endif
+                for (size_t i = 0; i < panelRows; i++)
+                    sum[j][i] += panel[i] * bValue;
+            }
+        }
+    }
+    else // op(b)(kk, j) = b[j + kk * ldb]
+    {
+        const ElemType* bRow = b + j0;
+        for (size_t kk = 0; kk < k; kk++, panel += panelRows, bRow += ldb)
+        {
+            for (size_t j = 0; j < NumCols; j++)
+            {
+                const ElemType bValue = bRow[j];
+#ifdef __GNUC__
+#pragma omp simd
+#endif
+                for (size_t i = 0; i < panelRows; i++)
+                    sum[j][i] += panel[i] * bValue;
+            }
+        }
+    }
+    for (size_t j = 0; j < NumCols; j++)
+    {
+        ElemType* cCol = c + (j0 + j) * ldc;
+        for (size_t i = 0; i < rows; i++)
+            cCol[i] = beta == 0 ? alpha * sum[j][i] : alpha * sum[j][i] + beta * cCol[i]; // (beta == 0 must not read c, like GEMM)
+    }
+}
+
+/// <summary>Matrix-matrix multiply with a packed matrix a: c = alpha * op(a) * op(b) + beta*c</summary>
+/// Each panel of a is multiplied with 4 columns of op(b) at a time. This is meant for products with few columns,
+/// e.g. one time step of a recurrent network; panels of op(a) are processed in parallel.
+template <class ElemType>
+void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUPackedMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const bool transposeB,
+                                                 ElemType beta, CPUMatrix<ElemType>& c)
+{
+    const size_t m = a.GetNumRows();
+    const size_t k = a.GetNumCols();
+    const size_t l = transposeB ? b.GetNumCols() : b.GetNumRows();
+    const size_t n = transposeB ? b.GetNumRows() : b.GetNumCols();
+    if (k != l)
+        InvalidArgument("CPUMatrix<ElemType>::MultiplyAndWeightedAdd : The inner dimensions of a and b must match.");
+
+    if (beta == 0)
+        c.RequireSize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    if (m == 0 || n == 0)
+        return;
+
+    const ElemType* pb = b.Data();
+    const size_t ldb = b.GetNumRows();
+    ElemType* pc = c.Data();
+    const size_t ldc = c.GetNumRows();
+    const size_t panelRows = CPUPackedMatrix<ElemType>::PanelRows;
+#pragma omp parallel for if (m * n * k > 65536)
+    for (long p = 0; p < (long) a.GetNumPanels(); p++)
+    {
+        const ElemType* panel = a.Panel(p);
+        ElemType* cPanel = pc + p * panelRows;
+        const size_t rows = min(panelRows, m - p * panelRows);
+        size_t j0 = 0;
+        for (; j0 + 4 <= n; j0 += 4)
+            MultiplyPackedPanel<ElemType, 4>(alpha, panel, k, pb, ldb, transposeB, j0, beta, cPanel, ldc, rows);
+        switch (n - j0)
+        {
+        case 3: MultiplyPackedPanel<ElemType, 3>(alpha, panel, k, pb, ldb, transposeB, j0, beta, cPanel, ldc, rows); break;
+        case 2: MultiplyPackedPanel<ElemType, 2>(alpha, panel, k, pb, ldb, transposeB, j0, beta, cPanel, ldc, rows); break;
+        case 1: MultiplyPackedPanel<ElemType, 1>(alpha, panel, k, pb, ldb, transposeB, j0, beta, cPanel, ldc, rows); break;
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b,
                                                     ElemType beta, CPUMatrix<ElemType>& c)
@@ -6090,6 +6677,9 @@ struct TensorOpReduction<ElemType, OPFN, ReductionOp, N, -1>
 // perform loop over regular index k for N-nary operations (N counting the output)
 // -----------------------------------------------------------------------
 
+// minimum length of the innermost loop of a tensor operation to be split across threads
+static const size_t TensorOpMinParallelSize = 4096;
+
 // perform loop over regular index k and reducing index m for N operands (counting the output)
 template <class ElemType, typename OPFN, typename ReductionOp, size_t N, bool vectorizable, int m, int k>
 struct TensorOpIteration
@@ -6126,8 +6716,12 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/,
         ElemType* pb = pointers[1];
         ElemType* pc = pointers[2];
         size_t K = regularOpDims[0];
+        // short vectors, e.g. per-frame operations in recurrent loops, are not worth the overhead of a parallel region
+        if (K < TensorOpMinParallelSize)
+            for (size_t k = 0; k < K; k++)
+                TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         // special-case beta and alpha to allow the compiler to short-circuit it
-        if (beta != 0)
+        else if (beta != 0)
 #pragma omp parallel for
             for (int k = 0; k < (int) K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
@@ -6141,7 +6735,6 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/,
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, 1, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
         // TODO: The signedness of k (required for omp) causes an extra sign-extend.
-        // TODO: OMP adds LOTS of overhead. Do we need a guard, a min size when to use it?
     }
 };
 // and unary
@@ -6155,8 +6748,12 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/,
         ElemType* pa = pointers[0];
         ElemType* pb = pointers[1];
         size_t K = regularOpDims[0];
+        // short vectors, e.g. per-frame operations in recurrent loops, are not worth the overhead of a parallel region
+        if (K < TensorOpMinParallelSize)
+            for (size_t k = 0; k < K; k++)
+                TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         // special-case beta and alpha to allow the compiler to short-circuit it
-        if (beta != 0)
+        else if (beta != 0)
 #pragma omp parallel for
             for (int k = 0; k < (int) K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
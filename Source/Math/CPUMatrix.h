@@ -6,6 +6,7 @@
 #include "Basics.h" // for RuntimeError()
 #include "Matrix.h"
 #include "File.h"
+#include "Half.h"
 #include "Helpers.h"
 #include "CommonMatrix.h"
 #include "CPURNGHandle.h"
@@ -27,6 +28,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 double logadd(double x, double y);
 
+class CPUHalfMatrix;
+template <class ElemType> class CPUPackedMatrix;
+
 //To compy with BLAS libraries matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor
 //convertion is need when passing data between CPUMatrix and C++ matrices
 template <class ElemType>
@@ -101,6 +105,7 @@ public:
                      ElemType RMS_WGT_DEC,
                      ElemType RMS_WGT_MIN,
                      const bool needAveMultiplier);
+    void FusedUpdateWeights(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>& functionValues, const FusedWeightUpdateParams& params, ElemType adaWeight, ElemType adaMul);
 
 
     void Reshape(const size_t numRows, const size_t numCols);
@@ -223,6 +228,14 @@ public:
     CPUMatrix<ElemType>& InplaceHardmax(const bool isColWise);
     CPUMatrix<ElemType>& AssignHardmaxOf(const CPUMatrix<ElemType>& a, const bool isColWise);
 
+    // fused softmax and cross entropy (column-wise), without materializing the softmax:
+    // [this] = -sum_ij labels(i,j) * (z(i,j) - logSumExp(0,j)) (1x1), where logSumExp(0,j) = log sum_i exp(z(i,j)).
+    // Zero labels are skipped, so columns without labels (gaps) contribute nothing. An empty 'labels' only computes logSumExp.
+    CPUMatrix<ElemType>& AssignCrossEntropyWithSoftmaxOf(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z, CPUMatrix<ElemType>& logSumExp);
+    // c += alpha * (softmax(z) - labels), with the softmax recomputed from z and logSumExp (alpha is 1x1; an empty 'labels' counts as 0)
+    static void AddCrossEntropyWithSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z,
+                                                   const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& c);
+
     // sequence training
     CPUMatrix<ElemType>& DropFrame(const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& gamma, const ElemType& threshhold);
     CPUMatrix<ElemType>& AssignSequenceError(const ElemType hsmoothingWeight, const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& dnnoutput, const CPUMatrix<ElemType>& gamma, ElemType alpha);
@@ -382,11 +395,17 @@ public:
 
 public:
     static int SetNumThreads(int numThreads); // note: this does not depend on <ElemType>, i.e. you can call it on any <ElemType>
+    static void SetUseCounterBasedRNG(bool useCounterBasedRNG); // random fills from Philox, independent of the number of threads; also does not depend on <ElemType>
+    static bool UseCounterBasedRNG();
 
     // static BLAS functions
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
 
     static void MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
+    // same with 16-bit a, which is converted to ElemType panel by panel; the products are accumulated in ElemType
+    static void MultiplyAndWeightedAdd(ElemType alpha, const CPUHalfMatrix& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
+    // same with a packed op(a), for products with few columns (see CPUPackedMatrix)
+    static void MultiplyAndWeightedAdd(ElemType alpha, const CPUPackedMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
     static void MultiplyAndAdd(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
@@ -447,17 +466,13 @@ public:
     friend File& operator>>(File& stream, CPUMatrix<ElemType>& us)
     {
         stream.GetMarker(fileMarkerBeginSection, std::wstring(L"BMAT"));
-        size_t elsize;
-        stream >> elsize;
-        if (sizeof(ElemType) != elsize)
-            RuntimeError("Template argument size doesn't match those in file");
+        const FileElementType elementType = GetFileElementType<ElemType>(stream); // (16-bit elements are converted)
         std::wstring matrixName;
         size_t numRows, numCols;
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
         ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        GetFileElements(stream, elementType, d_array, numRows * numCols);
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         us.SetValue(numRows, numCols, d_array, matrixFlagNormal);
 
@@ -467,15 +482,14 @@ public:
     friend File& operator<<(File& stream, const CPUMatrix<ElemType>& us)
     {
         stream.PutMarker(fileMarkerBeginSection, std::wstring(L"BMAT"));
-        stream << sizeof(ElemType);
+        const FileElementType elementType = PutFileElementType<ElemType>(stream); // (16-bit if the file was opened with fileOptionsFloat16 or fileOptionsBFloat16)
 
         std::wstring s = std::wstring(L"unnamed");
         int format = us.GetFormat();
         stream << s << format;
 
         stream << us.m_numRows << us.m_numCols;
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << us.Buffer()[i];
+        PutFileElements(stream, elementType, us.Buffer(), us.GetNumElements());
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         return stream;
     }
@@ -515,6 +529,24 @@ private:
     void Clear();
 };
 
+// element-wise helpers for the fused weight update kernels of CPUMatrix and CPUSparseMatrix
+
+// gradient clipping (scaling and truncation) followed by L2 regularization
+template <class ElemType>
+inline ElemType PreprocessGradientElement(ElemType g, ElemType w, ElemType scale, ElemType threshold, ElemType l2Weight)
+{
+    g *= scale;
+    g = g > threshold ? threshold : (g < -threshold ? -threshold : g);
+    return g + l2Weight * w;
+}
+
+// proximal L1 step, same as InplaceSoftThreshold()
+template <class ElemType>
+inline ElemType SoftThresholdElement(ElemType w, ElemType threshold)
+{
+    return w > threshold ? w - threshold : (w < -threshold ? w + threshold : 0);
+}
+
 typedef CPUMatrix<float> CPUSingleMatrix;
 typedef CPUMatrix<double> CPUDoubleMatrix;
 
@@ -0,0 +1,177 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMemAllocator.cpp -- allocator of host memory for the buffers of CPUMatrix and CPUSparseMatrix
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "CPUMemAllocator.h"
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Each block starts with a header that holds its capacity, so that Free() knows the size class.
+// The header takes a full alignment unit, so that the returned pointer is aligned as well.
+static const size_t HeaderSize = CPUMemAllocator::Alignment;
+static const size_t HugePageSize = 2 * 1024 * 1024;
+
+CPUMemAllocator::CPUMemAllocator(size_t maxCachedBytes, bool useHugePages)
+    : m_maxCachedBytes(maxCachedBytes), m_useHugePages(useHugePages)
+{
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+CPUMemAllocator::~CPUMemAllocator()
+{
+    ReleaseCachedMemory();
+}
+
+/*static*/ CPUMemAllocator& CPUMemAllocator::Instance()
+{
+    static std::once_flag onceFlag; // (a function-local static object would not be initialized thread-safely by VS2013)
+    static CPUMemAllocator* instance;
+    std::call_once(onceFlag, [] { instance = new CPUMemAllocator(); });
+    return *instance;
+}
+
+// round up to one of 4 size classes per power of two, e.g. 1280, 1536, 1792, 2048 for sizes in (1024, 2048]
+/*static*/ size_t CPUMemAllocator::GetSizeClass(size_t size)
+{
+    if (size <= Alignment)
+        return Alignment;
+    size_t k = 0;
+    while ((size - 1) >> (k + 1))
+        k++; // now 2^k < size <= 2^(k+1)
+    const size_t step = (size_t) 1 << (k - 2);
+    return (size + step - 1) / step * step;
+}
+
+void* CPUMemAllocator::AllocateBlock(size_t capacity)
+{
+    const size_t size = HeaderSize + capacity;
+    void* p;
+#ifdef _WIN32
+    // Large pages on Windows require the SeLockMemoryPrivilege, so they are not used.
+    p = _aligned_malloc(size, Alignment);
+#else
+    const bool huge = m_useHugePages && capacity >= HugePageSize;
+    if (posix_memalign(&p, huge ? HugePageSize : Alignment, size) != 0)
+        p = nullptr;
+#ifdef MADV_HUGEPAGE
+    if (p && huge)
+        madvise(p, size, MADV_HUGEPAGE); // (only a hint)
+#endif
+#endif
+    if (!p)
+        RuntimeError("CPUMemAllocator: Failed to allocate %llu bytes.", (unsigned long long) size);
+    *(size_t*) p = capacity;
+    return (char*) p + HeaderSize;
+}
+
+/*static*/ void CPUMemAllocator::FreeBlock(void* p)
+{
+#ifdef _WIN32
+    _aligned_free((char*) p - HeaderSize);
+#else
+    free((char*) p - HeaderSize);
+#endif
+}
+
+void* CPUMemAllocator::Malloc(size_t size)
+{
+    if (size == 0)
+        return nullptr;
+    const size_t capacity = GetSizeClass(size);
+    void* p = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.numAllocations++;
+        auto iter = m_cachedBlocks.find(capacity);
+        if (iter != m_cachedBlocks.end() && !iter->second.empty())
+        {
+            p = iter->second.back();
+            iter->second.pop_back();
+            m_statistics.numCacheHits++;
+            m_statistics.numBytesCached -= capacity;
+        }
+        m_statistics.numBytesInUse += capacity;
+        m_statistics.peakNumBytesInUse = max(m_statistics.peakNumBytesInUse, m_statistics.numBytesInUse);
+    }
+    if (!p) // (not holding the lock while going to the heap)
+    {
+        try
+        {
+            p = AllocateBlock(capacity);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistics.numBytesInUse -= capacity;
+            throw;
+        }
+    }
+    return p;
+}
+
+void CPUMemAllocator::Free(void* p)
+{
+    if (!p)
+        return;
+    const size_t capacity = *(const size_t*) ((const char*) p - HeaderSize);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.numBytesInUse -= capacity;
+        if (m_statistics.numBytesCached + capacity <= m_maxCachedBytes)
+        {
+            m_cachedBlocks[capacity].push_back(p);
+            m_statistics.numBytesCached += capacity;
+            return;
+        }
+    }
+    FreeBlock(p);
+}
+
+void CPUMemAllocator::SetOptions(size_t maxCachedBytes, bool useHugePages)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxCachedBytes = maxCachedBytes;
+        m_useHugePages = useHugePages;
+    }
+    ReleaseCachedMemory(); // (blocks allocated with the previous options)
+}
+
+void CPUMemAllocator::ReleaseCachedMemory()
+{
+    std::unordered_map<size_t, std::vector<void*>> cachedBlocks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cachedBlocks.swap(m_cachedBlocks);
+        m_statistics.numBytesCached = 0;
+    }
+    for (const auto& iter : cachedBlocks)
+        for (void* p : iter.second)
+            FreeBlock(p);
+}
+
+CPUMemAllocator::Statistics CPUMemAllocator::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void CPUMemAllocator::PrintStatistics(FILE* f) const
+{
+    const Statistics statistics = GetStatistics();
+    fprintf(f, "CPU memory: %llu allocations, %.1f%% reused from the cache; %.1f MB peak, %.1f MB in use, %.1f MB cached.\n",
+            (unsigned long long) statistics.numAllocations, statistics.numAllocations > 0 ? 100.0 * statistics.numCacheHits / statistics.numAllocations : 0.0,
+            statistics.peakNumBytesInUse / 1048576.0, statistics.numBytesInUse / 1048576.0, statistics.numBytesCached / 1048576.0);
+}
+} } }
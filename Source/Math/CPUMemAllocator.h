@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMemAllocator.h -- allocator of host memory for the buffers of CPUMatrix and CPUSparseMatrix
+//
+#pragma once
+
+#include "MemAllocator.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+// -----------------------------------------------------------------------
+// CPUMemAllocator -- allocates blocks aligned for SIMD loads, and keeps freed blocks for reuse
+// Sizes are rounded up to size classes (4 per power of two), so that the temporaries of the
+// next minibatch find the blocks freed by the previous one instead of going to the heap
+// (and, for large blocks, taking page faults again). Blocks are not initialized.
+// All CPU matrices allocate from Instance(); the cache can be limited or disabled with SetOptions().
+// -----------------------------------------------------------------------
+
+class MATH_API CPUMemAllocator : public MemAllocator
+{
+public:
+    static const size_t Alignment = 64; // cache line, and widest SIMD load (AVX-512)
+
+    struct Statistics
+    {
+        size_t numAllocations;    // calls to Malloc() with size > 0
+        size_t numCacheHits;      // ...that were served from the cache of freed blocks
+        size_t numBytesInUse;     // allocated and not freed (rounded up to the size classes)
+        size_t peakNumBytesInUse;
+        size_t numBytesCached;    // freed and kept for reuse
+    };
+
+    CPUMemAllocator(size_t maxCachedBytes = 256 * 1024 * 1024, bool useHugePages = false);
+    ~CPUMemAllocator();
+
+    void* Malloc(size_t size) override;
+    void Free(void* p) override;
+
+    // maxCachedBytes = 0 disables the cache. Huge pages are used for blocks of 2 MB and more (Linux only: transparent huge pages).
+    void SetOptions(size_t maxCachedBytes, bool useHugePages);
+    void ReleaseCachedMemory();
+    Statistics GetStatistics() const;
+    void PrintStatistics(FILE* f) const;
+
+    // the allocator of all CPU matrices (never destroyed, since matrices may still be freed during static destruction)
+    static CPUMemAllocator& Instance();
+
+    template <class T>
+    static T* New(size_t n, bool zero)
+    {
+        T* p = (T*) Instance().Malloc(n * sizeof(T));
+        if (zero && p)
+            memset(p, 0, n * sizeof(T));
+        return p;
+    }
+    static void Delete(void* p)
+    {
+        Instance().Free(p);
+    }
+
+private:
+    CPUMemAllocator(const CPUMemAllocator&) = delete;
+    CPUMemAllocator& operator=(const CPUMemAllocator&) = delete;
+
+    static size_t GetSizeClass(size_t size);
+    void* AllocateBlock(size_t capacity);
+    static void FreeBlock(void* p);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<void*>> m_cachedBlocks; // [capacity] -> freed blocks
+    size_t m_maxCachedBytes;
+    bool m_useHugePages;
+    Statistics m_statistics;
+};
+} } }
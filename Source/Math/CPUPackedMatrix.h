@@ -0,0 +1,99 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUPackedMatrix.h -- the left operand of a CPU matrix product, packed once for many products
+//
+#pragma once
+
+#include "Basics.h"
+#include <algorithm>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// CPUPackedMatrix -- op(a) of c = op(a) * op(b), stored in the layout that the multiplication kernel reads
+// BLAS packs a into such a layout inside every GEMM call. When the same a (e.g. a weight matrix) is
+// multiplied with many small b (e.g. one time step of a recurrent loop at a time), packing it once and
+// keeping it saves one pass over a per call.
+// op(a) [m x k] is stored as ceil(m / PanelRows) panels. A panel holds PanelRows rows of op(a), one
+// column after the other, so the kernel reads it sequentially; the last panel is padded with zeros.
+// The owner must Clear() it when a changes. See CPUMatrix<ElemType>::MultiplyAndWeightedAdd().
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class CPUPackedMatrix
+{
+public:
+    static const size_t PanelRows = 16; // (two AVX registers of float)
+
+    // Whether a product with op(a) [m x k] and n columns should use a packed a. BLAS re-reads a from memory for its
+    // packing in every call once a does not fit into the cache, which dominates for few columns. For more columns,
+    // or for a small a, BLAS is faster.
+    static bool IsBeneficial(size_t m, size_t k, size_t n)
+    {
+        return m * k >= 512 * 1024 && n <= 8;
+    }
+
+    CPUPackedMatrix()
+        : m_numRows(0), m_numCols(0), m_transposed(false)
+    {
+    }
+
+    size_t GetNumRows() const { return m_numRows; } // of op(a)
+    size_t GetNumCols() const { return m_numCols; } // of op(a)
+    bool IsEmpty() const { return m_numRows * m_numCols == 0; }
+    bool IsTransposed() const { return m_transposed; }
+    size_t GetNumPanels() const { return (m_numRows + PanelRows - 1) / PanelRows; }
+    const ElemType* Panel(size_t p) const { return m_data.data() + p * PanelRows * m_numCols; }
+
+    // pack op(a) from the column-major [numRows x numCols] matrix 'a' (e.g. CPUMatrix::Data())
+    void Pack(const ElemType* a, size_t numRows, size_t numCols, bool transpose)
+    {
+        m_transposed = transpose;
+        m_numRows = transpose ? numCols : numRows;
+        m_numCols = transpose ? numRows : numCols;
+        const size_t m = m_numRows, k = m_numCols;
+        m_data.assign(GetNumPanels() * PanelRows * k, 0);
+#pragma omp parallel for if (m * k > 65536)
+        for (long p = 0; p < (long) GetNumPanels(); p++)
+        {
+            ElemType* panel = m_data.data() + p * PanelRows * k;
+            const size_t rows = std::min(PanelRows, m - p * PanelRows);
+            if (transpose) // op(a)(row, kk) = a(kk, row), which is contiguous in kk
+            {
+                for (size_t i = 0; i < rows; i++)
+                {
+                    const ElemType* src = a + (p * PanelRows + i) * numRows;
+                    for (size_t kk = 0; kk < k; kk++)
+                        panel[kk * PanelRows + i] = src[kk];
+                }
+            }
+            else // the rows of a panel are contiguous in each column of a
+            {
+                for (size_t kk = 0; kk < k; kk++)
+                {
+                    const ElemType* src = a + p * PanelRows + kk * numRows;
+                    for (size_t i = 0; i < rows; i++)
+                        panel[kk * PanelRows + i] = src[i];
+                }
+            }
+        }
+    }
+
+    void Clear()
+    {
+        m_numRows = m_numCols = 0;
+        m_data.clear();
+        m_data.shrink_to_fit();
+    }
+
+private:
+    size_t m_numRows;
+    size_t m_numCols;
+    bool m_transposed;
+    std::vector<ElemType> m_data;
+};
+
+}}}
@@ -10,9 +10,49 @@
 #include "RNGHandle.h"
 #include <memory>
 #include <random>
+#include <stdint.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// Philox4x32 -- counter-based random number generator (Philox4x32-10 of Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011)
+// Generate(key, counter) returns 4 random 32-bit words as a function of its arguments only,
+// so a fill can be split across threads (each computing its own counters) with the same result for any number of threads.
+// 'substream' selects an independent sequence for the same key and counter (the upper half of the 128-bit counter).
+// -----------------------------------------------------------------------
+
+class Philox4x32
+{
+public:
+    static void Generate(uint64_t key, uint64_t counter, uint32_t result[4], uint32_t substream = 0)
+    {
+        uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+        uint32_t c0 = (uint32_t) counter, c1 = (uint32_t) (counter >> 32), c2 = substream, c3 = 0;
+        for (int round = 0; round < 10; round++)
+        {
+            if (round > 0)
+            {
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            const uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+            const uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+            c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+            c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+            c1 = (uint32_t) p1;
+            c3 = (uint32_t) p0;
+        }
+        result[0] = c0;
+        result[1] = c1;
+        result[2] = c2;
+        result[3] = c3;
+    }
+};
+
+// The CPU random state of a node (e.g. dropout). It holds
+//  - a std engine, from which the sequential fills draw (the default, see CPUMatrix::SetUseCounterBasedRNG()), and
+//  - a Philox key and the next unused counter for the counter-based fills. Each such fill reserves the counters it
+//    uses with SkipAhead(), so that consecutive fills get different numbers.
 class CPURNGHandle : public RNGHandle
 {
 public:
@@ -23,20 +63,34 @@ public:
     {
         return *m_generator;
     }
-
-private:
-    std::unique_ptr<std::ranlux64_base_01> m_generator;
-
 #else
     std::default_random_engine& Generator()
     {
         return *m_generator;
     }
+#endif
+
+    uint64_t Seed() const
+    {
+        return m_seed;
+    }
+
+    // returns the first of 'numCounters' consecutive counters, and moves past them
+    uint64_t SkipAhead(uint64_t numCounters)
+    {
+        const uint64_t firstCounter = m_counter;
+        m_counter += numCounters;
+        return firstCounter;
+    }
 
 private:
+#ifdef _MSC_VER
+    std::unique_ptr<std::ranlux64_base_01> m_generator;
+#else
     std::unique_ptr<std::default_random_engine> m_generator;
 #endif
-
+    uint64_t m_seed;
+    uint64_t m_counter;
 };
 
 }}}
@@ -17,6 +17,8 @@
 #include <random>
 #include <chrono>
 #include <iostream>
+#include <algorithm>
+#include <vector>
 #ifdef LEAKDETECT
 #include <vld.h>
 #endif
@@ -245,8 +247,9 @@ void CPUSparseMatrix<ElemType>::SetValue(const size_t row, const size_t col, con
         SetColIdx((int) c);
     }
 	// Note we don't have m_nz anymore. In order for the change from m_nz to
-    // NzCount to make sense, we need to propogate nz+1 to all col slices.
-    for (size_t max = c + 1; max < m_numCols + 1; max++)
+    // NzCount to make sense, we need to propogate nz+1 to all col slices (row slices for CSR).
+    const size_t numOuter = (GetFormat() == matrixFormatSparseCSC) ? m_numCols : m_numRows;
+    for (size_t max = c + 1; max < numOuter + 1; max++)
     {
         SecondaryIndexLocation()[max] = CPUSPARSE_INDEX_TYPE(nz + 1);
     }
@@ -615,17 +618,14 @@ void CPUSparseMatrix<ElemType>::Allocate(const size_t numRows, const size_t numC
     {
         if (GetFormat() == MatrixFormat::matrixFormatSparseCSC || GetFormat() == MatrixFormat::matrixFormatSparseCSR)
         {
-            auto* pArray      = new ElemType[numNZElemToReserve]();
-            auto* unCompIndex = new CPUSPARSE_INDEX_TYPE[numNZElemToReserve]();
-            auto* compIndex   = new CPUSPARSE_INDEX_TYPE[newCompIndexSize]();
+            // only the column/row starts must be zero (no non-zero elements yet); the elements and their indices are written before they are read
+            auto* pArray      = CPUMemAllocator::New<ElemType>(numNZElemToReserve, /*zero=*/false);
+            auto* unCompIndex = CPUMemAllocator::New<CPUSPARSE_INDEX_TYPE>(numNZElemToReserve, /*zero=*/false);
+            auto* compIndex   = CPUMemAllocator::New<CPUSPARSE_INDEX_TYPE>(newCompIndexSize, /*zero=*/true);
 
             if (keepExistingValues && (NzCount() > numNZElemToReserve || GetCompIndexSize() > newCompIndexSize))
                 LogicError("Allocate: To keep values m_nz should <= numNZElemToReserve and m_compIndexSize <= newCompIndexSize");
 
-			memset(pArray, 0, sizeof(ElemType) * numNZElemToReserve);
-			memset(unCompIndex, 0, sizeof(CPUSPARSE_INDEX_TYPE) * numNZElemToReserve);
-			memset(compIndex, 0, sizeof(CPUSPARSE_INDEX_TYPE) * newCompIndexSize);
-
             if (keepExistingValues && NzCount() > 0)
             {
                 assert(GetCompIndexSize() > 0 && NzCount() < numNZElemToReserve);
@@ -635,9 +635,9 @@ void CPUSparseMatrix<ElemType>::Allocate(const size_t numRows, const size_t numC
             }
 
             // TODO: This is super ugly. The internals of the storage object should be a shared_ptr.
-            delete[] Buffer();
-            delete[] GetUnCompIndex();
-            delete[] GetCompIndex();
+            CPUMemAllocator::Delete(Buffer());
+            CPUMemAllocator::Delete(GetUnCompIndex());
+            CPUMemAllocator::Delete(GetCompIndex());
 
             SetBuffer(pArray, numNZElemToReserve, false);
             SetUnCompIndex(unCompIndex);
@@ -645,8 +645,8 @@ void CPUSparseMatrix<ElemType>::Allocate(const size_t numRows, const size_t numC
         }
         else if (GetFormat() == MatrixFormat::matrixFormatSparseBlockCol || GetFormat() == MatrixFormat::matrixFormatSparseBlockRow)
         {
-            ElemType* blockVal = new ElemType[numNZElemToReserve];
-            size_t* blockIds = new size_t[newCompIndexSize];
+            ElemType* blockVal = CPUMemAllocator::New<ElemType>(numNZElemToReserve, /*zero=*/false);
+            size_t* blockIds = CPUMemAllocator::New<size_t>(newCompIndexSize, /*zero=*/false);
 
             if (keepExistingValues && (NzCount() > numNZElemToReserve || GetCompIndexSize() > newCompIndexSize))
                 LogicError("Resize: To keep values m_nz should <= numNZElemToReserve and m_compIndexSize <= newCompIndexSize");
@@ -658,8 +658,8 @@ void CPUSparseMatrix<ElemType>::Allocate(const size_t numRows, const size_t numC
                 memcpy(blockIds, GetBlockIds(), sizeof(size_t) * GetCompIndexSize());
             }
 
-            delete[] Buffer();
-            delete[] GetBlockIds();
+            CPUMemAllocator::Delete(Buffer());
+            CPUMemAllocator::Delete(GetBlockIds());
 
             SetBuffer(blockVal, numNZElemToReserve, false);
             SetBlockIds(blockIds);
@@ -741,6 +741,132 @@ void CPUSparseMatrix<ElemType>::Reset()
     SetBlockIdShift(0);
 }
 
+// -----------------------------------------------------------------------
+// dense x sparse products
+// Each column of the result c = op(lhs) * op(rhs) is a weighted sum of columns of op(lhs), with the weights
+// taken from the nonzeros of op(rhs). The columns of c that receive anything are listed once per call
+// (without a map), and are then computed independently, hence in parallel and without write conflicts.
+// -----------------------------------------------------------------------
+
+// minimum number of multiply-adds for which the columns of the product are computed in parallel
+static const size_t SparseProductMinParallelWork = 32768;
+
+// the nonzero columns of op(rhs) (that is, of the result), each with its (lhs index, weight) pairs
+template <class ElemType>
+struct SparseProductColumns
+{
+    vector<size_t> outputCols;             // [b] -> column index of the result, ascending
+    vector<size_t> start;                  // [b] -> first entry of column b; one element more than outputCols
+    vector<CPUSPARSE_INDEX_TYPE> lhsIndex; // [entry] -> column of op(lhs)
+    vector<ElemType> weights;              // [entry] -> nonzero value of rhs
+};
+
+template <class ElemType>
+static void GetSparseProductColumns(const CPUSparseMatrix<ElemType>& rhs, bool transposeB, SparseProductColumns<ElemType>& columns)
+{
+    // A CSR matrix is the CSC matrix of its transpose, with the same index arrays.
+    if (rhs.GetFormat() == matrixFormatSparseCSR)
+        transposeB = !transposeB;
+    else if (rhs.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+    const size_t numOuter = rhs.GetFormat() == matrixFormatSparseCSR ? rhs.GetNumRows() : rhs.GetNumCols();
+    const CPUSPARSE_INDEX_TYPE* outerStart = rhs.SecondaryIndexLocation(); // (absolute positions, also in a slice view)
+    const CPUSPARSE_INDEX_TYPE* innerIndex = rhs.MajorIndexLocation();     // (relative to the slice view, as the values)
+    const ElemType* values = rhs.NzValues();
+    const size_t nz = outerStart[numOuter] - outerStart[0];
+
+    columns.outputCols.clear();
+    columns.start.assign(1, 0);
+    columns.lhsIndex.resize(nz);
+    columns.weights.resize(nz);
+    if (!transposeB)
+    {
+        // column j of the result takes the nonzeros of column j of rhs, in place
+        for (size_t j = 0; j < numOuter; j++)
+        {
+            const size_t begin = outerStart[j] - outerStart[0];
+            const size_t end = outerStart[j + 1] - outerStart[0];
+            if (begin == end)
+                continue;
+            columns.outputCols.push_back(j);
+            columns.start.push_back(end);
+        }
+        memcpy(columns.lhsIndex.data(), innerIndex, sizeof(CPUSPARSE_INDEX_TYPE) * nz);
+        memcpy(columns.weights.data(), values, sizeof(ElemType) * nz);
+    }
+    else
+    {
+        // Column i of the result takes the nonzeros of row i of rhs, i.e. (j, value) for all nonzeros (i, j).
+        // Sorting the nonzeros by (i, position) groups them by output column, in a deterministic order.
+        vector<uint64_t> keys(nz);
+        for (size_t j = 0; j < numOuter; j++)
+            for (size_t p = outerStart[j] - outerStart[0]; p < outerStart[j + 1] - outerStart[0]; p++)
+                keys[p] = ((uint64_t) innerIndex[p] << 32) | p;
+        sort(keys.begin(), keys.end());
+        // the rhs column of each nonzero
+        vector<CPUSPARSE_INDEX_TYPE> outerIndex(nz);
+        for (size_t j = 0; j < numOuter; j++)
+            for (size_t p = outerStart[j] - outerStart[0]; p < outerStart[j + 1] - outerStart[0]; p++)
+                outerIndex[p] = (CPUSPARSE_INDEX_TYPE) j;
+        for (size_t e = 0; e < nz; e++)
+        {
+            const size_t i = (size_t) (keys[e] >> 32);
+            const size_t p = (size_t) (keys[e] & 0xffffffff);
+            if (e > 0 && i != columns.outputCols.back())
+                columns.start.push_back(e);
+            if (e == 0 || i != columns.outputCols.back())
+                columns.outputCols.push_back(i);
+            columns.lhsIndex[e] = outerIndex[p];
+            columns.weights[e] = values[p];
+        }
+        if (nz > 0)
+            columns.start.push_back(nz);
+    }
+}
+
+// adds alpha * op(lhs) * (weights of output column b) to the column given by getOutputColumn(b), for all b
+template <class ElemType, class GetOutputColumnFn>
+static void AccumulateSparseProductColumns(ElemType alpha, const CPUMatrix<ElemType>& lhs, bool transposeA,
+                                           const SparseProductColumns<ElemType>& columns, const GetOutputColumnFn& getOutputColumn)
+{
+    const long numColumns = (long) columns.outputCols.size();
+    const size_t lhsRows = lhs.GetNumRows();
+    const size_t m = transposeA ? lhs.GetNumCols() : lhsRows;
+    const ElemType* lhsData = lhs.Data();
+    const bool parallel = columns.weights.size() * m >= SparseProductMinParallelWork && numColumns > 1;
+
+#pragma omp parallel for schedule(dynamic, 4) if (parallel)
+    for (long b = 0; b < numColumns; b++)
+    {
+        ElemType* out = getOutputColumn(b);
+        const size_t begin = columns.start[b];
+        const size_t end = columns.start[b + 1];
+        if (!transposeA)
+        {
+            // out += alpha * w * lhs(:, k) for each entry (k, w)
+            for (size_t e = begin; e < end; e++)
+            {
+                const ElemType weight = alpha * columns.weights[e];
+                const ElemType* lhsCol = lhsData + columns.lhsIndex[e] * lhsRows;
+                for (size_t i = 0; i < m; i++)
+                    out[i] += weight * lhsCol[i];
+            }
+        }
+        else
+        {
+            // out[i] += alpha * (sum over the entries (k, w) of lhs(k, i) * w), reading column i of lhs
+            for (size_t i = 0; i < m; i++)
+            {
+                const ElemType* lhsCol = lhsData + i * lhsRows;
+                ElemType sum = 0;
+                for (size_t e = begin; e < end; e++)
+                    sum += lhsCol[columns.lhsIndex[e]] * columns.weights[e];
+                out[i] += alpha * sum;
+            }
+        }
+    }
+}
+
 // c = alpha*op(lhs) * op(rhs) + beta*c
 // dense x sparse = dense
 template <class ElemType>
@@ -781,88 +907,19 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
         }
     }
 
-    // TODO: Implement CSR as a transposition of b, like we do for GPU.
-    if (rhs.GetFormat() != matrixFormatSparseCSC)
-        NOT_IMPLEMENTED;
-
     // Do the actual multiplication.
-    ElemType* valueBuffer = rhs.Buffer() + *rhs.SecondaryIndexLocation(); // Points to the value buffer of the current  view (i.e. buffer containing indices of non-zero elements)
-    int* rowIndexBuffer   = rhs.MajorIndexLocation();                     // Points to the index buffer of the current view. (i.e. buffer containing indices of non-zero elements)
-    int iNonzero          = 0;                                            // Number of nonzero elements handled so far for curent slice view.
-    int numPreviosNonzero = rhs.SecondaryIndexLocation()[0];              // Total number of nonzero values handled in previous slices.
-    if (!transposeA && !transposeB)
-    {
-        for (size_t colB = 0; colB < rhs.GetNumCols(); colB++)
-        {
-            size_t end = rhs.SecondaryIndexLocation()[colB + 1] - numPreviosNonzero;
-            for (; iNonzero < end; iNonzero++)
-            {
-                size_t rowB = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType val = valueBuffer[iNonzero];
-
-                for (size_t rowA = 0; rowA < lhs.GetNumRows(); rowA++)
-                {
-                    c(rowA, colB) += alpha * lhs(rowA, rowB) * val;
-                }
-            }
-        }
-    }
-    else if (!transposeA && transposeB)
-    {
-        for (size_t colB = 0; colB < rhs.GetNumCols(); colB++)
-        {
-            size_t end = rhs.SecondaryIndexLocation()[colB + 1] - numPreviosNonzero;
-            for (; iNonzero < end; iNonzero++)
-            {
-                size_t rowB = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType val = valueBuffer[iNonzero];
-
-                for (size_t rowA = 0; rowA < lhs.GetNumRows(); rowA++)
-                {
-                    c(rowA, rowB) += alpha * lhs(rowA, colB) * val;
-                }
-            }
-        }
-    }
-    // the transposeA case is copy-paste from above with rows/cols of lhs swapped
-    else if (transposeA && !transposeB)
-    {
-        for (size_t colB = 0; colB < rhs.GetNumCols(); colB++)
-        {
-            size_t end = rhs.SecondaryIndexLocation()[colB + 1] - numPreviosNonzero;
-            for (; iNonzero < end; iNonzero++)
-            {
-                size_t rowB = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType val = valueBuffer[iNonzero];
-
-                for (size_t colA = 0; colA < lhs.GetNumCols(); colA++)
-                {
-                    c(colA, colB) += alpha * lhs(rowB, colA) * val;
-                }
-            }
-        }
-    }
-    else if (transposeA && transposeB)
+    SparseProductColumns<ElemType> columns;
+    GetSparseProductColumns(rhs, transposeB, columns);
+    ElemType* cData = c.Data();
+    AccumulateSparseProductColumns(alpha, lhs, transposeA, columns, [&](long b)
     {
-        for (size_t colB = 0; colB < rhs.GetNumCols(); colB++)
-        {
-            size_t end = rhs.SecondaryIndexLocation()[colB + 1] - numPreviosNonzero;
-            for (; iNonzero < end; iNonzero++)
-            {
-                size_t rowB = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType val = valueBuffer[iNonzero];
-
-                for (size_t colA = 0; colA < lhs.GetNumCols(); colA++)
-                {
-                    c(colA, rowB) += alpha * lhs(colB, colA) * val;
-                }
-            }
-        }
-    }
+        return cData + columns.outputCols[b] * m;
+    });
 }
 
 // dense x sparse = sparse
 // c = alpha * op(lhs) * op(rhs)
+// The result is in block-column format, with the nonzero columns in ascending order.
 template <class ElemType>
 void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
                                                const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, CPUSparseMatrix<ElemType>& c)
@@ -878,81 +935,32 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
     size_t l = transposeB ? (int) rhs.GetNumCols() : (int) rhs.GetNumRows();
     size_t n = transposeB ? (int) rhs.GetNumRows() : (int) rhs.GetNumCols();
 
-    assert(m > 0 && k > 0 && l > 0 && n > 0);
-    m;
-    n; // converting from size_t to int may cause overflow
+    assert(m > 0 && k > 0 && l > 0 && n > 0); // converting from size_t to int may cause overflow
     assert(k == l);
     if (k != l)
     {
         InvalidArgument("CPUSparseMatrix::MultiplyAndAdd: The inner dimensions of a and b must match.");
     }
 
-    c.Reset();
-
-    if (!transposeA && !transposeB)
-    {
-        NOT_IMPLEMENTED;
-    }
-    else if (!transposeA && transposeB)
-    {
-        if (rhs.GetFormat() != matrixFormatSparseCSC)
-            NOT_IMPLEMENTED;
-
-        // allocate enough memory
-        c.SetFormat(matrixFormatSparseBlockCol);
-        c.RequireSizeAndAllocate(m, n, m * min(n, rhs.NzCount()), true, false);
+    SparseProductColumns<ElemType> columns;
+    GetSparseProductColumns(rhs, transposeB, columns);
+    const size_t numBlocks = columns.outputCols.size();
 
-        map<size_t, size_t> w2Id;
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
-        { // j ranges over batches
-            size_t start = rhs.SecondaryIndexLocation()[j];
-            size_t end = rhs.SecondaryIndexLocation()[j + 1];
-
-            for (size_t p = start; p < end; p++)
-            {
-                size_t i = rhs.MajorIndexLocation()[p]; // i ranges over words
-                ElemType val = rhs.Buffer()[p];  // 1 for(i, j)
+    // allocate enough memory
+    c.Reset();
+    c.SetFormat(matrixFormatSparseBlockCol);
+    c.RequireSizeAndAllocate(m, n, m * numBlocks, true, false);
+    c.SetBlockSize(numBlocks);
+    if (numBlocks == 0)
+        return;
+    memcpy(c.GetBlockIds(), columns.outputCols.data(), sizeof(size_t) * numBlocks);
+    memset(c.Buffer(), 0, sizeof(ElemType) * m * numBlocks);
 
-                bool first = true;
-                if (w2Id.find(i) == w2Id.end())
-                {
-                    size_t id = w2Id.size();
-                    w2Id[i] = id;
-                    c.GetBlockIds()[c.GetBlockSize()] = i;
-                    c.SetBlockSize(c.GetBlockSize() + 1);
-                }
-                else
-                {
-                    first = false;
-                }
-                size_t pos = w2Id[i] * lhs.GetNumRows();
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                { // h range over hidden layer
-                    if (first == true)
-                    {
-                        c.Buffer()[pos] = alpha * lhs(h, j) * val;
-                    }
-                    else
-                    {
-                        c.Buffer()[pos] += alpha * lhs(h, j) * val;
-                    }
-                    pos++;
-                }
-            }
-        }
-        if (c.GetBlockSize() * m > c.GetSizeAllocated())
-        {
-            LogicError("Sparse matrix is unexpectedly out of range.");
-        }
-    }
-    else if (transposeA && !transposeB)
-    {
-        NOT_IMPLEMENTED;
-    }
-    else
+    ElemType* cData = c.Buffer();
+    AccumulateSparseProductColumns(alpha, lhs, transposeA, columns, [&](long b)
     {
-        NOT_IMPLEMENTED;
-    }
+        return cData + b * m;
+    });
 }
 
 // dense += sparse
@@ -1009,6 +1017,42 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
 }
 
+// The log-sum-exp of the columns of z is computed by the dense kernel; the labels then only contribute their nonzero elements.
+template <class ElemType>
+/*static*/ void CPUSparseMatrix<ElemType>::AssignCrossEntropyWithSoftmaxOf(const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& criterion)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+    if (labels.GetNumRows() != z.GetNumRows() || labels.GetNumCols() != z.GetNumCols())
+        InvalidArgument("AssignCrossEntropyWithSoftmaxOf: The dimensions of labels and z must match.");
+
+    criterion.AssignCrossEntropyWithSoftmaxOf(CPUMatrix<ElemType>(), z, logSumExp);
+    double sum = 0;
+    for (size_t j = 0; j < labels.GetNumCols(); j++)
+    {
+        const ElemType lse = logSumExp(0, j);
+        for (size_t p = labels.SecondaryIndexLocation()[j]; p < labels.SecondaryIndexLocation()[j + 1]; p++)
+            sum += labels.Buffer()[p] * (lse - z(labels.GetUnCompIndex()[p], j));
+    }
+    criterion(0, 0) = (ElemType) sum;
+}
+
+template <class ElemType>
+/*static*/ void CPUSparseMatrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z,
+                                                                            const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& c)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+    if (labels.GetNumRows() != z.GetNumRows() || labels.GetNumCols() != z.GetNumCols())
+        InvalidArgument("AddCrossEntropyWithSoftmaxGradient: The dimensions of labels and z must match.");
+
+    CPUMatrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(alpha, CPUMatrix<ElemType>(), z, logSumExp, c);
+    const ElemType a = alpha(0, 0);
+    for (size_t j = 0; j < labels.GetNumCols(); j++)
+        for (size_t p = labels.SecondaryIndexLocation()[j]; p < labels.SecondaryIndexLocation()[j + 1]; p++)
+            c(labels.GetUnCompIndex()[p], j) -= a * labels.Buffer()[p];
+}
+
 template <class ElemType>
 /*static*/ bool CPUSparseMatrix<ElemType>::AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold)
 {
@@ -1137,6 +1181,352 @@ ElemType CPUSparseMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& c, const bool n
         return 1;
 }
 
+// Applies 'missed' zero-gradient steps to one block (column, or row for block-row format) of the parameter and of
+// the optimizer state in closed form. Helper for FusedUpdateWeights() and CatchUpFusedUpdates().
+template <class ElemType>
+static void CatchUpFusedUpdateBlock(const FusedWeightUpdateParams& params, ElemType adaWeight, size_t missed,
+                                    ElemType* val, ElemType* state, size_t n, size_t first, size_t len, size_t elementStride)
+{
+    const ElemType learnRatePerSample = (ElemType) params.learnRatePerSample;
+    const ElemType momentum = (ElemType) params.momentum;
+    const ElemType decay = pow(momentum, (ElemType) missed);
+    // sum_{k=1..missed} momentum^k, i.e. how far the parameter drifts along the smoothed gradient while untouched
+    ElemType drift = momentum == 1 ? (ElemType) missed : momentum * (1 - decay) / (1 - momentum);
+    switch (params.type)
+    {
+    case FusedWeightUpdateType::Momentum:
+    case FusedWeightUpdateType::Nesterov:
+    {
+        drift *= learnRatePerSample * (params.type == FusedWeightUpdateType::Nesterov ? momentum : 1);
+        for (size_t i = 0, k = first; i < len; i++, k += elementStride)
+        {
+            val[k] -= drift * state[k];
+            state[k] *= decay;
+        }
+        break;
+    }
+    case FusedWeightUpdateType::AdaGrad:
+        break; // zero gradients leave the AdaGrad state unchanged
+    case FusedWeightUpdateType::FSAdaGrad:
+    {
+        const ElemType adaDecay = pow(adaWeight, (ElemType) missed);
+        ElemType* smoothAda = state;
+        ElemType* smoothMom = state + n;
+        for (size_t i = 0, k = first; i < len; i++, k += elementStride)
+        {
+            smoothAda[k] *= adaDecay;
+            if (momentum > 0.0f)
+            {
+                val[k] -= learnRatePerSample * drift * smoothMom[k];
+                smoothMom[k] *= decay;
+            }
+        }
+        break;
+    }
+    case FusedWeightUpdateType::RmsProp:
+    {
+        // the variance decays with gamma, and the step size shrinks since the gradient sign is zero
+        const ElemType gammaDecay = pow((ElemType) params.rmsGamma, (ElemType) missed);
+        const ElemType stepDecay = pow((ElemType) params.rmsWeightDec, (ElemType) missed);
+        const ElemType weightMin = (ElemType) params.rmsWeightMin;
+        ElemType* avars = state;
+        ElemType* signs = state + n;
+        ElemType* steps = state + 2 * n;
+        for (size_t i = 0, k = first; i < len; i++, k += elementStride)
+        {
+            avars[k] *= gammaDecay;
+            steps[k] = std::max(steps[k] * stepDecay, weightMin);
+            signs[k] = 0;
+        }
+        break;
+    }
+    default:
+        InvalidArgument("FusedUpdateWeights: Unknown update type %d.", (int) params.type);
+    }
+}
+
+// Sparse counterpart of CPUMatrix::FusedUpdateWeights() for block-sparse gradients (e.g. from LookupTable or Times
+// with a sparse input): only the columns (rows for block-row format) present in the gradient are read and written,
+// in the parameter as well as in the optimizer state 'c', so the cost scales with the number of touched columns.
+// All update types are supported. Untouched columns have a zero gradient; for AdaGrad that leaves everything unchanged,
+// while for momentum, FSAdaGrad and RmsProp the state decays and (momentum) the parameter keeps moving. If
+// params.sparseUpdateHistory is given, these missed steps are applied in closed form when a column is touched again,
+// using the current hyperparameters ("lazy catch-up"). Clipping, L2 and L1 are applied to the touched columns only.
+// As in NormalGrad(), the momentum state of the plain and Nesterov updates does not include the learning rate.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::FusedUpdateWeights(CPUMatrix<ElemType>& c,
+                                                   CPUMatrix<ElemType>& functionValues,
+                                                   const FusedWeightUpdateParams& params,
+                                                   ElemType adaWeight,
+                                                   ElemType adaMul)
+{
+    const bool isBlockCol = GetFormat() == MatrixFormat::matrixFormatSparseBlockCol;
+    if (!isBlockCol && GetFormat() != MatrixFormat::matrixFormatSparseBlockRow)
+        RuntimeError("CPUSparseMatrix::FusedUpdateWeights() only supports block sparse format");
+    if (functionValues.GetNumRows() != GetNumRows() || functionValues.GetNumCols() != GetNumCols())
+        LogicError("FusedUpdateWeights: The gradient dimensions [%d x %d] do not match the parameter dimensions [%d x %d].",
+                   (int) GetNumRows(), (int) GetNumCols(), (int) functionValues.GetNumRows(), (int) functionValues.GetNumCols());
+
+    const size_t numRows = GetNumRows();
+    const size_t numCols = GetNumCols();
+    const size_t n = numRows * numCols;
+    const size_t len = isBlockCol ? numRows : numCols;         // elements per block
+    const size_t numBlockIds = isBlockCol ? numCols : numRows; // number of possible blocks
+    const size_t blockStride = isBlockCol ? numRows : 1;       // offset of a block's first element in dense storage, per block id
+    const size_t elementStride = isBlockCol ? 1 : numRows;     // offset between consecutive elements of a block in dense storage
+
+    // allocate the state in the same layout as the dense update functions
+    size_t numStateParts = 1;
+    if (params.type == FusedWeightUpdateType::FSAdaGrad)
+        numStateParts = 2; // smoothed AdaGrad denominator, smoothed gradient
+    else if (params.type == FusedWeightUpdateType::RmsProp)
+        numStateParts = 3; // variances, signs, steps
+    const bool initialize = c.IsEmpty() || c.GetNumRows() != numRows || c.GetNumCols() != numStateParts * numCols;
+    if (initialize)
+    {
+        c.RequireSize(numRows, numStateParts * numCols);
+        c.SetValue(0.0);
+        if (params.type == FusedWeightUpdateType::RmsProp)
+            c.ColumnSlice(2 * numCols, numCols).SetValue(ElemType(0.02)); // initial step size
+    }
+
+    SparseUpdateHistory* history = params.sparseUpdateHistory;
+    size_t numUpdates = 0;
+    if (history)
+    {
+        if (initialize || history->lastUpdate.size() != numBlockIds || history->isBlockCol != isBlockCol)
+            history->lastUpdate.assign(numBlockIds, history->numUpdates);
+        history->isBlockCol = isBlockCol;
+        numUpdates = ++history->numUpdates;
+    }
+
+    const long numBlocks = (long) GetBlockSize();
+    const size_t* blockIds = GetBlockIds();
+    const size_t blockIdShift = GetBlockIdShift();
+    ElemType* grad = Buffer();
+    ElemType* val = functionValues.Data();
+    ElemType* state = c.Data();
+
+    const ElemType scale = (ElemType) params.gradientScale;
+    const ElemType threshold = (ElemType) params.truncationThreshold;
+    const ElemType l2Weight = (ElemType) params.l2Weight;
+    const ElemType l1Threshold = (ElemType) params.l1Threshold;
+    const bool applyL1 = l1Threshold > 0;
+    const ElemType learnRatePerSample = (ElemType) params.learnRatePerSample;
+    const ElemType momentum = (ElemType) params.momentum;
+    const bool needAveMultiplier = params.needAveMultiplier;
+
+    // applies the updates the block with the given id missed since it was last touched, and marks it as updated
+    auto catchUp = [&](size_t id)
+    {
+        if (!history)
+            return;
+        const size_t missed = numUpdates - 1 - history->lastUpdate[id];
+        history->lastUpdate[id] = numUpdates;
+        if (missed > 0)
+            CatchUpFusedUpdateBlock(params, adaWeight, missed, val, state, n, id * blockStride, len, elementStride);
+    };
+
+    double aveMultiplier = 0;
+    switch (params.type)
+    {
+    case FusedWeightUpdateType::Momentum:
+    case FusedWeightUpdateType::Nesterov:
+    {
+        const bool useNesterovMomentum = params.type == FusedWeightUpdateType::Nesterov;
+#pragma omp parallel for
+        for (long j = 0; j < numBlocks; j++)
+        {
+            const size_t id = blockIds[j] - blockIdShift;
+            catchUp(id);
+            const ElemType* g = grad + j * len;
+            for (size_t i = 0, k = id * blockStride; i < len; i++, k += elementStride)
+            {
+                ElemType w = val[k];
+                const ElemType gi = PreprocessGradientElement(g[i], w, scale, threshold, l2Weight);
+                const ElemType s = momentum * state[k] + (1 - momentum) * gi;
+                state[k] = s;
+                w -= learnRatePerSample * (useNesterovMomentum ? momentum * s + (1 - momentum) * gi : s);
+                val[k] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+            }
+        }
+        break;
+    }
+    case FusedWeightUpdateType::AdaGrad:
+    {
+        const ElemType floor = 1e-16f;
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long j = 0; j < numBlocks; j++)
+        {
+            const size_t id = blockIds[j] - blockIdShift;
+            catchUp(id);
+            ElemType* g = grad + j * len;
+            for (size_t i = 0, k = id * blockStride; i < len; i++, k += elementStride)
+            {
+                ElemType w = val[k];
+                const ElemType gi = PreprocessGradientElement(g[i], w, scale, threshold, l2Weight);
+                const ElemType a = state[k] + gi * gi;
+                state[k] = a;
+                const ElemType denom = sqrt(a + floor);
+                if (needAveMultiplier)
+                {
+                    g[i] = gi / denom;
+                    aveMultiplier += 1 / denom;
+                }
+                else
+                {
+                    w -= learnRatePerSample * gi / denom;
+                    val[k] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+                }
+            }
+        }
+        break;
+    }
+    case FusedWeightUpdateType::FSAdaGrad:
+    {
+        ElemType* smoothAda = state;
+        ElemType* smoothMom = state + n;
+#pragma omp parallel for
+        for (long j = 0; j < numBlocks; j++)
+        {
+            const size_t id = blockIds[j] - blockIdShift;
+            catchUp(id);
+            const ElemType* g = grad + j * len;
+            for (size_t i = 0, k = id * blockStride; i < len; i++, k += elementStride)
+            {
+                ElemType w = val[k];
+                ElemType gi = PreprocessGradientElement(g[i], w, scale, threshold, l2Weight);
+                const ElemType adaSqr = adaWeight * smoothAda[k] + (1.0f - adaWeight) * gi * gi;
+                smoothAda[k] = adaSqr;
+                if (adaSqr != 0.0f)
+                {
+                    ElemType ada = adaMul * ((ElemType) 1.0 / sqrt(adaSqr));
+                    if (ada > 10.0f)
+                        ada = 10.0f;
+                    gi *= ada;
+                }
+
+                if (momentum > 0.0f)
+                {
+                    gi = momentum * smoothMom[k] + (1.0f - momentum) * gi;
+                    smoothMom[k] = gi;
+                }
+
+                w -= learnRatePerSample * gi;
+                val[k] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+            }
+        }
+        break;
+    }
+    case FusedWeightUpdateType::RmsProp:
+    {
+        const ElemType floor = 1e-6f;
+        const ElemType gamma = (ElemType) params.rmsGamma;
+        const ElemType oneMinusGamma = ElemType(1.0) - gamma;
+        const ElemType weightInc = (ElemType) params.rmsWeightInc;
+        const ElemType weightMax = (ElemType) params.rmsWeightMax;
+        const ElemType weightDec = (ElemType) params.rmsWeightDec;
+        const ElemType weightMin = (ElemType) params.rmsWeightMin;
+        ElemType* avars = state;         // accumulated variances for RMS scaling
+        ElemType* signs = state + n;     // sign of previous gradient
+        ElemType* steps = state + 2 * n; // current step size
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long j = 0; j < numBlocks; j++)
+        {
+            const size_t id = blockIds[j] - blockIdShift;
+            catchUp(id);
+            ElemType* g = grad + j * len;
+            for (size_t i = 0, k = id * blockStride; i < len; i++, k += elementStride)
+            {
+                ElemType w = val[k];
+                const ElemType gi = PreprocessGradientElement(g[i], w, scale, threshold, l2Weight);
+                ElemType avar = initialize ? gi * gi : avars[k];
+                ElemType step = steps[k];
+                const ElemType sign = signs[k];
+                avar = gamma * avar + oneMinusGamma * (gi * gi);
+                avars[k] = avar;
+                const int gradSign = (ElemType(0) < gi) - (gi < ElemType(0));
+                if (sign * gradSign > 0)
+                    step = std::min(step * weightInc, weightMax);
+                else
+                    step = std::max(step * weightDec, weightMin);
+                steps[k] = step;
+                signs[k] = (ElemType) gradSign;
+
+                const ElemType a = step / sqrt(avar + floor);
+                if (needAveMultiplier)
+                {
+                    g[i] = gi * a;
+                    aveMultiplier += a;
+                }
+                else
+                {
+                    w -= learnRatePerSample * gi * a;
+                    val[k] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+                }
+            }
+        }
+        break;
+    }
+    default:
+        InvalidArgument("FusedUpdateWeights: Unknown update type %d.", (int) params.type);
+    }
+
+    // AdaGrad and RmsProp with average multiplier: apply the normalized gradient left in the buffer
+    const size_t nz = numBlocks * len;
+    if (needAveMultiplier && nz > 0 && (params.type == FusedWeightUpdateType::AdaGrad || params.type == FusedWeightUpdateType::RmsProp))
+    {
+        const ElemType stepSize = (ElemType) (learnRatePerSample / (aveMultiplier / nz));
+#pragma omp parallel for
+        for (long j = 0; j < numBlocks; j++)
+        {
+            const size_t id = blockIds[j] - blockIdShift;
+            const ElemType* g = grad + j * len;
+            for (size_t i = 0, k = id * blockStride; i < len; i++, k += elementStride)
+            {
+                ElemType w = val[k] - stepSize * g[i];
+                val[k] = applyL1 ? SoftThresholdElement(w, l1Threshold) : w;
+            }
+        }
+    }
+}
+
+// Brings all blocks that were not touched by the last FusedUpdateWeights() call up to date, so that the parameter
+// 'functionValues' equals what dense updates would have produced (up to regularization). Call before the parameter
+// is read outside of training, e.g. before evaluation or saving the model.
+template <class ElemType>
+/*static*/ void CPUSparseMatrix<ElemType>::CatchUpFusedUpdates(CPUMatrix<ElemType>& c,
+                                                             CPUMatrix<ElemType>& functionValues,
+                                                             const FusedWeightUpdateParams& params,
+                                                             ElemType adaWeight)
+{
+    SparseUpdateHistory* history = params.sparseUpdateHistory;
+    if (!history || c.IsEmpty())
+        return;
+
+    const size_t numRows = functionValues.GetNumRows();
+    const size_t numCols = functionValues.GetNumCols();
+    const bool isBlockCol = history->isBlockCol;
+    const long numBlockIds = (long) (isBlockCol ? numCols : numRows);
+    if (history->lastUpdate.size() != (size_t) numBlockIds)
+        LogicError("CatchUpFusedUpdates: The update history does not match the parameter dimensions [%d x %d].", (int) numRows, (int) numCols);
+    const size_t len = isBlockCol ? numRows : numCols;
+    const size_t blockStride = isBlockCol ? numRows : 1;
+    const size_t elementStride = isBlockCol ? 1 : numRows;
+
+    ElemType* val = functionValues.Data();
+    ElemType* state = c.Data();
+    const size_t numUpdates = history->numUpdates;
+#pragma omp parallel for
+    for (long id = 0; id < numBlockIds; id++)
+    {
+        const size_t missed = numUpdates - history->lastUpdate[id];
+        history->lastUpdate[id] = numUpdates;
+        if (missed > 0)
+            CatchUpFusedUpdateBlock(params, adaWeight, missed, val, state, numRows * numCols, id * blockStride, len, elementStride);
+    }
+}
+
 template <class ElemType>
 CPUSparseMatrix<ElemType>& CPUSparseMatrix<ElemType>::InplaceTruncateTop(const ElemType threshold)
 {
@@ -126,6 +126,11 @@ public:
 
     static void ScaleAndAdd(const ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, CPUMatrix<ElemType>& c);
 
+    // fused softmax and cross entropy against sparse (CSC) labels, see CPUMatrix::AssignCrossEntropyWithSoftmaxOf(); only the nonzero labels are visited
+    static void AssignCrossEntropyWithSoftmaxOf(const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& criterion);
+    static void AddCrossEntropyWithSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& z,
+                                                   const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& c);
+
     static bool AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold = 1e-8);
 
     // sum(vec(a).*vec(b))
@@ -204,6 +209,8 @@ public:
 public:
     void NormalGrad(CPUMatrix<ElemType>& c, const ElemType momentum);
     ElemType Adagrad(CPUMatrix<ElemType>& c, const bool needAveMultiplier);
+    void FusedUpdateWeights(CPUMatrix<ElemType>& c, CPUMatrix<ElemType>& functionValues, const FusedWeightUpdateParams& params, ElemType adaWeight, ElemType adaMul);
+    static void CatchUpFusedUpdates(CPUMatrix<ElemType>& c, CPUMatrix<ElemType>& functionValues, const FusedWeightUpdateParams& params, ElemType adaWeight);
 
 public:
     CPUSparseMatrix<ElemType>& InplaceTruncateTop(const ElemType threshold);
@@ -14,9 +14,12 @@
 #endif
 
 #include "Basics.h"
+#include "CPUMemAllocator.h"
 #include <string>
 #include <stdint.h>
 #include <memory>
+#include <limits>
+#include <vector>
 
 #pragma warning( disable: 4251 )
 typedef unsigned char byte;
@@ -202,6 +205,60 @@ enum MatrixFlags
     matrixFlagSetValueOnDevice = 1 << bitPosSetValueOnDevice, // SetValue() call has a buffer that is already on the device
 };
 
+// -----------------------------------------------------------------------
+// FusedWeightUpdateParams -- describes a complete per-parameter SGD step
+// (gradient clipping, L2, optimizer update, L1) so that Matrix::FusedUpdateWeights()
+// can apply it in a single sweep over parameter, gradient and optimizer state.
+// -----------------------------------------------------------------------
+
+enum class FusedWeightUpdateType : int
+{
+    Momentum,  // plain SGD with (optional) momentum, as in NormalGrad()
+    Nesterov,  // NormalGrad() with Nesterov momentum
+    AdaGrad,
+    FSAdaGrad,
+    RmsProp
+};
+
+// Per-column (block-column gradients) or per-row (block-row gradients) bookkeeping for sparse weight updates.
+// Columns not touched by a minibatch are left alone; when they are touched again, the momentum and decay
+// steps they missed are applied in closed form ("lazy catch-up"). This is owned by the caller, one per parameter.
+// Until then the parameter lags behind; Matrix::CatchUpFusedUpdates() brings all columns up to date.
+struct SparseUpdateHistory
+{
+    size_t numUpdates = 0;              // number of updates performed so far
+    std::vector<size_t> lastUpdate;     // value of numUpdates after the last update that touched each column/row
+    bool isBlockCol = true;             // whether lastUpdate is indexed by column (block-column gradients) or by row
+};
+
+struct FusedWeightUpdateParams
+{
+    FusedWeightUpdateType type = FusedWeightUpdateType::Momentum;
+    double learnRatePerSample = 0;
+    double momentum = 0;                     // momentum per minibatch
+    size_t mbSize = 1;                       // actual minibatch size (FSAdaGrad statistics)
+
+    // preprocessing of the raw gradient, applied in this order
+    double gradientScale = 1;                // norm-based clipping: gradient *= gradientScale
+    double truncationThreshold = std::numeric_limits<double>::infinity(); // truncation-based clipping to [-t, t]
+    double l2Weight = 0;                     // gradient += l2Weight * value (already scaled by minibatch size)
+
+    // postprocessing of the updated value
+    double l1Threshold = 0;                  // soft-threshold (proximal L1) applied after the step
+
+    bool needAveMultiplier = false;          // AdaGrad and RmsProp
+
+    // RmsProp
+    double rmsGamma = 0;
+    double rmsWeightInc = 0;
+    double rmsWeightMax = 0;
+    double rmsWeightDec = 0;
+    double rmsWeightMin = 0;
+
+    // sparse gradients only: history for the lazy catch-up of untouched columns; nullptr disables the catch-up
+    SparseUpdateHistory* sparseUpdateHistory = nullptr;
+};
+
 // -----------------------------------------------------------------------
 // BaseMatrixStorage -- base class for all matrix types (CPU, GPU) x (dense, sparse)
 // -----------------------------------------------------------------------
@@ -239,17 +296,17 @@ public:
         {
             if (m_computeDevice < 0)
             {
-                delete[] m_pArray;
+                CPUMemAllocator::Delete(m_pArray);
                 m_pArray = nullptr;
                 m_nzValues = nullptr;
 
-                delete[] m_unCompIndex;
+                CPUMemAllocator::Delete(m_unCompIndex);
                 m_unCompIndex = nullptr;
 
-                delete[] m_compIndex;
+                CPUMemAllocator::Delete(m_compIndex);
                 m_compIndex = nullptr;
 
-                delete[] m_blockIds;
+                CPUMemAllocator::Delete(m_blockIds);
                 m_blockIds = nullptr;
             }
             else
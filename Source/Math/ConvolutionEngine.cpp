@@ -550,7 +550,8 @@ private:
 // This engine supports arbitrary convolution configuration with full
 // sharing and implemented using unroll + GEMM technique 
 // (High performance convolutional neural networks for document processing; Chellapilla, Puri, Simard)
-// Uses reference engine for pooling operations.
+// Pooling uses specialized kernels for the common 2D cases (see below)
+// and the reference engine otherwise.
 //------------------------------------------------------------------
 template <class ElemType>
 class GemmConvolutionEngine : public ReferenceConvolutionEngine<ElemType>
@@ -561,8 +562,9 @@ public:
 
 public:
     GemmConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
-        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind), m_argmaxIn(nullptr), m_argmaxOut(nullptr), m_argmaxCols(0)
     {
+        m_fastPooling = poolKind != PoolKind::None && InitFastPooling();
     }
 
 protected:
@@ -574,6 +576,7 @@ protected:
     using Base::m_deviceId;
     using Base::m_imageLayout;
     using Base::m_maxTempMemSizeInSamples;
+    using Base::m_poolKind;
 
     using Base::m_mpRowCol;
     using Base::m_mpRowIwht;
@@ -839,12 +842,396 @@ protected:
         }
 }
 
+    // Pooling over the first two dimensions of a [W x H x C] (or [W x H]) input with a square 2x2 or 3x3 window
+    // and stride 1 or 2, which covers most image models, has specialized kernels. Each thread pools whole
+    // (sample, channel) planes, row by row, so that the rows of a window stay in cache. The window loops have
+    // constant bounds (and are unrolled) except where the window is clipped at the borders of the plane.
+    // Max pooling saves the index of the maximum of each window, so that the backward pass is a scatter
+    // over the output instead of a search of each window. Ties go to the first maximum in the window, like
+    // in MaxUnpooling(); the reference backward pass instead propagates to all inputs that equal the maximum.
+    void ForwardPoolingCore(const Mat& in, Mat& out) override
+    {
+        if (!m_fastPooling || !IsDense(in) || !IsDense(out))
+        {
+            Base::ForwardPoolingCore(in, out);
+            return;
+        }
+        if (m_poolKind == PoolKind::Max)
+        {
+            m_argmax.resize(out.GetNumElements());
+            MaxPooling(in, out.Data(), m_argmax.data());
+            m_argmaxIn = in.Data();
+            m_argmaxOut = out.Data();
+            m_argmaxCols = in.GetNumCols();
+        }
+        else if (m_poolKind == PoolKind::Average)
+            AveragePooling(in, out);
+        else
+            InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
+    }
+
+    void BackwardPoolingCore(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad) override
+    {
+        if (!m_fastPooling || !IsDense(out) || !IsDense(srcGrad) || !IsDense(in) || !IsDense(grad))
+        {
+            Base::BackwardPoolingCore(out, srcGrad, in, grad);
+            return;
+        }
+        if (m_poolKind == PoolKind::Max)
+        {
+            // The saved indices are only valid for the matrices of the last forward pass
+            // (not e.g. when a loop runs the forward pass over all frames before the backward pass).
+            if (in.Data() != m_argmaxIn || out.Data() != m_argmaxOut || in.GetNumCols() != m_argmaxCols)
+            {
+                std::vector<ElemType> maxValues(out.GetNumElements());
+                m_argmax.resize(out.GetNumElements());
+                MaxPooling(in, maxValues.data(), m_argmax.data());
+                m_argmaxIn = in.Data();
+                m_argmaxOut = out.Data();
+                m_argmaxCols = in.GetNumCols();
+            }
+            ScatterByIndex(srcGrad, m_argmax.data(), grad, /*accumulate=*/true);
+        }
+        else if (m_poolKind == PoolKind::Average)
+            AveragePoolingBackward(srcGrad, grad);
+        else
+            InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
+    }
+
+    void MaxUnpoolingCore(const Mat& out, const Mat& poolIn, Mat& in) override
+    {
+        if (!m_fastPooling || !IsDense(out) || !IsDense(poolIn) || !IsDense(in))
+        {
+            Base::MaxUnpoolingCore(out, poolIn, in);
+            return;
+        }
+        // (the indices of the maxima of poolIn are always recomputed: poolIn need not have gone through ForwardPooling())
+        std::vector<ElemType> maxValues(out.GetNumElements());
+        std::vector<int> argmax(out.GetNumElements());
+        MaxPooling(poolIn, maxValues.data(), argmax.data());
+        in.SetValue(0); // (like Matrix::MaxUnpooling())
+        ScatterByIndex(out, argmax.data(), in, /*accumulate=*/false);
+    }
+
+private:
+    struct PoolingGeometry
+    {
+        int width, height, channels;
+        int outWidth, outHeight;
+        int window, stride;
+        int firstX, firstY; // input coordinates of the first window (negative with padding)
+    };
+
+    // Detect the geometries that the specialized pooling kernels support, and check them against the reference maps.
+    bool InitFastPooling()
+    {
+        const auto& inT = m_geometry->InputShape();
+        const auto& kernT = m_geometry->KernelShape();
+        const auto& outT = m_geometry->OutputShape();
+        size_t dimCount = inT.GetRank();
+        if (dimCount != 2 && dimCount != 3)
+            return false;
+        for (size_t i = 0; i < dimCount; i++)
+        {
+            if (m_geometry->GetMapCount(i) != 1)
+                return false;
+        }
+        size_t window = kernT[0];
+        size_t stride = m_geometry->GetStride(0);
+        if ((window != 2 && window != 3) || kernT[1] != window || (stride != 1 && stride != 2) || m_geometry->GetStride(1) != stride)
+            return false;
+        if (dimCount == 3 && (kernT[2] != 1 || m_geometry->GetStride(2) != 1 || outT[2] != inT[2]))
+            return false;
+        // With padding, a window may then be clipped on one side only, like in the reference maps.
+        if (inT[0] < window || inT[1] < window)
+            return false;
+
+        auto& p = m_pooling;
+        p.width = (int)inT[0];
+        p.height = (int)inT[1];
+        p.channels = dimCount == 3 ? (int)inT[2] : 1;
+        p.outWidth = (int)outT[0];
+        p.outHeight = (int)outT[1];
+        p.window = (int)window;
+        p.stride = (int)stride;
+
+        // MpRowCol maps an output cell to the input cell under the kernel origin, which is (window - 1) / 2 into the window.
+        const auto& mpRowCol = m_geometry->MpRowCol();
+        int origin = (p.window - 1) / 2;
+        p.firstX = mpRowCol[0] % p.width - origin;
+        p.firstY = mpRowCol[0] / p.width % p.height - origin;
+        size_t row = 0;
+        for (int c = 0; c < p.channels; c++)
+        {
+            for (int oy = 0; oy < p.outHeight; oy++)
+            {
+                for (int ox = 0; ox < p.outWidth; ox++)
+                {
+                    if (mpRowCol[row++] != (c * p.height + oy * p.stride + p.firstY + origin) * p.width + ox * p.stride + p.firstX + origin)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool IsDense(const Mat& m)
+    {
+        return m.GetMatrixType() == MatrixType::DENSE;
+    }
+
+    // range [begin, end) of the outputs along a dimension whose window lies inside the input
+    static void GetInteriorRange(int first, int size, int outSize, int window, int stride, int& begin, int& end)
+    {
+        begin = first >= 0 ? 0 : (-first + stride - 1) / stride;
+        end = size - window - first >= 0 ? (size - window - first) / stride + 1 : 0;
+        end = std::max(begin, std::min(end, outSize));
+        begin = std::min(begin, end);
+    }
+
+    // maximum of the window [y0, y1) x [x0, x1) of a plane, and its index in the plane (the first one for ties)
+    static void MaxOfWindow(const ElemType* plane, int width, int y0, int y1, int x0, int x1, ElemType& value, int& index)
+    {
+        ElemType maxValue = -std::numeric_limits<ElemType>::infinity();
+        int maxIndex = y0 * width + x0;
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                // (without branches, which mispredict on real data)
+                const ElemType v = plane[y * width + x];
+                const int greater = -(int)(v > maxValue); // all ones or zero
+                maxIndex = ((y * width + x) & greater) | (maxIndex & ~greater);
+                maxValue = std::max(maxValue, v);
+            }
+        }
+        value = maxValue;
+        index = maxIndex;
+    }
+
+    static ElemType SumOfWindow(const ElemType* plane, int width, int y0, int y1, int x0, int x1)
+    {
+        ElemType sum = 0;
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+                sum += plane[y * width + x];
+        }
+        return sum;
+    }
+
+    // In the interior of a plane, the loops over the window are outside the loop over the outputs of a row,
+    // so that the latter is vectorized.
+    template <int Window, int Stride>
+    static void MaxPoolingPlane(const PoolingGeometry& p, const ElemType* plane, ElemType* maxValues, int* argmax, int planeOffset)
+    {
+        int oxBegin, oxEnd;
+        GetInteriorRange(p.firstX, p.width, p.outWidth, Window, Stride, oxBegin, oxEnd);
+        for (int oy = 0; oy < p.outHeight; oy++, maxValues += p.outWidth, argmax += p.outWidth)
+        {
+            const int y = oy * Stride + p.firstY;
+            const int y0 = std::max(y, 0);
+            const int y1 = std::min(y + Window, p.height);
+            const bool interiorRow = y1 - y0 == Window;
+            for (int ox = 0; ox < p.outWidth; ox++)
+            {
+                if (interiorRow && ox == oxBegin) // (skip the interior)
+                    ox = oxEnd;
+                if (ox == p.outWidth)
+                    break;
+                const int x = ox * Stride + p.firstX;
+                MaxOfWindow(plane, p.width, y0, y1, std::max(x, 0), std::min(x + Window, p.width), maxValues[ox], argmax[ox]);
+            }
+            if (interiorRow)
+            {
+                for (int ox = oxBegin; ox < oxEnd; ox++)
+                {
+                    maxValues[ox] = -std::numeric_limits<ElemType>::infinity();
+                    argmax[ox] = y * p.width + ox * Stride + p.firstX;
+                }
+                for (int dy = 0; dy < Window; dy++)
+                {
+                    for (int dx = 0; dx < Window; dx++)
+                    {
+                        const int offset = (y + dy) * p.width + p.firstX + dx;
+                        const ElemType* src = plane + offset;
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                        {
+                            const ElemType v = src[ox * Stride];
+                            const int greater = -(int)(v > maxValues[ox]); // all ones or zero
+                            argmax[ox] = ((offset + ox * Stride) & greater) | (argmax[ox] & ~greater);
+                            maxValues[ox] = std::max(maxValues[ox], v);
+                        }
+                    }
+                }
+            }
+            for (int ox = 0; ox < p.outWidth; ox++)
+                argmax[ox] += planeOffset;
+        }
+    }
+
+    template <int Window, int Stride>
+    static void AveragePoolingPlane(const PoolingGeometry& p, const ElemType* plane, ElemType* out)
+    {
+        int oxBegin, oxEnd;
+        GetInteriorRange(p.firstX, p.width, p.outWidth, Window, Stride, oxBegin, oxEnd);
+        for (int oy = 0; oy < p.outHeight; oy++, out += p.outWidth)
+        {
+            const int y = oy * Stride + p.firstY;
+            const int y0 = std::max(y, 0);
+            const int y1 = std::min(y + Window, p.height);
+            const bool interiorRow = y1 - y0 == Window;
+            // Note that we divide by the number of input cells in the window (padding is not counted), like the reference engine.
+            for (int ox = 0; ox < p.outWidth; ox++)
+            {
+                if (interiorRow && ox == oxBegin) // (skip the interior)
+                    ox = oxEnd;
+                if (ox == p.outWidth)
+                    break;
+                const int x0 = std::max(ox * Stride + p.firstX, 0);
+                const int x1 = std::min(ox * Stride + p.firstX + Window, p.width);
+                out[ox] = SumOfWindow(plane, p.width, y0, y1, x0, x1) / ((y1 - y0) * (x1 - x0));
+            }
+            if (interiorRow)
+            {
+                for (int ox = oxBegin; ox < oxEnd; ox++)
+                    out[ox] = 0;
+                for (int dy = 0; dy < Window; dy++)
+                {
+                    for (int dx = 0; dx < Window; dx++)
+                    {
+                        const ElemType* src = plane + (y + dy) * p.width + p.firstX + dx;
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                            out[ox] += src[ox * Stride];
+                    }
+                }
+                for (int ox = oxBegin; ox < oxEnd; ox++)
+                    out[ox] /= Window * Window;
+            }
+        }
+    }
+
+    // max pooling of each (sample, channel) plane; argmax gets the index of the maximum in the input column
+    void MaxPooling(const Mat& in, ElemType* maxValues, int* argmax) const
+    {
+        const auto& p = m_pooling;
+        const size_t inRows = in.GetNumRows();
+        const int inPlaneSize = p.width * p.height;
+        const int outPlaneSize = p.outWidth * p.outHeight;
+        const ElemType* pin = in.Data();
+        const auto poolPlane = p.window == 2 ? (p.stride == 1 ? &MaxPoolingPlane<2, 1> : &MaxPoolingPlane<2, 2>)
+                                             : (p.stride == 1 ? &MaxPoolingPlane<3, 1> : &MaxPoolingPlane<3, 2>);
+        const int64_t planeCount = (int64_t)in.GetNumCols() * p.channels;
+#pragma omp parallel for
+        for (int64_t i = 0; i < planeCount; i++)
+        {
+            const int64_t sample = i / p.channels;
+            const int c = (int)(i % p.channels);
+            poolPlane(p, pin + sample * inRows + c * inPlaneSize, maxValues + i * outPlaneSize, argmax + i * outPlaneSize, c * inPlaneSize);
+        }
+    }
+
+    void AveragePooling(const Mat& in, Mat& out) const
+    {
+        const auto& p = m_pooling;
+        const size_t inRows = in.GetNumRows();
+        const int inPlaneSize = p.width * p.height;
+        const int outPlaneSize = p.outWidth * p.outHeight;
+        const ElemType* pin = in.Data();
+        ElemType* pout = out.Data();
+        const auto poolPlane = p.window == 2 ? (p.stride == 1 ? &AveragePoolingPlane<2, 1> : &AveragePoolingPlane<2, 2>)
+                                             : (p.stride == 1 ? &AveragePoolingPlane<3, 1> : &AveragePoolingPlane<3, 2>);
+        const int64_t planeCount = (int64_t)in.GetNumCols() * p.channels;
+#pragma omp parallel for
+        for (int64_t i = 0; i < planeCount; i++)
+        {
+            poolPlane(p, pin + (i / p.channels) * inRows + (i % p.channels) * inPlaneSize, pout + i * outPlaneSize);
+        }
+    }
+
+    void AveragePoolingBackward(const Mat& srcGrad, Mat& grad) const
+    {
+        const auto& p = m_pooling;
+        const size_t gradRows = grad.GetNumRows();
+        const int inPlaneSize = p.width * p.height;
+        const int outPlaneSize = p.outWidth * p.outHeight;
+        const ElemType* psrcGrad = srcGrad.Data();
+        ElemType* pgrad = grad.Data();
+        const int64_t planeCount = (int64_t)srcGrad.GetNumCols() * p.channels;
+        // (windows do not cross planes, so the planes can be processed in parallel)
+#pragma omp parallel for
+        for (int64_t i = 0; i < planeCount; i++)
+        {
+            ElemType* plane = pgrad + (i / p.channels) * gradRows + (i % p.channels) * inPlaneSize;
+            const ElemType* g = psrcGrad + i * outPlaneSize;
+            for (int oy = 0; oy < p.outHeight; oy++)
+            {
+                const int y = oy * p.stride + p.firstY;
+                const int y0 = std::max(y, 0);
+                const int y1 = std::min(y + p.window, p.height);
+                for (int ox = 0; ox < p.outWidth; ox++, g++)
+                {
+                    const int x = ox * p.stride + p.firstX;
+                    const int x0 = std::max(x, 0);
+                    const int x1 = std::min(x + p.window, p.width);
+                    const ElemType v = *g / ((y1 - y0) * (x1 - x0));
+                    for (int yy = y0; yy < y1; yy++)
+                    {
+                        for (int xx = x0; xx < x1; xx++)
+                            plane[yy * p.width + xx] += v;
+                    }
+                }
+            }
+        }
+    }
+
+    // dst(index[row, sample], sample) (+)= src(row, sample), for the indices of the maxima from MaxPooling()
+    void ScatterByIndex(const Mat& src, const int* index, Mat& dst, bool accumulate) const
+    {
+        const auto& p = m_pooling;
+        const size_t srcRows = src.GetNumRows();
+        const size_t dstRows = dst.GetNumRows();
+        const int outPlaneSize = p.outWidth * p.outHeight;
+        const ElemType* psrc = src.Data();
+        ElemType* pdst = dst.Data();
+        const int64_t planeCount = (int64_t)src.GetNumCols() * p.channels;
+        // (the indices of a plane point into the same plane of the input, so the planes can be processed in parallel)
+#pragma omp parallel for
+        for (int64_t i = 0; i < planeCount; i++)
+        {
+            const int64_t sample = i / p.channels;
+            const size_t first = (size_t)(i % p.channels) * outPlaneSize;
+            const ElemType* s = psrc + sample * srcRows + first;
+            const int* idx = index + sample * srcRows + first;
+            ElemType* d = pdst + sample * dstRows;
+            if (accumulate)
+            {
+                for (int k = 0; k < outPlaneSize; k++)
+                    d[idx[k]] += s[k];
+            }
+            else
+            {
+                for (int k = 0; k < outPlaneSize; k++)
+                    d[idx[k]] = s[k];
+            }
+        }
+    }
+
 public:
     static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
     {
         return deviceId < 0 &&
                find(begin(geometry->Sharing()), end(geometry->Sharing()), false) == end(geometry->Sharing());
     }
+
+private:
+    bool m_fastPooling;
+    PoolingGeometry m_pooling;
+    // indices of the maxima from the last max pooling forward pass, and the matrices they are for
+    std::vector<int> m_argmax;
+    const ElemType* m_argmaxIn;
+    const ElemType* m_argmaxOut;
+    size_t m_argmaxCols;
 };
 
 template <class ElemType>
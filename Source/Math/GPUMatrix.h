@@ -6,6 +6,7 @@
 #pragma once
 #include "Platform.h"
 #include "File.h"
+#include "Half.h"
 #include "Helpers.h"
 #include "CommonMatrix.h"
 #include "TensorShape.h" // only for SmallVector; I was hoping to keep this out
@@ -557,17 +558,13 @@ public:
     friend File& operator>>(File& stream, GPUMatrix<ElemType>& us)
     {
         stream.GetMarker(fileMarkerBeginSection, std::wstring(L"BMAT"));
-        size_t elsize;
-        stream >> elsize;
-        if (sizeof(ElemType) != elsize)
-            LogicError("Template argument size doesn't match those in file");
+        const FileElementType elementType = GetFileElementType<ElemType>(stream); // (16-bit elements are converted)
         std::wstring matrixNameDummy; // Note this is not used anymore, just a dummy for compatability.
         size_t numRows, numCols;
         int format;
         stream >> matrixNameDummy >> format >> numRows >> numCols;
         ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        GetFileElements(stream, elementType, d_array, numRows * numCols);
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         us.SetValue(numRows, numCols, us.GetComputeDeviceId(), d_array, matrixFlagNormal | format);
         delete[] d_array;
@@ -576,7 +573,7 @@ public:
     friend File& operator<<(File& stream, const GPUMatrix<ElemType>& us)
     {
         stream.PutMarker(fileMarkerBeginSection, std::wstring(L"BMAT"));
-        stream << sizeof(ElemType);
+        const FileElementType elementType = PutFileElementType<ElemType>(stream); // (16-bit if the file was opened with fileOptionsFloat16 or fileOptionsBFloat16)
 
         // TODO: This is now ignored on input, so we can should change to an empty string. This might break parsing, and must be tested first
         std::wstring s = std::wstring(L"unnamed");
@@ -585,8 +582,7 @@ public:
 
         stream << us.m_numRows << us.m_numCols;
         ElemType* pArray = us.CopyToArray();
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << pArray[i];
+        PutFileElements(stream, elementType, pArray, us.GetNumElements());
         
         delete[] pArray;
 
@@ -0,0 +1,259 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Half.h -- 16-bit floating-point storage (IEEE half precision and bfloat16) for matrices and model files
+//
+// Elements are stored as uint16_t and converted to float (or double) for computation, so that 16-bit
+// storage halves the memory traffic and the model size while all arithmetic stays in full precision.
+//
+#pragma once
+
+#include "Basics.h"
+#include "File.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)) // (all processors with AVX2 have F16C)
+#include <immintrin.h>
+#define CNTK_USE_F16C
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class Float16Format : int
+{
+    Half = 0,     // IEEE 754 binary16: 5 exponent bits, 10 mantissa bits; range +-65504
+    BFloat16 = 1, // upper half of a float: 8 exponent bits, 7 mantissa bits; range of float
+};
+
+// -----------------------------------------------------------------------
+// scalar conversions (round to nearest even; infinities and NaNs are preserved)
+// -----------------------------------------------------------------------
+
+inline float HalfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) // infinity or NaN
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0) // normal
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if (mantissa == 0) // zero
+        bits = sign;
+    else // subnormal: normalize
+    {
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t FloatToHalf(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    const uint16_t sign = (uint16_t) ((u >> 16) & 0x8000);
+    u &= 0x7fffffff;
+    if (u >= 0x7f800000) // infinity or NaN (NaNs stay quiet NaNs)
+        return sign | 0x7c00 | (u > 0x7f800000 ? 0x200 : 0);
+    if (u >= 0x477ff000) // rounds to 65520 or more: overflow
+        return sign | 0x7c00;
+    if (u >= 0x38800000) // normal: rebias the exponent and round the mantissa (a carry correctly increments the exponent)
+    {
+        u -= (127 - 15) << 23;
+        return sign | (uint16_t) ((u + 0xfff + ((u >> 13) & 1)) >> 13);
+    }
+    if (u < 0x33000000) // less than or equal to half the smallest subnormal: rounds to zero
+        return sign;
+    // subnormal: value = mantissa * 2^(exponent - 150), in units of 2^-24
+    const uint32_t exponent = u >> 23;
+    const uint32_t mantissa = (u & 0x7fffff) | 0x800000;
+    const uint32_t shift = 126 - exponent; // 14..24
+    uint32_t h = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (h & 1)))
+        h++; // (may round up to the smallest normal, which has the right encoding)
+    return sign | (uint16_t) h;
+}
+
+inline float BFloat16ToFloat(uint16_t b)
+{
+    const uint32_t bits = (uint32_t) b << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t FloatToBFloat16(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffff) > 0x7f800000) // NaN: truncating could turn it into infinity
+        return (uint16_t) ((u >> 16) | 0x40);
+    return (uint16_t) ((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+}
+
+// -----------------------------------------------------------------------
+// bulk conversions, used for converting blocks of 16-bit matrices and for model I/O
+// With F16C, IEEE half is converted 8 elements at a time.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+inline void ConvertFromFloat16(const uint16_t* src, ElemType* dst, size_t n, Float16Format format)
+{
+    size_t i = 0;
+    if (format == Float16Format::BFloat16)
+    {
+        for (; i < n; i++)
+            dst[i] = (ElemType) BFloat16ToFloat(src[i]);
+        return;
+    }
+#ifdef CNTK_USE_F16C
+    if (sizeof(ElemType) == sizeof(float))
+    {
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps((float*) dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (src + i))));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (ElemType) HalfToFloat(src[i]);
+}
+
+template <class ElemType>
+inline void ConvertToFloat16(const ElemType* src, uint16_t* dst, size_t n, Float16Format format)
+{
+    size_t i = 0;
+    if (format == Float16Format::BFloat16)
+    {
+        for (; i < n; i++)
+            dst[i] = FloatToBFloat16((float) src[i]);
+        return;
+    }
+#ifdef CNTK_USE_F16C
+    if (sizeof(ElemType) == sizeof(float))
+    {
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i*) (dst + i), _mm256_cvtps_ph(_mm256_loadu_ps((const float*) src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = FloatToHalf((float) src[i]);
+}
+
+// -----------------------------------------------------------------------
+// elements of dense matrices in files
+// A matrix section in a file starts with the element size. For files opened with fileOptionsFloat16
+// or fileOptionsBFloat16 (binary only), the elements are written with 2 bytes each, and the size is
+// followed by the Float16Format. When reading, 16-bit elements are converted to ElemType.
+// -----------------------------------------------------------------------
+
+struct FileElementType
+{
+    size_t size;          // sizeof(ElemType), or 2 for 16-bit elements
+    Float16Format format; // (16-bit elements only)
+};
+
+template <class ElemType>
+inline FileElementType PutFileElementType(File& stream)
+{
+    const int options = stream.GetOptions();
+    FileElementType type = { sizeof(ElemType), Float16Format::Half };
+    if (!stream.IsTextBased() && (options & (fileOptionsFloat16 | fileOptionsBFloat16)))
+    {
+        type.size = sizeof(uint16_t);
+        type.format = (options & fileOptionsBFloat16) ? Float16Format::BFloat16 : Float16Format::Half;
+    }
+    stream << type.size;
+    if (type.size == sizeof(uint16_t))
+        stream << (int) type.format;
+    return type;
+}
+
+template <class ElemType>
+inline FileElementType GetFileElementType(File& stream)
+{
+    FileElementType type = { 0, Float16Format::Half };
+    stream >> type.size;
+    if (type.size == sizeof(uint16_t))
+    {
+        int format;
+        stream >> format;
+        if (format != (int) Float16Format::Half && format != (int) Float16Format::BFloat16)
+            RuntimeError("Unknown 16-bit element format %d in file.", format);
+        type.format = (Float16Format) format;
+    }
+    else if (type.size != sizeof(ElemType))
+        RuntimeError("Template argument size doesn't match those in file");
+    return type;
+}
+
+template <class ElemType>
+inline void PutFileElements(File& stream, const FileElementType& type, const ElemType* data, size_t n)
+{
+    if (type.size != sizeof(uint16_t))
+    {
+        for (size_t i = 0; i < n; ++i)
+            stream << data[i];
+        return;
+    }
+    uint16_t buffer[4096];
+    for (size_t begin = 0; begin < n; begin += _countof(buffer))
+    {
+        const size_t count = std::min(n - begin, _countof(buffer));
+        ConvertToFloat16(data + begin, buffer, count, type.format);
+        for (size_t i = 0; i < count; ++i)
+            stream << buffer[i];
+    }
+}
+
+template <class ElemType>
+inline void GetFileElements(File& stream, const FileElementType& type, ElemType* data, size_t n)
+{
+    if (type.size != sizeof(uint16_t))
+    {
+        for (size_t i = 0; i < n; ++i)
+            stream >> data[i];
+        return;
+    }
+    uint16_t buffer[4096];
+    for (size_t begin = 0; begin < n; begin += _countof(buffer))
+    {
+        const size_t count = std::min(n - begin, _countof(buffer));
+        for (size_t i = 0; i < count; ++i)
+            stream >> buffer[i];
+        ConvertFromFloat16(buffer, data + begin, count, type.format);
+    }
+}
+
+// -----------------------------------------------------------------------
+// 16-bit element types in configs, e.g. saveModelElementType="bfloat16"
+// -----------------------------------------------------------------------
+
+// "float16" (IEEE half) or "bfloat16"
+inline Float16Format Float16FormatFromName(const std::wstring& name)
+{
+    if (EqualCI(name, L"float16"))
+        return Float16Format::Half;
+    else if (EqualCI(name, L"bfloat16"))
+        return Float16Format::BFloat16;
+    InvalidArgument("Unknown 16-bit element type '%ls'; valid values are 'float16' and 'bfloat16'.", name.c_str());
+}
+
+// option for files whose dense matrices are written with 16-bit elements of the given format (combine with fileOptionsBinary)
+inline FileOptions Float16FileOption(Float16Format format)
+{
+    return format == Float16Format::BFloat16 ? fileOptionsBFloat16 : fileOptionsFloat16;
+}
+
+}}}
@@ -8,14 +8,18 @@
 #include "Basics.h"
 #include "Matrix.h"
 #include "CPUMatrix.h"
+#include "CPUHalfMatrix.h"
+#include "CPUPackedMatrix.h"
 #include "CPUSparseMatrix.h"
 #include "GPUMatrix.h"
 #include "GPUSparseMatrix.h"
+#include "MatrixExpression.h"
 #include "File.h"
 #include <assert.h>
 #include <math.h>
 #include "GPUWatcher.h" // bring in this class as well so that it gets exported from this DLL
 #include <memory>
+#include <mutex>
 #ifndef CPUONLY
 #pragma comment(lib, "MathCUDA.lib") // built by CNTKMathCUDA project
 #endif
@@ -1466,9 +1470,8 @@ void Matrix<ElemType>::NormalGrad(Matrix<ElemType>& gradients,
         DISPATCH_MATRIX_ON_FLAG(&gradients, nullptr,
             { /* CPU dense */
                 ScaleAndAdd((1 - momentum) * learnRatePerSample, gradients, momentum, *this);
-                ScaleAndAdd(-momentum, *this, functionValues);
-                ScaleAndAdd(-(1 - momentum) * learnRatePerSample, gradients, functionValues);
-                // w_t = w_{t-1} - momentum * v_ {t-1} - (1-momentum)*learnRatePerSampele*gardient,
+                // w_t = w_{t-1} - momentum * v_ {t-1} - (1-momentum)*learnRatePerSampele*gardient, in one pass
+                AssignExpression(functionValues, Expr(functionValues) - momentum * Expr(*this) - (1 - momentum) * learnRatePerSample * Expr(gradients));
             },
             { /* GPU dense */
                 ScaleAndAdd((1 - momentum) * learnRatePerSample, gradients, momentum, *this);
@@ -1513,17 +1516,34 @@ ElemType Matrix<ElemType>::Adagrad(Matrix<ElemType>& gradients, const bool needA
 }
 
 template <class ElemType>
-void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum)
+static ElemType FSAdagradKeepWeight(size_t mbSize)
+{
+    const size_t adagradT = 2 * 3600 * 100;
+    return static_cast<ElemType>(exp(-1.0 * mbSize / adagradT));
+}
+
+// update the (global) FSAdaGrad frame statistics and return the resulting keep weight and multiplier
+// This is shared by FSAdagrad() and FusedUpdateWeights(). Hogwild workers update it concurrently, hence the lock.
+template <class ElemType>
+static void UpdateFSAdagradStatistics(size_t mbSize, ElemType& adagradkeepweight, ElemType& targetadagradavdenom_x_sqrtadagradsqrframes)
 {
     // TODO: The values of 'adagradT' and 'targetadagradavdenom' are currently hardcoded constants taken from DBN (empirically determined).
     // These should be made configurable if needed
-    const size_t adagradT = 2 * 3600 * 100;
     const ElemType targetadagradavdenom = 0.0025; // 1/400 magic constant
-    const ElemType adagradkeepweight = static_cast<ElemType>(exp(-1.0 * mbSize / adagradT));
+    adagradkeepweight = FSAdagradKeepWeight<ElemType>(mbSize);
 
     static ElemType aggadagradsqrframes = 0;
+    static std::mutex aggadagradsqrframesMutex;
+    std::lock_guard<std::mutex> lock(aggadagradsqrframesMutex);
     aggadagradsqrframes = adagradkeepweight * aggadagradsqrframes + (1.0f - adagradkeepweight) * mbSize;
-    const ElemType targetadagradavdenom_x_sqrtadagradsqrframes = static_cast<ElemType>(targetadagradavdenom * sqrt(aggadagradsqrframes));
+    targetadagradavdenom_x_sqrtadagradsqrframes = static_cast<ElemType>(targetadagradavdenom * sqrt(aggadagradsqrframes));
+}
+
+template <class ElemType>
+void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum)
+{
+    ElemType adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes;
+    UpdateFSAdagradStatistics(mbSize, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
 
     DISPATCH_MATRIX_ON_FLAG(&gradients, &gradients,
         { m_CPUMatrix->FSAdagrad(*gradients.m_CPUMatrix, *functionValues.m_CPUMatrix, learnRatePerSample, momentum, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes); SetDataLocation(CPU); },
@@ -1552,6 +1572,54 @@ ElemType Matrix<ElemType>::RmsProp(Matrix<ElemType>& gradients,
     // Note: Since both 'this' and gradients are changed, we must call SetDataLocation() on 'this' as well.
 }
 
+// Applies a complete weight update (clipping, L2, optimizer step, L1 as described by 'params') in a single sweep.
+// 'this' is the smoothed gradient. Only CPU matrices with dense or block-sparse gradients are supported; callers check
+// IsFusedWeightUpdateSupported() and otherwise fall back to the individual steps (NormalGrad(), Adagrad(), etc.).
+template <class ElemType>
+void Matrix<ElemType>::FusedUpdateWeights(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const FusedWeightUpdateParams& params)
+{
+    DecideAndMoveToRightDevice(*this, gradients, functionValues);
+
+    ElemType adaWeight = 0, adaMul = 0;
+    if (params.type == FusedWeightUpdateType::FSAdaGrad)
+        UpdateFSAdagradStatistics(params.mbSize, adaWeight, adaMul);
+
+    DISPATCH_MATRIX_ON_FLAG(&gradients, &gradients,
+        { m_CPUMatrix->FusedUpdateWeights(*gradients.m_CPUMatrix, *functionValues.m_CPUMatrix, params, adaWeight, adaMul); SetDataLocation(CPU); functionValues.SetDataLocation(CPU); },
+        { NOT_IMPLEMENTED; },
+        { gradients.m_CPUSparseMatrix->FusedUpdateWeights(*m_CPUMatrix, *functionValues.m_CPUMatrix, params, adaWeight, adaMul); SetDataLocation(CPU); functionValues.SetDataLocation(CPU); },
+        { NOT_IMPLEMENTED; });
+}
+
+// Applies the updates that columns of a sparse-updated parameter missed since they were last touched (see
+// SparseUpdateHistory). 'this' is the smoothed gradient; 'params' must carry the history used by FusedUpdateWeights().
+template <class ElemType>
+void Matrix<ElemType>::CatchUpFusedUpdates(Matrix<ElemType>& functionValues, const FusedWeightUpdateParams& params)
+{
+    if (!params.sparseUpdateHistory || params.sparseUpdateHistory->numUpdates == 0 || IsEmpty())
+        return;
+
+    ElemType adaWeight = 0;
+    if (params.type == FusedWeightUpdateType::FSAdaGrad)
+        adaWeight = FSAdagradKeepWeight<ElemType>(params.mbSize);
+
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { CPUSparseMatrix<ElemType>::CatchUpFusedUpdates(*m_CPUMatrix, *functionValues.m_CPUMatrix, params, adaWeight); SetDataLocation(CPU); functionValues.SetDataLocation(CPU); },
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; });
+}
+
+template <class ElemType>
+/*static*/ bool Matrix<ElemType>::IsFusedWeightUpdateSupported(const Matrix<ElemType>& gradients, const Matrix<ElemType>& functionValues)
+{
+    if (gradients.GetDeviceId() != CPUDEVICE || functionValues.GetDeviceId() != CPUDEVICE || functionValues.GetMatrixType() != MatrixType::DENSE)
+        return false;
+    if (gradients.GetMatrixType() == MatrixType::DENSE)
+        return true;
+    return gradients.GetFormat() == matrixFormatSparseBlockCol || gradients.GetFormat() == matrixFormatSparseBlockRow;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -2560,6 +2628,53 @@ Matrix<ElemType>& Matrix<ElemType>::AssignLogSoftmaxOf(const Matrix<ElemType>& a
     return *this;
 }
 
+// fused softmax and cross entropy (column-wise)
+// The criterion is computed in one pass over z, against dense or sparse labels, without writing the softmax.
+// CPU only; on the GPU, CrossEntropyWithSoftmaxNode composes it from the existing kernels, with its pooled softmax buffers.
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignCrossEntropyWithSoftmaxOf(const Matrix<ElemType>& labels, const Matrix<ElemType>& z, Matrix<ElemType>& logSumExp)
+{
+    if (labels.IsEmpty() || z.IsEmpty())
+        LogicError("AssignCrossEntropyWithSoftmaxOf: one of the input matrices is empty.");
+    if (z.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(z, labels, *this);
+    logSumExp._transferToDevice(z.GetDeviceId());
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    logSumExp.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    if (GetDeviceId() >= 0)
+        NOT_IMPLEMENTED;
+
+    if (labels.GetMatrixType() == SPARSE)
+        CPUSparseMatrix<ElemType>::AssignCrossEntropyWithSoftmaxOf(*labels.m_CPUSparseMatrix, *z.m_CPUMatrix, *logSumExp.m_CPUMatrix, *m_CPUMatrix);
+    else
+        m_CPUMatrix->AssignCrossEntropyWithSoftmaxOf(*labels.m_CPUMatrix, *z.m_CPUMatrix, *logSumExp.m_CPUMatrix);
+
+    return *this;
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& z,
+                                                          const Matrix<ElemType>& logSumExp, Matrix<ElemType>& c)
+{
+    if (z.GetMatrixType() != DENSE || c.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(c, z, labels);
+    alpha._transferToDevice(c.GetDeviceId());
+    logSumExp._transferToDevice(c.GetDeviceId());
+
+    if (c.GetDeviceId() >= 0)
+        NOT_IMPLEMENTED;
+
+    if (labels.GetMatrixType() == SPARSE)
+        CPUSparseMatrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(*alpha.m_CPUMatrix, *labels.m_CPUSparseMatrix, *z.m_CPUMatrix, *logSumExp.m_CPUMatrix, *c.m_CPUMatrix);
+    else
+        CPUMatrix<ElemType>::AddCrossEntropyWithSoftmaxGradient(*alpha.m_CPUMatrix, *labels.m_CPUMatrix, *z.m_CPUMatrix, *logSumExp.m_CPUMatrix, *c.m_CPUMatrix);
+}
+
 //[this]=softmax([this]) element wise
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::InplaceHardmax(const bool isColWise)
@@ -4460,6 +4575,32 @@ void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemT
     }
 }
 
+/// <summary>Matrix-matrix multiply with a 16-bit matrix a, e.g. frozen weights: c = alpha * op(a) * op(b) + beta*c</summary>
+/// This is only implemented for dense CPU matrices.
+template <class ElemType>
+void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUHalfMatrix& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB,
+                                              ElemType beta, Matrix<ElemType>& c)
+{
+    if (c.GetDeviceId() >= 0 || b.GetDeviceId() >= 0 || b.GetMatrixType() != DENSE || c.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, a, transposeA, *b.m_CPUMatrix, transposeB, beta, *c.m_CPUMatrix);
+    c.SetDataLocation(CPU, DENSE);
+}
+
+/// <summary>Matrix-matrix multiply with a packed op(a), e.g. weights that are multiplied once per time step: c = alpha * op(a) * op(b) + beta*c</summary>
+/// This is only implemented for dense CPU matrices.
+template <class ElemType>
+void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUPackedMatrix<ElemType>& a, const Matrix<ElemType>& b, const bool transposeB,
+                                              ElemType beta, Matrix<ElemType>& c)
+{
+    if (c.GetDeviceId() >= 0 || b.GetDeviceId() >= 0 || b.GetMatrixType() != DENSE || c.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, a, *b.m_CPUMatrix, transposeB, beta, *c.m_CPUMatrix);
+    c.SetDataLocation(CPU, DENSE);
+}
+
 template <class ElemType>
 /*static*/ void Matrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, ElemType beta, Matrix<ElemType>& c)
 {
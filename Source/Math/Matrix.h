@@ -43,11 +43,14 @@ template <class ElemType> class CPUMatrix;
 template <class ElemType> class GPUSparseMatrix;
 template <class ElemType> class CPUSparseMatrix;
 template <class ElemType> class DeviceBoundNumber;
+class CPUHalfMatrix;
+template <class ElemType> class CPUPackedMatrix;
 
 // <ElemType>-agnostic base class
 struct /*interface*/ MATH_API MatrixBase
 {
     virtual int GetDeviceId() const = 0;
+    virtual MatrixType GetMatrixType() const = 0;
     // TODO: Move more generic functions such as getting dims, resizing, and getting/setting as scalars in here.
     virtual ~MatrixBase();
 };
@@ -194,6 +197,10 @@ public:
     ElemType Adagrad(Matrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum);
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
+    // single-pass combination of clipping, L2, the above update functions and L1 (CPU only; dense or block-sparse gradients)
+    void FusedUpdateWeights(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const FusedWeightUpdateParams& params);
+    void CatchUpFusedUpdates(Matrix<ElemType>& functionValues, const FusedWeightUpdateParams& params);
+    static bool IsFusedWeightUpdateSupported(const Matrix<ElemType>& gradients, const Matrix<ElemType>& functionValues);
 
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
     void Resize(const Matrix<ElemType>& other) // TODO: Should this carry over numNZElemToReserve for sparse matrices?
@@ -351,6 +358,13 @@ public:
     Matrix<ElemType>& InplaceHardmax(const bool isColWise);
     Matrix<ElemType>& AssignHardmaxOf(const Matrix<ElemType>& a, const bool isColWise);
 
+    // fused softmax and cross entropy (column-wise): [this] = -sum_ij labels(i,j) * log softmax(z)(i,j) (1x1).
+    // The softmax is not materialized; only logSumExp = log sum_i exp(z(i,j)) (1 x #cols) is kept for the gradient. Labels may be sparse. CPU only.
+    Matrix<ElemType>& AssignCrossEntropyWithSoftmaxOf(const Matrix<ElemType>& labels, const Matrix<ElemType>& z, Matrix<ElemType>& logSumExp);
+    // c += alpha * (softmax(z) - labels), with the softmax recomputed from z and logSumExp (alpha is 1x1)
+    static void AddCrossEntropyWithSoftmaxGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& z,
+                                                   const Matrix<ElemType>& logSumExp, Matrix<ElemType>& c);
+
     // sequence training
     Matrix<ElemType>& DropFrame(const Matrix<ElemType>& label, const Matrix<ElemType>& gamma, const ElemType& threshhold);
     Matrix<ElemType>& AssignSequenceError(const ElemType hsmoothingWeight, const Matrix<ElemType>& label, const Matrix<ElemType>& dnnoutput, const Matrix<ElemType>& gamma, ElemType alpha);
@@ -519,6 +533,8 @@ public:
     static void SVD(const Matrix<ElemType>& A, Matrix<ElemType>& SIGMA, Matrix<ElemType>& U, Matrix<ElemType>& VT, Matrix<ElemType>& W);
 
     static void MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c); // SGEMM
+    static void MultiplyAndWeightedAdd(ElemType alpha, const CPUHalfMatrix& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c); // 16-bit a (CPU only)
+    static void MultiplyAndWeightedAdd(ElemType alpha, const CPUPackedMatrix<ElemType>& a, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c); // packed op(a) (CPU only)
     static void MultiplyAndAdd(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
@@ -0,0 +1,527 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MatrixExpression.h -- lazily evaluated elementwise expressions over Matrix<ElemType> and TensorView<ElemType>
+//
+// Chains of elementwise operations such as
+//     temp.AssignDifferenceOf(a, b); temp.ElementMultiplyWith(c); result.AssignSumOf(temp, d);
+// make one full pass over memory per operation, and need a temporary for each intermediate result.
+// With expression templates, the same computation is written as
+//     AssignExpression(result, (Expr(a) - Expr(b)) * Expr(c) + Expr(d));
+// The operators only record the expression tree (as a type); nothing is computed until AssignExpression(),
+// which, for dense matrices on the CPU, evaluates the whole tree in a single (parallel) loop over the elements,
+// without any temporary. Otherwise (GPU or sparse), the tree is evaluated node by node with the corresponding
+// Matrix operations, in place into the result along the left spine of the tree (the chain of first matrix operands),
+// so that a chain like the one above needs no temporary; only a right operand that is itself an operation,
+// e.g. (b + c) in a * (b + c), is evaluated into a temporary.
+//
+// All matrix operands must have the same dimensions (there is no broadcasting; use TensorView for that).
+// Scalars can be mixed in, e.g. 2 * Expr(a) + 1. The result may be one of the operands.
+// Supported: + - * / (elementwise), unary -, and SigmoidOf(), TanhOf(), ExpOf(), LogOf(), SqrtOf(), AbsOf(),
+// with the same semantics as the respective Matrix functions (e.g. LogOf() and / guard against 0).
+//
+// Expressions over TensorViews, e.g.
+//     AssignExpression(output, (Expr(input) - Expr(mean)) * Expr(invStdDev));
+// are evaluated node by node with the TensorView operations (one elementwise kernel each, on the CPU or GPU),
+// in place into the result, so they broadcast like those. They must be left-deep, i.e. the right operand of each
+// binary operation is a tensor, and scalars can only scale (* s, s *, / s). The result may only be the leftmost operand.
+//
+#pragma once
+
+#include "Basics.h"
+#include "Matrix.h"
+#include "CommonMatrix.h"
+#include "TensorOps.h"
+#include "TensorView.h"
+#include <memory>
+#include <type_traits>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// base of all expression types, so that the operators below only apply to expressions
+struct MatrixExpressionBase
+{
+};
+
+template <class E>
+struct IsMatrixExpression : std::is_base_of<MatrixExpressionBase, E>
+{
+};
+
+// -----------------------------------------------------------------------
+// leaves: matrices, tensors and scalars
+// Each expression type has:
+//  - isScalar, isLeaf
+//  - ForEachMatrix(f): calls f() for every matrix operand (to check dimensions and data location)
+//  - SpineMatrix(): the leftmost matrix operand, which the node-by-node evaluation reads first
+//  - Bind(): fetches the data pointers of the matrix operands, before the CPU loop
+//  - operator[](i): the value of element i (after Bind())
+//  - Evaluate(result): evaluates with Matrix operations (not for scalars)
+//  - EvaluateTensor(result): evaluates with TensorView operations (not for scalars)
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class MatrixOperand : public MatrixExpressionBase
+{
+public:
+    typedef ElemType ElementType;
+    static const bool isScalar = false;
+    static const bool isLeaf = true;
+
+    explicit MatrixOperand(const Matrix<ElemType>& matrix)
+        : m_matrix(matrix), m_data(nullptr)
+    {
+    }
+
+    template <class F>
+    void ForEachMatrix(const F& f) const { f(m_matrix); }
+    const Matrix<ElemType>* SpineMatrix() const { return &m_matrix; }
+    void Bind() const { m_data = m_matrix.Data(); }
+    ElemType operator[](size_t i) const { return m_data[i]; }
+
+    void Evaluate(Matrix<ElemType>& result) const { result.SetValue(m_matrix); }
+    // the value as a matrix: a leaf is used directly, an operation is evaluated into 'result' or a temporary
+    const Matrix<ElemType>& EvaluateSpine(Matrix<ElemType>& /*result*/) const { return m_matrix; }
+    const Matrix<ElemType>& Materialize(std::unique_ptr<Matrix<ElemType>>& /*temp*/, DEVICEID_TYPE /*deviceId*/) const { return m_matrix; }
+
+private:
+    const Matrix<ElemType>& m_matrix;
+    mutable const ElemType* m_data;
+};
+
+template <class ElemType>
+class TensorOperand : public MatrixExpressionBase
+{
+public:
+    typedef ElemType ElementType;
+    static const bool isScalar = false;
+    static const bool isLeaf = true;
+
+    explicit TensorOperand(const TensorView<ElemType>& tensor)
+        : m_tensor(tensor)
+    {
+    }
+
+    void EvaluateTensor(TensorView<ElemType>& result) const { result.AssignCopyOf(m_tensor); }
+    const TensorView<ElemType>& EvaluateTensorSpine(TensorView<ElemType>& /*result*/) const { return m_tensor; }
+
+private:
+    const TensorView<ElemType>& m_tensor;
+};
+
+template <class ElemType>
+class ScalarOperand : public MatrixExpressionBase
+{
+public:
+    typedef ElemType ElementType;
+    static const bool isScalar = true;
+    static const bool isLeaf = true;
+
+    explicit ScalarOperand(ElemType value)
+        : m_value(value)
+    {
+    }
+
+    template <class F>
+    void ForEachMatrix(const F&) const { }
+    const Matrix<ElemType>* SpineMatrix() const { return nullptr; }
+    void Bind() const { }
+    ElemType operator[](size_t) const { return m_value; }
+    ElemType Value() const { return m_value; }
+
+private:
+    ElemType m_value;
+};
+
+// wrap a matrix or tensor to start an expression
+template <class ElemType>
+inline MatrixOperand<ElemType> Expr(const Matrix<ElemType>& matrix)
+{
+    return MatrixOperand<ElemType>(matrix);
+}
+
+template <class ElemType>
+inline TensorOperand<ElemType> Expr(const TensorView<ElemType>& tensor)
+{
+    return TensorOperand<ElemType>(tensor);
+}
+
+// -----------------------------------------------------------------------
+// inner nodes
+// Evaluate() first evaluates the first matrix operand into the result (EvaluateSpine()), then applies the
+// operation in place; operands that are not on that spine are materialized into temporaries, unless they are leaves.
+// The caller must make sure that the result is no other operand than the leftmost one (see AssignExpression()).
+// -----------------------------------------------------------------------
+
+template <class Op, class A>
+class UnaryMatrixExpression : public MatrixExpressionBase
+{
+public:
+    typedef typename A::ElementType ElementType;
+    static const bool isScalar = false;
+    static const bool isLeaf = false;
+
+    explicit UnaryMatrixExpression(const A& a)
+        : m_a(a)
+    {
+    }
+
+    template <class F>
+    void ForEachMatrix(const F& f) const { m_a.ForEachMatrix(f); }
+    const Matrix<ElementType>* SpineMatrix() const { return m_a.SpineMatrix(); }
+    void Bind() const { m_a.Bind(); }
+    ElementType operator[](size_t i) const { return Op::Apply(m_a[i]); }
+
+    void Evaluate(Matrix<ElementType>& result) const
+    {
+        Op::Evaluate(result, m_a.EvaluateSpine(result));
+    }
+    const Matrix<ElementType>& EvaluateSpine(Matrix<ElementType>& result) const
+    {
+        Evaluate(result);
+        return result;
+    }
+    const Matrix<ElementType>& Materialize(std::unique_ptr<Matrix<ElementType>>& temp, DEVICEID_TYPE deviceId) const
+    {
+        temp.reset(new Matrix<ElementType>(deviceId));
+        Evaluate(*temp);
+        return *temp;
+    }
+
+    void EvaluateTensor(TensorView<ElementType>& result) const
+    {
+        result.DoUnaryOpOf(0, m_a.EvaluateTensorSpine(result), 1, Op::tensorOp, ElementWiseOperator::opSum);
+    }
+    const TensorView<ElementType>& EvaluateTensorSpine(TensorView<ElementType>& result) const
+    {
+        EvaluateTensor(result);
+        return result;
+    }
+
+private:
+    A m_a;
+};
+
+template <class Op, class L, class R>
+class BinaryMatrixExpression : public MatrixExpressionBase
+{
+public:
+    typedef typename L::ElementType ElementType;
+    static_assert(std::is_same<ElementType, typename R::ElementType>::value, "BinaryMatrixExpression: Operands must have the same element type.");
+    static_assert(!L::isScalar || !R::isScalar, "BinaryMatrixExpression: At least one operand must be a matrix expression.");
+    static const bool isScalar = false;
+    static const bool isLeaf = false;
+
+    BinaryMatrixExpression(const L& left, const R& right)
+        : m_left(left), m_right(right)
+    {
+    }
+
+    template <class F>
+    void ForEachMatrix(const F& f) const { m_left.ForEachMatrix(f); m_right.ForEachMatrix(f); }
+    const Matrix<ElementType>* SpineMatrix() const { return L::isScalar ? m_right.SpineMatrix() : m_left.SpineMatrix(); }
+    void Bind() const { m_left.Bind(); m_right.Bind(); }
+    ElementType operator[](size_t i) const { return Op::Apply(m_left[i], m_right[i]); }
+
+    void Evaluate(Matrix<ElementType>& result) const
+    {
+        Evaluate(result, std::integral_constant<bool, L::isScalar>(), std::integral_constant<bool, R::isScalar>());
+    }
+    const Matrix<ElementType>& EvaluateSpine(Matrix<ElementType>& result) const
+    {
+        Evaluate(result);
+        return result;
+    }
+    const Matrix<ElementType>& Materialize(std::unique_ptr<Matrix<ElementType>>& temp, DEVICEID_TYPE deviceId) const
+    {
+        temp.reset(new Matrix<ElementType>(deviceId));
+        Evaluate(*temp);
+        return *temp;
+    }
+
+    void EvaluateTensor(TensorView<ElementType>& result) const
+    {
+        EvaluateTensor(result, std::integral_constant<bool, L::isScalar>(), std::integral_constant<bool, R::isScalar>());
+    }
+    const TensorView<ElementType>& EvaluateTensorSpine(TensorView<ElementType>& result) const
+    {
+        EvaluateTensor(result);
+        return result;
+    }
+
+private:
+    void Evaluate(Matrix<ElementType>& result, std::false_type /*left is scalar*/, std::false_type /*right is scalar*/) const
+    {
+        std::unique_ptr<Matrix<ElementType>> rightTemp;
+        const Matrix<ElementType>& right = m_right.Materialize(rightTemp, result.GetDeviceId());
+        Op::Evaluate(result, m_left.EvaluateSpine(result), right);
+    }
+    void Evaluate(Matrix<ElementType>& result, std::true_type, std::false_type) const
+    {
+        Op::Evaluate(result, m_left.Value(), m_right.EvaluateSpine(result));
+    }
+    void Evaluate(Matrix<ElementType>& result, std::false_type, std::true_type) const
+    {
+        Op::Evaluate(result, m_left.EvaluateSpine(result), m_right.Value());
+    }
+
+    void EvaluateTensor(TensorView<ElementType>& result, std::false_type /*left is scalar*/, std::false_type /*right is scalar*/) const
+    {
+        static_assert(R::isLeaf, "AssignExpression: In a TensorView expression, the right operand of a binary operation must be a tensor or a scalar.");
+        result.DoBinaryOpOf(0, m_left.EvaluateTensorSpine(result), m_right.EvaluateTensorSpine(result), 1, Op::tensorOp, ElementWiseOperator::opSum);
+    }
+    void EvaluateTensor(TensorView<ElementType>& result, std::true_type, std::false_type) const
+    {
+        Op::EvaluateTensor(result, m_left.Value(), m_right.EvaluateTensorSpine(result));
+    }
+    void EvaluateTensor(TensorView<ElementType>& result, std::false_type, std::true_type) const
+    {
+        Op::EvaluateTensor(result, m_left.EvaluateTensorSpine(result), m_right.Value());
+    }
+
+    L m_left;
+    R m_right;
+};
+
+// -----------------------------------------------------------------------
+// operations: the elementwise function, and its evaluation with Matrix and TensorView operations
+// The Matrix operations must allow the result to be the first matrix operand (c == a, or c == b if a is a scalar).
+// -----------------------------------------------------------------------
+
+// (a TensorView expression can only be scaled by a scalar, since there is no TensorView operation that adds one)
+#define MatrixExpressionTensorScalarNotSupported(T) static_assert(sizeof(T) == 0, "AssignExpression: In a TensorView expression, scalars can only be factors or divisors.")
+
+struct MatrixSumOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opSum;
+    template <class T> static T Apply(T a, T b) { return a + b; }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, const Matrix<T>& b)
+    {
+        if (&c == &a) // (AssignSumOf() would swap the operands for 1 x 1 matrices)
+            c += b;
+        else
+            c.AssignSumOf(a, b);
+    }
+    template <class T> static void Evaluate(Matrix<T>& c, T a, const Matrix<T>& b) { c.AssignSumOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, T b) { c.AssignSumOf(b, a); }
+    template <class T> static void EvaluateTensor(TensorView<T>&, T, const TensorView<T>&) { MatrixExpressionTensorScalarNotSupported(T); }
+    template <class T> static void EvaluateTensor(TensorView<T>&, const TensorView<T>&, T) { MatrixExpressionTensorScalarNotSupported(T); }
+};
+
+struct MatrixDifferenceOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opDifference;
+    template <class T> static T Apply(T a, T b) { return a - b; }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, const Matrix<T>& b) { c.AssignDifferenceOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, T a, const Matrix<T>& b) { c.AssignDifferenceOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, T b) { c.AssignDifferenceOf(a, b); }
+    template <class T> static void EvaluateTensor(TensorView<T>&, T, const TensorView<T>&) { MatrixExpressionTensorScalarNotSupported(T); }
+    template <class T> static void EvaluateTensor(TensorView<T>&, const TensorView<T>&, T) { MatrixExpressionTensorScalarNotSupported(T); }
+};
+
+struct MatrixElementProductOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opElementwiseProduct;
+    template <class T> static T Apply(T a, T b) { return a * b; }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, const Matrix<T>& b) { c.AssignElementProductOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, T a, const Matrix<T>& b) { c.AssignProductOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, T b) { c.AssignProductOf(b, a); }
+    template <class T> static void EvaluateTensor(TensorView<T>& c, T a, const TensorView<T>& b) { c.AssignCopyOf(b, a); }
+    template <class T> static void EvaluateTensor(TensorView<T>& c, const TensorView<T>& a, T b) { c.AssignCopyOf(a, b); }
+};
+
+// like AssignElementDivisionOf(), divisors closer to 0 than EPS_IN_INVERSE are replaced by +-EPS_IN_INVERSE
+struct MatrixElementQuotientOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opElementwiseQuotient;
+    template <class T> static T Apply(T a, T b)
+    {
+        const T smallValue = EPS_IN_INVERSE;
+        if (b >= 0 && b < smallValue)
+            return a / smallValue;
+        else if (b < 0 && b > -smallValue)
+            return a / (-smallValue);
+        else
+            return a / b;
+    }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, const Matrix<T>& b) { c.AssignElementDivisionOf(a, b); }
+    template <class T> static void Evaluate(Matrix<T>& c, T a, const Matrix<T>& b) { c.AssignElementInverseOf(b); c.AssignProductOf(a, c); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a, T b) { c.AssignProductOf(Apply<T>(1, b), a); }
+    template <class T> static void EvaluateTensor(TensorView<T>&, T, const TensorView<T>&) { MatrixExpressionTensorScalarNotSupported(T); }
+    template <class T> static void EvaluateTensor(TensorView<T>& c, const TensorView<T>& a, T b) { c.AssignCopyOf(a, Apply<T>(1, b)); }
+};
+
+#undef MatrixExpressionTensorScalarNotSupported
+
+struct MatrixNegateOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opNegate;
+    template <class T> static T Apply(T a) { return -a; }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignProductOf(-1, a); }
+};
+
+struct MatrixSigmoidOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opSigmoid;
+    template <class T> static T Apply(T a) { return 1 / (1 + exp_(-a)); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignSigmoidOf(a); }
+};
+
+struct MatrixTanhOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opTanh;
+    template <class T> static T Apply(T a) { return tanh_(a); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignTanhOf(a); }
+};
+
+struct MatrixExpOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opExp;
+    template <class T> static T Apply(T a) { return exp_(a); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignExpOf(a); }
+};
+
+// like AssignLogOf(), values below EPS_IN_LOG give LOG_OF_EPS_IN_LOG
+struct MatrixLogOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opLog;
+    template <class T> static T Apply(T a) { return a < EPS_IN_LOG ? LOG_OF_EPS_IN_LOG : log_(a); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignLogOf(a); }
+};
+
+// like AssignSqrtOf(), negative values give 0
+struct MatrixSqrtOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opSqrt;
+    template <class T> static T Apply(T a) { return sqrt_(a > 0 ? a : 0); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignSqrtOf(a); }
+};
+
+struct MatrixAbsOp
+{
+    static const ElementWiseOperator tensorOp = ElementWiseOperator::opAbs;
+    template <class T> static T Apply(T a) { return fabs_(a); }
+    template <class T> static void Evaluate(Matrix<T>& c, const Matrix<T>& a) { c.AssignAbsOf(a); }
+};
+
+// -----------------------------------------------------------------------
+// operators and functions that build expressions
+// A plain number on either side of a binary operator becomes a ScalarOperand of the element type.
+// -----------------------------------------------------------------------
+
+#define DefineBinaryMatrixExpressionOperator(op, Op)                                                                                                                \
+    template <class L, class R, typename std::enable_if<IsMatrixExpression<L>::value && IsMatrixExpression<R>::value, int>::type = 0>                                \
+    inline BinaryMatrixExpression<Op, L, R> operator op(const L& left, const R& right)                                                                            \
+    {                                                                                                                                                               \
+        return BinaryMatrixExpression<Op, L, R>(left, right);                                                                                                      \
+    }                                                                                                                                                               \
+    template <class L, typename std::enable_if<IsMatrixExpression<L>::value, int>::type = 0>                                                                        \
+    inline BinaryMatrixExpression<Op, L, ScalarOperand<typename L::ElementType>> operator op(const L& left, typename L::ElementType right)                        \
+    {                                                                                                                                                               \
+        return BinaryMatrixExpression<Op, L, ScalarOperand<typename L::ElementType>>(left, ScalarOperand<typename L::ElementType>(right));                          \
+    }                                                                                                                                                               \
+    template <class R, typename std::enable_if<IsMatrixExpression<R>::value, int>::type = 0>                                                                        \
+    inline BinaryMatrixExpression<Op, ScalarOperand<typename R::ElementType>, R> operator op(typename R::ElementType left, const R& right)                        \
+    {                                                                                                                                                               \
+        return BinaryMatrixExpression<Op, ScalarOperand<typename R::ElementType>, R>(ScalarOperand<typename R::ElementType>(left), right);                          \
+    }
+
+DefineBinaryMatrixExpressionOperator(+, MatrixSumOp)
+DefineBinaryMatrixExpressionOperator(-, MatrixDifferenceOp)
+DefineBinaryMatrixExpressionOperator(*, MatrixElementProductOp)
+DefineBinaryMatrixExpressionOperator(/, MatrixElementQuotientOp)
+#undef DefineBinaryMatrixExpressionOperator
+
+#define DefineUnaryMatrixExpressionFunction(fn, Op)                                         \
+    template <class A, typename std::enable_if<IsMatrixExpression<A>::value, int>::type = 0> \
+    inline UnaryMatrixExpression<Op, A> fn(const A& a)                                      \
+    {                                                                                       \
+        return UnaryMatrixExpression<Op, A>(a);                                             \
+    }
+
+DefineUnaryMatrixExpressionFunction(operator-, MatrixNegateOp)
+DefineUnaryMatrixExpressionFunction(SigmoidOf, MatrixSigmoidOp)
+DefineUnaryMatrixExpressionFunction(TanhOf, MatrixTanhOp)
+DefineUnaryMatrixExpressionFunction(ExpOf, MatrixExpOp)
+DefineUnaryMatrixExpressionFunction(LogOf, MatrixLogOp)
+DefineUnaryMatrixExpressionFunction(SqrtOf, MatrixSqrtOp)
+DefineUnaryMatrixExpressionFunction(AbsOf, MatrixAbsOp)
+#undef DefineUnaryMatrixExpressionFunction
+
+// -----------------------------------------------------------------------
+// AssignExpression() -- result = expression
+// -----------------------------------------------------------------------
+
+// (below this size, the loop is not parallelized)
+static const size_t MatrixExpressionMinParallelSize = 4096;
+
+// the evaluation for GPU and sparse matrices: node by node, with the Matrix operations
+// The intermediate values are kept in the result, unless the result is also an operand that is read after the first operation.
+template <class ElemType, class Expression>
+Matrix<ElemType>& AssignExpressionByMatrixOperations(Matrix<ElemType>& result, const Expression& expression)
+{
+    size_t numResultOperands = 0;
+    expression.ForEachMatrix([&](const Matrix<ElemType>& m)
+    {
+        if (&m == &result)
+            numResultOperands++;
+    });
+    if (numResultOperands == 0 || (numResultOperands == 1 && expression.SpineMatrix() == &result))
+        expression.Evaluate(result);
+    else
+    {
+        Matrix<ElemType> temp(result.GetDeviceId());
+        expression.Evaluate(temp);
+        result.SetValue(temp);
+    }
+    return result;
+}
+
+template <class ElemType, class Expression>
+Matrix<ElemType>& AssignExpression(Matrix<ElemType>& result, const Expression& expression)
+{
+    static_assert(IsMatrixExpression<Expression>::value && !Expression::isScalar, "AssignExpression: The argument must be an expression with at least one matrix.");
+    static_assert(std::is_same<ElemType, typename Expression::ElementType>::value, "AssignExpression: The expression must have the element type of the result.");
+
+    // all operands must have the same dimensions; only dense CPU matrices can be evaluated in a single loop
+    size_t numRows = SIZE_MAX, numCols = 0;
+    bool fuse = result.GetCurrentMatrixLocation() == CurrentDataLocation::CPU && result.GetMatrixType() == MatrixType::DENSE;
+    expression.ForEachMatrix([&](const Matrix<ElemType>& m)
+    {
+        if (numRows == SIZE_MAX)
+        {
+            numRows = m.GetNumRows();
+            numCols = m.GetNumCols();
+        }
+        else if (m.GetNumRows() != numRows || m.GetNumCols() != numCols)
+            InvalidArgument("AssignExpression: The operands must have the same dimensions (%d x %d vs. %d x %d).", (int) m.GetNumRows(), (int) m.GetNumCols(), (int) numRows, (int) numCols);
+        fuse &= m.GetCurrentMatrixLocation() == CurrentDataLocation::CPU && m.GetMatrixType() == MatrixType::DENSE;
+    });
+
+    if (!fuse)
+        return AssignExpressionByMatrixOperations(result, expression);
+
+    if (result.GetNumRows() != numRows || result.GetNumCols() != numCols) // (not resizing in place, which would invalidate the result in Debug builds if it is an operand)
+        result.Resize(numRows, numCols);
+    ElemType* us = result.Data();
+    expression.Bind();
+    const long n = (long) (numRows * numCols);
+#pragma omp parallel for if (n >= (long) MatrixExpressionMinParallelSize)
+    for (long i = 0; i < n; i++)
+        us[i] = expression[i];
+    return result;
+}
+
+// result = expression, over TensorViews (see top of file)
+template <class ElemType, class Expression>
+TensorView<ElemType>& AssignExpression(TensorView<ElemType>& result, const Expression& expression)
+{
+    static_assert(IsMatrixExpression<Expression>::value && !Expression::isScalar, "AssignExpression: The argument must be an expression with at least one tensor.");
+    static_assert(std::is_same<ElemType, typename Expression::ElementType>::value, "AssignExpression: The expression must have the element type of the result.");
+
+    expression.EvaluateTensor(result);
+    return result;
+}
+
+}}}
@@ -22,7 +22,11 @@
 #include "stdafx.h"
 #include "Basics.h"
 #include "TensorView.h"
+#include "CPUPackedMatrix.h"
+#include "CPUHalfMatrix.h"
 #include <array>
+#include <mutex>
+#include <vector>
 
 #ifndef let
 #define let const auto
@@ -62,7 +66,7 @@ static bool Matches(size_t d1, size_t d2)
     return d1 == 1 || d2 == 1 || d1 == d2;
 } // do two dimensions match?
 
-template <class ElemType, size_t N>
+template <size_t N>
 static void PrepareTensorOperands(array<TensorShape, N> shapes, array<size_t, N>& offsets,
                                   SmallVector<size_t>& regularOpDims,
                                   array<SmallVector<ptrdiff_t>, N>& regularStrides,
@@ -220,6 +224,102 @@ static void PrepareTensorOperands(array<TensorShape, N> shapes, array<size_t, N>
         offsets[i] = shapes[i].GetOffset();
 }
 
+// The preparation above depends only on the operand shapes, which repeat every minibatch in static networks. For small
+// per-frame operations inside recurrent loops, it costs about as much as the operation itself. Hence the prepared operands
+// are cached for each number of operands, in a direct-mapped table keyed by the operand dimensions and strides. The offsets
+// are not part of the key: the per-frame slices of a loop differ only in them, and the preparation merely passes them through.
+template <size_t N>
+class PreparedTensorOperandsCache
+{
+    struct Entry
+    {
+        bool valid;
+        array<TensorShape, N> shapes;
+        SmallVector<size_t> regularOpDims, reducingOpDims;
+        array<SmallVector<ptrdiff_t>, N> regularStrides, reducingStrides;
+
+        Entry() : valid(false) { }
+
+        bool Matches(const array<TensorShape, N>& otherShapes) const
+        {
+            if (!valid)
+                return false;
+            for (size_t i = 0; i < N; i++) // (TensorShape::operator== only compares the dimensions)
+                if (shapes[i].GetDims() != otherShapes[i].GetDims() || shapes[i].GetStrides() != otherShapes[i].GetStrides())
+                    return false;
+            return true;
+        }
+    };
+
+    static size_t Hash(const array<TensorShape, N>& shapes)
+    {
+        size_t hash = 0;
+        auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+        for (const auto& shape : shapes)
+        {
+            for (size_t k = 0; k < shape.GetRank(); k++)
+            {
+                combine(shape[k]);
+                combine((size_t) shape.GetStrides()[k]);
+            }
+        }
+        return hash;
+    }
+
+    static const size_t s_numEntries = 64; // a network uses few distinct shapes per arity
+    std::mutex m_mutex;                    // operations may be executed concurrently
+    vector<Entry> m_entries;
+
+public:
+    static PreparedTensorOperandsCache s_instance; // (not a function-local static, whose initialization is not thread-safe in VS2013)
+
+    PreparedTensorOperandsCache()
+        : m_entries(s_numEntries)
+    {
+    }
+
+    void Get(const array<TensorShape, N>& shapes, array<size_t, N>& offsets,
+             SmallVector<size_t>& regularOpDims, array<SmallVector<ptrdiff_t>, N>& regularStrides,
+             SmallVector<size_t>& reducingOpDims, array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+    {
+        Entry& entry = m_entries[Hash(shapes) % s_numEntries];
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (entry.Matches(shapes))
+            {
+                for (size_t i = 0; i < N; i++)
+                    offsets[i] = shapes[i].GetOffset();
+                regularOpDims = entry.regularOpDims;
+                regularStrides = entry.regularStrides;
+                reducingOpDims = entry.reducingOpDims;
+                reducingStrides = entry.reducingStrides;
+                return;
+            }
+        }
+
+        PrepareTensorOperands<N>(shapes, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides); // (throws for incompatible shapes, which are not cached)
+
+        std::lock_guard<std::mutex> lock(m_mutex); // replace whatever was cached in this entry
+        entry.shapes = shapes;
+        entry.regularOpDims = regularOpDims;
+        entry.regularStrides = regularStrides;
+        entry.reducingOpDims = reducingOpDims;
+        entry.reducingStrides = reducingStrides;
+        entry.valid = true;
+    }
+};
+
+template <size_t N>
+PreparedTensorOperandsCache<N> PreparedTensorOperandsCache<N>::s_instance;
+
+template <size_t N>
+static void GetPreparedTensorOperands(const array<TensorShape, N>& shapes, array<size_t, N>& offsets,
+                                      SmallVector<size_t>& regularOpDims, array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                                      SmallVector<size_t>& reducingOpDims, array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    PreparedTensorOperandsCache<N>::s_instance.Get(shapes, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+}
+
 // enforce that in case of broadcasting, the output must not be an input
 template <class ElemType>
 static bool CheckDifferentObject(const TensorView<ElemType>& a, const TensorView<ElemType>& b)
@@ -239,7 +339,7 @@ void TensorView<ElemType>::DoUnaryOpOf(ElemType beta, const TensorView& a, ElemT
     array<size_t, 2> offsets;
     array<SmallVector<ptrdiff_t>, 2> regularStrides, reducingStrides;
     SmallVector<size_t> regularOpDims, reducingOpDims;
-    PrepareTensorOperands<ElemType, 2>(array<TensorShape, 2>{a.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+    GetPreparedTensorOperands<2>(array<TensorShape, 2>{a.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
 
     // output cannot be input when reducing
     if (reducingOpDims.size() > 0)
@@ -258,7 +358,7 @@ void TensorView<ElemType>::DoBinaryOpOf(ElemType beta, const TensorView& a, cons
     array<size_t, 3> offsets;
     array<SmallVector<ptrdiff_t>, 3> regularStrides, reducingStrides;
     SmallVector<size_t> regularOpDims, reducingOpDims;
-    PrepareTensorOperands<ElemType, 3>(array<TensorShape, 3>{a.GetShape(), b.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+    GetPreparedTensorOperands<3>(array<TensorShape, 3>{a.GetShape(), b.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
 
     // output cannot be input when reducing
     if (reducingOpDims.size() > 0)
@@ -276,7 +376,7 @@ void TensorView<ElemType>::DoTernaryOpOf(ElemType beta, const TensorView& a, con
     array<size_t, 4> offsets;
     array<SmallVector<ptrdiff_t>, 4> regularStrides, reducingStrides;
     SmallVector<size_t> regularOpDims, reducingOpDims;
-    PrepareTensorOperands<ElemType, 4>(array<TensorShape, 4>{a.GetShape(), b.GetShape(), c.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+    GetPreparedTensorOperands<4>(array<TensorShape, 4>{a.GetShape(), b.GetShape(), c.GetShape(), GetShape()}, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
 
     // output cannot be input when reducing
     if (reducingOpDims.size() > 0)
@@ -352,7 +452,7 @@ shared_ptr<Matrix<ElemType>> TensorView<ElemType>::AsMatrix() const
 }
 
 template <class ElemType>
-void TensorView<ElemType>::DoMatrixProductOf(ElemType beta, bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha)
+void TensorView<ElemType>::DoMatrixProductOf(ElemType beta, bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha, CPUPackedMatrix<ElemType>* packedA, CPUHalfMatrix* float16A)
 {
     // determine integration dimension offset
     auto shapeA = a.m_shape;
@@ -382,7 +482,26 @@ void TensorView<ElemType>::DoMatrixProductOf(ElemType beta, bool transC, const T
     let  B = b.Reshaped(shapeB).AsMatrix();
     auto C =   Reshaped(shapeC).AsMatrix();
     // and go
-    if (!transC)
+    let useFloat16A = float16A && !transC &&
+                      A->GetDeviceId() == CPUDEVICE && B->GetDeviceId() == CPUDEVICE && C->GetDeviceId() == CPUDEVICE &&
+                      A->GetMatrixType() == DENSE && B->GetMatrixType() == DENSE && C->GetMatrixType() == DENSE;
+    let usePackedA = !useFloat16A && packedA && !transC &&
+                     A->GetDeviceId() == CPUDEVICE && B->GetDeviceId() == CPUDEVICE && C->GetDeviceId() == CPUDEVICE &&
+                     A->GetMatrixType() == DENSE && B->GetMatrixType() == DENSE && C->GetMatrixType() == DENSE &&
+                     CPUPackedMatrix<ElemType>::IsBeneficial(shapeA[transA], shapeA[1 - transA], shapeC[1]);
+    if (useFloat16A)
+    {
+        if (float16A->IsEmpty() || float16A->GetNumRows() != A->GetNumRows() || float16A->GetNumCols() != A->GetNumCols())
+            float16A->AssignValuesOf(A->Data(), A->GetNumRows(), A->GetNumCols());
+        Matrix<ElemType>::MultiplyAndWeightedAdd(alpha, *float16A, transA, *B, transB, beta, *C);
+    }
+    else if (usePackedA)
+    {
+        if (packedA->IsEmpty() || packedA->GetNumRows() != shapeA[transA] || packedA->GetNumCols() != shapeA[1 - transA] || packedA->IsTransposed() != transA)
+            packedA->Pack(A->Data(), A->GetNumRows(), A->GetNumCols(), transA);
+        Matrix<ElemType>::MultiplyAndWeightedAdd(alpha, *packedA, *B, transB, beta, *C);
+    }
+    else if (!transC)
         Matrix<ElemType>::MultiplyAndWeightedAdd(alpha, *A, transA, *B, transB, beta, *C);
     else // C' = A * B  <==>  C = (A * B)' = B' * A'
         Matrix<ElemType>::MultiplyAndWeightedAdd(alpha, *B, !transB, *A, !transA, beta, *C);
@@ -139,9 +139,15 @@ public:
     // If beta == 0, c is not read out, i.e. it can be uninitialized or contain NaNs.
     // -------------------------------------------------------------------
 
-    void DoMatrixProductOf    (ElemType beta, bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha);
+    // If 'packedA' is given, a dense CPU product with few columns uses a packed op(a) from it (see CPUPackedMatrix::IsBeneficial()).
+    // It is (re-)packed if it is empty or has the wrong shape; the caller must Clear() it whenever the values of 'a' change.
+    // If 'float16A' is given, a dense CPU product multiplies from this 16-bit copy of a instead (see CPUHalfMatrix).
+    // It is (re-)quantized if it is empty or has the wrong shape; likewise, the caller must Clear() it whenever the values of 'a' change.
+    void DoMatrixProductOf    (ElemType beta, bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha, CPUPackedMatrix<ElemType>* packedA = nullptr, CPUHalfMatrix* float16A = nullptr);
     void AssignMatrixProductOf(               bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha = 1.0f) { DoMatrixProductOf(0,    transC, a, transA, b, transB, alpha); }
     void AddMatrixProductOf   (               bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, ElemType alpha = 1.0f) { DoMatrixProductOf(1.0f, transC, a, transA, b, transB, alpha); }
+    void AssignMatrixProductOf(               bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, CPUPackedMatrix<ElemType>& packedA) { DoMatrixProductOf(0, transC, a, transA, b, transB, 1.0f, &packedA); }
+    void AssignMatrixProductOf(               bool transC, const TensorView& a, bool transA, const TensorView& b, bool transB, CPUHalfMatrix& float16A) { DoMatrixProductOf(0, transC, a, transA, b, transB, 1.0f, nullptr, &float16A); }
 
     shared_ptr<Matrix<ElemType>> AsMatrix() const;
     const TensorShape& GetShape() const { return m_shape; }
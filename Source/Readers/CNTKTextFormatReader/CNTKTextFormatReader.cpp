@@ -46,7 +46,10 @@ CNTKTextFormatReader::CNTKTextFormatReader(MemoryProviderPtr provider,
         {
             // Verbosity is a general config parameter, not specific to the text format reader.
             int verbosity = config(L"verbosity", 0);
-            m_randomizer = make_shared<BlockRandomizer>(verbosity, window, m_deserializer, true);
+            // Sequences of similar length can be grouped into buckets of this many samples to reduce padding.
+            size_t lengthBucketSize = config(L"lengthBucketSize", (size_t)0);
+            m_randomizer = make_shared<BlockRandomizer>(verbosity, window, m_deserializer, true,
+                BlockRandomizer::DecimationMode::chunk, false /* useLegacyRandomization */, false /* multithreadedGetNextSequences */, lengthBucketSize);
         }
         else
         {
@@ -18,7 +18,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     SequenceRandomizer::SequenceRandomizer(
         int verbosity,
         IDataDeserializerPtr deserializer,
-        ChunkRandomizerPtr chunkRandomizer)
+        ChunkRandomizerPtr chunkRandomizer,
+        size_t lengthBucketSizeInSamples)
         : m_verbosity(verbosity),
         m_randomizedChunks(chunkRandomizer->GetRandomizedChunks()),
         m_chunkWindowBegin(0),
@@ -28,6 +29,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         m_currentSequenceCursor(0),
         m_currentChunkCursor(0),
         m_currentSampleCursor(0),
+        m_lengthBucketSizeInSamples(lengthBucketSizeInSamples),
         m_deserializer(deserializer)
     {
         size_t max = 0;
@@ -228,9 +230,16 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
         }
 
+        // The sequences of the chunk are now final; group them by length if requested.
+        // This keeps the sequences in their chunk, so that seeking and decimation are not affected.
+        size_t randomizedChunk = m_randomizedWindowEnd - m_chunkWindowBegin;
+        if (m_lengthBucketSizeInSamples > 0)
+        {
+            BucketSequencesByLength(m_sequenceWindow[randomizedChunk]);
+        }
+
         // Let's recalculate number of samples in the randomized chunks for efficient indexing in seek.
         size_t sampleCount = 0;
-        size_t randomizedChunk = m_randomizedWindowEnd - m_chunkWindowBegin;
         for (size_t index = 0; index < m_sequenceWindow[randomizedChunk].size(); index++)
         {
             sampleCount += m_sequenceWindow[randomizedChunk][index].m_numberOfSamples;
@@ -258,6 +267,51 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 m_randomizationCursor);
     }
 
+    // Groups randomized sequences by length into buckets, and shuffles the buckets.
+    // Sequences are sorted by length and cut into buckets of at least m_lengthBucketSizeInSamples samples each.
+    // Minibatches are taken in order, so a bucket of several minibatches yields minibatches of sequences of similar
+    // length, and only minibatches that straddle two buckets mix lengths. The order of the buckets and the direction
+    // within each bucket are random, with the same random numbers on all workers.
+    void SequenceRandomizer::BucketSequencesByLength(std::vector<RandomizedSequenceDescription>& sequences)
+    {
+        std::stable_sort(sequences.begin(), sequences.end(),
+            [](const RandomizedSequenceDescription& a, const RandomizedSequenceDescription& b) { return a.m_numberOfSamples < b.m_numberOfSamples; });
+
+        // Bucket boundaries as [begin, end) ranges in the sorted sequences.
+        std::vector<std::pair<size_t, size_t>> buckets;
+        size_t bucketBegin = 0;
+        size_t bucketSamples = 0;
+        for (size_t i = 0; i < sequences.size(); i++)
+        {
+            bucketSamples += sequences[i].m_numberOfSamples;
+            if (bucketSamples >= m_lengthBucketSizeInSamples || i + 1 == sequences.size())
+            {
+                buckets.push_back(std::make_pair(bucketBegin, i + 1));
+                bucketBegin = i + 1;
+                bucketSamples = 0;
+            }
+        }
+
+        for (size_t i = buckets.size(); i > 1; i--)
+        {
+            std::swap(buckets[i - 1], buckets[rand(0, i)]);
+        }
+
+        m_bufferBucketedSequences.clear();
+        for (const auto& bucket : buckets)
+        {
+            if (rand(0, 2) == 0)
+            {
+                m_bufferBucketedSequences.insert(m_bufferBucketedSequences.end(), sequences.begin() + bucket.first, sequences.begin() + bucket.second);
+            }
+            else
+            {
+                m_bufferBucketedSequences.insert(m_bufferBucketedSequences.end(), sequences.rbegin() + (sequences.size() - bucket.second), sequences.rbegin() + (sequences.size() - bucket.first));
+            }
+        }
+        sequences.swap(m_bufferBucketedSequences);
+    }
+
     // Sets current cursor to the given sample offset.
     // If offset is in the middle of the sequence, the next sequence is picked up.
     // If there is no sequence, an offset outside the sweep is returned.
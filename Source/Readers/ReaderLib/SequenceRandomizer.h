@@ -26,6 +26,8 @@ struct RandomizedSequenceDescription
 };
 
 // Class that given randomized chunks, randomizes sequence descriptions in a window of chunks.
+// Optionally, the sequences of each randomized chunk are grouped by length into buckets, which are then shuffled,
+// so that minibatches of sequences of similar length need less padding.
 // TODO: This code is still based on the old behavior, so that all current tests pass.
 // TODO: Can be simplified if we only randomized sequences forward.
 class SequenceRandomizer
@@ -34,7 +36,8 @@ public:
     SequenceRandomizer(
         int verbosity,
         IDataDeserializerPtr deserializer,
-        ChunkRandomizerPtr chunkRandomizer);
+        ChunkRandomizerPtr chunkRandomizer,
+        size_t lengthBucketSizeInSamples = 0);
 
     // Resets the current sweep according to the randomization seed provided.
     void Reset(size_t seed);
@@ -79,6 +82,9 @@ private:
     // Move the chunk cursor to the next chunk, randomizing more sequences if necessary.
     void MoveChunkCursor();
 
+    // Groups randomized sequences by length into buckets of m_lengthBucketSizeInSamples, and shuffles the buckets.
+    void BucketSequencesByLength(std::vector<RandomizedSequenceDescription>& sequences);
+
 private:
 
     IDataDeserializerPtr m_deserializer;
@@ -162,6 +168,12 @@ private:
     // Index of the last chunk in the window (exclusive).
     ChunkIdType m_chunkWindowEnd;
 
+    // Number of samples in a bucket of sequences of similar length (0: no bucketing).
+    size_t m_lengthBucketSizeInSamples;
+
+    // Used only as a buffer to reorder sequences into buckets without memory reallocation.
+    std::vector<RandomizedSequenceDescription> m_bufferBucketedSequences;
+
     // General configuration
     int m_verbosity;
 };
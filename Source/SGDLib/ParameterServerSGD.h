@@ -0,0 +1,492 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ParameterServerSGD.h -- asynchronous SGD with sharded parameter servers over MPI
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "Criterion.h"
+#include "Matrix.h"
+#include "MPIWrapper.h"
+#include "TimerUtility.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ParameterServerSGD -- asynchronous data-parallel SGD
+//
+// The last 'numServers' MPI ranks are parameter servers, all others are workers. Each learnable parameter
+// is owned by one server ("shard"); the assignment balances the number of elements across servers.
+// After each minibatch, a worker pushes its gradients (optionally quantized, with error feedback) to all
+// servers and pulls the current parameters back. A server applies every push right away with the regular
+// SGD update (learning rate, momentum, AdaGrad etc. all live on the server), without waiting for the other
+// workers. To bound the staleness, a server holds back its answer to a worker that is more than
+// 'maxStaleness' pushes ahead of the slowest worker still in the epoch; this worker then waits.
+// At the end of an epoch, the servers broadcast the model to all ranks, so that evaluation, learning-rate
+// control and saving the model work as for the synchronous methods.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ParameterServerSGD
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+    enum MessageTag
+    {
+        PushTag = 0x5053,  // worker -> server: gradients of the server's shard
+        ModelTag,          // server -> worker: current parameters of the shard
+        DoneTag            // worker -> server: worker has finished the epoch
+    };
+
+    struct PushHeader
+    {
+        double numSamples;
+        double momentumPerSample;
+        uint64_t modelVersion; // version of the shard the gradient was computed from (for statistics)
+    };
+
+    // a ModelTag message is a ModelHeader followed by the shard's parameters as ElemType
+    struct ModelHeader
+    {
+        uint64_t modelVersion; // number of updates the shard has received
+    };
+
+    struct ShardStats
+    {
+        double numParameters = 0;
+        double numUpdates = 0;
+        double numSamples = 0;
+        double sumStaleness = 0;
+        double maxStaleness = 0;
+        double numDeferredPulls = 0;
+        double secondsBusy = 0;
+    };
+
+public:
+    ParameterServerSGD(const MPIWrapperPtr& mpi, size_t numServers, size_t maxStaleness, size_t numGradientBits, int traceLevel)
+        : m_mpi(mpi), m_numServers(numServers), m_maxStaleness(maxStaleness), m_numGradientBits(numGradientBits), m_traceLevel(traceLevel)
+    {
+        if (m_numServers == 0 || m_numServers >= m_mpi->NumNodesInUse())
+            InvalidArgument("ParameterServerSGD: numServers (%d) must be at least 1 and less than the number of MPI ranks (%d).",
+                            (int) m_numServers, (int) m_mpi->NumNodesInUse());
+        if (m_numGradientBits != 8 && m_numGradientBits != 16 && m_numGradientBits != 8 * sizeof(ElemType))
+            InvalidArgument("ParameterServerSGD: gradientBits must be 8, 16 or %d.", (int) (8 * sizeof(ElemType)));
+        m_numWorkers = m_mpi->NumNodesInUse() - m_numServers;
+    }
+
+    size_t NumWorkers() const { return m_numWorkers; }
+    bool IsServer() const { return m_mpi->CurrentNodeRank() >= m_numWorkers; }
+    size_t WorkerIndex() const { return m_mpi->CurrentNodeRank(); } // (only valid on workers)
+
+    // assign the parameters to the servers; deterministic, so all ranks arrive at the same assignment
+    void OnEpochStart(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        if (m_owner.size() != learnableNodes.size())
+        {
+            m_owner.clear();
+            std::vector<size_t> load(m_numServers, 0);
+            for (const auto& node : learnableNodes)
+            {
+                if (!node->IsParameterUpdateRequired())
+                {
+                    m_owner.push_back(SIZE_MAX);
+                    continue;
+                }
+                size_t server = std::min_element(load.begin(), load.end()) - load.begin();
+                load[server] += DownCast(node)->Value().GetNumElements();
+                m_owner.push_back(server);
+            }
+            m_residuals.assign(learnableNodes.size(), std::vector<ElemType>());
+            m_modelVersions.assign(m_numServers, 0);
+        }
+        m_stats = ShardStats();
+        m_secondsWaiting = 0;
+    }
+
+    // -----------------------------------------------------------------------
+    // worker side
+    // -----------------------------------------------------------------------
+
+    // send this minibatch's gradients to the servers, and replace the local parameters by the servers' current ones
+    void PushGradientsAndPullModel(const std::list<ComputationNodeBasePtr>& learnableNodes, size_t numSamples, double momentumPerSample)
+    {
+        // post the receives first, so that a server's answer can be delivered while we are still sending to other servers
+        std::vector<std::vector<char>> replies(m_numServers);
+        std::vector<MPI_Request> requests(m_numServers);
+        for (size_t s = 0; s < m_numServers; s++)
+        {
+            replies[s].resize(sizeof(ModelHeader) + ShardSize(learnableNodes, s) * sizeof(ElemType));
+            MPI_Irecv(replies[s].data(), (int) replies[s].size(), MPI_CHAR, (int) ServerRank(s), ModelTag,
+                      m_mpi->Communicator(), &requests[s]) || MpiFail("PushGradientsAndPullModel: MPI_Irecv");
+        }
+
+        std::vector<char> message;
+        for (size_t s = 0; s < m_numServers; s++)
+        {
+            PushHeader header = { (double) numSamples, momentumPerSample, (uint64_t) m_modelVersions[s] };
+            message.assign((const char*) &header, (const char*) &header + sizeof(header));
+            size_t i = 0;
+            for (const auto& node : learnableNodes)
+            {
+                if (m_owner[i] == s)
+                    EncodeGradient(DownCast(node)->Gradient(), m_residuals[i], message);
+                i++;
+            }
+            MPI_Send(message.data(), (int) message.size(), MPI_CHAR, (int) ServerRank(s), PushTag, m_mpi->Communicator()) || MpiFail("PushGradientsAndPullModel: MPI_Send");
+        }
+
+        Timer waitTimer;
+        waitTimer.Start();
+        MPI_Waitall((int) requests.size(), requests.data(), MPI_STATUSES_IGNORE) || MpiFail("PushGradientsAndPullModel: MPI_Waitall");
+        waitTimer.Stop();
+        m_secondsWaiting += waitTimer.ElapsedSeconds();
+
+        for (size_t s = 0; s < m_numServers; s++)
+        {
+            ModelHeader header;
+            memcpy(&header, replies[s].data(), sizeof(header));
+            m_modelVersions[s] = (size_t) header.modelVersion;
+            const ElemType* data = reinterpret_cast<const ElemType*>(replies[s].data() + sizeof(header)); // (vector storage is suitably aligned)
+            size_t i = 0;
+            for (const auto& node : learnableNodes)
+            {
+                if (m_owner[i++] != s)
+                    continue;
+                auto& value = DownCast(node)->Value();
+                value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), const_cast<ElemType*>(data));
+                data += value.GetNumElements();
+                node->BumpEvalTimeStamp();
+            }
+        }
+    }
+
+    // tell the servers that this worker has no more data in this epoch
+    void OnWorkerDataEnd()
+    {
+        for (size_t s = 0; s < m_numServers; s++)
+            MPI_Send(nullptr, 0, MPI_CHAR, (int) ServerRank(s), DoneTag, m_mpi->Communicator()) || MpiFail("OnWorkerDataEnd: MPI_Send");
+    }
+
+    // -----------------------------------------------------------------------
+    // server side
+    // -----------------------------------------------------------------------
+
+    // Serve pushes until all workers are done with the epoch. 'updateWeights(node, smoothedGradient, numSamples, momentumPerSample)'
+    // applies the gradient that was received into node->Gradient().
+    void Serve(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients,
+               const std::function<void(const ComputationNodeBasePtr&, Matrix<ElemType>&, size_t, double)>& updateWeights)
+    {
+        const size_t myShard = m_mpi->CurrentNodeRank() - m_numWorkers;
+        std::vector<size_t> clocks(m_numWorkers, 0); // number of pushes received from each worker in this epoch
+        std::vector<bool> done(m_numWorkers, false);
+        std::vector<bool> pending(m_numWorkers, false); // worker waits for our answer
+        std::vector<bool> deferred(m_numWorkers, false);
+        std::list<std::pair<MPI_Request, std::vector<char>>> sends;
+        std::vector<char> message;
+        size_t numActive = m_numWorkers;
+        size_t& version = m_modelVersions[myShard];
+        m_stats.numParameters = (double) ShardSize(learnableNodes, myShard);
+
+        while (numActive > 0)
+        {
+            MPI_Status status;
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, m_mpi->Communicator(), &status) || MpiFail("Serve: MPI_Probe");
+            int count;
+            MPI_Get_count(&status, MPI_CHAR, &count) || MpiFail("Serve: MPI_Get_count");
+            message.resize(std::max(count, 1));
+            MPI_Recv(message.data(), count, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, m_mpi->Communicator(), MPI_STATUS_IGNORE) || MpiFail("Serve: MPI_Recv");
+            const size_t worker = status.MPI_SOURCE;
+            if (worker >= m_numWorkers)
+                LogicError("Serve: Unexpected message from rank %d.", (int) worker);
+
+            Timer busyTimer;
+            busyTimer.Start();
+            if (status.MPI_TAG == DoneTag)
+            {
+                done[worker] = true;
+                numActive--;
+            }
+            else if (status.MPI_TAG == PushTag)
+            {
+                PushHeader header;
+                memcpy(&header, message.data(), sizeof(header));
+                const char* data = message.data() + sizeof(header);
+                size_t i = 0;
+                auto smoothedGradientIter = smoothedGradients.begin();
+                for (const auto& node : learnableNodes)
+                {
+                    auto& smoothedGradient = *smoothedGradientIter++;
+                    if (m_owner[i++] != myShard)
+                        continue;
+                    data = DecodeGradient(data, DownCast(node));
+                    updateWeights(node, smoothedGradient, (size_t) header.numSamples, header.momentumPerSample);
+                }
+                if (data != message.data() + count)
+                    LogicError("Serve: Malformed gradient message from rank %d.", (int) worker);
+
+                const double staleness = (double) (version - header.modelVersion);
+                version++;
+                clocks[worker]++;
+                pending[worker] = true;
+                m_stats.numUpdates++;
+                m_stats.numSamples += header.numSamples;
+                m_stats.sumStaleness += staleness;
+                m_stats.maxStaleness = std::max(m_stats.maxStaleness, staleness);
+            }
+            else
+                LogicError("Serve: Unexpected message tag %d from rank %d.", status.MPI_TAG, (int) worker);
+
+            // answer the pulls that are within the staleness bound
+            size_t minClock = SIZE_MAX;
+            for (size_t w = 0; w < m_numWorkers; w++)
+                if (!done[w])
+                    minClock = std::min(minClock, clocks[w]);
+            for (size_t w = 0; w < m_numWorkers; w++)
+            {
+                if (!pending[w])
+                    continue;
+                if (!done[w] && clocks[w] > minClock + m_maxStaleness)
+                {
+                    if (!deferred[w])
+                        m_stats.numDeferredPulls++;
+                    deferred[w] = true;
+                    continue;
+                }
+                sends.emplace_back();
+                auto& reply = sends.back().second;
+                const ModelHeader header = { (uint64_t) version };
+                reply.resize(sizeof(header) + (size_t) m_stats.numParameters * sizeof(ElemType));
+                memcpy(reply.data(), &header, sizeof(header));
+                ElemType* data = reinterpret_cast<ElemType*>(reply.data() + sizeof(header));
+                size_t i = 0;
+                for (const auto& node : learnableNodes)
+                {
+                    if (m_owner[i++] != myShard)
+                        continue;
+                    const auto& value = DownCast(node)->Value();
+                    value.CopySection(value.GetNumRows(), value.GetNumCols(), data, value.GetNumRows());
+                    data += value.GetNumElements();
+                }
+                MPI_Isend(reply.data(), (int) reply.size(), MPI_CHAR, (int) w, ModelTag,
+                          m_mpi->Communicator(), &sends.back().first) || MpiFail("Serve: MPI_Isend");
+                pending[w] = false;
+                deferred[w] = false;
+            }
+
+            // release the buffers of completed sends
+            for (auto iter = sends.begin(); iter != sends.end();)
+            {
+                int completed;
+                MPI_Test(&iter->first, &completed, MPI_STATUS_IGNORE) || MpiFail("Serve: MPI_Test");
+                iter = completed ? sends.erase(iter) : next(iter);
+            }
+            busyTimer.Stop();
+            m_stats.secondsBusy += busyTimer.ElapsedSeconds();
+        }
+        for (auto& send : sends)
+            MPI_Wait(&send.first, MPI_STATUS_IGNORE) || MpiFail("Serve: MPI_Wait");
+    }
+
+    // -----------------------------------------------------------------------
+    // all ranks
+    // -----------------------------------------------------------------------
+
+    // Collective: distribute the final model from the servers to all ranks, and aggregate the criteria and statistics.
+    void OnEpochEnd(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                    /*in/out*/ size_t& totalEpochSamples, /*in/out*/ EpochCriterion& epochCriterion, /*in/out*/ std::vector<EpochCriterion>& epochEvalErrors)
+    {
+        std::vector<ElemType> buffer;
+        size_t i = 0;
+        for (const auto& node : learnableNodes)
+        {
+            size_t owner = m_owner[i++];
+            if (owner == SIZE_MAX)
+                continue;
+            auto& value = DownCast(node)->Value();
+            buffer.resize(value.GetNumElements());
+            if (m_mpi->CurrentNodeRank() == ServerRank(owner))
+                value.CopySection(value.GetNumRows(), value.GetNumCols(), buffer.data(), value.GetNumRows());
+            m_mpi->Bcast(buffer.data(), buffer.size(), ServerRank(owner));
+            value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), buffer.data());
+            node->BumpEvalTimeStamp();
+        }
+
+        // criteria and sample counts come from the workers (servers contribute zeros)
+        std::vector<double> criteria;
+        criteria.push_back((double) totalEpochSamples);
+        criteria.push_back(epochCriterion.first);
+        criteria.push_back((double) epochCriterion.second);
+        for (const auto& evalError : epochEvalErrors)
+        {
+            criteria.push_back(evalError.first);
+            criteria.push_back((double) evalError.second);
+        }
+        m_mpi->AllReduce(criteria);
+        totalEpochSamples = (size_t) criteria[0];
+        epochCriterion = EpochCriterion(criteria[1], (size_t) criteria[2]);
+        for (size_t k = 0; k < epochEvalErrors.size(); k++)
+            epochEvalErrors[k] = EpochCriterion(criteria[3 + 2 * k], (size_t) criteria[4 + 2 * k]);
+
+        // per-shard statistics, reported by the main node
+        std::vector<double> stats(7 * m_numServers + 1, 0.0);
+        if (IsServer())
+        {
+            double* myStats = stats.data() + 7 * (m_mpi->CurrentNodeRank() - m_numWorkers);
+            myStats[0] = m_stats.numParameters;
+            myStats[1] = m_stats.numUpdates;
+            myStats[2] = m_stats.numSamples;
+            myStats[3] = m_stats.sumStaleness;
+            myStats[4] = m_stats.maxStaleness;
+            myStats[5] = m_stats.numDeferredPulls;
+            myStats[6] = m_stats.secondsBusy;
+        }
+        else
+            stats.back() = m_secondsWaiting;
+        m_mpi->AllReduce(stats);
+        if (m_traceLevel > 0 && m_mpi->IsMainNode())
+        {
+            for (size_t s = 0; s < m_numServers; s++)
+            {
+                const double* shardStats = stats.data() + 7 * s;
+                fprintf(stderr, "\t\t(parameter server stats) shard %d (rank %d): %.0f parameters; %.0f updates, %.0f samples; staleness average = %.2f, max = %.0f; %.0f deferred pulls; %.2f seconds busy\n",
+                        (int) s, (int) ServerRank(s), shardStats[0], shardStats[1], shardStats[2],
+                        shardStats[1] > 0 ? shardStats[3] / shardStats[1] : 0.0, shardStats[4], shardStats[5], shardStats[6]);
+            }
+            fprintf(stderr, "\t\t(parameter server stats) %d workers waited %.2f seconds in total for the servers\n", (int) m_numWorkers, stats.back());
+        }
+    }
+
+private:
+    size_t ServerRank(size_t shard) const { return m_numWorkers + shard; }
+
+    size_t ShardSize(const std::list<ComputationNodeBasePtr>& learnableNodes, size_t shard) const
+    {
+        size_t size = 0, i = 0;
+        for (const auto& node : learnableNodes)
+            if (m_owner[i++] == shard)
+                size += DownCast(node)->Value().GetNumElements();
+        return size;
+    }
+
+    // Appends a gradient to a push message. With fewer than 8 * sizeof(ElemType) bits, the values are quantized
+    // uniformly between their min and max; the quantization error is carried over to the next minibatch.
+    void EncodeGradient(const Matrix<ElemType>& gradient, std::vector<ElemType>& residual, std::vector<char>& message)
+    {
+        const size_t n = gradient.GetNumElements();
+        m_gradientBuffer.resize(n);
+        if (gradient.GetMatrixType() == MatrixType::DENSE)
+            gradient.CopySection(gradient.GetNumRows(), gradient.GetNumCols(), m_gradientBuffer.data(), gradient.GetNumRows());
+        else
+        {
+            Matrix<ElemType> denseGradient(gradient.GetNumRows(), gradient.GetNumCols(), CPUDEVICE);
+            denseGradient.AssignValuesOf(gradient);
+            denseGradient.CopySection(gradient.GetNumRows(), gradient.GetNumCols(), m_gradientBuffer.data(), gradient.GetNumRows());
+        }
+
+        if (m_numGradientBits == 8 * sizeof(ElemType))
+        {
+            message.insert(message.end(), (const char*) m_gradientBuffer.data(), (const char*) (m_gradientBuffer.data() + n));
+            return;
+        }
+
+        residual.resize(n, 0);
+        ElemType lo = std::numeric_limits<ElemType>::max(), hi = std::numeric_limits<ElemType>::lowest();
+        for (size_t k = 0; k < n; k++)
+        {
+            m_gradientBuffer[k] += residual[k];
+            lo = std::min(lo, m_gradientBuffer[k]);
+            hi = std::max(hi, m_gradientBuffer[k]);
+        }
+        const size_t numLevels = ((size_t) 1 << m_numGradientBits) - 1;
+        const ElemType step = hi > lo ? (hi - lo) / numLevels : 1;
+        message.insert(message.end(), (const char*) &lo, (const char*) (&lo + 1));
+        message.insert(message.end(), (const char*) &step, (const char*) (&step + 1));
+        size_t offset = message.size();
+        message.resize(offset + n * m_numGradientBits / 8);
+        for (size_t k = 0; k < n; k++)
+        {
+            size_t q = (size_t) ((m_gradientBuffer[k] - lo) / step + (ElemType) 0.5);
+            q = std::min(q, numLevels);
+            residual[k] = m_gradientBuffer[k] - (lo + q * step);
+            if (m_numGradientBits == 8)
+                message[offset + k] = (char) (unsigned char) q;
+            else
+            {
+                unsigned short q16 = (unsigned short) q;
+                memcpy(&message[offset + 2 * k], &q16, 2);
+            }
+        }
+    }
+
+    // reads a gradient written by EncodeGradient() into the node's Gradient(); returns the position after it
+    const char* DecodeGradient(const char* data, const ComputationNodePtr& node)
+    {
+        const auto& value = node->Value();
+        const size_t n = value.GetNumElements();
+        m_gradientBuffer.resize(n);
+        if (m_numGradientBits == 8 * sizeof(ElemType))
+        {
+            memcpy(m_gradientBuffer.data(), data, n * sizeof(ElemType));
+            data += n * sizeof(ElemType);
+        }
+        else
+        {
+            ElemType lo, step;
+            memcpy(&lo, data, sizeof(lo));
+            memcpy(&step, data + sizeof(lo), sizeof(step));
+            data += 2 * sizeof(ElemType);
+            for (size_t k = 0; k < n; k++)
+            {
+                size_t q;
+                if (m_numGradientBits == 8)
+                    q = (unsigned char) data[k];
+                else
+                {
+                    unsigned short q16;
+                    memcpy(&q16, data + 2 * k, 2);
+                    q = q16;
+                }
+                m_gradientBuffer[k] = lo + q * step;
+            }
+            data += n * m_numGradientBits / 8;
+        }
+
+        auto& gradient = node->Gradient();
+        if (gradient.GetMatrixType() != MatrixType::DENSE)
+            gradient.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+        gradient.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), m_gradientBuffer.data());
+        return data;
+    }
+
+    ComputationNodePtr DownCast(const ComputationNodeBasePtr& inode) const
+    {
+        ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(inode);
+        if (!node)
+            InvalidArgument("an ComputationNodeBasePtr of mismatching precision was passed");
+        return node;
+    }
+
+    MPIWrapperPtr m_mpi;
+    size_t m_numServers;
+    size_t m_numWorkers;
+    size_t m_maxStaleness;
+    size_t m_numGradientBits;
+    int m_traceLevel;
+
+    std::vector<size_t> m_owner;                    // server index of each learnable node (SIZE_MAX if not updated)
+    std::vector<std::vector<ElemType>> m_residuals; // (workers) quantization error per learnable node
+    std::vector<size_t> m_modelVersions;            // number of updates each shard had when we last pulled it (servers: own shard's count)
+    std::vector<ElemType> m_gradientBuffer;
+    ShardStats m_stats;                             // (servers) statistics of the current epoch
+    double m_secondsWaiting = 0;                    // (workers) time spent waiting for the servers in the current epoch
+};
+
+}}}
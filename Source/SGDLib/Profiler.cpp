@@ -4,7 +4,11 @@
 //
 #include <cassert>
 #include <stdio.h>
+#include <algorithm>
+#include "Basics.h"
+#include "fileutil.h"
 #include "Profiler.h"
+#include "ComputationNode.h"
 #include "BestGpu.h" // for CPUONLY flag only
 
 #ifndef CPUONLY
@@ -19,9 +23,19 @@ void cudaProfilerStop()
 }
 #endif
 
-Profiler::Profiler(int numSamples)
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+Profiler::Profiler(int numSamples, int numNodeSamples, const std::wstring& traceFilePath)
     : m_numSamples(numSamples),
-      m_isProfilingActive(false)
+      m_isProfilingActive(false),
+      m_numNodeSamples(numNodeSamples),
+      m_isNodeProfilingActive(false),
+      m_numNodeSamplesTaken(0),
+      m_traceFilePath(traceFilePath),
+      m_environment(nullptr),
+      m_startTime(std::chrono::steady_clock::now()),
+      m_nodeProfilingBeginTime(0),
+      m_nodeProfilingEndTime(0)
 {
 }
 
@@ -29,6 +43,14 @@ Profiler::~Profiler()
 {
     if (m_isProfilingActive)
         Stop();
+    if (m_isNodeProfilingActive)
+        StopNodeProfiling();
+}
+
+void Profiler::Attach(ComputationEnvironment& environment)
+{
+    assert(!m_isNodeProfilingActive);
+    m_environment = &environment;
 }
 
 void Profiler::Start()
@@ -51,6 +73,18 @@ void Profiler::NextSample()
         if (m_numSamples > 0)
             Start();
     }
+
+    if (m_isNodeProfilingActive)
+    {
+        m_numNodeSamplesTaken++;
+        if (--m_numNodeSamples == 0)
+            StopNodeProfiling();
+    }
+    else
+    {
+        if (m_numNodeSamples > 0)
+            StartNodeProfiling();
+    }
 }
 
 void Profiler::Stop()
@@ -60,3 +94,151 @@ void Profiler::Stop()
     fprintf(stderr, "Stopping profiling\n");
     m_isProfilingActive = false;
 }
+
+// -----------------------------------------------------------------------
+// profiling of nodes and phases of training
+// -----------------------------------------------------------------------
+
+void Profiler::StartNodeProfiling()
+{
+    assert(!m_isNodeProfilingActive);
+    m_isNodeProfilingActive = true;
+    fprintf(stderr, "Starting profiling of nodes for %d minibatches\n", m_numNodeSamples);
+    if (m_environment)
+        m_environment->m_profiler = this;
+    m_nodeProfilingBeginTime = GetTime();
+}
+
+void Profiler::StopNodeProfiling()
+{
+    assert(m_isNodeProfilingActive);
+    m_nodeProfilingEndTime = GetTime();
+    if (m_environment)
+        m_environment->m_profiler = nullptr;
+    m_isNodeProfilingActive = false;
+    fprintf(stderr, "Stopping profiling of nodes\n");
+
+    PrintSummary();
+    if (!m_traceFilePath.empty())
+        WriteTrace();
+}
+
+double Profiler::GetTime() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+}
+
+void Profiler::RecordNodeExecution(const ComputationNodeBase& node, bool isBackprop, double beginTime, double endTime, size_t numBytesAllocated)
+{
+    if (isBackprop && none_of(node.GetInputs().begin(), node.GetInputs().end(), [](const ComputationNodeBasePtr& input) { return input->NeedsGradient(); }))
+        return; // nothing to do (e.g. a LearnableParameter)
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& statistics = m_nodeStatistics[&node];
+    if (statistics.name.empty())
+    {
+        statistics.name = node.NodeName();
+        statistics.operation = node.OperationName();
+    }
+    // count the estimated FLOPs at the first call of each sample (recurrent loops call once per time step)
+    int& lastSample = isBackprop ? statistics.lastBackpropSample : statistics.lastForwardSample;
+    if (lastSample != m_numNodeSamplesTaken)
+    {
+        lastSample = m_numNodeSamplesTaken;
+        double numFLOPs = node.GetEstimatedNumFLOPs();
+        if (isBackprop) // about the same effort for the gradient of each input
+            numFLOPs *= count_if(node.GetInputs().begin(), node.GetInputs().end(), [](const ComputationNodeBasePtr& input) { return input->NeedsGradient(); });
+        statistics.numFLOPs += numFLOPs;
+    }
+    RecordEvent(statistics, isBackprop, beginTime, endTime, numBytesAllocated);
+}
+
+void Profiler::RecordPhase(const char* name, double beginTime, double endTime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& statistics = m_phaseStatistics[name];
+    if (statistics.name.empty())
+        statistics.name = msra::strfun::utf16(name);
+    RecordEvent(statistics, /*isBackprop=*/false, beginTime, endTime, 0);
+}
+
+void Profiler::RecordEvent(Statistics& statistics, bool isBackprop, double beginTime, double endTime, size_t numBytesAllocated)
+{
+    (isBackprop ? statistics.backpropTime : statistics.forwardTime) += endTime - beginTime;
+    statistics.numCalls++;
+    statistics.numBytesAllocated += numBytesAllocated;
+
+    if (m_traceFilePath.empty() || m_traceEvents.size() >= s_maxNumTraceEvents)
+        return;
+    auto threadIndex = m_threadIndices.insert(make_pair(std::this_thread::get_id(), m_threadIndices.size())).first->second;
+    m_traceEvents.push_back(TraceEvent{ &statistics, isBackprop, beginTime, endTime, threadIndex, numBytesAllocated });
+}
+
+// print a table of all nodes and phases, most expensive first
+void Profiler::PrintSummary() const
+{
+    std::vector<const Statistics*> entries;
+    for (const auto& iter : m_phaseStatistics)
+        entries.push_back(&iter.second);
+    for (const auto& iter : m_nodeStatistics)
+        entries.push_back(&iter.second);
+    sort(entries.begin(), entries.end(), [](const Statistics* a, const Statistics* b) { return a->forwardTime + a->backpropTime > b->forwardTime + b->backpropTime; });
+
+    const double numSamples = max(m_numNodeSamplesTaken, 1);
+    const double totalTime = m_nodeProfilingEndTime - m_nodeProfilingBeginTime;
+    fprintf(stderr, "\nProfile of %d minibatches, %.3f ms per minibatch (times, bytes and FLOPs per minibatch):\n\n", m_numNodeSamplesTaken, 1e3 * totalTime / numSamples);
+    fprintf(stderr, "%12s %12s %7s %8s %12s %10s %8s   %s\n", "forward ms", "backprop ms", "time %", "calls", "alloc bytes", "MFLOPs", "GFLOP/s", "node");
+    for (const Statistics* entry : entries)
+    {
+        const double time = entry->forwardTime + entry->backpropTime;
+        fprintf(stderr, "%12.3f %12.3f %7.2f %8.1f %12.0f %10.3f %8.3f   %ls%ls%ls%ls\n",
+                1e3 * entry->forwardTime / numSamples, 1e3 * entry->backpropTime / numSamples, totalTime > 0 ? 100 * time / totalTime : 0.0,
+                entry->numCalls / numSamples, entry->numBytesAllocated / numSamples, 1e-6 * entry->numFLOPs / numSamples, time > 0 ? 1e-9 * entry->numFLOPs / time : 0.0,
+                entry->operation.empty() ? L"[" : L"", entry->name.c_str(), entry->operation.empty() ? L"]" : L" : ", entry->operation.c_str());
+    }
+    fprintf(stderr, "\n");
+}
+
+static std::string JsonEscape(const std::wstring& s)
+{
+    std::string result;
+    for (char c : msra::strfun::utf8(s))
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char) c < ' ')
+            result += msra::strfun::strprintf("\\u%04x", (int) c);
+        else
+            result += c;
+    }
+    return result;
+}
+
+// write all events in the Trace Event Format of chrome://tracing
+void Profiler::WriteTrace() const
+{
+    try
+    {
+        FILE* f = fopenOrDie(m_traceFilePath, L"wb");
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (size_t i = 0; i < m_traceEvents.size(); i++)
+        {
+            const auto& event = m_traceEvents[i];
+            const Statistics& statistics = *event.statistics;
+            fprintf(f, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"operation\": \"%s\", \"allocatedBytes\": %llu}}%s\n",
+                    JsonEscape(statistics.name).c_str(), statistics.operation.empty() ? "phase" : event.isBackprop ? "backprop" : "forward",
+                    (int) event.threadIndex, 1e6 * event.beginTime, 1e6 * (event.endTime - event.beginTime),
+                    JsonEscape(statistics.operation).c_str(), (unsigned long long) event.numBytesAllocated, i + 1 < m_traceEvents.size() ? "," : "");
+        }
+        fprintf(f, "]}\n");
+        fcloseOrDie(f);
+        fprintf(stderr, "Profiler: wrote %d events to trace file %ls%s\n", (int) m_traceEvents.size(), m_traceFilePath.c_str(),
+                m_traceEvents.size() >= s_maxNumTraceEvents ? " (truncated)" : "");
+    }
+    catch (const std::exception& e) // (called from the destructor, e.g. if training fails)
+    {
+        fprintf(stderr, "Profiler: failed to write trace file %ls: %s\n", m_traceFilePath.c_str(), e.what());
+    }
+}
+
+}}}
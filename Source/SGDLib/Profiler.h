@@ -4,19 +4,112 @@
 //
 #pragma once
 
-class Profiler
+#include "ComputationEnvironment.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Profiler -- profiles a given number of minibatches, either
+//  - with the CUDA profiler, which is started before and stopped after them, or
+//  - on the CPU, by timing every node execution (ForwardProp() and Backprop()) and phases of training such as reading.
+//    Wall time, allocated bytes and estimated FLOPs are aggregated per node into a summary that is printed when done,
+//    and optionally all events are written as a trace file that can be viewed with chrome://tracing.
+// Note that node timing does not synchronize with the GPU, so it is only meaningful for CPU training.
+class Profiler : public IComputationNodeProfiler
 {
 public:
     // Initializes profiler asking it to take given number of samples (0 to disable) and then stop
-    Profiler(int numSamples);
+    // 'numNodeSamples' is the number of samples to time the nodes of (0 to disable); see Attach().
+    Profiler(int numSamples, int numNodeSamples = 0, const std::wstring& traceFilePath = std::wstring());
     ~Profiler(); // stops the profiler
     // Notifies transition to the next sample
     void NextSample();
 
+    // nodes are timed in the network with the given environment (which must outlive the profiler)
+    void Attach(ComputationEnvironment& environment);
+
+    // times a phase of training for the duration of its scope, e.g. Profiler::Scope profilerScope(profiler, "GetMinibatch");
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const char* name)
+            : m_profiler(profiler), m_name(name), m_isActive(profiler.m_isNodeProfilingActive), m_beginTime(m_isActive ? profiler.GetTime() : 0)
+        {
+        }
+        ~Scope()
+        {
+            if (m_isActive)
+                m_profiler.RecordPhase(m_name, m_beginTime, m_profiler.GetTime());
+        }
+
+    private:
+        Profiler& m_profiler;
+        const char* m_name;
+        bool m_isActive;
+        double m_beginTime;
+    };
+
+    // IComputationNodeProfiler
+    virtual double GetTime() const override;
+    virtual void RecordNodeExecution(const ComputationNodeBase& node, bool isBackprop, double beginTime, double endTime, size_t numBytesAllocated) override;
+
 private:
     void Start();
     void Stop();
+    void StartNodeProfiling();
+    void StopNodeProfiling();
+
+    // aggregated over all profiled samples, for a node or a phase of training
+    struct Statistics
+    {
+        std::wstring name;
+        std::wstring operation; // (empty for phases)
+        double forwardTime = 0; // (phases count as forward)
+        double backpropTime = 0;
+        size_t numCalls = 0;
+        size_t numBytesAllocated = 0;
+        double numFLOPs = 0;
+        int lastForwardSample = -1; // FLOPs are estimated for the whole minibatch, so they are only counted once per sample
+        int lastBackpropSample = -1;
+    };
+    struct TraceEvent
+    {
+        const Statistics* statistics;
+        bool isBackprop;
+        double beginTime;
+        double endTime;
+        size_t threadIndex;
+        size_t numBytesAllocated;
+    };
+
+    void RecordPhase(const char* name, double beginTime, double endTime);
+    void RecordEvent(Statistics& statistics, bool isBackprop, double beginTime, double endTime, size_t numBytesAllocated); // call with m_mutex locked
+    void PrintSummary() const;
+    void WriteTrace() const;
 
     int m_numSamples;
     bool m_isProfilingActive;
+
+    int m_numNodeSamples;
+    bool m_isNodeProfilingActive;
+    int m_numNodeSamplesTaken;
+    std::wstring m_traceFilePath;
+    ComputationEnvironment* m_environment;
+    std::chrono::steady_clock::time_point m_startTime;
+    double m_nodeProfilingBeginTime;
+    double m_nodeProfilingEndTime;
+
+    std::mutex m_mutex; // nodes may be executed concurrently
+    std::map<const ComputationNodeBase*, Statistics> m_nodeStatistics;
+    std::map<std::string, Statistics> m_phaseStatistics;
+    std::vector<TraceEvent> m_traceEvents;
+    std::map<std::thread::id, size_t> m_threadIndices;
+    static const size_t s_maxNumTraceEvents = 10000000;
 };
+
+}}}
@@ -21,6 +21,11 @@
 
 #include <map>
 #include <set>
+#include <mutex>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -151,6 +156,20 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                       IDataReader* trainSetDataReader,
                                       IDataReader* validationSetDataReader)
 {
+    // let the network hoist loop-invariant computation out of recurrent loops, compute outside of loops on the valid frames only,
+    // and fuse chains of elementwise operations (CPU only); this recompiles the network
+    if (m_hoistLoopInvariantComputations || m_packedExecution || m_fuseElementwiseOperations)
+    {
+        net->EnableLoopInvariantHoisting(m_hoistLoopInvariantComputations);
+        net->EnablePackedExecution(m_packedExecution);
+        net->EnableElementwiseFusion(m_fuseElementwiseOperations);
+        net->CompileNetwork();
+    }
+
+    // execute independent nodes concurrently (CPU only)
+    if (m_numParallelTraversalThreads > 1)
+        net->SetNumParallelTraversalThreads(m_numParallelTraversalThreads);
+
     let& criterionNodes = GetTrainCriterionNodes(net);
 
     fprintf(stderr, "\n");
@@ -309,6 +328,10 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     {
         InitModelAggregationHandler(m_syncStatsTrace, net->GetDeviceId());
     }
+    else if (GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD)
+    {
+        InitParameterServer(m_syncStatsTrace);
+    }
     
     // precompute mean and invStdDev nodes and save initial model
     // When no precompute, only save if we did not load the model from a 
@@ -432,7 +455,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 // In case of parallel training only the main node should we saving the model to prevent
                 // the parallel training nodes from colliding to write the same file
                 if ((m_mpi == nullptr) || m_mpi->IsMainNode())
-                    net->Save(m_modelPath);
+                    net->Save(m_modelPath, m_finalModelFileOptions);
             }
             break;
         }
@@ -559,7 +582,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // broadcast epochCriterion to make sure each processor will have the same learning rate schedule
         if ((GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD 
             ||
-            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) 
+            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD
+            ||
+            GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD) 
             && (m_mpi->NumNodesInUse() > 1))
         {
             m_mpi->Bcast(&epochCriterion.first,  1, m_mpi->MainNodeRank());
@@ -617,7 +642,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                         // In case of parallel training only the main node should we saving the model to prevent
                         // the parallel training nodes from colliding to write the same file
                         if ((m_mpi == nullptr) || m_mpi->IsMainNode())
-                            net->Save(GetModelNameForEpoch(i, true));
+                            net->Save(GetModelNameForEpoch(i, true), m_finalModelFileOptions);
 
                         LOGPRINTF(stderr, "Finished training and saved final model\n\n");
                         break;
@@ -693,7 +718,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 SaveCheckPointInfo(i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
                 auto modelName = GetModelNameForEpoch(i);
                 LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
-                net->Save(modelName);
+                net->Save(modelName, modelName == m_modelPath ? m_finalModelFileOptions : FileOptions::fileOptionsBinary);
                 if (!m_keepCheckPointFiles)
                 {
                     // delete previous checkpoint file to save space
@@ -786,7 +811,13 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     epochCriterion = EpochCriterion(0);
     epochEvalErrors.assign(epochEvalErrors.size(), EpochCriterion(0));
 
+    if (UsingHogwild(net, refNode))
+        return TrainOneEpochHogwild(net, epochNumber, epochSize, trainSetDataReader, learnRatePerSample, tunedMBSize,
+                                    criterionNodes, evaluationNodes, learnableNodes, smoothedGradients, epochCriterion, epochEvalErrors, prefixMsg);
+
     double totalTimeInMBs = 0; // use double since timer has sub-microsecond time resolution
+    size_t numPaddedColsSinceLastLogged = 0; // gap columns of the minibatches since last logged, out of
+    size_t numColsSinceLastLogged = 0;       // all columns
 
     // initialize statistics
     size_t totalEpochSamples = 0;
@@ -796,6 +827,29 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     bool useGradientAggregation = UsingGradientAggregation(epochNumber);
     bool useModelAggregation = UsingModelAggregation(epochNumber);
     bool useParallelTrain = UsingParallelTrain(epochNumber);
+    bool useParameterServer = UsingParameterServer(epochNumber);
+
+    if (useParameterServer)
+    {
+        m_parameterServer->OnEpochStart(learnableNodes);
+        if (m_parameterServer->IsServer())
+        {
+            // server ranks do not train, they apply the gradients pushed by the workers to their shard of the model
+            LOGPRINTF(stderr, "Serving parameters for ParameterServerSGD training (MyRank = %d, NumWorkers = %d).\n",
+                      (int) m_mpi->CurrentNodeRank(), (int) m_parameterServer->NumWorkers());
+            m_parameterServer->Serve(learnableNodes, smoothedGradients,
+                                     [&](const ComputationNodeBasePtr& node, Matrix<ElemType>& smoothedGradient, size_t numSamples, double momentumPerSample)
+                                     {
+                                         if (learnRatePerSample > m_minLearnRate * 0.01)
+                                             UpdateWeights(node, smoothedGradient, learnRatePerSample, momentumPerSample, numSamples,
+                                                           m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum);
+                                     });
+            m_parameterServer->OnEpochEnd(learnableNodes, totalEpochSamples, epochCriterion, epochEvalErrors);
+            return totalEpochSamples;
+        }
+        if (!trainSetDataReader->SupportsDistributedMBRead())
+            InvalidArgument("ParameterServerSGD requires a reader that supports distributed reading.");
+    }
 
     // MA-related variables
     size_t nSamplesSinceLastModelSync = 0;
@@ -807,15 +861,27 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     }
 
     std::vector<Matrix<ElemType>*> learnParamsGradients;
-    Profiler profiler(m_numMBsToCUDAProfile);
+    Profiler profiler(m_numMBsToCUDAProfile, m_numMBsToCPUProfile, m_cpuProfileTraceFile);
+    profiler.Attach(net->Environment());
 
     // resetting this, so profiling is performed for one epoch only
+    // This is intended for both profilers: the first minibatches of the first epoch trained by this run are
+    // representative, and the node summary and the trace file are written only once (a later epoch would overwrite it).
     m_numMBsToCUDAProfile = 0;
+    m_numMBsToCPUProfile = 0;
 
     bool useDistributedMBReading = useParallelTrain &&
                                    m_enableDistributedMBReading &&
                                    trainSetDataReader->SupportsDistributedMBRead();
-    if (useDistributedMBReading)
+    if (useParameterServer)
+    {
+        // each worker reads its own share of the data; the workers do not synchronize at the end of the epoch
+        trainSetDataReader->StartDistributedMinibatchLoop(tunedMBSize, epochNumber, m_parameterServer->WorkerIndex(),
+                                                          m_parameterServer->NumWorkers(), epochSize);
+        useDistributedMBReading = false;
+        useParallelTrain = false;
+    }
+    else if (useDistributedMBReading)
     {
         trainSetDataReader->StartDistributedMinibatchLoop(tunedMBSize, epochNumber, m_mpi->CurrentNodeRank(),
                                                           m_mpi->NumNodesInUse(), epochSize);
@@ -862,6 +928,13 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         }
     }
 
+    if (useParameterServer)
+    {
+        fprintf(stderr, ", ParameterServerSGD training (MyRank = %d, NumWorkers = %d, NumServers = %d, MaxStaleness = %d, NumGradientBits = %d)",
+                (int) m_mpi->CurrentNodeRank(), (int) m_parameterServer->NumWorkers(), (int) m_numParameterServers,
+                (int) m_maxParameterStaleness, (int) m_numParameterServerGradientBits);
+    }
+
     if (useDistributedMBReading)
     {
         fprintf(stderr, ", distributed reading is ENABLED");
@@ -905,8 +978,12 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // get minibatch
         // TODO: is it guaranteed that the GPU is already completed at this point, is it safe to overwrite the buffers?
         size_t actualMBSize = 0;
-        bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, criterionNodes[0],
-                                                                                useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize, m_mpi);
+        bool wasDataRead;
+        {
+            Profiler::Scope profilerScope(profiler, "GetMinibatch");
+            wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, criterionNodes[0],
+                                                                               useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize, m_mpi);
+        }
         if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) // in case of distributed reading, we do a few more loops until all ranks have completed
             break;                                                                // end of epoch
 
@@ -1017,6 +1094,14 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // #samples according to the default dynamic axis, for use with criterion nodes that do not have an MBLayout
         size_t numSamplesWithLabelOfNetwork = wasDataRead ? net->GetNumSamplesWithLabelOfNetwork(actualMBSize) : 0;
 
+        // the share of padding in the minibatches, which all nodes compute on unless packedExecution is enabled
+        if (wasDataRead)
+        {
+            const auto& pMBLayout = net->GetMBLayoutPtrOfNetwork();
+            numColsSinceLastLogged += pMBLayout->GetNumCols();
+            numPaddedColsSinceLastLogged += pMBLayout->GetNumCols() - pMBLayout->GetActualNumSamples();
+        }
+
         // Sum of actualMBSize across all nodes when using parallel training
         // 'aggregate' here means accross-worker aggregate for this one minibatch.
         size_t aggregateNumSamples = actualMBSize;
@@ -1072,7 +1157,11 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             for (size_t i = 0; i < evaluationNodes.size(); i++)
                 m_gradHeader->evalErrors[i] = localEpochEvalErrors.GetCriterion(i);
 
-            bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), epochNumber);
+            bool samplesProcessed;
+            {
+                Profiler::Scope profilerScope(profiler, "AggregateGradients");
+                samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), epochNumber);
+            }
             noMoreSamplesToProcess = !samplesProcessed;
 
             aggregateNumSamples          = m_gradHeader->numSamples;
@@ -1083,8 +1172,20 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         }
 
         // update model parameters
-        if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
+        if (useParameterServer)
         {
+            // the servers apply the update; we continue from their current model
+            if (aggregateNumSamples > 0)
+            {
+                Profiler::Scope profilerScope(profiler, "UpdateWeights");
+                size_t numSamplesInMinibatch = criterionNodes[0]->HasMBLayout() ? aggregateNumSamplesWithLabel : aggregateNumSamples;
+                m_parameterServer->PushGradientsAndPullModel(learnableNodes, numSamplesInMinibatch,
+                                                             GetMomentumPerSample(epochNumber, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()));
+            }
+        }
+        else if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
+        {
+            Profiler::Scope profilerScope(profiler, "UpdateWeights");
 #if 1       // BUGBUG: We must skip gaps in our momentum, clipping, regularization etc. criteria.
             // This will break test cases. So for now, we will only enable this for per-sample criteria.
             size_t numSamplesInMinibatch = aggregateNumSamples;
@@ -1210,6 +1311,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 for (size_t i = 0; i < epochEvalErrors.size(); i++)
                     (epochEvalErrors[i] - epochEvalErrorsLastLogged[i]).LogCriterion(evaluationNodes[i]->NodeName());
 
+                if (numPaddedColsSinceLastLogged > 0)
+                    fprintf(stderr, "padding = %.1f%%; ", 100.0 * numPaddedColsSinceLastLogged / numColsSinceLastLogged);
                 fprintf(stderr, ("time = " + GeneratePaddedFloatOrExpFormat(0, 4, totalTimeInMBs) + "s; samplesPerSecond = %.1f\n").c_str(),
                         totalTimeInMBs, trainSamplesSinceLastLogged / totalTimeInMBs);
             }
@@ -1229,6 +1332,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             epochEvalErrorsLastLogged = epochEvalErrors;
 
             totalTimeInMBs = 0;
+            numPaddedColsSinceLastLogged = 0;
+            numColsSinceLastLogged = 0;
         }
 
         timer.Restart();
@@ -1251,12 +1356,33 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     // --- END MAIN MINIBATCH LOOP
 
+    // parameters updated from sparse gradients may have columns that lag behind (see SparseUpdateHistory);
+    // bring them up to date before the model is aggregated, evaluated or saved
+    if (!m_sparseUpdateHistories.empty())
+    {
+        auto smoothedGradientIter = smoothedGradients.begin();
+        for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+        {
+            auto historyIter = m_sparseUpdateHistories.find(*nodeIter);
+            if (historyIter == m_sparseUpdateHistories.end() || historyIter->second.numUpdates == 0) // (not updated through FusedUpdateWeights())
+                continue;
+            auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+            CatchUpSparseUpdatesS(this, node->Value(), node->Gradient(), *smoothedGradientIter,
+                                  learnRatePerSample * node->GetLearningRateMultiplier(),
+                                  GetMomentumPerSample(epochNumber, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()),
+                                  tunedMBSize, m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum, historyIter->second);
+        }
+    }
+
     if (useModelAggregation )
     {
         m_pMASGDHelper->OnEpochEnd(learnableNodes, smoothedGradients, nSamplesSinceLastModelSync);
         nSamplesSinceLastModelSync = 0;
     }
 
+    if (useParameterServer)
+        m_parameterServer->OnWorkerDataEnd();
+
     // hoist the accumulated criterion value from GPU side to our 'out'  variables
     // (unless we useGradientAggregation, in which case they are accumulated in the 'out' variables directly)
     if (!useGradientAggregation)
@@ -1299,6 +1425,366 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // 3. modify return value 
         totalEpochSamples = totalEpochSamplesOfAllWorkers;
     }
+
+    // in case of parameter servers, fetch the final model from the servers and aggregate the criteria of all workers
+    if (useParameterServer)
+        m_parameterServer->OnEpochEnd(learnableNodes, totalEpochSamples, epochCriterion, epochEvalErrors);
+    return totalEpochSamples;
+}
+
+// -----------------------------------------------------------------------
+// Hogwild training -- multithreaded data-parallel training within one process
+// -----------------------------------------------------------------------
+
+// Hogwild is used for CPU training if requested and no other feature that TrainOneEpochHogwild() does not
+// implement (MPI-parallel training, KL-regularized adaptation, sub-minibatching, gradient check, profiling) is in use.
+// Profiling covers the first epoch trained by this run only, hence Hogwild starts with the next one in that case.
+template <class ElemType>
+bool SGD<ElemType>::UsingHogwild(ComputationNetworkPtr net, const ComputationNodeBasePtr& refNode) const
+{
+    if (m_hogwildThreads <= 1)
+        return false;
+    const char* reason = nullptr;
+    if (net->GetDeviceId() != CPUDEVICE)
+        reason = "the network is not on the CPU";
+    else if (GetParallelizationMethod() != ParallelizationMethod::none)
+        reason = "parallel (MPI) training is enabled";
+    else if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
+        reason = "KL-regularized adaptation is enabled";
+    else if (m_maxSamplesInRAM < SIZE_MAX || m_numSubminiBatches > 1)
+        reason = "sub-minibatching is enabled";
+    else if (m_doGradientCheck)
+        reason = "gradient check is enabled";
+    else if (m_numMBsToCPUProfile > 0 || m_numMBsToCUDAProfile > 0)
+        reason = "profiling is enabled for this epoch";
+    if (reason)
+    {
+        LOGPRINTF(stderr, "hogwildThreads is ignored since %s.\n", reason);
+        return false;
+    }
+    return true;
+}
+
+// Each worker thread owns a replica of the network and pulls its own minibatches from the (shared, serialized)
+// reader. With m_hogwildSyncPeriod == 0, the replicas' parameters alias those of 'net', and the workers apply their
+// updates to them concurrently without any locking (Hogwild). Otherwise, each worker trains a private copy and
+// every m_hogwildSyncPeriod minibatches adds its change since the last merge, divided by the number of workers,
+// to the shared model and continues from the result. Each worker updates its own optimizer state (momentum etc.),
+// which starts from 'smoothedGradients'; at the end of the epoch, the workers' states are averaged into
+// 'smoothedGradients', so that they are checkpointed and carried over to the next epoch like in TrainOneEpoch().
+template <class ElemType>
+size_t SGD<ElemType>::TrainOneEpochHogwild(ComputationNetworkPtr net,
+                                           const int epochNumber,
+                                           const size_t epochSize,
+                                           IDataReader* trainSetDataReader,
+                                           const double learnRatePerSample,
+                                           size_t tunedMBSize,
+                                           const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                           const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                           const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                           std::list<Matrix<ElemType>>& smoothedGradients,
+                                           /*out*/ EpochCriterion& epochCriterion,
+                                           /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
+                                           const std::string& prefixMsg)
+{
+    const size_t numWorkers = m_hogwildThreads;
+    const bool lockFree = m_hogwildSyncPeriod == 0;
+
+    // create the replicas once, by round-tripping the network through a model file
+    if (m_hogwildNet != net || m_hogwildWorkers.size() != numWorkers)
+    {
+        m_hogwildWorkers.clear();
+        wstring replicaFileName = m_modelPath + L".hogwild";
+        net->Save(replicaFileName);
+        for (size_t w = 0; w < numWorkers; w++)
+        {
+            auto worker = std::make_unique<HogwildWorker>();
+            worker->net = ComputationNetwork::CreateFromFile<ElemType>(CPUDEVICE, replicaFileName);
+            worker->criterionNode = worker->net->GetNodeFromName(criterionNodes[0]->NodeName());
+            for (const auto& node : evaluationNodes)
+                worker->evaluationNodes.push_back(worker->net->GetNodeFromName(node->NodeName()));
+            for (const auto& node : learnableNodes)
+            {
+                auto replicaNode = worker->net->GetNodeFromName(node->NodeName());
+                worker->learnableNodes.push_back(replicaNode);
+                const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(replicaNode)->Value();
+                worker->smoothedGradients.push_back(Matrix<ElemType>(value.GetNumRows(), value.GetNumCols(), CPUDEVICE));
+                worker->modelAtLastSync.push_back(Matrix<ElemType>(CPUDEVICE));
+            }
+            worker->net->AllocateAllMatrices(worker->evaluationNodes, {}, worker->criterionNode);
+            for (const auto& node : worker->net->FeatureNodes())
+                worker->inputMatrices.AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+            for (const auto& node : worker->net->LabelNodes())
+                worker->inputMatrices.AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+            m_hogwildWorkers.push_back(move(worker));
+        }
+        _wunlink(replicaFileName.c_str());
+        m_hogwildNet = net;
+    }
+
+    // bring the replicas in line with the current model and optimizer state
+    for (auto& worker : m_hogwildWorkers)
+    {
+        auto modelAtLastSyncIter = worker->modelAtLastSync.begin();
+        auto nodeIter = learnableNodes.begin();
+        auto smoothedGradientIter = smoothedGradients.begin();
+        auto workerSmoothedGradientIter = worker->smoothedGradients.begin();
+        for (const auto& replicaNode : worker->learnableNodes)
+        {
+            (workerSmoothedGradientIter++)->SetValue(*smoothedGradientIter++);
+            auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter++)->Value();
+            auto& replicaValue = dynamic_pointer_cast<ComputationNode<ElemType>>(replicaNode)->Value();
+            if (lockFree)
+            {
+                if (value.GetMatrixType() != MatrixType::DENSE)
+                    RuntimeError("TrainOneEpochHogwild: Parameter %ls must be dense for lock-free Hogwild training.", replicaNode->NodeName().c_str());
+                replicaValue.SetValue(value.GetNumRows(), value.GetNumCols(), CPUDEVICE, value.Data(), matrixFlagDontOwnBuffer);
+            }
+            else
+            {
+                replicaValue.SetValue(value);
+                (modelAtLastSyncIter++)->SetValue(value);
+            }
+            replicaNode->BumpEvalTimeStamp();
+        }
+        worker->net->StartEvaluateMinibatchLoop(worker->evaluationNodes);
+        worker->net->StartEvaluateMinibatchLoop(worker->criterionNode);
+    }
+
+    trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
+
+    fprintf(stderr, "\n");
+    if (lockFree)
+        LOGPRINTF(stderr, "Starting minibatch loop, Hogwild training (%d threads, lock-free parameter updates).\n", (int) numWorkers);
+    else
+        LOGPRINTF(stderr, "Starting minibatch loop, Hogwild training (%d threads, merging every %d minibatches).\n", (int) numWorkers, (int) m_hogwildSyncPeriod);
+
+    // adds a worker's changes since the last merge to the shared model, and continues from the result
+    std::mutex modelMutex;
+    auto mergeWorker = [&](HogwildWorker& worker)
+    {
+        std::lock_guard<std::mutex> lock(modelMutex);
+        auto modelAtLastSyncIter = worker.modelAtLastSync.begin();
+        auto nodeIter = learnableNodes.begin();
+        for (const auto& replicaNode : worker.learnableNodes)
+        {
+            auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter++)->Value();
+            auto& replicaValue = dynamic_pointer_cast<ComputationNode<ElemType>>(replicaNode)->Value();
+            auto& modelAtLastSync = *modelAtLastSyncIter++;
+            Matrix<ElemType>::ScaleAndAdd((ElemType) (1.0 / numWorkers), replicaValue, value);
+            Matrix<ElemType>::ScaleAndAdd((ElemType) (-1.0 / numWorkers), modelAtLastSync, value);
+            replicaValue.SetValue(value);
+            modelAtLastSync.SetValue(value);
+            replicaNode->BumpEvalTimeStamp();
+        }
+    };
+
+    // per-minibatch progress of all workers together, logged like in TrainOneEpoch()
+    std::mutex progressMutex;
+    int numMBsRun = 0;
+    EpochCriterion criterionSoFar(0), criterionLastLogged(0);
+    std::vector<EpochCriterion> evalErrorsSoFar(evaluationNodes.size(), EpochCriterion(0)), evalErrorsLastLogged(evaluationNodes.size(), EpochCriterion(0));
+    size_t numColsSinceLastLogged = 0, numPaddedColsSinceLastLogged = 0;
+    Timer timer;
+    timer.Start();
+    auto logProgress = [&](const EpochCriterion& criterion, const std::vector<EpochCriterion>& evalErrors, size_t numCols, size_t numPaddedCols)
+    {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        numMBsRun++;
+        criterionSoFar += criterion;
+        for (size_t i = 0; i < evalErrors.size(); i++)
+            evalErrorsSoFar[i] += evalErrors[i];
+        numColsSinceLastLogged += numCols;
+        numPaddedColsSinceLastLogged += numPaddedCols;
+        if (numMBsRun <= m_firstMBsToShowResult || (m_numMBsToShowResult && (numMBsRun % m_numMBsToShowResult == 0)))
+        {
+            timer.Stop();
+            EpochCriterion criterionSinceLastLogged = criterionSoFar - criterionLastLogged;
+            if (m_traceLevel > 0)
+            {
+                PREPENDTS(stderr);
+                fprintf(stderr, "%s Epoch[%2d of %d]-Minibatch[%4d-%4d]: ",
+                        prefixMsg.c_str(), epochNumber + 1, (int) m_maxEpochs,
+                        (int) (numMBsRun - m_numMBsToShowResult + 1), numMBsRun);
+                criterionSinceLastLogged.LogCriterion(criterionNodes[0]->NodeName());
+                for (size_t i = 0; i < evalErrorsSoFar.size(); i++)
+                    (evalErrorsSoFar[i] - evalErrorsLastLogged[i]).LogCriterion(evaluationNodes[i]->NodeName());
+                if (numPaddedColsSinceLastLogged > 0)
+                    fprintf(stderr, "padding = %.1f%%; ", 100.0 * numPaddedColsSinceLastLogged / numColsSinceLastLogged);
+                fprintf(stderr, ("time = " + GeneratePaddedFloatOrExpFormat(0, 4, timer.ElapsedSeconds()) + "s; samplesPerSecond = %.1f\n").c_str(),
+                        timer.ElapsedSeconds(), criterionSinceLastLogged.second / timer.ElapsedSeconds());
+                fflush(stderr);
+            }
+            if (criterionSoFar.IsNan())
+                RuntimeError("The training criterion is not a number (NAN).");
+            criterionLastLogged = criterionSoFar;
+            evalErrorsLastLogged = evalErrorsSoFar;
+            numColsSinceLastLogged = 0;
+            numPaddedColsSinceLastLogged = 0;
+            timer.Restart();
+        }
+    };
+
+    std::mutex readerMutex;
+    std::vector<size_t> workerSamples(numWorkers, 0);
+    std::vector<EpochCriterion> workerCriteria(numWorkers);
+    std::vector<std::vector<EpochCriterion>> workerEvalErrors(numWorkers);
+    std::vector<std::exception_ptr> workerExceptions(numWorkers);
+    const int numThreadsPerWorker = std::max(1, (int) std::thread::hardware_concurrency() / (int) numWorkers);
+    auto workerLoop = [&](size_t w)
+    {
+        try
+        {
+            HogwildWorker& worker = *m_hogwildWorkers[w];
+            const std::vector<ComputationNodeBasePtr> workerCriterionNodes{ worker.criterionNode };
+            CriterionAccumulator<ElemType> localCriterion(1, CPUDEVICE);
+            CriterionAccumulator<ElemType> localEvalErrors(worker.evaluationNodes.size(), CPUDEVICE);
+#ifdef _OPENMP
+            omp_set_num_threads(numThreadsPerWorker); // (per-thread setting) split the cores among the workers
+#endif
+            size_t numMBsSinceSync = 0;
+            EpochCriterion criterionReported(0); // running totals of this worker as of its last call to logProgress()
+            std::vector<EpochCriterion> evalErrorsReported(worker.evaluationNodes.size(), EpochCriterion(0));
+            for (;;)
+            {
+                size_t actualMBSize = 0;
+                bool wasDataRead;
+                {
+                    std::lock_guard<std::mutex> lock(readerMutex);
+                    wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, worker.net, worker.criterionNode,
+                                                                                       false, false, worker.inputMatrices, actualMBSize, m_mpi);
+                }
+                if (!wasDataRead)
+                    break;
+                if (actualMBSize == 0)
+                    continue;
+
+                MarkDropoutNodesEvalTimeStampAsOutdated(worker.net, worker.criterionNode);
+                ComputationNetwork::BumpEvalTimeStamp(worker.net->FeatureNodes());
+                ComputationNetwork::BumpEvalTimeStamp(worker.net->LabelNodes());
+
+                worker.net->ForwardProp(worker.evaluationNodes);
+                worker.net->ForwardProp(worker.criterionNode);
+                if (learnRatePerSample > 0.01 * m_minLearnRate)
+                    worker.net->Backprop(worker.criterionNode);
+
+                size_t numSamplesWithLabelOfNetwork = worker.net->GetNumSamplesWithLabelOfNetwork(actualMBSize);
+                localCriterion.Add(workerCriterionNodes, 0, numSamplesWithLabelOfNetwork);
+                for (size_t i = 0; i < worker.evaluationNodes.size(); i++)
+                    localEvalErrors.Add(worker.evaluationNodes, i, numSamplesWithLabelOfNetwork);
+                size_t numSamplesInMinibatch = CriterionAccumulator<ElemType>::GetNumSamples(worker.criterionNode, numSamplesWithLabelOfNetwork);
+                workerSamples[w] += numSamplesInMinibatch;
+
+                // contribute this minibatch to the progress log
+                const auto& pMBLayout = worker.net->GetMBLayoutPtrOfNetwork();
+                EpochCriterion criterion = localCriterion.GetCriterion(0);
+                std::vector<EpochCriterion> evalErrors;
+                for (size_t i = 0; i < worker.evaluationNodes.size(); i++)
+                {
+                    EpochCriterion evalError = localEvalErrors.GetCriterion(i);
+                    evalErrors.push_back(evalError - evalErrorsReported[i]);
+                    evalErrorsReported[i] = evalError;
+                }
+                logProgress(criterion - criterionReported, evalErrors, pMBLayout->GetNumCols(), pMBLayout->GetNumCols() - pMBLayout->GetActualNumSamples());
+                criterionReported = criterion;
+
+                if (learnRatePerSample > m_minLearnRate * 0.01)
+                {
+                    // sparse gradients are applied to the touched columns only; the others catch up at the end of the epoch
+                    double momentumPerSample = GetMomentumPerSample(epochNumber, worker.net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences());
+                    auto smoothedGradientIter = worker.smoothedGradients.begin();
+                    for (auto nodeIter = worker.learnableNodes.begin(); nodeIter != worker.learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+                    {
+                        auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+                        if (!node->IsParameterUpdateRequired())
+                            continue;
+                        UpdateWeightsS(this, node->Value(), node->Gradient(), *smoothedGradientIter,
+                                       learnRatePerSample * node->GetLearningRateMultiplier(), momentumPerSample, numSamplesInMinibatch,
+                                       m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum,
+                                       node->Gradient().GetMatrixType() == MatrixType::SPARSE ? &worker.sparseUpdateHistories[*nodeIter] : nullptr);
+                        node->BumpEvalTimeStamp();
+                    }
+                }
+
+                if (!lockFree && ++numMBsSinceSync >= m_hogwildSyncPeriod)
+                {
+                    mergeWorker(worker);
+                    numMBsSinceSync = 0;
+                }
+            }
+
+            // bring the columns that lag behind from sparse updates up to date, as TrainOneEpoch() does
+            bool caughtUp = false;
+            auto smoothedGradientIter = worker.smoothedGradients.begin();
+            for (auto nodeIter = worker.learnableNodes.begin(); nodeIter != worker.learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+            {
+                auto historyIter = worker.sparseUpdateHistories.find(*nodeIter);
+                if (historyIter == worker.sparseUpdateHistories.end() || historyIter->second.numUpdates == 0)
+                    continue;
+                auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+                CatchUpSparseUpdatesS(this, node->Value(), node->Gradient(), *smoothedGradientIter,
+                                      learnRatePerSample * node->GetLearningRateMultiplier(),
+                                      GetMomentumPerSample(epochNumber, worker.net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()),
+                                      tunedMBSize, m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum, historyIter->second);
+                caughtUp = true;
+            }
+
+            if (!lockFree && (numMBsSinceSync > 0 || caughtUp))
+                mergeWorker(worker);
+
+            workerCriteria[w] = localCriterion.GetCriterion(0);
+            for (size_t i = 0; i < worker.evaluationNodes.size(); i++)
+                workerEvalErrors[w].push_back(localEvalErrors.GetCriterion(i));
+        }
+        catch (...)
+        {
+            workerExceptions[w] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < numWorkers; w++)
+        threads.push_back(std::thread(workerLoop, w));
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& exception : workerExceptions)
+        if (exception)
+            std::rethrow_exception(exception);
+
+    // the parameters of 'net' were changed behind its back
+    for (const auto& node : learnableNodes)
+        node->BumpEvalTimeStamp();
+
+    // average the workers' optimizer states into the one that is checkpointed
+    // (A worker that did not update a parameter may still hold it in a different shape; it is left out.)
+    std::vector<typename std::list<Matrix<ElemType>>::const_iterator> workerSmoothedGradientIters;
+    for (const auto& worker : m_hogwildWorkers)
+        workerSmoothedGradientIters.push_back(worker->smoothedGradients.begin());
+    for (auto& smoothedGradient : smoothedGradients)
+    {
+        size_t numMerged = 0;
+        for (auto& workerSmoothedGradientIter : workerSmoothedGradientIters)
+        {
+            const auto& workerSmoothedGradient = *workerSmoothedGradientIter++;
+            if (numMerged == 0)
+                smoothedGradient.SetValue(workerSmoothedGradient);
+            else if (workerSmoothedGradient.GetNumRows() == smoothedGradient.GetNumRows() && workerSmoothedGradient.GetNumCols() == smoothedGradient.GetNumCols())
+                Matrix<ElemType>::ScaleAndAdd((ElemType) 1, workerSmoothedGradient, smoothedGradient);
+            else
+                continue;
+            numMerged++;
+        }
+        Matrix<ElemType>::Scale((ElemType) (1.0 / numMerged), smoothedGradient);
+    }
+
+    size_t totalEpochSamples = 0;
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        totalEpochSamples += workerSamples[w];
+        epochCriterion += workerCriteria[w];
+        for (size_t i = 0; i < workerEvalErrors[w].size(); i++)
+            epochEvalErrors[i] += workerEvalErrors[w][i];
+    }
     return totalEpochSamples;
 }
 
@@ -1898,6 +2384,17 @@ void SGD<ElemType>::InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE de
 #endif 
     }
 }
+template <class ElemType>
+void SGD<ElemType>::InitParameterServer(int traceLevel)
+{
+    if (m_parameterServer)
+        return;
+    if (m_mpi == nullptr || m_mpi->NumNodesInUse() < 2)
+        InvalidArgument("ParameterServerSGD requires at least two MPI ranks (one worker and one server).");
+    m_parameterServer = make_shared<ParameterServerSGD<ElemType>>(m_mpi, m_numParameterServers, m_maxParameterStaleness,
+                                                                  m_numParameterServerGradientBits, traceLevel);
+}
+
 // public:
 // UpdateWeightsS - static version of UpdateWeights()
 // not static since it wants to access protected methods on the SGD object
@@ -1911,7 +2408,8 @@ template <class ElemType>
                                               const double L2RegWeight,
                                               const double L1RegWeight,
                                               const bool needAveMultiplier,
-                                              const bool useNesterovMomentum)
+                                              const bool useNesterovMomentum,
+                                              SparseUpdateHistory* sparseUpdateHistory)
 {
     // we use simple linear (instead of log linear) scaling here
     const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
@@ -1927,11 +2425,25 @@ template <class ElemType>
     // make actualMBSize is a valid value
     assert(actualMBSize > 0);
 
+    GradientsUpdateType adpType = sgd->GradUpdateType();
+    double noiseStd = sgd->GradientUpdateNoiseStd();
+
+    // fast path: clipping, L2, update and L1 in a single sweep over the data
+    if (sgd->m_useFusedWeightUpdate && noiseStd == 0 && Matrix<ElemType>::IsFusedWeightUpdateSupported(gradientValues, functionValues))
+    {
+        smoothedGradient.FusedUpdateWeights(gradientValues, functionValues,
+                                            sgd->GetFusedWeightUpdateParams(gradientValues, learnRatePerSample, momentum, actualMBSize,
+                                                                            L2RegWeight, L1RegWeight, needAveMultiplier, useNesterovMomentum,
+                                                                            sparseUpdateHistory));
+#if DUMPOUTPUT
+        functionValues.Print("Parameter Update");
+#endif
+        return;
+    }
+
     // clipping gradients to prevent outliers
     sgd->ClipGradient(gradientValues, actualMBSize);
 
-    GradientsUpdateType adpType = sgd->GradUpdateType();
-    double noiseStd = sgd->GradientUpdateNoiseStd();
     Matrix<ElemType> sgdUpdateNoise((DEVICEID_TYPE) functionValues.GetDeviceId());
     if (noiseStd > 0)
     {
@@ -1992,6 +2504,29 @@ template <class ElemType>
 #endif
 }
 
+// CatchUpSparseUpdatesS - apply the updates that the columns of a parameter updated by UpdateWeightsS() from sparse
+// gradients missed since they were last touched (see SparseUpdateHistory), assuming minibatches of 'actualMBSize' samples
+template <class ElemType>
+/*static*/ void SGD<ElemType>::CatchUpSparseUpdatesS(const SGD<ElemType>* sgd, Matrix<ElemType>& functionValues,
+                                                     const Matrix<ElemType>& gradientValues,
+                                                     Matrix<ElemType>& smoothedGradient,
+                                                     const double learnRatePerSample,
+                                                     const double momentumPerSample,
+                                                     size_t actualMBSize,
+                                                     const double L2RegWeight,
+                                                     const double L1RegWeight,
+                                                     const bool needAveMultiplier,
+                                                     const bool useNesterovMomentum,
+                                                     SparseUpdateHistory& sparseUpdateHistory)
+{
+    // same per-minibatch momentum as UpdateWeightsS()
+    const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
+    smoothedGradient.CatchUpFusedUpdates(functionValues,
+                                         sgd->GetFusedWeightUpdateParams(gradientValues, learnRatePerSample, momentum, actualMBSize,
+                                                                         L2RegWeight, L1RegWeight, needAveMultiplier, useNesterovMomentum,
+                                                                         &sparseUpdateHistory));
+}
+
 // protected:
 
 // UpdateWeights - update the weights in
@@ -2012,10 +2547,12 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
         LogicError("UpdateWeights() called for a learnable ComputationNode which has m_learningRateMultiplier == 0!");
 
     double nodeDependentLearningRatePerSample = learnRatePerSample * node->GetLearningRateMultiplier();
-    UpdateWeightsS(this, dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value(), dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient(),
+    auto& gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient();
+    UpdateWeightsS(this, dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value(), gradient,
                    smoothedGradient, nodeDependentLearningRatePerSample, momentumPerSample,
                    actualMBSize, L2RegWeight, L1RegWeight,
-                   needAveMultiplier, m_useNesterovMomentum);
+                   needAveMultiplier, m_useNesterovMomentum,
+                   gradient.GetMatrixType() == MatrixType::SPARSE ? &m_sparseUpdateHistories[node] : nullptr);
     node->BumpEvalTimeStamp();
 }
 
@@ -2040,6 +2577,66 @@ void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actual
     }
 }
 
+// gather everything UpdateWeightsS() does for one parameter into a description for Matrix::FusedUpdateWeights()
+template <class ElemType>
+FusedWeightUpdateParams SGD<ElemType>::GetFusedWeightUpdateParams(const Matrix<ElemType>& gradient,
+                                                                  const double learnRatePerSample,
+                                                                  const double momentum,
+                                                                  const size_t actualMBSize,
+                                                                  const double L2RegWeight, const double L1RegWeight,
+                                                                  const bool needAveMultiplier,
+                                                                  const bool useNesterovMomentum,
+                                                                  SparseUpdateHistory* sparseUpdateHistory) const
+{
+    FusedWeightUpdateParams params;
+    switch (GradUpdateType())
+    {
+    case GradientsUpdateType::None:
+        params.type = useNesterovMomentum ? FusedWeightUpdateType::Nesterov : FusedWeightUpdateType::Momentum;
+        break;
+    case GradientsUpdateType::AdaGrad:
+        params.type = FusedWeightUpdateType::AdaGrad;
+        break;
+    case GradientsUpdateType::FSAdaGrad:
+        params.type = FusedWeightUpdateType::FSAdaGrad;
+        break;
+    case GradientsUpdateType::RmsProp:
+        params.type = FusedWeightUpdateType::RmsProp;
+        params.rmsGamma = m_rpi.gamma;
+        params.rmsWeightInc = m_rpi.inc;
+        params.rmsWeightMax = m_rpi.max;
+        params.rmsWeightDec = m_rpi.dec;
+        params.rmsWeightMin = m_rpi.min;
+        break;
+    default:
+        LogicError("GetFusedWeightUpdateParams: Unexpected gradient update type.");
+    }
+    params.learnRatePerSample = learnRatePerSample;
+    params.momentum = momentum;
+    params.mbSize = actualMBSize;
+    params.needAveMultiplier = needAveMultiplier;
+    params.sparseUpdateHistory = sparseUpdateHistory;
+
+    // same as ClipGradient(), but only determines the scale or threshold; it is applied while sweeping over the data
+    if (m_clippingThresholdPerSample != std::numeric_limits<double>::infinity())
+    {
+        double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+        if (m_gradientClippingWithTruncation)
+            params.truncationThreshold = maxGradientPerMB;
+        else
+        {
+            double gradientNorm = gradient.FrobeniusNorm();
+            if (gradientNorm > maxGradientPerMB)
+                params.gradientScale = maxGradientPerMB / gradientNorm;
+        }
+    }
+
+    // regularizers are multiplied by actualMBSize so that they are invariant to minibatch size since learning rate is per sample
+    params.l2Weight = L2RegWeight > 0 ? L2RegWeight * actualMBSize : 0;
+    params.l1Threshold = learnRatePerSample * L1RegWeight * actualMBSize;
+    return params;
+}
+
 template <class ElemType>
 void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                                        const double learnRatePerSample,
@@ -2371,7 +2968,8 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
     else if (EqualCI(s, L"DataParallelSGD"))         return ParallelizationMethod::dataParallelSGD;
     else if (EqualCI(s, L"ModelAveragingSGD"))       return ParallelizationMethod::modelAveragingSGD;
     else if (EqualCI(s, L"BlockMomentumSGD"))        return ParallelizationMethod::blockMomentumSGD;
-    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD)");
+    else if (EqualCI(s, L"ParameterServerSGD"))      return ParallelizationMethod::parameterServerSGD;
+    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD | ParameterServerSGD)");
 }
 
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
@@ -2456,9 +3054,20 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t)10);
     m_firstMBsToShowResult = configSGD(L"firstMBsToShowResult", (size_t)0);
     m_numMBsToCUDAProfile = configSGD(L"numMBsToCUDAProfile", (size_t)0);
+    m_numMBsToCPUProfile = configSGD(L"numMBsToCPUProfile", (size_t)0);
+    m_cpuProfileTraceFile = (const wstring&) configSGD(L"cpuProfileTraceFile", L"");
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
+    m_useFusedWeightUpdate = configSGD(L"fusedWeightUpdate", true);
+    m_fuseElementwiseOperations = configSGD(L"fuseElementwiseOperations", false);
+    const wstring saveModelElementType = (const wstring&) configSGD(L"saveModelElementType", L""); // "float16" or "bfloat16"
+    m_finalModelFileOptions = saveModelElementType.empty() ? FileOptions::fileOptionsBinary : (FileOptions) (FileOptions::fileOptionsBinary | Float16FileOption(Float16FormatFromName(saveModelElementType)));
+    m_hoistLoopInvariantComputations = configSGD(L"hoistLoopInvariantComputations", false);
+    m_packedExecution = configSGD(L"packedExecution", false);
+    m_numParallelTraversalThreads = configSGD(L"parallelTraversalThreads", (size_t) 1);
+    m_hogwildThreads = configSGD(L"hogwildThreads", (size_t) 0);
+    m_hogwildSyncPeriod = configSGD(L"hogwildSyncPeriod", (size_t) 0);
 
     // sequence-training parameters
     m_hSmoothingWeight = configSGD(L"hSmoothingWeight", 0.95);
@@ -2619,6 +3228,9 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_enableDistributedMBReading = false;
     m_parallelizationStartEpochNum = 0;
     m_modelAggregationBlockSize = 0; 
+    m_numParameterServers = 1;
+    m_maxParameterStaleness = 4;
+    m_numParameterServerGradientBits = 8 * sizeofElemType;
 
     if (configSGD.Exists(L"ParallelTrain"))
     {
@@ -2754,6 +3366,15 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
                 InitializeAndCheckBlockMomentumSGDParameters();
                 
             }
+            if (configParallelTrain.Exists(L"ParameterServerSGD"))
+            {
+                const ConfigRecordType& configPSSGD(configParallelTrain(L"ParameterServerSGD", ConfigRecordType::Record()));
+                m_numParameterServers = configPSSGD(L"numServers", (size_t) 1);
+                m_maxParameterStaleness = configPSSGD(L"maxStaleness", (size_t) 4);
+                m_numParameterServerGradientBits = configPSSGD(L"gradientBits", (size_t) (8 * sizeofElemType));
+                if (m_numParameterServers >= numMPIWorkers)
+                    InvalidArgument("ParameterServerSGD: numServers must be less than the number of MPI ranks, so that at least one rank trains.");
+            }
         } // if (!pMPI)
     } // if (configSGD.Exists(L"ParallelTrain"))
 }
@@ -19,6 +19,7 @@
 #include <random>
 #include "Profiler.h"
 #include "MASGD.h"
+#include "ParameterServerSGD.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
@@ -60,6 +61,7 @@ enum class ParallelizationMethod : int
     dataParallelSGD = 1,
     modelAveragingSGD = 2,
     blockMomentumSGD = 3,
+    parameterServerSGD = 4,
     modelParallelSGD = (1 << 8) // Currently unsupported
 };
 
@@ -196,6 +198,30 @@ protected:
     bool m_gradientClippingWithTruncation;
     double m_clippingThresholdPerSample;
 
+    // perform clipping, regularization and the update in a single sweep where supported (dense CPU gradients)
+    bool m_useFusedWeightUpdate;
+
+    // replace chains of elementwise operations by single nodes that compute them in one pass (CPU only)
+    bool m_fuseElementwiseOperations;
+
+    // file options for the final model, which may be written with 16-bit elements (the models of the other epochs keep full precision)
+    FileOptions m_finalModelFileOptions;
+
+    // split products with stacked loop-invariant and recurrent inputs, so that the loop-invariant part is computed outside the loop
+    bool m_hoistLoopInvariantComputations;
+
+    // compute the nodes outside of recurrent loops on the valid frames only, skipping the padding of sequences of different lengths
+    bool m_packedExecution;
+
+    // number of CPU threads that execute independent nodes of the network concurrently (1: sequential traversal)
+    size_t m_numParallelTraversalThreads;
+
+    // Hogwild training: number of worker threads that each train a replica of the network on their own minibatches (0 or 1: off)
+    size_t m_hogwildThreads;
+    // 0: workers update the shared parameters in place without locking; N > 0: workers train private copies of the
+    // parameters and merge their changes into the shared model every N minibatches
+    size_t m_hogwildSyncPeriod;
+
     intargvector m_numMiniBatch4LRSearch;
     size_t m_numBestSearchEpoch;
 
@@ -240,6 +266,8 @@ protected:
     size_t m_numMBsToShowResult = 0;
     size_t m_firstMBsToShowResult = 0;
     int m_numMBsToCUDAProfile;
+    int m_numMBsToCPUProfile;           // number of minibatches to time the nodes of (see Profiler); first epoch of the run only
+    std::wstring m_cpuProfileTraceFile; // if not empty, the node timings are written there as a chrome://tracing file
 
     bool m_doGradientCheck;
     double m_gradientCheckSigDigit;
@@ -275,6 +303,11 @@ protected:
     double m_blockLearningRate; 
     double m_blockMomentumAsTimeConstant;
 
+    // Parallel training with parameter servers
+    size_t m_numParameterServers; // the last m_numParameterServers MPI ranks serve the model, the others train
+    size_t m_maxParameterStaleness; // max number of pushes a worker may be ahead of the slowest worker
+    size_t m_numParameterServerGradientBits;
+
     bool m_needAveMultiplier;
     double m_L2RegWeight;
     double m_L1RegWeight;
@@ -469,8 +502,25 @@ protected:
                          /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
                          const std::string& prefixMsg = "");
 
+    // multithreaded single-process variant of TrainOneEpoch(), see m_hogwildThreads
+    bool UsingHogwild(ComputationNetworkPtr net, const ComputationNodeBasePtr& refNode) const;
+    size_t TrainOneEpochHogwild(ComputationNetworkPtr net,
+                                const int epochNumber,
+                                const size_t epochSize,
+                                IDataReader* trainSetDataReader,
+                                const double learnRatePerSample,
+                                size_t tunedMBSize,
+                                const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                std::list<Matrix<ElemType>>& smoothedGradients,
+                                /*out*/ EpochCriterion& epochCriterion,
+                                /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
+                                const std::string& prefixMsg);
+
     void InitDistGradAgg(int numEvalNodes, int traceLevel);
     void InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE devID);
+    void InitParameterServer(int traceLevel);
 public:
     // UpdateWeightsS - static version of UpdateWeights()
     static void UpdateWeightsS(const SGD* sgd, Matrix<ElemType>& functionValues,
@@ -482,7 +532,20 @@ public:
                                const double L2RegWeight,
                                const double L1RegWeight,
                                const bool needAveMultiplier,
-                               const bool useNesterovMomentum);
+                               const bool useNesterovMomentum,
+                               SparseUpdateHistory* sparseUpdateHistory = nullptr);
+
+    static void CatchUpSparseUpdatesS(const SGD* sgd, Matrix<ElemType>& functionValues,
+                                      const Matrix<ElemType>& gradientValues,
+                                      Matrix<ElemType>& smoothedGradient,
+                                      const double learnRatePerSample,
+                                      const double momentumPerSample,
+                                      size_t actualMBSize,
+                                      const double L2RegWeight,
+                                      const double L1RegWeight,
+                                      const bool needAveMultiplier,
+                                      const bool useNesterovMomentum,
+                                      SparseUpdateHistory& sparseUpdateHistory);
 
 protected:
     // UpdateWeights - update the weights in
@@ -497,6 +560,16 @@ protected:
 
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
 
+    // describes clipping, regularization and the update for Matrix::FusedUpdateWeights()
+    FusedWeightUpdateParams GetFusedWeightUpdateParams(const Matrix<ElemType>& gradient,
+                                                       const double learnRatePerSample,
+                                                       const double momentum,
+                                                       const size_t actualMBSize,
+                                                       const double L2RegWeight, const double L1RegWeight,
+                                                       const bool needAveMultiplier,
+                                                       const bool useNesterovMomentum,
+                                                       SparseUpdateHistory* sparseUpdateHistory) const;
+
     void SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen, // TODO: combine totalSamplesSeen and prevCriterion into a EpochCriterion type
                             const double learnRatePerSample,
                             const std::list<Matrix<ElemType>>& smoothedGradients,
@@ -558,6 +631,26 @@ protected:
     std::shared_ptr<struct DistGradHeader> m_gradHeader;
 
     shared_ptr<IMASGD<ElemType>> m_pMASGDHelper;
+    shared_ptr<ParameterServerSGD<ElemType>> m_parameterServer;
+
+    // per-parameter bookkeeping for sparse gradient updates (lazy momentum/decay catch-up of untouched columns)
+    // Updated from the const UpdateWeights(); not part of the checkpoint, so the catch-up restarts after loading one.
+    mutable std::map<ComputationNodeBasePtr, SparseUpdateHistory> m_sparseUpdateHistories;
+
+    // state of one Hogwild worker thread
+    struct HogwildWorker
+    {
+        ComputationNetworkPtr net; // replica of the trained network
+        ComputationNodeBasePtr criterionNode;
+        std::vector<ComputationNodeBasePtr> evaluationNodes;
+        std::list<ComputationNodeBasePtr> learnableNodes;  // in the same order as the trained network's
+        std::list<Matrix<ElemType>> smoothedGradients;     // optimizer state, private to the worker during an epoch
+        std::map<ComputationNodeBasePtr, SparseUpdateHistory> sparseUpdateHistories; // per replica parameter, see m_sparseUpdateHistories
+        std::list<Matrix<ElemType>> modelAtLastSync;       // (m_hogwildSyncPeriod > 0) shared model as of the last merge
+        StreamMinibatchInputs inputMatrices;
+    };
+    std::vector<std::unique_ptr<HogwildWorker>> m_hogwildWorkers;
+    ComputationNetworkPtr m_hogwildNet; // the network m_hogwildWorkers were created for
 
 private:
     void MarkDropoutNodesEvalTimeStampAsOutdated(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode);
@@ -572,9 +665,13 @@ private:
                  GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) &&
                 (epochNumber >= m_parallelizationStartEpochNum));
     }
+    bool UsingParameterServer(size_t epochNumber) const
+    {
+        return ((GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD) && (epochNumber >= m_parallelizationStartEpochNum));
+    }
     bool UsingParallelTrain(size_t epochNumber) const
     {
-        return UsingGradientAggregation(epochNumber) || UsingModelAggregation(epochNumber);
+        return UsingGradientAggregation(epochNumber) || UsingModelAggregation(epochNumber) || UsingParameterServer(epochNumber);
     }
 };
 
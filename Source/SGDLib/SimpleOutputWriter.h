@@ -18,11 +18,105 @@
 #include <cstdio>
 #include "ProgressTracing.h"
 #include "ComputationNetworkBuilder.h"
+#include "MPIWrapper.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
 
 using namespace std;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// AsyncOutputQueue -- runs output jobs (formatting and writing) in order on a background thread
+// At most 'maxPending' jobs are queued; Post() blocks beyond that, to bound the memory held by the snapshots.
+// An exception in a job is rethrown by the next Post() or by Finish().
+// -----------------------------------------------------------------------
+
+class AsyncOutputQueue
+{
+public:
+    AsyncOutputQueue(size_t maxPending)
+        : m_maxPending(max(maxPending, (size_t) 1)), m_finishing(false), m_thread([this]() { Run(); })
+    {
+    }
+
+    ~AsyncOutputQueue()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_finishing = true;
+            }
+            m_changed.notify_all();
+            m_thread.join();
+        }
+    }
+
+    void Post(function<void()>&& job)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_jobs.size() < m_maxPending || m_error; });
+        if (m_error)
+            rethrow_exception(m_error);
+        m_jobs.push_back(move(job));
+        m_changed.notify_all();
+    }
+
+    // wait until all jobs have been run
+    void Finish()
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_finishing = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+        if (m_error)
+            rethrow_exception(m_error);
+    }
+
+private:
+    void Run()
+    {
+        for (;;)
+        {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_changed.wait(lock, [this]() { return !m_jobs.empty() || m_finishing; });
+                if (m_jobs.empty() || m_error)
+                    return;
+                job = move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            m_changed.notify_all();
+            try
+            {
+                job();
+            }
+            catch (...)
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_error = current_exception();
+                m_changed.notify_all();
+                return;
+            }
+        }
+    }
+
+    size_t m_maxPending;
+    bool m_finishing;
+    deque<function<void()>> m_jobs;
+    exception_ptr m_error;
+    mutex m_mutex;
+    condition_variable m_changed;
+    thread m_thread; // (last, so that it starts after the other members are initialized)
+};
 
 template <class ElemType>
 class SimpleOutputWriter
@@ -30,8 +124,10 @@ class SimpleOutputWriter
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
 
 public:
-    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0)
-        : m_net(net), m_verbosity(verbosity)
+    // With an 'mpi' object and more than one rank, the text output (WriteOutput() with an outputPath) is distributed:
+    // each rank reads its share of the data and writes it to its own shard, see WriteOutputDistributed().
+    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0, const MPIWrapperPtr& mpi = nullptr)
+        : m_net(net), m_verbosity(verbosity), m_mpi(mpi)
     {
     }
 
@@ -152,6 +248,13 @@ public:
     // TODO: Remove code dup with above function by creating a fake Writer object and then calling the other function.
     void WriteOutput(IDataReader& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, const WriteFormattingOptions& formattingOptions, size_t numOutputSamples = requestDataSize, bool nodeUnitTest = false)
     {
+        if (m_mpi && m_mpi->NumNodesInUse() > 1 && !nodeUnitTest)
+        {
+            if (!dataReader.SupportsDistributedMBRead())
+                InvalidArgument("write: Distributed output requires a reader that supports distributed reading.");
+            return WriteOutputDistributed(dataReader, mbSize, outputPath, outputNodeNames, formattingOptions, numOutputSamples);
+        }
+
         // In case of unit test, make sure backprop works
         ScopedNetworkOperationMode modeGuard(m_net, nodeUnitTest ? NetworkOperationMode::training : NetworkOperationMode::inferring);
 
@@ -292,9 +395,184 @@ public:
             iter.second->Flush();
     }
 
+    // Distributed version of WriteOutput() for scoring large data sets: Each rank reads its share of the data
+    // and writes it to its own shard '<outputPath>.<nodeName>.rank<r>'. The text formatting and writing runs on a
+    // background thread, overlapped with the evaluation of the following minibatches.
+    // The main node writes '<outputPath>.manifest', which lists the shards and, in reading order (by minibatch,
+    // then rank), the byte range of each minibatch within its shard, so that the shards can be merged in order.
+    // Prologue and epilogue are written to each shard, outside of these ranges.
+    void WriteOutputDistributed(IDataReader& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, const WriteFormattingOptions& formattingOptions, size_t numOutputSamples = requestDataSize,
+                                size_t maxPendingMinibatches = 4)
+    {
+        ScopedNetworkOperationMode modeGuard(m_net, NetworkOperationMode::inferring);
+
+        if (outputPath == L"-")
+            InvalidArgument("write: Distributed output cannot be written to stdout.");
+
+        const size_t rank = m_mpi->CurrentNodeRank();
+        const size_t numRanks = m_mpi->NumNodesInUse();
+
+        std::vector<ComputationNodeBasePtr> outputNodes = m_net->OutputNodesByName(outputNodeNames);
+        std::vector<ComputationNodeBasePtr> inputNodes = m_net->InputNodesForOutputs(outputNodeNames);
+        m_net->AllocateAllMatrices({}, outputNodes, nullptr);
+        StreamMinibatchInputs inputMatrices = DataReaderHelpers::RetrieveInputMatrices(inputNodes);
+
+        std::vector<std::string> labelMapping;
+        if ((formattingOptions.isCategoryLabel || formattingOptions.isSparse) && !formattingOptions.labelMappingFile.empty())
+            File::LoadLabelFile(formattingOptions.labelMappingFile, labelMapping);
+
+        // open this rank's shards
+        File::MakeIntermediateDirs(outputPath);
+        std::vector<shared_ptr<File>> outputStreams;
+        for (auto& onode : outputNodes)
+        {
+            outputStreams.push_back(make_shared<File>(ShardPath(outputPath, onode->NodeName(), rank), fileOptionsWrite | fileOptionsText));
+            fprintfOrDie(*outputStreams.back(), "%s", formattingOptions.prologue.c_str());
+        }
+
+        // per minibatch: minibatch index, #samples, and [begin,end) byte offsets for each output node
+        // Each record is filled in by the output thread; we only look at them after outputQueue.Finish().
+        const size_t recordSize = 2 + 2 * outputNodes.size();
+        std::vector<shared_ptr<std::vector<size_t>>> records;
+
+        dataReader.StartDistributedMinibatchLoop(mbSize, 0, rank, numRanks, numOutputSamples);
+        m_net->StartEvaluateMinibatchLoop(outputNodes);
+
+        char formatChar = !formattingOptions.isCategoryLabel ? 'f' : !formattingOptions.labelMappingFile.empty() ? 's' : 'u';
+        std::string valueFormatString = "%" + formattingOptions.precisionFormat + formatChar;
+
+        size_t totalSamples = 0;
+        size_t actualMBSize;
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        {
+            AsyncOutputQueue outputQueue(maxPendingMinibatches);
+            for (size_t numMBsRun = 0; DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, true, true, inputMatrices, actualMBSize, m_mpi); numMBsRun++)
+            {
+                if (actualMBSize == 0) // (distributed reading may leave a rank without data in a minibatch)
+                    continue;
+                ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+
+                // compute, and take a snapshot of what is to be written, so that the network can go on with the next minibatch
+                struct Snapshot
+                {
+                    shared_ptr<ElemType> data;
+                    size_t rows;
+                    TensorShape sampleLayout;
+                    MBLayoutPtr pMBLayout;
+                };
+                auto snapshots = make_shared<std::vector<Snapshot>>();
+                for (auto& onode : outputNodes)
+                {
+                    m_net->ForwardProp(onode);
+                    auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(onode);
+                    Snapshot snapshot;
+                    snapshot.data = shared_ptr<ElemType>(node->Value().CopyToArray(), [](ElemType* p) { delete[] p; });
+                    snapshot.rows = node->Value().GetNumRows();
+                    snapshot.sampleLayout = node->GetSampleLayout();
+                    if (node->HasMBLayout())
+                    {
+                        snapshot.pMBLayout = make_shared<MBLayout>();
+                        snapshot.pMBLayout->CopyFrom(node->GetMBLayout());
+                    }
+                    snapshots->push_back(snapshot);
+                }
+
+                auto record = make_shared<std::vector<size_t>>(recordSize);
+                (*record)[0] = numMBsRun;
+                (*record)[1] = actualMBSize;
+                records.push_back(record);
+                outputQueue.Post([&, snapshots, record, numMBsRun]()
+                {
+                    for (size_t i = 0; i < outputNodes.size(); i++)
+                    {
+                        const auto& name = outputNodes[i]->NodeName();
+                        const auto& snapshot = (*snapshots)[i];
+                        File& file = *outputStreams[i];
+                        (*record)[2 + 2 * i] = file.GetPosition();
+                        ComputationNode<ElemType>::WriteMinibatchWithFormatting(file, snapshot.data.get(), snapshot.rows, snapshot.sampleLayout, snapshot.pMBLayout,
+                            FrameRange(), SIZE_MAX, SIZE_MAX, formattingOptions.transpose, formattingOptions.isCategoryLabel, formattingOptions.isSparse, labelMapping,
+                            formattingOptions.Processed(name, formattingOptions.sequenceSeparator, numMBsRun),
+                            formattingOptions.Processed(name, formattingOptions.sequencePrologue, numMBsRun),
+                            formattingOptions.Processed(name, formattingOptions.sequenceEpilogue, numMBsRun),
+                            formattingOptions.Processed(name, formattingOptions.elementSeparator, numMBsRun),
+                            formattingOptions.Processed(name, formattingOptions.sampleSeparator, numMBsRun),
+                            valueFormatString);
+                        (*record)[3 + 2 * i] = file.GetPosition();
+                    }
+                });
+                totalSamples += actualMBSize;
+
+                numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+                dataReader.DataEnd();
+            }
+            outputQueue.Finish();
+        }
+
+        for (auto& stream : outputStreams)
+        {
+            fprintfOrDie(*stream, "%s", formattingOptions.epilogue.c_str());
+            stream->Flush();
+        }
+
+        // gather the records on the main node: all ranks contribute their records to their slice of a zero-filled vector
+        std::vector<size_t> numRecords(numRanks, 0);
+        numRecords[rank] = records.size();
+        m_mpi->AllReduce(numRecords);
+        size_t numRecordsBefore = 0;
+        for (size_t r = 0; r < rank; r++)
+            numRecordsBefore += numRecords[r];
+        size_t numRecordsTotal = numRecordsBefore;
+        for (size_t r = rank; r < numRanks; r++)
+            numRecordsTotal += numRecords[r];
+        std::vector<size_t> allRecords(numRecordsTotal * recordSize, 0);
+        for (size_t j = 0; j < records.size(); j++)
+            std::copy(records[j]->begin(), records[j]->end(), allRecords.begin() + (numRecordsBefore + j) * recordSize);
+        m_mpi->AllReduce(allRecords);
+        m_mpi->AllReduce(&totalSamples, 1);
+
+        if (m_mpi->IsMainNode())
+        {
+            // order: by minibatch index, then by rank
+            std::vector<std::pair<size_t, size_t>> order; // (record index, rank)
+            for (size_t r = 0, k = 0; r < numRanks; r++)
+                for (size_t j = 0; j < numRecords[r]; j++, k++)
+                    order.push_back(std::make_pair(k, r));
+            std::stable_sort(order.begin(), order.end(), [&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b)
+            {
+                return allRecords[a.first * recordSize] < allRecords[b.first * recordSize];
+            });
+
+            File manifest(outputPath + L".manifest", fileOptionsWrite | fileOptionsText);
+            fprintfOrDie(manifest, "# distributed output of the write command: %d ranks, %d output nodes\n", (int) numRanks, (int) outputNodes.size());
+            fprintfOrDie(manifest, "# shard <rank> <node> <path>\n");
+            for (size_t r = 0; r < numRanks; r++)
+                for (auto& onode : outputNodes)
+                    fprintfOrDie(manifest, "shard %d %ls %ls\n", (int) r, onode->NodeName().c_str(), ShardPath(outputPath, onode->NodeName(), r).c_str());
+            fprintfOrDie(manifest, "# minibatch <index> <rank> <numSamples> then for each node in the order above: <byteBegin> <byteEnd>\n");
+            for (const auto& entry : order)
+            {
+                const size_t* record = allRecords.data() + entry.first * recordSize;
+                fprintfOrDie(manifest, "minibatch %d %d %d", (int) record[0], (int) entry.second, (int) record[1]);
+                for (size_t i = 0; i < outputNodes.size(); i++)
+                    fprintfOrDie(manifest, " %llu %llu", (unsigned long long) record[2 + 2 * i], (unsigned long long) record[3 + 2 * i]);
+                fprintfOrDie(manifest, "\n");
+            }
+            manifest.Flush();
+        }
+
+        fprintf(stderr, "Written to %ls*\nTotal Samples Evaluated = %lu (over %d ranks)\n", outputPath.c_str(), totalSamples, (int) numRanks);
+    }
+
 private:
+    static std::wstring ShardPath(const std::wstring& outputPath, const std::wstring& nodeName, size_t rank)
+    {
+        return outputPath + L"." + nodeName + L".rank" + std::to_wstring(rank);
+    }
+
     ComputationNetworkPtr m_net;
     int m_verbosity;
+    MPIWrapperPtr m_mpi;
     void operator=(const SimpleOutputWriter&); // (not assignable)
 };
 
@@ -284,5 +284,90 @@ BOOST_AUTO_TEST_CASE(EvalSparseTimesTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalStreamingRecurrenceTest)
+{
+    // h(t) = x(t) + 0.5 h(t-1), o(t) = h(t) + x(t-2)
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "h = Plus(i1, Times(Constant(0.5), PastValue(1, h, timeStep=1, defaultHiddenActivity=0.1))) \n"
+        "ol = Plus(h, PastValue(1, i1, timeStep=2, defaultHiddenActivity=0), tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // the output for a whole sequence
+    auto expectedOutput = [](const std::vector<float>& x)
+    {
+        std::vector<float> o(x.size());
+        float h = 0.1f;
+        for (size_t t = 0; t < x.size(); t++)
+        {
+            h = x[t] + 0.5f * h;
+            o[t] = h + (t >= 2 ? x[t - 2] : 0);
+        }
+        return o;
+    };
+
+    const std::vector<float> sequence1{ 1, 2, 3, 4, 5, 6 };
+    const std::vector<float> sequence2{ 10, 20, 30, 40 };
+    std::vector<float> output1, output2;
+
+    // evaluates the given chunks of the given sessions, and appends their outputs
+    auto evaluate = [&](const std::vector<size_t>& sessionIds, const std::vector<std::vector<float>>& chunks, std::vector<std::vector<float>*> outputs)
+    {
+        std::vector<Values<float>> inputBuffers(sessionIds.size(), Values<float>(1));
+        std::vector<Values<float>> outputBuffers;
+        for (size_t j = 0; j < sessionIds.size(); j++)
+        {
+            inputBuffers[j][0].m_buffer = chunks[j];
+            outputBuffers.push_back(outputLayouts.CreateBuffers<float>({ chunks[j].size() }));
+        }
+        eval->ForwardPassStreaming(sessionIds, inputBuffers, outputBuffers);
+        for (size_t j = 0; j < sessionIds.size(); j++)
+        {
+            BOOST_REQUIRE_EQUAL(outputBuffers[j][0].m_buffer.size(), chunks[j].size());
+            outputs[j]->insert(outputs[j]->end(), outputBuffers[j][0].m_buffer.begin(), outputBuffers[j][0].m_buffer.end());
+        }
+    };
+
+    // chunks of different lengths, including one that is shorter than the delay of 2
+    evaluate({ 1, 2 }, { { 1, 2 }, { 10, 20, 30 } }, { &output1, &output2 });
+    evaluate({ 1 }, { { 3 } }, { &output1 });
+    evaluate({ 2, 1 }, { { 40 }, { 4, 5, 6 } }, { &output2, &output1 });
+
+    auto expected1 = expectedOutput(sequence1);
+    auto expected2 = expectedOutput(sequence2);
+    BOOST_REQUIRE_EQUAL(output1.size(), expected1.size());
+    BOOST_REQUIRE_EQUAL(output2.size(), expected2.size());
+    for (size_t t = 0; t < expected1.size(); t++)
+        BOOST_CHECK_CLOSE(output1[t], expected1[t], 1e-4);
+    for (size_t t = 0; t < expected2.size(); t++)
+        BOOST_CHECK_CLOSE(output2[t], expected2[t], 1e-4);
+
+    // an ended session starts a new sequence
+    eval->EndStreamingSession(1);
+    std::vector<float> output3;
+    evaluate({ 1 }, { { 1, 2 } }, { &output3 });
+    BOOST_CHECK_CLOSE(output3[0], expected1[0], 1e-4);
+    BOOST_CHECK_CLOSE(output3[1], expected1[1], 1e-4);
+
+    // the output buffers must have room for the chunk
+    std::vector<Values<float>> inputBuffers(1, Values<float>(1));
+    std::vector<Values<float>> outputBuffers(1, outputLayouts.CreateBuffers<float>({ 1 }));
+    inputBuffers[0][0].m_buffer = { 1, 2 };
+    BOOST_REQUIRE_THROW(eval->ForwardPassStreaming({ 3 }, inputBuffers, outputBuffers), std::exception); // Not enough capacity in output.
+
+    eval->Destroy();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }}}}
\ No newline at end of file
@@ -9,6 +9,7 @@
 //#include "Windows.h"
 #include "Matrix.h"
 #include "CPUMatrix.h"
+#include "CPUSparseMatrix.h"
 #include "TensorView.h"
 #include "Sequences.h"
 #include <chrono>
@@ -336,10 +337,53 @@ void MandSTest(int count, int devId)
     delete[] data3;
 }
 
+// dense x sparse products of a word embedding (hiddenDim x vocabSize) with a minibatch of one-hot words,
+// with the words drawn from a Zipf-like distribution, as in text data
+template <class ElemType>
+void SparseEmbeddingTest(int hiddenDim, int vocabSize, int mbSize, int count)
+{
+    cout << "Testing CPUSparseMatrix" << endl;
+    cout << "E(" << hiddenDim << "x" << vocabSize << ") and X(" << vocabSize << "," << mbSize << ")" << endl;
+    CPUMatrix<ElemType> E(hiddenDim, vocabSize);
+    randomInitializeCPUMatrix<ElemType>(E);
+    CPUSparseMatrix<ElemType> X(matrixFormatSparseCSC, vocabSize, mbSize, mbSize);
+    for (int j = 0; j < mbSize; j++)
+    {
+        double u = 1.0 * rand() / RAND_MAX;
+        X.SetValue((size_t) (pow((double) vocabSize, u) - 1), j, 1);
+    }
+    CPUMatrix<ElemType> H(hiddenDim, mbSize);
+    randomInitializeCPUMatrix<ElemType>(H);
+    CPUSparseMatrix<ElemType> gradient(matrixFormatSparseBlockCol);
+
+    auto t_start = clock();
+    for (int i = 0; i < count; ++i)
+        CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, E, false, X, false, 0, H);
+    auto t_end = clock();
+    std::cout << "H = E * X in: " << 1.0 * (t_end - t_start) / (CLOCKS_PER_SEC * count) << " seconds" << endl;
+
+    t_start = clock();
+    for (int i = 0; i < count; ++i)
+        CPUSparseMatrix<ElemType>::MultiplyAndAdd(1, H, false, X, true, gradient);
+    t_end = clock();
+    std::cout << "gradient = H * X' (block columns) in: " << 1.0 * (t_end - t_start) / (CLOCKS_PER_SEC * count) << " seconds" << endl;
+
+    t_start = clock();
+    for (int i = 0; i < count; ++i)
+        CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, H, false, X, true, 0, E);
+    t_end = clock();
+    std::cout << "gradient = H * X' (dense) in: " << 1.0 * (t_end - t_start) / (CLOCKS_PER_SEC * count) << " seconds" << endl;
+}
+
 int wmain()
 {
     // MandSTest<float>(100, 2);
 
+    cout << endl << "********************CPUSparseMatrix embedding TEST********************" << endl;
+    SparseEmbeddingTest<float>(128, 10000, 1024, 10);
+    SparseEmbeddingTest<float>(128, 100000, 1024, 10);
+    SparseEmbeddingTest<float>(128, 1000000, 1024, 10);
+
     /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
     SquareMultiplyAndAdd10TimesAvgTest<float>(4096,10);
 
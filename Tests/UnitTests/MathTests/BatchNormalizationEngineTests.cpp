@@ -408,6 +408,111 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationBackward)
     }
 }
 
+// The CPU engine is compared against a straightforward double-precision implementation.
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuEngine)
+{
+    std::mt19937 rng(0);
+    std::normal_distribution<float> nd;
+    auto randomMatrix = [&](size_t r, size_t c, float offset) -> SingleMatrix
+    {
+        vec buf(r * c);
+        std::generate(begin(buf), end(buf), [&] { return offset + nd(rng); });
+        return SingleMatrix(r, c, buf.data(), CPUDEVICE, matrixFlagNormal);
+    };
+
+    const double eps = 1e-5;
+    for (const auto& inOutT : { TensorShape(17), TensorShape(200), TensorShape(5, 4, 3), TensorShape(1, 1, 70) })
+    for (bool spatial : { false, true })
+    for (double expAvgFactor : { 1.0, 0.1 })
+    for (bool fusedRelu : { false, true })
+    {
+        if (spatial && inOutT.GetRank() < 3)
+            continue;
+        const size_t batchSize = 13;
+        const size_t crow = inOutT.GetNumElements();
+        const size_t crowScaleBias = spatial ? inOutT[2] : crow;
+        const size_t spatialSize = crow / crowScaleBias;
+        const size_t m = batchSize * spatialSize;
+        auto eng = BNEng::Create(CPUDEVICE, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cpu, fusedRelu);
+
+        SingleMatrix x = randomMatrix(crow, batchSize, 100); // (large mean, to test the numerical stability of the variance)
+        SingleMatrix scale = randomMatrix(crowScaleBias, 1, 0);
+        SingleMatrix bias = randomMatrix(crowScaleBias, 1, 0);
+        SingleMatrix runMean = randomMatrix(crowScaleBias, 1, 0);
+        SingleMatrix runInvStdDev = randomMatrix(crowScaleBias, 1, 1);
+        SingleMatrix dy = randomMatrix(crow, batchSize, 0);
+        SingleMatrix dx = randomMatrix(crow, batchSize, 0);
+        SingleMatrix out(crow, batchSize, CPUDEVICE);
+        SingleMatrix saveMean(CPUDEVICE), saveInvStdDev(CPUDEVICE), dScale(CPUDEVICE), dBias(CPUDEVICE);
+
+        // expected values
+        SingleMatrix expOut(crow, batchSize, CPUDEVICE), expDx(dx.DeepClone());
+        SingleMatrix expMean(crowScaleBias, 1, CPUDEVICE), expInvStdDev(crowScaleBias, 1, CPUDEVICE), expDScale(crowScaleBias, 1, CPUDEVICE), expDBias(crowScaleBias, 1, CPUDEVICE);
+        SingleMatrix expRunMean(runMean.DeepClone()), expRunInvStdDev(runInvStdDev.DeepClone());
+        for (size_t c = 0; c < crowScaleBias; c++)
+        {
+            auto forEach = [&](const std::function<void(size_t i, size_t n)>& f)
+            {
+                for (size_t n = 0; n < batchSize; n++)
+                    for (size_t k = 0; k < spatialSize; k++)
+                        f(c * spatialSize + k, n);
+            };
+            double mean = 0, variance = 0;
+            forEach([&](size_t i, size_t n) { mean += x(i, n); });
+            mean /= m;
+            forEach([&](size_t i, size_t n) { variance += (x(i, n) - mean) * (x(i, n) - mean); });
+            const double invStdDev = 1 / sqrt(variance / m + eps);
+            expMean(c, 0) = (float) mean;
+            expInvStdDev(c, 0) = (float) invStdDev;
+            expRunMean(c, 0) = (float) (expAvgFactor * mean + (1 - expAvgFactor) * runMean(c, 0));
+            expRunInvStdDev(c, 0) = (float) (expAvgFactor * invStdDev + (1 - expAvgFactor) * runInvStdDev(c, 0));
+
+            double ds = 0, db = 0;
+            forEach([&](size_t i, size_t n)
+            {
+                const double xHat = (x(i, n) - mean) * invStdDev;
+                const double y = scale(c, 0) * xHat + bias(c, 0);
+                expOut(i, n) = (float) (fusedRelu ? std::max(y, 0.0) : y);
+                const double g = fusedRelu && y <= 0 ? 0 : dy(i, n);
+                ds += g * xHat;
+                db += g;
+            });
+            expDScale(c, 0) = (float) ds;
+            expDBias(c, 0) = (float) db;
+            forEach([&](size_t i, size_t n)
+            {
+                const double xHat = (x(i, n) - mean) * invStdDev;
+                const double y = scale(c, 0) * xHat + bias(c, 0);
+                const double g = fusedRelu && y <= 0 ? 0 : dy(i, n);
+                expDx(i, n) += (float) (scale(c, 0) * invStdDev * (g - (xHat * ds + db) / m));
+            });
+        }
+
+        eng->Forward(x, scale, bias, expAvgFactor, /*blendFactor=*/0, runMean, runInvStdDev, out, eps, saveMean, saveInvStdDev);
+        eng->Backward(x, dy, dx, scale, /*blendFactor=*/0, saveMean, saveInvStdDev, dScale, dBias);
+
+        std::stringstream tmsg;
+        tmsg << "inOut tensor: " << (std::string)inOutT << ", spatial = " << spatial << ", expAvg = " << expAvgFactor << ", fusedRelu = " << fusedRelu;
+        std::string emsg;
+        BOOST_REQUIRE_MESSAGE(CheckEqual(saveMean, expMean, emsg, 1e-5f, 1e-5f), "saveMean, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(saveInvStdDev, expInvStdDev, emsg, 1e-3f, 1e-5f), "saveInvStdDev, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(runMean, expRunMean, emsg, 1e-5f, 1e-5f), "runMean, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(runInvStdDev, expRunInvStdDev, emsg, 1e-3f, 1e-5f), "runInvStdDev, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(out, expOut, emsg, 1e-3f, 1e-3f), "out, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dScale, expDScale, emsg, 1e-3f, 1e-3f), "dScale, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dBias, expDBias, emsg, 1e-4f, 1e-4f), "dBias, " << tmsg.str() << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dx, expDx, emsg, 1e-3f, 1e-3f), "dx, " << tmsg.str() << ". " << emsg);
+
+        // inference: only the running statistics are used, and saveMean/saveInvStdDev are returned empty
+        eng->Forward(x, scale, bias, /*expAvgFactor=*/0, /*blendFactor=*/1, runMean, runInvStdDev, out, eps, saveMean, saveInvStdDev);
+        BOOST_REQUIRE(saveMean.IsEmpty() && saveInvStdDev.IsEmpty());
+        BOOST_REQUIRE_MESSAGE(CheckEqual(runMean, expRunMean, emsg, 1e-5f, 1e-5f), "runMean (inference), " << tmsg.str() << ". " << emsg);
+        const size_t i = crow - 1, n = batchSize - 1, c = crowScaleBias - 1;
+        const float y = scale(c, 0) * (x(i, n) - runMean(c, 0)) * runInvStdDev(c, 0) + bias(c, 0);
+        BOOST_REQUIRE_CLOSE(out(i, n) + 1, (fusedRelu ? std::max(y, 0.0f) : y) + 1, 1e-2);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
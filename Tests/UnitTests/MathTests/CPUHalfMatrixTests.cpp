@@ -0,0 +1,118 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUHalfMatrix.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(CPUHalfMatrixSuite)
+
+BOOST_AUTO_TEST_CASE(HalfConversions)
+{
+    // exactly representable values, and rounding to nearest even
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f), 0x3c00);
+    BOOST_CHECK_EQUAL(FloatToHalf(-2.0f), 0xc000);
+    BOOST_CHECK_EQUAL(FloatToHalf(65504.0f), 0x7bff);
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f + 1.0f / 2048), 0x3c00);                 // tie: to even
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f + 3.0f / 2048), 0x3c02);                 // tie: to even
+    BOOST_CHECK_EQUAL(FloatToHalf(65519.0f), 0x7bff);
+    BOOST_CHECK_EQUAL(FloatToHalf(65520.0f), 0x7c00);                           // overflow
+    BOOST_CHECK_EQUAL(FloatToHalf(ldexpf(1.0f, -24)), 0x0001);                  // smallest subnormal
+    BOOST_CHECK_EQUAL(FloatToHalf(ldexpf(1.0f, -25)), 0x0000);                  // tie: to even
+    BOOST_CHECK_EQUAL(FloatToHalf(ldexpf(1.5f, -25)), 0x0001);
+    BOOST_CHECK_EQUAL(FloatToHalf(ldexpf(1023.5f, -24)), 0x0400);               // rounds up to the smallest normal
+    BOOST_CHECK_EQUAL(FloatToHalf(-std::numeric_limits<float>::infinity()), 0xfc00);
+    BOOST_CHECK(std::isnan(HalfToFloat(FloatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+    // all finite half values convert to float and back exactly
+    for (uint32_t h = 0; h < 0x10000; h++)
+    {
+        if ((h & 0x7c00) == 0x7c00)
+            continue;
+        BOOST_REQUIRE_EQUAL(FloatToHalf(HalfToFloat((uint16_t) h)), h);
+    }
+    BOOST_CHECK_EQUAL(HalfToFloat(0x0001), ldexpf(1.0f, -24));
+    BOOST_CHECK_EQUAL(HalfToFloat(0x3555), 0.333251953125f);
+
+    // bfloat16 keeps the exponent of float, and rounds the mantissa to 8 bits
+    BOOST_CHECK_EQUAL(FloatToBFloat16(1.0f), 0x3f80);
+    BOOST_CHECK_EQUAL(FloatToBFloat16(1.0f + 1.0f / 256), 0x3f80);              // tie: to even
+    BOOST_CHECK_EQUAL(FloatToBFloat16(1.0f + 3.0f / 256), 0x3f82);              // tie: to even
+    BOOST_CHECK_EQUAL(FloatToBFloat16(1e30f), 0x714a);                         // (0x7149f2ca rounded up)
+    BOOST_CHECK_EQUAL(BFloat16ToFloat(0x714a), 1.0002555517e30f);
+    BOOST_CHECK(std::isnan(BFloat16ToFloat(FloatToBFloat16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+BOOST_AUTO_TEST_CASE(HalfBulkConversions)
+{
+    // the bulk conversions (vectorized with F16C) agree with the scalar ones, including the remainder
+    std::vector<float> values(37);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = (float) ((i * 7919) % 1000) / 7.0f - 60.0f;
+    std::vector<uint16_t> h(values.size());
+    std::vector<float> f(values.size());
+    std::vector<double> d(values.size());
+    for (Float16Format format : { Float16Format::Half, Float16Format::BFloat16 })
+    {
+        ConvertToFloat16(values.data(), h.data(), values.size(), format);
+        ConvertFromFloat16(h.data(), f.data(), values.size(), format);
+        ConvertFromFloat16(h.data(), d.data(), values.size(), format);
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            const uint16_t expected = format == Float16Format::Half ? FloatToHalf(values[i]) : FloatToBFloat16(values[i]);
+            BOOST_CHECK_EQUAL(h[i], expected);
+            BOOST_CHECK_EQUAL(f[i], format == Float16Format::Half ? HalfToFloat(expected) : BFloat16ToFloat(expected));
+            BOOST_CHECK_EQUAL(d[i], f[i]);
+            BOOST_CHECK_CLOSE(f[i], values[i], format == Float16Format::Half ? 0.05 : 0.4);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUHalfMatrixMultiplyAndWeightedAdd)
+{
+    // 16-bit a gives the same result as the full-precision GEMM with the rounded a
+    // (k = 300 spans several panels for m = 500)
+    const size_t m = 500, k = 300, n = 7;
+    for (Float16Format format : { Float16Format::Half, Float16Format::BFloat16 })
+    {
+        for (bool transposeA : { false, true })
+        {
+            for (bool transposeB : { false, true })
+            {
+                CPUMatrix<float> a = transposeA ? CPUMatrix<float>::RandomUniform(k, m, -1, 1, 1) : CPUMatrix<float>::RandomUniform(m, k, -1, 1, 1);
+                CPUMatrix<float> b = transposeB ? CPUMatrix<float>::RandomUniform(n, k, -1, 1, 2) : CPUMatrix<float>::RandomUniform(k, n, -1, 1, 2);
+                CPUMatrix<float> c = CPUMatrix<float>::RandomUniform(m, n, -1, 1, 3);
+                CPUMatrix<float> expected = c; // (deep copy)
+
+                CPUHalfMatrix a16(a, format);
+                BOOST_CHECK(a16.GetFormat() == format);
+                BOOST_CHECK_EQUAL(a16.GetNumRows(), a.GetNumRows());
+                CPUMatrix<float> aRounded;
+                a16.CopyTo(aRounded);
+                BOOST_CHECK(aRounded.IsEqualTo(a, format == Float16Format::Half ? 1e-3f : 1e-2f));
+
+                CPUMatrix<float>::MultiplyAndWeightedAdd(0.5f, aRounded, transposeA, b, transposeB, 2.0f, expected);
+                CPUMatrix<float>::MultiplyAndWeightedAdd(0.5f, a16, transposeA, b, transposeB, 2.0f, c);
+                BOOST_CHECK(c.IsEqualTo(expected, 1e-4f));
+
+                CPUMatrix<float> c0;
+                CPUMatrix<float>::MultiplyAndWeightedAdd(1.0f, a16, transposeA, b, transposeB, 0.0f, c0); // (beta = 0 sizes c)
+                BOOST_CHECK_EQUAL(c0.GetNumRows(), m);
+                BOOST_CHECK_EQUAL(c0.GetNumCols(), n);
+            }
+        }
+    }
+
+    CPUHalfMatrix a16(CPUMatrix<float>::RandomUniform(4, 3, -1, 1, 1));
+    CPUMatrix<float> b(4, 2), c(4, 2);
+    BOOST_CHECK_THROW(CPUMatrix<float>::MultiplyAndWeightedAdd(1.0f, a16, false, b, false, 0.0f, c), std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
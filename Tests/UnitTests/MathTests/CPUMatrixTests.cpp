@@ -898,6 +898,180 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_AUTO_TEST_CASE(PhiloxKnownAnswer)
+{
+    // test vector of the reference implementation (Random123)
+    uint32_t words[4];
+    Philox4x32::Generate(0, 0, words);
+    BOOST_CHECK_EQUAL(words[0], 0x6627e8d5u);
+    BOOST_CHECK_EQUAL(words[1], 0xe169c58du);
+    BOOST_CHECK_EQUAL(words[2], 0xbc57ac4cu);
+    BOOST_CHECK_EQUAL(words[3], 0x9b00dbd8u);
+}
+
+// selects the counter-based random fills for the duration of a test
+struct CounterBasedRNGFixture : RandomSeedFixture
+{
+    CounterBasedRNGFixture()
+    {
+        SMatrix::SetUseCounterBasedRNG(true);
+    }
+    ~CounterBasedRNGFixture()
+    {
+        SMatrix::SetUseCounterBasedRNG(false);
+    }
+};
+
+// a fill must equal the serial evaluation of the generator, however many threads it was split across
+BOOST_FIXTURE_TEST_CASE(CPUMatrixRandomFillIsIndependentOfThreads, CounterBasedRNGFixture)
+{
+    const unsigned long seed = 4711;
+    SMatrix m(301, 203); // (larger than the parallel threshold, and not a multiple of 4)
+    m.SetUniformRandomValue(-2, 3, seed);
+    const float* data = m.Data();
+    for (size_t i = 0; i < m.GetNumElements(); i++)
+    {
+        uint32_t words[4];
+        Philox4x32::Generate(seed, i / 4, words);
+        const float expected = -2 + 5 * ((words[i % 4] >> 8) * (1.0f / 16777216.0f));
+        BOOST_REQUIRE_CLOSE(data[i], expected, 1e-4f);
+    }
+}
+
+// the counter-based fill with its float arithmetic must be as normal as the std generator
+template <class ElemType>
+static void CheckGaussianRandomValue(unsigned long seed)
+{
+    CPUMatrix<ElemType> m(300, 200);
+    m.SetGaussianRandomValue(1, 0.5, seed);
+    const double n = (double) m.GetNumElements();
+    const double mean = m.SumOfElements() / n;
+    double variance = 0, fourthMoment = 0;
+    foreach_coord (i, j, m)
+    {
+        const double d = (m(i, j) - mean) * (m(i, j) - mean);
+        variance += d / n;
+        fourthMoment += d * d / n;
+    }
+    BOOST_CHECK_CLOSE(mean, 1.0, 1);
+    BOOST_CHECK_CLOSE(sqrt(variance), 0.5, 2);
+    BOOST_CHECK_CLOSE(fourthMoment / (variance * variance), 3.0, 5); // kurtosis
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixGaussianRandomValue, RandomSeedFixture)
+{
+    CheckGaussianRandomValue<float>(IncrementCounter());
+    CheckGaussianRandomValue<double>(IncrementCounter());
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixGaussianRandomValueCounterBased, CounterBasedRNGFixture)
+{
+    CheckGaussianRandomValue<float>(IncrementCounter());
+    CheckGaussianRandomValue<double>(IncrementCounter());
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixUniformRandomMask, CounterBasedRNGFixture)
+{
+    CPURNGHandle rng(CPUDEVICE, 42);
+    SMatrix mask1(300, 200), mask2(300, 200);
+    mask1.SetUniformRandomMask(0.3f, 2, rng);
+    mask2.SetUniformRandomMask(0.3f, 2, rng);
+    size_t numMasked = 0;
+    foreach_coord (i, j, mask1)
+    {
+        BOOST_REQUIRE(mask1(i, j) == 0 || mask1(i, j) == 2);
+        numMasked += mask1(i, j) == 0;
+    }
+    BOOST_CHECK_CLOSE(numMasked / (double) mask1.GetNumElements(), 0.3, 3);
+    // the second mask continues the stream of the handle
+    BOOST_CHECK(!mask2.IsEqualTo(mask1));
+
+    // the same seed gives the same masks
+    CPURNGHandle rngAgain(CPUDEVICE, 42);
+    SMatrix mask3(300, 200);
+    mask3.SetUniformRandomMask(0.3f, 2, rngAgain);
+    BOOST_CHECK(mask3.IsEqualTo(mask1));
+}
+
+// compare FusedUpdateWeights() against the sequence of individual steps it replaces
+static void UpdateWeightsReference(FusedWeightUpdateType type, DMatrix& smoothed, DMatrix& gradient, DMatrix& value, const FusedWeightUpdateParams& params, double adaWeight, double adaMul)
+{
+    gradient.InplaceTruncate(params.truncationThreshold);
+    DMatrix::ScaleAndAdd(params.l2Weight, value, gradient);
+    const double learnRate = params.learnRatePerSample;
+    const double momentum = params.momentum;
+    if (type == FusedWeightUpdateType::Momentum || type == FusedWeightUpdateType::Nesterov)
+    {
+        if (smoothed.IsEmpty())
+        {
+            smoothed.Resize(gradient.GetNumRows(), gradient.GetNumCols());
+            smoothed.SetValue(0);
+        }
+        DMatrix::Scale(momentum, smoothed);
+        DMatrix::ScaleAndAdd((1 - momentum) * learnRate, gradient, smoothed);
+        if (type == FusedWeightUpdateType::Momentum)
+            value -= smoothed;
+        else
+        {
+            DMatrix::ScaleAndAdd(-momentum, smoothed, value);
+            DMatrix::ScaleAndAdd(-(1 - momentum) * learnRate, gradient, value);
+        }
+    }
+    else if (type == FusedWeightUpdateType::AdaGrad)
+    {
+        double aveMultiplier = smoothed.Adagrad(gradient, params.needAveMultiplier);
+        DMatrix::ScaleAndAdd(-learnRate / aveMultiplier, gradient, value);
+    }
+    else if (type == FusedWeightUpdateType::FSAdaGrad)
+        smoothed.FSAdagrad(gradient, value, learnRate, momentum, adaWeight, adaMul);
+    else
+    {
+        double aveMultiplier = smoothed.RmsProp(gradient, params.rmsGamma, params.rmsWeightInc, params.rmsWeightMax,
+                                                params.rmsWeightDec, params.rmsWeightMin, params.needAveMultiplier);
+        DMatrix::ScaleAndAdd(-learnRate / aveMultiplier, gradient, value);
+    }
+    value.InplaceSoftThreshold(params.l1Threshold);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFusedUpdateWeights, RandomSeedFixture)
+{
+    const double adaWeight = 0.99;
+    const double adaMul = 0.01;
+    for (auto type : { FusedWeightUpdateType::Momentum, FusedWeightUpdateType::Nesterov, FusedWeightUpdateType::AdaGrad,
+                       FusedWeightUpdateType::FSAdaGrad, FusedWeightUpdateType::RmsProp })
+    {
+        for (bool needAveMultiplier : { false, true })
+        {
+            FusedWeightUpdateParams params;
+            params.type = type;
+            params.learnRatePerSample = 0.1;
+            params.momentum = 0.9;
+            params.truncationThreshold = 0.5;
+            params.l2Weight = 0.01;
+            params.l1Threshold = 0.001;
+            params.needAveMultiplier = needAveMultiplier;
+            params.rmsGamma = 0.99;
+            params.rmsWeightInc = 1.2;
+            params.rmsWeightMax = 10;
+            params.rmsWeightDec = 0.75;
+            params.rmsWeightMin = 0.1;
+
+            DMatrix value = DMatrix::RandomUniform(17, 13, -1, 1, IncrementCounter());
+            DMatrix fusedValue(value);
+            DMatrix smoothed, fusedSmoothed;
+            for (int i = 0; i < 3; i++)
+            {
+                DMatrix gradient = DMatrix::RandomUniform(17, 13, -1, 1, IncrementCounter());
+                DMatrix fusedGradient(gradient);
+                UpdateWeightsReference(type, smoothed, gradient, value, params, adaWeight, adaMul);
+                fusedSmoothed.FusedUpdateWeights(fusedGradient, fusedValue, params, adaWeight, adaMul);
+            }
+            BOOST_CHECK(fusedValue.IsEqualTo(value, c_epsilonDoubleE11));
+            BOOST_CHECK(fusedSmoothed.IsEqualTo(smoothed, c_epsilonDoubleE11));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
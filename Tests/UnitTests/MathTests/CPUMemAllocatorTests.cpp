@@ -0,0 +1,85 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/CPUMemAllocator.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUSparseMatrix.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(CPUMemAllocatorSuite)
+
+BOOST_AUTO_TEST_CASE(CPUMemAllocatorAlignsAndReusesBlocks)
+{
+    CPUMemAllocator allocator;
+    const size_t sizes[] = { 1, 65, 1000, 4096, 12345, 1 << 20 }; // (all of different size classes)
+    for (size_t size : sizes)
+    {
+        void* p = allocator.Malloc(size);
+        BOOST_CHECK_EQUAL((size_t) p % CPUMemAllocator::Alignment, 0);
+        memset(p, 0xff, size); // (must be writable)
+        allocator.Free(p);
+        // the next block of this size reuses the freed one
+        void* q = allocator.Malloc(size);
+        BOOST_CHECK_EQUAL(q, p);
+        allocator.Free(q);
+    }
+    BOOST_CHECK(allocator.Malloc(0) == nullptr);
+
+    auto statistics = allocator.GetStatistics();
+    BOOST_CHECK_EQUAL(statistics.numAllocations, 2 * (sizeof(sizes) / sizeof(*sizes)));
+    BOOST_CHECK_EQUAL(statistics.numCacheHits, sizeof(sizes) / sizeof(*sizes));
+    BOOST_CHECK_EQUAL(statistics.numBytesInUse, 0);
+    BOOST_CHECK_GE(statistics.peakNumBytesInUse, 1 << 20);
+    BOOST_CHECK_GT(statistics.numBytesCached, 0);
+
+    allocator.ReleaseCachedMemory();
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().numBytesCached, 0);
+}
+
+BOOST_AUTO_TEST_CASE(CPUMemAllocatorLimitsCache)
+{
+    CPUMemAllocator allocator(/*maxCachedBytes=*/4096);
+    void* small = allocator.Malloc(1000);
+    void* large = allocator.Malloc(100000);
+    allocator.Free(small);
+    allocator.Free(large); // exceeds the limit: goes back to the heap
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().numBytesCached, 1024);
+
+    allocator.SetOptions(/*maxCachedBytes=*/0, /*useHugePages=*/true);
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().numBytesCached, 0);
+    void* huge = allocator.Malloc(4 << 20);
+    BOOST_CHECK_EQUAL((size_t) huge % CPUMemAllocator::Alignment, 0);
+    allocator.Free(huge);
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().numBytesCached, 0);
+}
+
+BOOST_AUTO_TEST_CASE(CPUMatricesUseAllocator)
+{
+    const auto before = CPUMemAllocator::Instance().GetStatistics();
+    {
+        CPUSingleMatrix m(17, 5);
+        BOOST_CHECK_EQUAL((size_t) m.Data() % CPUMemAllocator::Alignment, 0);
+        foreach_coord (i, j, m)
+            BOOST_CHECK_EQUAL(m(i, j), 0); // new dense matrices are still zero-initialized
+
+        CPUSparseMatrix<float> s(MatrixFormat::matrixFormatSparseCSC, 10, 4, 8);
+        BOOST_CHECK_EQUAL(s.NzCount(), 0);
+        s.SetValue(3, 2, 1.5f);
+        BOOST_CHECK_EQUAL(s.NzCount(), 1);
+        CPUSingleMatrix dense = s.CopyColumnSliceToDense(0, 4);
+        BOOST_CHECK_EQUAL(dense(3, 2), 1.5f);
+        BOOST_CHECK_EQUAL(dense(2, 3), 0);
+    }
+    const auto after = CPUMemAllocator::Instance().GetStatistics();
+    BOOST_CHECK_GE(after.numAllocations, before.numAllocations + 4);
+    BOOST_CHECK_EQUAL(after.numBytesInUse, before.numBytesInUse);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
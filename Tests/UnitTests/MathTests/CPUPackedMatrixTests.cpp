@@ -0,0 +1,91 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUPackedMatrix.h"
+#include "TensorView.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(CPUPackedMatrixSuite)
+
+BOOST_AUTO_TEST_CASE(CPUPackedMatrixMultiplyAndWeightedAdd)
+{
+    // m = 37 leaves a partial last panel, and n up to 9 covers all column remainders
+    const size_t m = 37, k = 45;
+    for (bool transposeA : { false, true })
+    {
+        const CPUMatrix<float> a = transposeA ? CPUMatrix<float>::RandomUniform(k, m, -1, 1, 1) : CPUMatrix<float>::RandomUniform(m, k, -1, 1, 1);
+        CPUPackedMatrix<float> packedA;
+        packedA.Pack(a.Data(), a.GetNumRows(), a.GetNumCols(), transposeA);
+        BOOST_CHECK_EQUAL(packedA.GetNumRows(), m);
+        BOOST_CHECK_EQUAL(packedA.GetNumCols(), k);
+        BOOST_CHECK_EQUAL(packedA.GetNumPanels(), (m + CPUPackedMatrix<float>::PanelRows - 1) / CPUPackedMatrix<float>::PanelRows);
+        for (bool transposeB : { false, true })
+        {
+            for (size_t n = 1; n <= 9; n++)
+            {
+                const CPUMatrix<float> b = transposeB ? CPUMatrix<float>::RandomUniform(n, k, -1, 1, 2) : CPUMatrix<float>::RandomUniform(k, n, -1, 1, 2);
+                CPUMatrix<float> c = CPUMatrix<float>::RandomUniform(m, n, -1, 1, 3);
+                CPUMatrix<float> expected = c; // (deep copy)
+                CPUMatrix<float>::MultiplyAndWeightedAdd(0.5f, a, transposeA, b, transposeB, 2.0f, expected);
+                CPUMatrix<float>::MultiplyAndWeightedAdd(0.5f, packedA, b, transposeB, 2.0f, c);
+                BOOST_CHECK(c.IsEqualTo(expected, 1e-4f));
+
+                CPUMatrix<float> c0(m, n);
+                c0.SetValue(std::numeric_limits<float>::quiet_NaN()); // (beta = 0 does not read c)
+                CPUMatrix<float>::MultiplyAndWeightedAdd(1.0f, a, transposeA, b, transposeB, 0.0f, expected);
+                CPUMatrix<float>::MultiplyAndWeightedAdd(1.0f, packedA, b, transposeB, 0.0f, c0);
+                BOOST_CHECK(c0.IsEqualTo(expected, 1e-4f));
+            }
+        }
+    }
+
+    CPUPackedMatrix<float> packedA;
+    packedA.Pack(CPUMatrix<float>::RandomUniform(4, 3, -1, 1, 1).Data(), 4, 3, false);
+    CPUMatrix<float> b(4, 2), c(4, 2);
+    BOOST_CHECK_THROW(CPUMatrix<float>::MultiplyAndWeightedAdd(1.0f, packedA, b, false, 0.0f, c), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(CPUPackedMatrixTensorProduct)
+{
+    // a large enough a is packed for a product with few columns; BLAS is used otherwise
+    const size_t m = 1024, k = 512;
+    BOOST_REQUIRE(CPUPackedMatrix<float>::IsBeneficial(m, k, 4));
+    BOOST_REQUIRE(!CPUPackedMatrix<float>::IsBeneficial(m, k, 64));
+    const auto a = make_shared<Matrix<float>>(Matrix<float>::RandomUniform(k, m, CPUDEVICE, -1, 1, 1));
+    const TensorView<float> aView(a, TensorShape(k, m));
+    CPUPackedMatrix<float> packedA;
+    for (size_t n : { 4, 64 })
+    {
+        const auto b = make_shared<Matrix<float>>(Matrix<float>::RandomUniform(k, n, CPUDEVICE, -1, 1, 2));
+        const auto c = make_shared<Matrix<float>>(m, n, CPUDEVICE);
+        const auto expected = make_shared<Matrix<float>>(m, n, CPUDEVICE);
+        TensorView<float>(expected, TensorShape(m, n)).AssignMatrixProductOf(false, aView, true, TensorView<float>(b, TensorShape(k, n)), false);
+        packedA.Clear();
+        TensorView<float>(c, TensorShape(m, n)).AssignMatrixProductOf(false, aView, true, TensorView<float>(b, TensorShape(k, n)), false, packedA);
+        BOOST_CHECK(c->IsEqualTo(*expected, 1e-4f));
+        BOOST_CHECK_EQUAL(packedA.IsEmpty(), n == 64);
+    }
+
+    // the packed copy is used until it is cleared, even if a changes
+    const auto b = make_shared<Matrix<float>>(Matrix<float>::RandomUniform(k, 3, CPUDEVICE, -1, 1, 2));
+    const auto c = make_shared<Matrix<float>>(m, 3, CPUDEVICE);
+    TensorView<float> cView(c, TensorShape(m, 3));
+    cView.AssignMatrixProductOf(false, aView, true, TensorView<float>(b, TensorShape(k, 3)), false, packedA);
+    const Matrix<float> before = c->DeepClone();
+    a->SetValue(0);
+    cView.AssignMatrixProductOf(false, aView, true, TensorView<float>(b, TensorShape(k, 3)), false, packedA);
+    BOOST_CHECK(c->IsEqualTo(before));
+    packedA.Clear();
+    cView.AssignMatrixProductOf(false, aView, true, TensorView<float>(b, TensorShape(k, 3)), false, packedA);
+    BOOST_CHECK_EQUAL(c->MatrixNorm1(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
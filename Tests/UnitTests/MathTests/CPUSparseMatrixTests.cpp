@@ -61,6 +61,188 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCopyColumnSliceToDense, RandomSeedFixture
     BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
 }
 
+// a sparse (block-column) update with lazy catch-up must match the dense update on a gradient that is zero in untouched columns
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixFusedUpdateWeights, RandomSeedFixture)
+{
+    const size_t hiddenDim = 5;
+    const size_t vocabSize = 20;
+    const size_t mbSize = 4;
+    const double adaWeight = 0.99;
+    const double adaMul = 0.01;
+    for (auto type : { FusedWeightUpdateType::Momentum, FusedWeightUpdateType::Nesterov, FusedWeightUpdateType::AdaGrad,
+                       FusedWeightUpdateType::FSAdaGrad, FusedWeightUpdateType::RmsProp })
+    {
+        FusedWeightUpdateParams params;
+        params.type = type;
+        params.learnRatePerSample = 0.1;
+        params.momentum = 0.9;
+        params.rmsGamma = 0.99;
+        params.rmsWeightInc = 1.2;
+        params.rmsWeightMax = 10;
+        params.rmsWeightDec = 0.75;
+        params.rmsWeightMin = 0.1;
+        SparseUpdateHistory history;
+        FusedWeightUpdateParams sparseParams = params;
+        sparseParams.sparseUpdateHistory = &history;
+
+        DenseMatrix denseValue = DenseMatrix::RandomUniform(hiddenDim, vocabSize, -1, 1, IncrementCounter());
+        DenseMatrix sparseValue(denseValue);
+        DenseMatrix denseSmoothed, sparseSmoothed;
+        for (size_t step = 0; step < 8; step++)
+        {
+            // gradient of a lookup: outputGradient * input^T with one-hot input columns
+            DenseMatrix outputGradient = DenseMatrix::RandomUniform(hiddenDim, mbSize, -1, 1, IncrementCounter());
+            SparseMatrix input(MatrixFormat::matrixFormatSparseCSC, vocabSize, mbSize, 0);
+            DenseMatrix denseGradient(hiddenDim, vocabSize);
+            denseGradient.SetValue(0);
+            for (size_t j = 0; j < mbSize; j++)
+            {
+                size_t word = (step * 7 + j * j * 3) % vocabSize;
+                input.SetValue(word, j, 1);
+                for (size_t h = 0; h < hiddenDim; h++)
+                    denseGradient(h, word) += outputGradient(h, j);
+            }
+            SparseMatrix sparseGradient(MatrixFormat::matrixFormatSparseBlockCol);
+            SparseMatrix::MultiplyAndAdd(1, outputGradient, false, input, true, sparseGradient);
+
+            denseSmoothed.FusedUpdateWeights(denseGradient, denseValue, params, adaWeight, adaMul);
+            sparseGradient.FusedUpdateWeights(sparseSmoothed, sparseValue, sparseParams, adaWeight, adaMul);
+        }
+        // columns not touched by the last minibatches still lag behind until caught up
+        SparseMatrix::CatchUpFusedUpdates(sparseSmoothed, sparseValue, sparseParams, adaWeight);
+        BOOST_CHECK(sparseValue.IsEqualTo(denseValue, c_epsilonFloatE5));
+    }
+}
+
+// dense x sparse products must match the dense products, for all transpositions, for CSC and CSR, and for dense and block-column results
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyDenseBySparse, RandomSeedFixture)
+{
+    const size_t m = 7;
+    const size_t k = 40;
+    const size_t n = 30;
+    for (bool transposeA : { false, true })
+    for (bool transposeB : { false, true })
+    for (auto format : { MatrixFormat::matrixFormatSparseCSC, MatrixFormat::matrixFormatSparseCSR })
+    {
+        DenseMatrix a = DenseMatrix::RandomUniform(transposeA ? k : m, transposeA ? m : k, -1, 1, IncrementCounter());
+        DenseMatrix b = DenseMatrix::RandomUniform(transposeB ? n : k, transposeB ? k : n, -1, 1, IncrementCounter());
+        // keep about a quarter of the elements, with some empty rows and columns
+        foreach_coord (i, j, b)
+        {
+            if (fabs(b(i, j)) < 0.75 || i % 5 == 0 || j % 7 == 0)
+                b(i, j) = 0;
+        }
+        SparseMatrix sb(format, b.GetNumRows(), b.GetNumCols(), 0);
+        const bool columnMajor = format == MatrixFormat::matrixFormatSparseCSC;
+        for (size_t outer = 0; outer < (columnMajor ? b.GetNumCols() : b.GetNumRows()); outer++)
+        {
+            for (size_t inner = 0; inner < (columnMajor ? b.GetNumRows() : b.GetNumCols()); inner++)
+            {
+                const size_t i = columnMajor ? inner : outer;
+                const size_t j = columnMajor ? outer : inner;
+                if (b(i, j) != 0)
+                    sb.SetValue(i, j, b(i, j));
+            }
+        }
+
+        // c = 0.5 * op(a) * op(b) + 2 * c
+        DenseMatrix expected = DenseMatrix::RandomUniform(m, n, -1, 1, IncrementCounter());
+        DenseMatrix c(expected);
+        DenseMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, b, transposeB, 2, expected);
+        SparseMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, sb, transposeB, 2, c);
+        BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE4));
+
+        // c = 0.5 * op(a) * op(b) into block columns, which are the nonzero columns in ascending order
+        DenseMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, b, transposeB, 0, expected);
+        SparseMatrix blockCol(MatrixFormat::matrixFormatSparseBlockCol);
+        SparseMatrix::MultiplyAndAdd(0.5, a, transposeA, sb, transposeB, blockCol);
+        DenseMatrix blockColDense(m, n);
+        blockColDense.SetValue(0);
+        const size_t numBlocks = blockCol.NzCount() / m;
+        const size_t* blockIds = blockCol.BlockIdsLocation();
+        for (size_t block = 0; block < numBlocks; block++)
+        {
+            const size_t j = blockIds[block];
+            BOOST_CHECK(block == 0 || j > blockIds[block - 1]);
+            for (size_t i = 0; i < m; i++)
+                blockColDense(i, j) = blockCol.NzValues()[block * m + i];
+        }
+        BOOST_CHECK(blockColDense.IsEqualTo(expected, c_epsilonFloatE4));
+        size_t numNonzeroColumns = 0;
+        for (size_t j = 0; j < n; j++)
+        {
+            bool nonzero = false;
+            for (size_t i = 0; i < m; i++)
+                nonzero |= expected(i, j) != 0;
+            numNonzeroColumns += nonzero;
+        }
+        BOOST_CHECK_EQUAL(numBlocks, numNonzeroColumns);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixCrossEntropyWithSoftmax, RandomSeedFixture)
+{
+    const size_t m = 10;
+    const size_t n = 6;
+    const size_t gap = 3; // column without a label
+    DenseMatrix z = DenseMatrix::RandomUniform(m, n, -5, 5, IncrementCounter());
+    DenseMatrix labels(m, n);
+    labels.SetValue(0);
+    SparseMatrix sparseLabels(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+    for (size_t j = 0; j < n; j++)
+    {
+        if (j != gap)
+        {
+            labels((j * 3) % m, j) = 1;
+            sparseLabels.SetValue((j * 3) % m, j, 1);
+        }
+    }
+
+    // reference: materialized log softmax
+    DenseMatrix logSoftmax(m, n);
+    logSoftmax.AssignLogSoftmaxOf(z, true);
+    double expectedCriterion = 0;
+    foreach_coord (i, j, z)
+        expectedCriterion -= labels(i, j) * logSoftmax(i, j);
+    DenseMatrix alpha(1, 1);
+    alpha(0, 0) = 0.5;
+    DenseMatrix initialGradient = DenseMatrix::RandomUniform(m, n, -1, 1, IncrementCounter());
+    DenseMatrix expectedGradient(initialGradient);
+    foreach_coord (i, j, z)
+        expectedGradient(i, j) += alpha(0, 0) * (exp(logSoftmax(i, j)) - labels(i, j));
+
+    for (bool sparse : { false, true })
+    {
+        DenseMatrix criterion;
+        DenseMatrix logSumExp;
+        if (sparse)
+            SparseMatrix::AssignCrossEntropyWithSoftmaxOf(sparseLabels, z, logSumExp, criterion);
+        else
+            criterion.AssignCrossEntropyWithSoftmaxOf(labels, z, logSumExp);
+        BOOST_CHECK_CLOSE(criterion(0, 0), expectedCriterion, 1e-10);
+        BOOST_CHECK_EQUAL(logSumExp.GetNumRows(), 1);
+        BOOST_CHECK_EQUAL(logSumExp.GetNumCols(), n);
+        for (size_t j = 0; j < n; j++)
+            BOOST_CHECK_CLOSE(logSumExp(0, j), z(0, j) - logSoftmax(0, j), 1e-10);
+
+        DenseMatrix gradient(initialGradient);
+        if (sparse)
+            SparseMatrix::AddCrossEntropyWithSoftmaxGradient(alpha, sparseLabels, z, logSumExp, gradient);
+        else
+            DenseMatrix::AddCrossEntropyWithSoftmaxGradient(alpha, labels, z, logSumExp, gradient);
+        BOOST_CHECK(gradient.IsEqualTo(expectedGradient, 1e-12));
+
+        // the values of z in a column without labels do not matter
+        DenseMatrix zWithNan(z);
+        zWithNan(0, gap) = std::numeric_limits<double>::quiet_NaN();
+        if (sparse)
+            SparseMatrix::AssignCrossEntropyWithSoftmaxOf(sparseLabels, zWithNan, logSumExp, criterion);
+        else
+            criterion.AssignCrossEntropyWithSoftmaxOf(labels, zWithNan, logSumExp);
+        BOOST_CHECK_CLOSE(criterion(0, 0), expectedCriterion, 1e-10);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -499,6 +499,92 @@ BOOST_AUTO_TEST_CASE(PoolingBackward)
     }
 }
 
+BOOST_AUTO_TEST_CASE(PoolingGemmEngine)
+{
+    // The GEMM engine pools 2D inputs with 2x2/3x3 windows and stride 1/2 with specialized CPU kernels.
+    // Compare forward, backward and unpooling with the reference engine.
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> batchSizeG(1, 8);
+    std::normal_distribution<float> nd;
+
+    auto randomMatrix = [&](size_t r, size_t c) -> SingleMatrix
+    {
+        vec buf(r * c);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        return SingleMatrix(r, c, buf.data(), CPUDEVICE, matrixFlagNormal);
+    };
+
+    auto configs = GeneratePoolTestConfigs();
+    for (size_t k : {2, 3})
+    {
+        for (size_t stride : {1, 2})
+        {
+            for (bool pad : {false, true})
+            {
+                configs.push_back(std::make_shared<ConvolveGeometry>(TensorShape(17, 12, 4),
+                    TensorShape(k, k, 1), TensorShape(1), TensorShape(stride, stride, 1),
+                    ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{pad, pad, false},
+                    TensorShape(0), TensorShape(0)));
+            }
+        }
+    }
+    // No channel dimension.
+    configs.push_back(std::make_shared<ConvolveGeometry>(TensorShape(9, 8),
+        TensorShape(3, 3), TensorShape(1), TensorShape(2, 2),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true},
+        TensorShape(0), TensorShape(0)));
+
+    for (auto kind : {PoolKind::Max, PoolKind::Average})
+    {
+        for (const auto& g : configs)
+        {
+            auto baseEng = ConvEng::Create(g, CPUDEVICE, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::Reference);
+            auto testEng = ConvEng::Create(g, CPUDEVICE, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::Gemm);
+
+            size_t n = batchSizeG(rng);
+            size_t crowIn = g->InputShape().GetNumElements();
+            size_t crowOut = g->OutputShape().GetNumElements();
+            SingleMatrix in = randomMatrix(crowIn, n);
+            SingleMatrix out(crowOut, n, CPUDEVICE);
+            SingleMatrix outB(crowOut, n, CPUDEVICE);
+            testEng->ForwardPooling(in, out);
+            baseEng->ForwardPooling(in, outB);
+
+            std::stringstream tmsg;
+            tmsg << "Geometry: " << (std::string)(*g) << ", Pool: " << (int)kind << ", Batch: " << n;
+            std::string msg = " are not equal, " + tmsg.str();
+            float relErr = Err<float>::Rel;
+            float absErr = Err<float>::Abs;
+            std::string emsg;
+            BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr, absErr), "out" << msg << ". " << emsg);
+
+            // Pool another input first, so that the maxima saved by the forward pass are not those of 'in'.
+            SingleMatrix in2 = randomMatrix(crowIn, n);
+            SingleMatrix out2(crowOut, n, CPUDEVICE);
+            for (bool sameInput : {true, false})
+            {
+                if (!sameInput)
+                    testEng->ForwardPooling(in2, out2);
+                SingleMatrix srcGrad = randomMatrix(crowOut, n);
+                SingleMatrix grad = randomMatrix(crowIn, n);
+                SingleMatrix gradB = grad.DeepClone();
+                testEng->BackwardPooling(out, srcGrad, in, grad);
+                baseEng->BackwardPooling(outB, srcGrad, in, gradB);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(grad, gradB, emsg, relErr, absErr), "grad" << msg << ". " << emsg);
+            }
+
+            if (kind == PoolKind::Max)
+            {
+                SingleMatrix inU = randomMatrix(crowIn, n);
+                SingleMatrix inUB = inU.DeepClone();
+                testEng->MaxUnpooling(out, in, inU);
+                baseEng->MaxUnpooling(outB, in, inUB);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(inU, inUB, emsg, 0.0f, 0.0f), "inU" << msg << ". " << emsg);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(MaxUnpooling)
 {
     using IntMatrix = Matrix<int>;
@@ -0,0 +1,121 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/Matrix.h"
+#include "../../../Source/Math/MatrixExpression.h"
+#include "../../../Source/Math/TensorView.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(MatrixExpressionSuite)
+
+BOOST_FIXTURE_TEST_CASE(MatrixExpressionFusedAndEager, RandomSeedFixture)
+{
+    // 100 x 50 is above the size at which the loop is parallelized
+    for (size_t numCols : { 3, 50 })
+    {
+        const SingleMatrix a = SingleMatrix::RandomUniform(100, numCols, CPUDEVICE, -1, 1, IncrementCounter());
+        const SingleMatrix b = SingleMatrix::RandomUniform(100, numCols, CPUDEVICE, 2, 4, IncrementCounter());
+        const SingleMatrix c = SingleMatrix::RandomUniform(100, numCols, CPUDEVICE, -1, 1, IncrementCounter());
+
+        // explicit chain of Matrix operations
+        SingleMatrix temp(CPUDEVICE), expected(CPUDEVICE);
+        expected.AssignDifferenceOf(a, b);
+        expected.ElementMultiplyWith(c);
+        temp.AssignSigmoidOf(a);
+        expected += temp;
+        temp.AssignLogOf(b);
+        expected.AssignElementDivisionOf(expected, temp);
+        expected.AssignDifferenceOf(expected, 1.0f);
+        expected.AssignProductOf(2.0f, expected);
+
+        const auto expression = 2 * ((((Expr(a) - Expr(b)) * Expr(c) + SigmoidOf(Expr(a))) / LogOf(Expr(b))) - 1);
+        SingleMatrix fused(CPUDEVICE), eager(CPUDEVICE);
+        AssignExpression(fused, expression);
+        AssignExpressionByMatrixOperations(eager, expression); // (the fallback for GPU and sparse matrices)
+        BOOST_CHECK_EQUAL(fused.GetNumRows(), 100);
+        BOOST_CHECK_EQUAL(fused.GetNumCols(), numCols);
+        BOOST_CHECK(fused.IsEqualTo(expected, c_epsilonFloatE4));
+        BOOST_CHECK(eager.IsEqualTo(expected, c_epsilonFloatE4));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixExpressionFunctions, RandomSeedFixture)
+{
+    SingleMatrix a(2, 3, CPUDEVICE);
+    a(0, 0) = 0; a(1, 0) = -1; a(0, 1) = 4; a(1, 1) = 0.25f; a(0, 2) = -2; a(1, 2) = 1e-20f;
+
+    // the same guards as the Matrix functions: log(0) and sqrt(-1) are finite, division by 0 is by EPS_IN_INVERSE
+    for (int i = 0; i < 6; i++)
+    {
+        SingleMatrix result(CPUDEVICE), expected(CPUDEVICE);
+        switch (i)
+        {
+        case 0: AssignExpression(result, LogOf(Expr(a)));    expected.AssignLogOf(a);                      break;
+        case 1: AssignExpression(result, SqrtOf(Expr(a)));   expected.AssignSqrtOf(a);                     break;
+        case 2: AssignExpression(result, 1 / Expr(a));       expected.AssignElementInverseOf(a);           break;
+        case 3: AssignExpression(result, AbsOf(-Expr(a)));   expected.AssignAbsOf(a);                      break;
+        case 4: AssignExpression(result, ExpOf(Expr(a)));    expected.AssignExpOf(a);                      break;
+        case 5: AssignExpression(result, TanhOf(Expr(a)));   expected.AssignTanhOf(a);                     break;
+        }
+        BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE5));
+        for (size_t k = 0; k < result.GetNumElements(); k++)
+            BOOST_CHECK(std::isfinite(result.Data()[k]));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixExpressionAliasing, RandomSeedFixture)
+{
+    // the result may be one of the operands, e.g. for an in-place update
+    SingleMatrix x = SingleMatrix::RandomUniform(7, 5, CPUDEVICE, -1, 1, IncrementCounter());
+    const SingleMatrix g = SingleMatrix::RandomUniform(7, 5, CPUDEVICE, -1, 1, IncrementCounter());
+    SingleMatrix expected = x.DeepClone();
+    Matrix<float>::ScaleAndAdd(-0.1f, g, expected);
+    expected.AssignProductOf(0.9f, expected);
+
+    SingleMatrix eager = x.DeepClone();
+    AssignExpression(x, 0.9f * (Expr(x) - 0.1f * Expr(g)));
+    AssignExpressionByMatrixOperations(eager, 0.9f * (Expr(eager) - 0.1f * Expr(g))); // (evaluated in place)
+    BOOST_CHECK(x.IsEqualTo(expected, c_epsilonFloatE5));
+    BOOST_CHECK(eager.IsEqualTo(expected, c_epsilonFloatE5));
+
+    // also if the result is an operand that is read after the first operation
+    expected.AssignDifferenceOf(g, x);
+    expected.ElementMultiplyWith(x);
+    AssignExpressionByMatrixOperations(x, (Expr(g) - Expr(x)) * Expr(x));
+    BOOST_CHECK(x.IsEqualTo(expected, c_epsilonFloatE5));
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixExpressionTensorView, RandomSeedFixture)
+{
+    // per-row normalization of [5 x 4] with broadcast [5 x 1] vectors, evaluated with the TensorView operations
+    auto input = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(5, 4, CPUDEVICE, -1, 1, IncrementCounter()));
+    auto mean = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(5, 1, CPUDEVICE, -1, 1, IncrementCounter()));
+    auto invStdDev = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(5, 1, CPUDEVICE, 1, 2, IncrementCounter()));
+    auto output = make_shared<SingleMatrix>(5, 4, CPUDEVICE);
+    TensorView<float> outputView(output, TensorShape(5, 4));
+    AssignExpression(outputView, 2 * SigmoidOf((Expr(TensorView<float>(input, TensorShape(5, 4))) - Expr(TensorView<float>(mean, TensorShape(5, 1)))) * Expr(TensorView<float>(invStdDev, TensorShape(5, 1)))) / 4);
+
+    for (size_t j = 0; j < 4; j++)
+        for (size_t i = 0; i < 5; i++)
+        {
+            const float expected = 2 / (1 + exp(-((*input)(i, j) - (*mean)(i, 0)) * (*invStdDev)(i, 0))) / 4;
+            BOOST_CHECK_CLOSE((*output)(i, j), expected, 1e-4f);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(MatrixExpressionDimensionMismatch)
+{
+    SingleMatrix a(3, 4, CPUDEVICE), b(4, 3, CPUDEVICE), result(CPUDEVICE);
+    a.SetValue(1);
+    b.SetValue(2);
+    BOOST_CHECK_THROW(AssignExpression(result, Expr(a) + Expr(b)), std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
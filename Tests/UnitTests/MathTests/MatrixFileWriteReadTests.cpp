@@ -37,6 +37,45 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteRead, RandomSeedFixture)
     BOOST_CHECK(matrixCpuCopy.IsEqualTo(matrixCpuRead, c_epsilonFloatE5));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteRead16Bit, RandomSeedFixture)
+{
+    CPUMatrix<float> matrixCpu = CPUMatrix<float>::RandomUniform(43, 10, -26.3f, 30.2f, IncrementCounter());
+
+    for (int options : { (int) fileOptionsFloat16, (int) fileOptionsBFloat16 })
+    {
+        const Float16Format format = options == fileOptionsFloat16 ? Float16Format::Half : Float16Format::BFloat16;
+        std::wstring fileName16(L"M16.bin");
+        File file16(fileName16, fileOptionsBinary | fileOptionsReadWrite | options);
+        file16 << matrixCpu;
+        const uint64_t size16 = file16.GetPosition();
+        file16 << matrixCpu; // (a second copy, to read into double)
+        file16.SetPosition(0);
+
+        // the elements are read back as they were rounded to 16 bits
+        CPUMatrix<float> matrixCpuRead;
+        file16 >> matrixCpuRead;
+        CPUMatrix<double> matrixCpuReadDouble;
+        file16 >> matrixCpuReadDouble;
+        BOOST_CHECK_EQUAL(matrixCpuRead.GetNumRows(), 43);
+        BOOST_CHECK_EQUAL(matrixCpuRead.GetNumCols(), 10);
+        foreach_coord (i, j, matrixCpu)
+        {
+            uint16_t h;
+            ConvertToFloat16(&matrixCpu(i, j), &h, 1, format);
+            float expected;
+            ConvertFromFloat16(&h, &expected, 1, format);
+            BOOST_CHECK_EQUAL(matrixCpuRead(i, j), expected);
+            BOOST_CHECK_EQUAL(matrixCpuReadDouble(i, j), expected);
+        }
+
+        // the elements take half the space (the 16-bit format takes an int)
+        std::wstring fileName32(L"M32.bin");
+        File file32(fileName32, fileOptionsBinary | fileOptionsWrite);
+        file32 << matrixCpu;
+        BOOST_CHECK_EQUAL(file32.GetPosition() - size16, 43 * 10 * (sizeof(float) - sizeof(uint16_t)) - sizeof(int));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixFileWriteRead, RandomSeedFixture)
 {
     // Test Matrix in Dense mode
@@ -23,7 +23,7 @@ BOOST_AUTO_TEST_CASE(ElementwiseAddition)
     // elementwise sum
     tensorTester.OneTensorTest("elementwise addition", 1e-8, [&tensorTester](DEVICEID_TYPE deviceId)
     {
-        return tensorTester.BroadcastingTest(TensorShape{ 512, 256 }, TensorShape({ 512, 256 }), deviceId);
+        return tensorTester.BroadcastingTest(TensorShape{ 512, 256 }, TensorShape(512, 256), deviceId);
     });
 }
 
@@ -36,7 +36,7 @@ BOOST_AUTO_TEST_CASE(AdditionWithSimpleBroadcasting)
     // simple broadcasting
     tensorTester.OneTensorTest("addition wth simple broadcasting", 1e-8, [&tensorTester](DEVICEID_TYPE deviceId)
     {
-        return tensorTester.BroadcastingTest(TensorShape{ 3, 2 }, TensorShape({ 3, 1 }), deviceId);
+        return tensorTester.BroadcastingTest(TensorShape{ 3, 2 }, TensorShape(3, 1), deviceId);
     });
 }
 
@@ -47,7 +47,7 @@ BOOST_AUTO_TEST_CASE(BiasAddition)
     // typical bias for convolutional layer
     tensorTester.OneTensorTest("bias addition (broadcasting)", 1e-8, [&tensorTester](DEVICEID_TYPE deviceId)
     {
-        return tensorTester.BroadcastingTest(TensorShape{ 28, 28, 128, 32 }, TensorShape({ 1, 1, 128 }), deviceId);
+        return tensorTester.BroadcastingTest(TensorShape{ 28, 28, 128, 32 }, TensorShape(1, 1, 128), deviceId);
     });
 }
 
@@ -58,7 +58,7 @@ BOOST_AUTO_TEST_CASE(BiasAddition2)
     //         Something fishy going on. Dimension overflow?
     tensorTester.OneTensorTest("bias addition (broadcasting)", 1e-8, [&tensorTester](DEVICEID_TYPE deviceId)
     {
-        return tensorTester.BroadcastingTest(TensorShape{ 256, 256, 64, 32 }, TensorShape({ 1, 1, 64 }), deviceId);
+        return tensorTester.BroadcastingTest(TensorShape{ 256, 256, 64, 32 }, TensorShape(1, 1, 64), deviceId);
     });
 }
 
@@ -81,10 +81,38 @@ BOOST_AUTO_TEST_CASE(BiasGradient2)
     // typical bias gradient (reduction) for convolutional layer
     tensorTester.OneTensorTest("bias gradient (reduction)", 1e-1, [&tensorTester](DEVICEID_TYPE deviceId)
     {
-        return tensorTester.BiasGradientTest(TensorShape{ 256, 256, 64, 32 }, TensorShape({ 1, 1, 64 }), deviceId);
+        return tensorTester.BiasGradientTest(TensorShape{ 256, 256, 64, 32 }, TensorShape(1, 1, 64), deviceId);
     });
 }
 
+// operands with the same dimensions but different strides must not share the cached preparation of the operation,
+// and operands that differ only in their offset must share it but still address their own elements
+BOOST_AUTO_TEST_CASE(SameDimensionsDifferentStrides)
+{
+    // a = [ 0 1 2 ; 3 4 5 ; ... ] as a 3 x 4 tensor (column-major, so that a(i,j) = i + 3 * j)
+    vector<float> init(12);
+    for (size_t i = 0; i < init.size(); i++)
+        init[i] = (float) i;
+    let sob = make_shared<Matrix<float>>(12, 1, init.data(), CPUDEVICE);
+    let resultSob = make_shared<Matrix<float>>(8, 1, CPUDEVICE);
+    TensorView<float> result(resultSob, TensorShape(2, 4));
+
+    // the same operation on 2 x 4 views of rows [0,2), rows [1,3), and a contiguous tensor, twice each
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        for (size_t firstRow = 0; firstRow < 2; firstRow++)
+        {
+            result.AssignCopyOf(TensorView<float>(sob, TensorShape(3, 4).NarrowTo(0, firstRow, firstRow + 2)));
+            for (size_t j = 0; j < 4; j++)
+                for (size_t i = 0; i < 2; i++)
+                    BOOST_CHECK_EQUAL((*resultSob)(i + 2 * j, 0), (float) (firstRow + i + 3 * j));
+        }
+        result.AssignCopyOf(TensorView<float>(sob, TensorShape(2, 4)));
+        for (size_t k = 0; k < 8; k++)
+            BOOST_CHECK_EQUAL((*resultSob)(k, 0), (float) k);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ColumnSliceMultAndAdd)
 {
     ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
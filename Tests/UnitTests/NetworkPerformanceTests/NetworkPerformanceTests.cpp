@@ -0,0 +1,105 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NetworkPerformanceTests.cpp -- measures the traversal of networks on the CPU; this is meant for performance
+// optimization and does not check results (see the NetworkTests for that).
+//
+#include "stdafx.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+// A network of 'numBranches' independent towers over a shared input, with their outputs summed up:
+// criterion = Sum(sum_k V_k * Tanh(W2_k * Sigmoid(W1_k * x)))
+// Its nodes are independent across towers, so PARTraversalFlowControlNode can run them concurrently.
+template <class ElemType>
+struct MultiBranchNetwork
+{
+    ComputationNetworkPtr net;
+    ComputationNodeBasePtr criterion;
+    shared_ptr<ComputationNode<ElemType>> input;
+
+    MultiBranchNetwork(size_t numBranches, size_t inputDim, size_t hiddenDim, size_t numSamples)
+        : net(make_shared<ComputationNetwork>(CPUDEVICE))
+    {
+        ComputationNetworkBuilder<ElemType> builder(*net);
+        input = builder.CreateLearnableParameter(L"x", inputDim, numSamples);
+        input->SetLearningRateMultiplier(0);
+        vector<shared_ptr<ComputationNode<ElemType>>> parameters;
+        shared_ptr<ComputationNode<ElemType>> sum;
+        for (size_t k = 0; k < numBranches; k++)
+        {
+            auto w1 = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W1_%d", (int) k), hiddenDim, inputDim);
+            auto w2 = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W2_%d", (int) k), hiddenDim, hiddenDim);
+            auto v  = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"V_%d",  (int) k), 1, hiddenDim);
+            parameters.insert(parameters.end(), { w1, w2, v });
+            auto branch = builder.Times(v, builder.Tanh(builder.Times(w2, builder.Sigmoid(builder.Times(w1, input)))));
+            sum = sum ? builder.Plus(sum, branch) : branch;
+        }
+        criterion = builder.Sum(sum, L"criterion");
+        net->AddToNodeGroup(L"criterion", criterion);
+        net->CompileNetwork();
+        net->AllocateAllMatrices({}, {}, criterion);
+
+        unsigned long seed = 1;
+        net->RandomInitLearnableParameters(input, /*uniformInit=*/true, seed++, /*initValueScale=*/1.0);
+        for (auto& parameter : parameters)
+            net->RandomInitLearnableParameters(parameter, /*uniformInit=*/true, seed++, /*initValueScale=*/1.0);
+    }
+
+    // one training step without update
+    void ForwardAndBackprop()
+    {
+        input->BumpEvalTimeStamp(); // pretend new data, so that all nodes get recomputed
+        net->ForwardProp(criterion);
+        net->Backprop(criterion);
+    }
+
+    // average time of one step in seconds, with 'numThreads' threads for the traversal (1 = sequential)
+    double Measure(size_t numThreads, size_t numIterations)
+    {
+        net->SetNumParallelTraversalThreads(numThreads);
+        ForwardAndBackprop(); // warm-up
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < numIterations; i++)
+            ForwardAndBackprop();
+        chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / numIterations;
+    }
+};
+
+// sequential traversal vs. concurrent execution of independent nodes (WorkStealingScheduler)
+template <class ElemType>
+void ParallelTraversalTest(size_t numBranches, size_t hiddenDim, size_t numSamples, size_t numIterations)
+{
+    cout << "Testing PARTraversalFlowControlNode" << endl;
+    cout << numBranches << " branches of " << hiddenDim << " hidden units, " << numSamples << " samples per minibatch" << endl;
+    MultiBranchNetwork<ElemType> network(numBranches, /*inputDim=*/hiddenDim, hiddenDim, numSamples);
+    ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::training);
+
+    const double sequential = network.Measure(1, numIterations);
+    cout << "Sequential traversal in: " << sequential << " seconds per minibatch" << endl;
+    for (size_t numThreads : { 2, 4, 8 })
+    {
+        const double parallel = network.Measure(numThreads, numIterations);
+        cout << "Parallel traversal with " << numThreads << " threads in: " << parallel << " seconds per minibatch (speed-up " << sequential / parallel << ")" << endl;
+    }
+}
+
+int main()
+{
+    cout << endl << "********************PARTraversalFlowControlNode TEST********************" << endl;
+    // many small towers: each node is too small to keep all cores busy through OpenMP alone
+    ParallelTraversalTest<float>(16, 64, 32, 50);
+    ParallelTraversalTest<float>(16, 256, 32, 20);
+    // few large towers: the products are parallelized inside the nodes already
+    ParallelTraversalTest<float>(4, 1024, 256, 10);
+
+    return 0;
+}
@@ -6,9 +6,12 @@
 
 #include "Config.h"
 #include "Actions.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
 #include "boost/filesystem.hpp"
 #include <boost/test/unit_test_log.hpp>
 #include <boost/test/unit_test_suite.hpp>
+#include <functional>
 
 using namespace Microsoft::MSR::CNTK;
 using namespace std;
@@ -158,6 +161,112 @@ struct DataFixture
         BOOST_CHECK_EQUAL_COLLECTIONS(beginStream1, end, beginStream2, end);
     }
 };
+
+// A network built by a test: the constructor of a derived struct adds the nodes to 'net' with a ComputationNetworkBuilder,
+// calls Compile() and one of the Allocate...() functions, and then sets the values of the parameters and inputs.
+template <class ElemType>
+struct TestNetwork
+{
+    ComputationNetworkPtr net;
+    ComputationNodeBasePtr criterion;
+    std::vector<ComputationNodeBasePtr> outputs;                   // evaluation nodes besides the criterion
+    std::vector<shared_ptr<ComputationNode<ElemType>>> parameters; // see RandomInitParameters() and CheckSameResults()
+
+    TestNetwork()
+        : net(make_shared<ComputationNetwork>(CPUDEVICE))
+    {
+    }
+
+    void Compile(const ComputationNodeBasePtr& criterionNode)
+    {
+        criterion = criterionNode;
+        net->AddToNodeGroup(L"criterion", criterion);
+        net->CompileNetwork();
+    }
+
+    // for networks without a minibatch layout, e.g. with parameters as inputs
+    void Allocate()
+    {
+        net->AllocateAllMatrices({}, outputs, criterion);
+    }
+
+    void AllocateFrames(size_t numSamples)
+    {
+        net->GetMBLayoutPtrOfNetwork()->InitAsFrameMode(numSamples);
+        Allocate();
+    }
+
+    // parallel sequences of the given lengths, padded with gaps to the longest one
+    void AllocateSequences(const std::vector<size_t>& sequenceLengths)
+    {
+        const size_t numTimeSteps = *max_element(sequenceLengths.begin(), sequenceLengths.end());
+        auto layout = net->GetMBLayoutPtrOfNetwork();
+        layout->Init(sequenceLengths.size(), numTimeSteps);
+        for (size_t s = 0; s < sequenceLengths.size(); s++)
+        {
+            layout->AddSequence(s, s, 0, sequenceLengths[s]);
+            if (sequenceLengths[s] < numTimeSteps)
+                layout->AddGap(s, sequenceLengths[s], numTimeSteps);
+        }
+        Allocate();
+    }
+
+    // uniformly distributed values, with consecutive seeds in the order of 'parameters'
+    void RandomInitParameters(unsigned long firstSeed, double initValueScale = 1.0)
+    {
+        unsigned long seed = firstSeed;
+        for (const auto& parameter : parameters)
+            net->RandomInitLearnableParameters(parameter, /*uniformInit=*/true, seed++, initValueScale);
+    }
+
+    // uniformly distributed values in [-1, 1] for 'numCols' columns of an input
+    static void SetRandomValue(const shared_ptr<ComputationNode<ElemType>>& input, size_t numCols, unsigned long seed)
+    {
+        input->Value().Resize(input->GetSampleMatrixNumRows(), numCols);
+        input->Value().SetUniformRandomValue(-1, 1, seed);
+    }
+
+    // one training step without update
+    void ForwardAndBackprop()
+    {
+        net->ForwardProp(criterion);
+        net->Backprop(criterion);
+    }
+
+    // compares the criterion and the gradients after ForwardAndBackprop() with those of 'expected', the same network built without a rewrite
+    void CheckSameResults(const TestNetwork& expected) const
+    {
+        BOOST_CHECK_CLOSE((ElemType) criterion->Get00Element(), (ElemType) expected.criterion->Get00Element(), (ElemType) 1e-3);
+        BOOST_REQUIRE_EQUAL(parameters.size(), expected.parameters.size());
+        for (size_t i = 0; i < parameters.size(); i++)
+            BOOST_CHECK(parameters[i]->Gradient().IsEqualTo(expected.parameters[i]->Gradient(), (ElemType) 1e-5));
+    }
+};
+
+// Compares 'gradient', the gradient of the criterion returned by 'evaluate' w.r.t. the value of 'node', with central differences,
+// for every element except those in the columns flagged by 'skipColumns'.
+inline void CheckGradientNumerically(const shared_ptr<ComputationNode<double>>& node, const Matrix<double>& gradient,
+                                     const std::function<double()>& evaluate, const std::vector<bool>& skipColumns = {})
+{
+    const double epsilon = 1e-5;
+    auto& value = node->Value();
+    for (size_t j = 0; j < value.GetNumCols(); j++)
+    {
+        if (j < skipColumns.size() && skipColumns[j])
+            continue;
+        for (size_t i = 0; i < value.GetNumRows(); i++)
+        {
+            const double original = value(i, j);
+            value(i, j) = original + epsilon;
+            const double plus = evaluate();
+            value(i, j) = original - epsilon;
+            const double minus = evaluate();
+            value(i, j) = original;
+            const double numerical = (plus - minus) / (2 * epsilon);
+            BOOST_CHECK_SMALL(gradient(i, j) - numerical, 1e-6 + 1e-4 * fabs(numerical));
+        }
+    }
+}
 }
 }
 }
@@ -0,0 +1,64 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// FusedElementwiseTests.cpp -- checks that fusing trees of elementwise operations into a FusedElementwiseNode
+// (ComputationNetwork::EnableElementwiseFusion()) does not change values and gradients.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "FusedNodes.h"
+#include "LinearAlgebraNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// A network with an elementwise tree over two learned projections and an input that needs no gradient:
+// h = Sigmoid(a) .* Tanh(b) + Exp(-a) - Log(Sigmoid(b)) + c .* a, with a = WA * x, b = WB * x, criterion = Sum(h)
+struct ElementwiseTreeNetwork : TestNetwork<float>
+{
+    ElementwiseTreeNetwork(bool fuse, size_t inputDim, size_t hiddenDim, size_t numSamples)
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        auto x = builder.CreateInputNode(L"x", inputDim);
+        auto c = builder.CreateInputNode(L"c", hiddenDim);
+        parameters = { builder.CreateLearnableParameter(L"WA", hiddenDim, inputDim), builder.CreateLearnableParameter(L"WB", hiddenDim, inputDim) };
+        auto a = builder.Times(parameters[0], x, /*outputRank=*/1, L"a");
+        auto b = builder.Times(parameters[1], x, /*outputRank=*/1, L"b");
+        auto h = builder.Plus(builder.Minus(builder.Plus(builder.ElementTimes(builder.Sigmoid(a), builder.Tanh(b)), builder.Exp(builder.Negate(a))),
+                                            builder.Log(builder.Sigmoid(b))),
+                              builder.ElementTimes(c, a), L"h");
+        net->EnableElementwiseFusion(fuse);
+        Compile(builder.Sum(h, L"criterion"));
+        AllocateFrames(numSamples);
+
+        RandomInitParameters(/*firstSeed=*/1);
+        SetRandomValue(x, numSamples, 3);
+        SetRandomValue(c, numSamples, 4);
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(FusedElementwiseSuite)
+
+BOOST_AUTO_TEST_CASE(FusedElementwiseMatchesUnfused)
+{
+    ElementwiseTreeNetwork unfused(/*fuse=*/false, /*inputDim=*/6, /*hiddenDim=*/5, /*numSamples=*/7);
+    ElementwiseTreeNetwork fused(/*fuse=*/true, /*inputDim=*/6, /*hiddenDim=*/5, /*numSamples=*/7);
+
+    // the whole tree became one node with the inputs a, b and c
+    auto h = fused.net->GetNodeFromName(L"h");
+    BOOST_REQUIRE(h->OperationName() == OperationNameOf(FusedElementwiseNode));
+    BOOST_CHECK_EQUAL(h->GetNumInputs(), 3);
+    BOOST_CHECK(unfused.net->GetNodeFromName(L"h")->OperationName() == OperationNameOf(PlusNode));
+
+    ScopedNetworkOperationMode unfusedModeGuard(unfused.net, NetworkOperationMode::training);
+    ScopedNetworkOperationMode fusedModeGuard(fused.net, NetworkOperationMode::training);
+    unfused.ForwardAndBackprop();
+    fused.ForwardAndBackprop();
+    fused.CheckSameResults(unfused);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
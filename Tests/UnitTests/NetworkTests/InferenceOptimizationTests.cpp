@@ -0,0 +1,149 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// InferenceOptimizationTests.cpp -- compares networks rewritten by ComputationNetwork::OptimizeForInference() with the originals.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "ConvolutionalNodes.h"
+#include "DeprecatedNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "TrainingNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// A network that is built the same way with and without OptimizeForInference(), for evaluation of a single output
+struct InferenceNetwork : TestNetwork<float>
+{
+    ComputationNodeBasePtr output;
+    shared_ptr<ComputationNode<float>> features;
+    std::vector<std::pair<float, float>> parameterRanges; // of the values of 'parameters'
+
+    // a parameter with uniformly distributed random values (set in Compile(), after the initialization by CompileNetwork())
+    shared_ptr<ComputationNode<float>> Parameter(ComputationNetworkBuilder<float>& builder, const std::wstring& name, const TensorShape& shape, float low = -1, float high = 1)
+    {
+        parameters.push_back(builder.CreateLearnableParameter(name, shape));
+        parameterRanges.push_back(std::make_pair(low, high));
+        return parameters.back();
+    }
+
+    void Compile(bool optimize, size_t numSamples)
+    {
+        net->AddToNodeGroup(L"output", output);
+        net->CompileNetwork();
+        for (size_t i = 0; i < parameters.size(); i++)
+            parameters[i]->Value().SetUniformRandomValue(parameterRanges[i].first, parameterRanges[i].second, /*seed=*/i + 1);
+        if (optimize && net->OptimizeForInference())
+            net->CompileNetwork();
+        output = net->GetNodeFromName(L"output");
+        outputs = { output };
+        AllocateFrames(numSamples);
+        SetRandomValue(features, numSamples, 12345);
+    }
+
+    Matrix<float> Evaluate()
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::inferring);
+        features->BumpEvalTimeStamp();
+        net->ForwardProp(output);
+        return output->As<ComputationNode<float>>()->Value().DeepClone();
+    }
+
+    size_t CountNodes(const std::wstring& operationName) const
+    {
+        auto nodes = net->GetAllNodes();
+        return count_if(nodes.begin(), nodes.end(), [&](const ComputationNodeBasePtr& node) { return node->OperationName() == operationName; });
+    }
+};
+
+// output = BN(TransposeTimes(W2, Dropout(ReLU(BN(W1 * PerDimMeanVarNormalization(features) + b1)))))
+static InferenceNetwork CreateFeedForwardNetwork(bool optimize, size_t inputDim, size_t hiddenDim, size_t outputDim, size_t numSamples)
+{
+    InferenceNetwork network;
+    auto& net = network.net;
+    ComputationNetworkBuilder<float> builder(*net);
+    network.features = builder.CreateInputNode(L"features", inputDim);
+    auto normalized = builder.PerDimMeanVarNormalization(network.features,
+                                                         network.Parameter(builder, L"mean", TensorShape(inputDim)),
+                                                         network.Parameter(builder, L"invStdDev", TensorShape(inputDim), 0.5f, 2.0f), L"normalized");
+    auto z1 = builder.Plus(builder.Times(network.Parameter(builder, L"W1", TensorShape(hiddenDim, inputDim)), normalized, /*outputRank=*/1, L"h1"),
+                           network.Parameter(builder, L"b1", TensorShape(hiddenDim)), L"z1");
+    auto bn1 = builder.BatchNormalization(z1, network.Parameter(builder, L"scale1", TensorShape(hiddenDim)), network.Parameter(builder, L"bias1", TensorShape(hiddenDim)),
+                                          network.Parameter(builder, L"runMean1", TensorShape(hiddenDim)), network.Parameter(builder, L"runInvStdDev1", TensorShape(hiddenDim), 0.5f, 2.0f),
+                                          /*spatial=*/false, 0, 0, 1e-5, /*useCntkEngine=*/true, ImageLayoutKind::CHW, L"bn1");
+    auto dropout = builder.Dropout(builder.RectifiedLinear(bn1, L"r1"), L"d1");
+    dropout->As<DropoutNode<float>>()->SetDropoutRate(0.5);
+    auto h2 = builder.TransposeTimes(network.Parameter(builder, L"W2", TensorShape(hiddenDim, outputDim)), dropout, L"h2");
+    network.output = builder.BatchNormalization(h2, network.Parameter(builder, L"scale2", TensorShape(outputDim)), network.Parameter(builder, L"bias2", TensorShape(outputDim)),
+                                                network.Parameter(builder, L"runMean2", TensorShape(outputDim)), network.Parameter(builder, L"runInvStdDev2", TensorShape(outputDim), 0.5f, 2.0f),
+                                                /*spatial=*/false, 0, 0, 1e-5, /*useCntkEngine=*/true, ImageLayoutKind::CHW, L"output");
+    network.Compile(optimize, numSamples);
+    return network;
+}
+
+// output = ReLU(spatial BN(Convolution(W, features) + b))
+static InferenceNetwork CreateConvolutionalNetwork(bool optimize, size_t numSamples)
+{
+    const size_t width = 6, height = 5, inputChannels = 2, outputChannels = 3;
+    InferenceNetwork network;
+    auto& net = network.net;
+    ComputationNetworkBuilder<float> builder(*net);
+    network.features = builder.CreateInputNode(L"features", TensorShape(width, height, inputChannels));
+    auto conv = builder.Convolution(network.Parameter(builder, L"W", TensorShape(outputChannels, 3 * 3 * inputChannels)), network.features,
+                                    /*kernelWidth=*/3, /*kernelHeight=*/3, outputChannels, /*horizontalSubsample=*/1, /*verticalSubsample=*/1,
+                                    ImageLayoutKind::CHW, /*zeroPadding=*/true, 0, L"conv");
+    auto z = builder.Plus(conv, network.Parameter(builder, L"b", TensorShape(1, 1, outputChannels)), L"z");
+    auto bn = builder.BatchNormalization(z, network.Parameter(builder, L"scale", TensorShape(outputChannels)), network.Parameter(builder, L"bias", TensorShape(outputChannels)),
+                                         network.Parameter(builder, L"runMean", TensorShape(outputChannels)), network.Parameter(builder, L"runInvStdDev", TensorShape(outputChannels), 0.5f, 2.0f),
+                                         /*spatial=*/true, 0, 0, 1e-5, /*useCntkEngine=*/true, ImageLayoutKind::CHW, L"bn");
+    network.output = builder.RectifiedLinear(bn, L"output");
+    network.Compile(optimize, numSamples);
+    return network;
+}
+
+static void CheckEqual(const Matrix<float>& expected, const Matrix<float>& actual)
+{
+    BOOST_REQUIRE_EQUAL(expected.GetNumRows(), actual.GetNumRows());
+    BOOST_REQUIRE_EQUAL(expected.GetNumCols(), actual.GetNumCols());
+    for (size_t j = 0; j < expected.GetNumCols(); j++)
+        for (size_t i = 0; i < expected.GetNumRows(); i++)
+            BOOST_CHECK_SMALL(expected(i, j) - actual(i, j), 1e-4f * (1 + fabs(expected(i, j))));
+}
+
+BOOST_AUTO_TEST_SUITE(InferenceOptimizationSuite)
+
+BOOST_AUTO_TEST_CASE(OptimizeFeedForwardNetwork)
+{
+    auto original = CreateFeedForwardNetwork(/*optimize=*/false, /*inputDim=*/5, /*hiddenDim=*/7, /*outputDim=*/4, /*numSamples=*/3);
+    auto optimized = CreateFeedForwardNetwork(/*optimize=*/true, /*inputDim=*/5, /*hiddenDim=*/7, /*outputDim=*/4, /*numSamples=*/3);
+    CheckEqual(original.Evaluate(), optimized.Evaluate());
+
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(BatchNormalizationNode)), 0);
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(DropoutNode)), 0);
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(PerDimMeanVarNormalizationNode)), 0);
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(TransposeTimesNode)), 0);
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(TimesNode)), 2);
+    // the first BN was folded into the existing bias, the second one needed a new one
+    BOOST_CHECK(optimized.net->GetNodeFromName(L"bn1")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(optimized.net->GetNodeFromName(L"output")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(optimized.net->GetNodeFromName(L"output.unbiased")->OperationName() == OperationNameOf(TimesNode));
+    BOOST_CHECK_LT(optimized.net->GetTotalNumberOfNodes(), original.net->GetTotalNumberOfNodes());
+}
+
+BOOST_AUTO_TEST_CASE(OptimizeConvolutionalNetwork)
+{
+    auto original = CreateConvolutionalNetwork(/*optimize=*/false, /*numSamples=*/2);
+    auto optimized = CreateConvolutionalNetwork(/*optimize=*/true, /*numSamples=*/2);
+    CheckEqual(original.Evaluate(), optimized.Evaluate());
+
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(BatchNormalizationNode)), 0);
+    BOOST_CHECK_EQUAL(optimized.CountNodes(OperationNameOf(ConvolutionNode)), 1);
+    BOOST_CHECK_EQUAL(optimized.net->GetTotalNumberOfNodes(), original.net->GetTotalNumberOfNodes() - 5); // BN and its four parameters
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
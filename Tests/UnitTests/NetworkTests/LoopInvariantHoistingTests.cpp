@@ -0,0 +1,62 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LoopInvariantHoistingTests.cpp -- checks that moving loop-invariant computation out of recurrent loops
+// (ComputationNetwork::EnableLoopInvariantHoisting()) does not change the results.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "LinearAlgebraNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// A recurrent network whose recurrence multiplies a weight matrix with the inputs stacked around the previous state:
+// h = Tanh(W * RowStack(x, PastValue(h), y)), criterion = Sum(h)
+struct StackedRecurrenceNetwork : TestNetwork<float>
+{
+    StackedRecurrenceNetwork(bool hoist, size_t inputDim, size_t hiddenDim, size_t numTimeSteps)
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        auto x = builder.CreateInputNode(L"x", inputDim);
+        auto y = builder.CreateInputNode(L"y", inputDim);
+        parameters = { builder.CreateLearnableParameter(L"W", hiddenDim, 2 * inputDim + hiddenDim) };
+        auto pastValue = builder.PastValue(nullptr, /*initHiddenActivity=*/0.1f, hiddenDim, /*timeStep=*/1, L"hPrev");
+        auto h = builder.Tanh(builder.Times(parameters[0], builder.RowStack({ x, pastValue, y }), /*outputRank=*/1, L"z"), L"h");
+        pastValue->AttachInputs({ h });
+        net->EnableLoopInvariantHoisting(hoist);
+        Compile(builder.Sum(h, L"criterion"));
+        AllocateSequences({ numTimeSteps });
+
+        RandomInitParameters(/*firstSeed=*/1);
+        SetRandomValue(x, numTimeSteps, 2);
+        SetRandomValue(y, numTimeSteps, 3);
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(LoopInvariantHoistingSuite)
+
+BOOST_AUTO_TEST_CASE(LoopInvariantHoistingMatchesOriginal)
+{
+    StackedRecurrenceNetwork original(/*hoist=*/false, /*inputDim=*/5, /*hiddenDim=*/7, /*numTimeSteps=*/9);
+    StackedRecurrenceNetwork hoisted(/*hoist=*/true, /*inputDim=*/5, /*hiddenDim=*/7, /*numTimeSteps=*/9);
+
+    // the product was split, and its invariant parts left the loop
+    BOOST_CHECK(hoisted.net->GetNodeFromName(L"z")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(hoisted.net->GetNodeFromName(L"z")->IsPartOfLoop());
+    BOOST_CHECK(!hoisted.net->GetNodeFromName(L"z.t0")->IsPartOfLoop());
+    BOOST_CHECK(hoisted.net->GetNodeFromName(L"z.t1")->IsPartOfLoop());
+    BOOST_CHECK(!hoisted.net->GetNodeFromName(L"z.t2")->IsPartOfLoop());
+
+    ScopedNetworkOperationMode originalModeGuard(original.net, NetworkOperationMode::training);
+    ScopedNetworkOperationMode hoistedModeGuard(hoisted.net, NetworkOperationMode::training);
+    original.ForwardAndBackprop();
+    hoisted.ForwardAndBackprop();
+    hoisted.CheckSameResults(original);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PackedExecutionTests.cpp -- checks that computing the nodes outside of recurrent loops on the valid frames only
+// (ComputationNetwork::EnablePackedExecution()) does not change the results.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "ReshapingNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// A recurrent network between two layers outside of the loop, trained on a minibatch of sequences of different lengths:
+// hx = Tanh(W1 * x + b1), h = Tanh(W2 * RowStack(hx, PastValue(h))), criterion = CrossEntropyWithSoftmax(labels, W3 * h)
+struct PaddedRecurrenceNetwork : TestNetwork<float>
+{
+    PaddedRecurrenceNetwork(bool packed, size_t inputDim, size_t hiddenDim, size_t labelDim, const std::vector<size_t>& sequenceLengths)
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        auto x = builder.CreateInputNode(L"x", inputDim);
+        auto labels = builder.CreateInputNode(L"labels", labelDim);
+        parameters = { builder.CreateLearnableParameter(L"W1", hiddenDim, inputDim), builder.CreateLearnableParameter(L"b1", hiddenDim, 1),
+                       builder.CreateLearnableParameter(L"W2", hiddenDim, 2 * hiddenDim), builder.CreateLearnableParameter(L"W3", labelDim, hiddenDim) };
+        auto hx = builder.Tanh(builder.Plus(builder.Times(parameters[0], x), parameters[1]), L"hx");
+        auto pastValue = builder.PastValue(nullptr, /*initHiddenActivity=*/0.1f, hiddenDim, /*timeStep=*/1, L"hPrev");
+        auto h = builder.Tanh(builder.Times(parameters[2], builder.RowStack({ hx, pastValue })), L"h");
+        pastValue->AttachInputs({ h });
+        auto z = builder.Times(parameters[3], h, /*outputRank=*/1, L"z");
+        net->EnablePackedExecution(packed);
+        Compile(builder.CrossEntropyWithSoftmax(labels, z, L"criterion"));
+        AllocateSequences(sequenceLengths);
+
+        RandomInitParameters(/*firstSeed=*/1);
+        // the gaps hold garbage, as they would after reading
+        const size_t numCols = net->GetMBLayoutPtrOfNetwork()->GetNumCols();
+        SetRandomValue(x, numCols, 5);
+        labels->Value().Resize(labelDim, numCols);
+        labels->Value().SetValue(0);
+        for (size_t j = 0; j < numCols; j++)
+            labels->Value().SetValue((j * 7) % labelDim, j, 1.0f);
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(PackedExecutionSuite)
+
+BOOST_AUTO_TEST_CASE(PackedExecutionMatchesPadded)
+{
+    const std::vector<size_t> sequenceLengths = { 7, 3, 5 };
+    PaddedRecurrenceNetwork original(/*packed=*/false, /*inputDim=*/4, /*hiddenDim=*/6, /*labelDim=*/3, sequenceLengths);
+    PaddedRecurrenceNetwork packed(/*packed=*/true, /*inputDim=*/4, /*hiddenDim=*/6, /*labelDim=*/3, sequenceLengths);
+
+    // the layers outside of the loop compute on the valid frames, and are unpacked for the loop
+    BOOST_CHECK(packed.net->GetNodeFromName(L"hx")->GetMBLayout() == packed.net->GetMBLayoutPtrOfNetwork()->GetPackedLayout());
+    BOOST_CHECK(packed.net->GetNodeFromName(L"z")->GetMBLayout() == packed.net->GetMBLayoutPtrOfNetwork()->GetPackedLayout());
+    BOOST_CHECK(packed.net->GetNodeFromName(L"hx.unpacked")->OperationName() == OperationNameOf(UnpackFramesNode));
+    BOOST_CHECK(packed.net->GetNodeFromName(L"h.packed")->OperationName() == OperationNameOf(PackFramesNode));
+    BOOST_CHECK(packed.net->GetNodeFromName(L"labels.packed")->OperationName() == OperationNameOf(PackFramesNode));
+    BOOST_CHECK(packed.net->GetNodeFromName(L"h")->GetMBLayout() == packed.net->GetMBLayoutPtrOfNetwork());
+    BOOST_CHECK(packed.net->GetNodeFromName(L"h")->IsPartOfLoop());
+
+    ScopedNetworkOperationMode originalModeGuard(original.net, NetworkOperationMode::training);
+    ScopedNetworkOperationMode packedModeGuard(packed.net, NetworkOperationMode::training);
+    original.ForwardAndBackprop();
+    packed.ForwardAndBackprop();
+    packed.CheckSameResults(original);
+
+    const size_t numValidFrames = 7 + 3 + 5;
+    BOOST_CHECK_EQUAL(packed.net->GetMBLayoutPtrOfNetwork()->GetPackedLayout()->GetNumCols(), numValidFrames);
+
+    // packing is done once
+    const size_t numNodes = packed.net->GetTotalNumberOfNodes();
+    packed.net->CompileNetwork();
+    BOOST_CHECK_EQUAL(packed.net->GetTotalNumberOfNodes(), numNodes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
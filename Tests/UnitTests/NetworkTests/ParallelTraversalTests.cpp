@@ -0,0 +1,80 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ParallelTraversalTests.cpp -- compares concurrent execution of independent nodes (ComputationNetwork::SetNumParallelTraversalThreads())
+// with the sequential traversal on a multi-branch network (see NetworkPerformanceTests for timings).
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// A network of 'numBranches' independent towers over a shared input, with their outputs summed up:
+// criterion = Sum(sum_k V_k * Tanh(W2_k * Sigmoid(W1_k * x)))
+struct MultiBranchNetwork : TestNetwork<float>
+{
+    shared_ptr<ComputationNode<float>> input;
+
+    MultiBranchNetwork(size_t numBranches, size_t inputDim, size_t hiddenDim, size_t numSamples)
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        input = builder.CreateLearnableParameter(L"x", inputDim, numSamples);
+        input->SetLearningRateMultiplier(0);
+        shared_ptr<ComputationNode<float>> sum;
+        for (size_t k = 0; k < numBranches; k++)
+        {
+            auto w1 = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W1_%d", (int) k), hiddenDim, inputDim);
+            auto w2 = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W2_%d", (int) k), hiddenDim, hiddenDim);
+            auto v  = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"V_%d",  (int) k), 1, hiddenDim);
+            parameters.insert(parameters.end(), { w1, w2, v });
+            auto branch = builder.Times(v, builder.Tanh(builder.Times(w2, builder.Sigmoid(builder.Times(w1, input)))));
+            sum = sum ? builder.Plus(sum, branch) : branch;
+        }
+        Compile(builder.Sum(sum, L"criterion"));
+        Allocate();
+
+        net->RandomInitLearnableParameters(input, /*uniformInit=*/true, /*randomSeed=*/1, /*initValueScale=*/1.0);
+        RandomInitParameters(/*firstSeed=*/2);
+    }
+
+    // one training step without update
+    void ForwardAndBackprop()
+    {
+        input->BumpEvalTimeStamp(); // pretend new data, so that all nodes get recomputed
+        TestNetwork<float>::ForwardAndBackprop();
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(ParallelTraversalSuite)
+
+BOOST_AUTO_TEST_CASE(ParallelTraversalMatchesSequential)
+{
+    MultiBranchNetwork network(/*numBranches=*/6, /*inputDim=*/32, /*hiddenDim=*/48, /*numSamples=*/16);
+    ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::training);
+
+    network.net->SetNumParallelTraversalThreads(1);
+    network.ForwardAndBackprop();
+    const float expectedCriterion = (float) network.criterion->Get00Element();
+    std::vector<Matrix<float>> expectedGradients;
+    for (const auto& parameter : network.parameters)
+        expectedGradients.push_back(parameter->Gradient().DeepClone());
+
+    for (size_t numThreads : { 2, 4 })
+    {
+        network.net->SetNumParallelTraversalThreads(numThreads);
+        for (size_t iteration = 0; iteration < 5; iteration++)
+        {
+            network.ForwardAndBackprop();
+            BOOST_CHECK_CLOSE((float) network.criterion->Get00Element(), expectedCriterion, 1e-3f);
+            for (size_t i = 0; i < network.parameters.size(); i++)
+                BOOST_CHECK(network.parameters[i]->Gradient().IsEqualTo(expectedGradients[i], 1e-5f));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,94 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ProfilerTests.cpp -- checks that the Profiler times the nodes of a network and writes a chrome://tracing file
+//
+#include "stdafx.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "Profiler.h"
+#include <fstream>
+#include <sstream>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(ProfilerSuite)
+
+BOOST_AUTO_TEST_CASE(ProfilerWritesNodeTrace)
+{
+    // criterion = Sum(Tanh(W * x))
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateLearnableParameter(L"x", 8, 4);
+    x->SetLearningRateMultiplier(0);
+    auto w = builder.CreateLearnableParameter(L"W", 16, 8);
+    ComputationNodeBasePtr criterion = builder.Sum(builder.Tanh(builder.Times(w, x, /*outputRank=*/1, L"product"), L"h"), L"criterion");
+    net->AddToNodeGroup(L"criterion", criterion);
+    net->CompileNetwork();
+    net->AllocateAllMatrices({}, {}, criterion);
+    net->RandomInitLearnableParameters(x, /*uniformInit=*/true, /*randomSeed=*/1, /*initValueScale=*/1.0);
+    net->RandomInitLearnableParameters(w, /*uniformInit=*/true, /*randomSeed=*/2, /*initValueScale=*/1.0);
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+
+    const std::wstring traceFilePath = L"ProfilerTests.trace.json";
+    {
+        Profiler profiler(/*numSamples=*/0, /*numNodeSamples=*/2, traceFilePath);
+        profiler.Attach(net->Environment());
+        for (size_t minibatch = 0; minibatch < 4; minibatch++)
+        {
+            {
+                Profiler::Scope profilerScope(profiler, "GetMinibatch");
+                x->BumpEvalTimeStamp();
+            }
+            net->ForwardProp(criterion);
+            net->Backprop(criterion);
+            // minibatch 0 is not profiled; minibatches 1 and 2 are
+            BOOST_CHECK((net->Environment().m_profiler != nullptr) == (minibatch == 1 || minibatch == 2));
+            profiler.NextSample();
+        }
+        BOOST_CHECK(net->Environment().m_profiler == nullptr);
+    }
+
+    std::ifstream traceFile(msra::strfun::utf8(traceFilePath));
+    BOOST_REQUIRE(traceFile.good());
+    std::stringstream trace;
+    trace << traceFile.rdbuf();
+    traceFile.close();
+    remove(msra::strfun::utf8(traceFilePath).c_str());
+
+    auto countOccurrences = [&](const std::string& pattern)
+    {
+        size_t count = 0;
+        for (size_t pos = trace.str().find(pattern); pos != std::string::npos; pos = trace.str().find(pattern, pos + 1))
+            count++;
+        return count;
+    };
+    BOOST_CHECK_EQUAL(trace.str().find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["), 0);
+    BOOST_CHECK_EQUAL(countOccurrences("\"name\": \"GetMinibatch\", \"cat\": \"phase\""), 2);
+    BOOST_CHECK_EQUAL(countOccurrences("\"name\": \"product\", \"cat\": \"forward\""), 2);
+    BOOST_CHECK_EQUAL(countOccurrences("\"name\": \"product\", \"cat\": \"backprop\""), 2);
+    BOOST_CHECK_EQUAL(countOccurrences("\"name\": \"h\", \"cat\": \"forward\""), 2);
+    BOOST_CHECK_EQUAL(countOccurrences("\"name\": \"W\", \"cat\": \"backprop\""), 0); // (no inputs)
+}
+
+BOOST_AUTO_TEST_CASE(EstimatedNumFLOPs)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateLearnableParameter(L"x", 8, 4);
+    auto w = builder.CreateLearnableParameter(L"W", 16, 8);
+    auto product = builder.Times(w, x);
+    auto h = builder.Tanh(product);
+    net->AddToNodeGroup(L"output", h);
+    net->CompileNetwork();
+
+    BOOST_CHECK_EQUAL(product->GetEstimatedNumFLOPs(), 2 * 16 * 8 * 4);
+    BOOST_CHECK_EQUAL(h->GetEstimatedNumFLOPs(), 16 * 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,108 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// RNNNodeTests.cpp -- checks the gradients of LSTMNode and GRUNode against finite differences
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "RNNNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// criterion = Sum(out .* out), where out = LSTM/GRU(W, x), over two sequences of different lengths (the shorter one followed by a gap)
+template <class RNNNode>
+struct RNNStackNetwork : TestNetwork<double>
+{
+    shared_ptr<ComputationNode<double>> weights;
+    shared_ptr<ComputationNode<double>> input;
+    shared_ptr<ComputationNode<double>> output;
+
+    RNNStackNetwork(size_t inputDim, size_t hiddenDim, size_t numLayers, bool bidirectional)
+    {
+        const size_t numTimeSteps = 5;
+        ComputationNetworkBuilder<double> builder(*net);
+        auto rnn = New<RNNNode>(CPUDEVICE, L"rnn", hiddenDim, numLayers, bidirectional);
+        input = builder.CreateInputNode(L"x", inputDim);
+        input->SetLearningRateMultiplier(1); // (so that the input gets a gradient)
+        weights = builder.CreateLearnableParameter(L"W", rnn->GetHiddenDim() * (std::is_same<RNNNode, LSTMNode<double>>::value ? 4 : 3), rnn->GetNumWeightColumns(inputDim));
+        output = net->AddNodeToNetAndAttachInputs(rnn, { weights, input });
+        Compile(builder.Sum(builder.ElementTimes(output, output), L"criterion"));
+        AllocateSequences({ numTimeSteps, 3 });
+
+        parameters = { weights };
+        RandomInitParameters(/*firstSeed=*/1, /*initValueScale=*/10.0);
+        SetRandomValue(input, 2 * numTimeSteps, 2);
+    }
+
+    double Evaluate()
+    {
+        weights->BumpEvalTimeStamp();
+        input->BumpEvalTimeStamp();
+        net->ForwardProp(criterion);
+        return criterion->Get00Element();
+    }
+
+    void Check()
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+        Evaluate();
+        net->Backprop(criterion);
+        const Matrix<double> weightsGradient = weights->Gradient().DeepClone();
+        const Matrix<double> inputGradient = input->Gradient().DeepClone();
+
+        // the gap produces zero output and receives no gradient
+        for (size_t j : { 7, 9 })
+        {
+            for (size_t i = 0; i < output->Value().GetNumRows(); i++)
+                BOOST_CHECK_EQUAL(output->Value()(i, j), 0);
+            for (size_t i = 0; i < inputGradient.GetNumRows(); i++)
+                BOOST_CHECK_EQUAL(inputGradient(i, j), 0);
+        }
+
+        CheckGradientNumerically(weights, weightsGradient, [&] { return Evaluate(); });
+        CheckGradientNumerically(input, inputGradient, [&] { return Evaluate(); }, { false, false, false, false, false, false, false, true, false, true });
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(RNNNodeSuite)
+
+BOOST_AUTO_TEST_CASE(LSTMNodeGradient)
+{
+    RNNStackNetwork<LSTMNode<double>>(/*inputDim=*/3, /*hiddenDim=*/4, /*numLayers=*/1, /*bidirectional=*/false).Check();
+}
+
+BOOST_AUTO_TEST_CASE(LSTMNodeStackedBidirectionalGradient)
+{
+    RNNStackNetwork<LSTMNode<double>>(/*inputDim=*/3, /*hiddenDim=*/4, /*numLayers=*/2, /*bidirectional=*/true).Check();
+}
+
+BOOST_AUTO_TEST_CASE(GRUNodeGradient)
+{
+    RNNStackNetwork<GRUNode<double>>(/*inputDim=*/3, /*hiddenDim=*/4, /*numLayers=*/1, /*bidirectional=*/false).Check();
+}
+
+BOOST_AUTO_TEST_CASE(GRUNodeStackedBidirectionalGradient)
+{
+    RNNStackNetwork<GRUNode<double>>(/*inputDim=*/3, /*hiddenDim=*/4, /*numLayers=*/2, /*bidirectional=*/true).Check();
+}
+
+// sequences that continue across minibatches (truncated BPTT) would need the state of the previous minibatch
+BOOST_AUTO_TEST_CASE(RNNNodeRejectsTruncatedSequences)
+{
+    for (bool continuesInNextMinibatch : { false, true })
+    {
+        RNNStackNetwork<LSTMNode<double>> network(/*inputDim=*/3, /*hiddenDim=*/4, /*numLayers=*/1, /*bidirectional=*/false);
+        auto layout = network.net->GetMBLayoutPtrOfNetwork();
+        layout->Init(2, 5);
+        layout->AddSequence(0, 0, continuesInNextMinibatch ? 0 : -2, continuesInNextMinibatch ? 8 : 5);
+        layout->AddSequence(1, 1, 0, 5);
+        BOOST_CHECK_THROW(network.Evaluate(), std::invalid_argument);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,216 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SampledSoftmaxTests.cpp -- checks SampledCrossEntropyWithSoftmaxNode against the full softmax and against finite differences
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "TrainingNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// criterion = SampledCrossEntropyWithSoftmax(labels, x, W, b) with sparse labels,
+// over two sequences of different lengths (the shorter one followed by a gap)
+struct SampledSoftmaxNetwork : TestNetwork<double>
+{
+    static const size_t numTimeSteps = 4;
+    static const unsigned long randomSeed = 7;
+
+    shared_ptr<SampledCrossEntropyWithSoftmaxNode<double>> sampledSoftmax;
+    shared_ptr<ComputationNode<double>> input;
+    shared_ptr<ComputationNode<double>> weights;
+    shared_ptr<ComputationNode<double>> bias;
+    std::vector<size_t> labels; // class of each column, SIZE_MAX for gaps
+
+    SampledSoftmaxNetwork(size_t hiddenDim, size_t numClasses, size_t numSamples, const std::wstring& samplingDistribution)
+    {
+        ComputationNetworkBuilder<double> builder(*net);
+        input = builder.CreateInputNode(L"x", hiddenDim);
+        input->SetLearningRateMultiplier(1); // (so that the input gets a gradient)
+        auto labelsNode = builder.CreateSparseInputNode(L"labels", numClasses);
+        weights = builder.CreateLearnableParameter(L"W", hiddenDim, numClasses);
+        bias = builder.CreateLearnableParameter(L"b", numClasses, 1);
+        Compile(builder.SampledCrossEntropyWithSoftmax(labelsNode, input, weights, bias, numSamples, samplingDistribution, L"criterion"));
+        sampledSoftmax = dynamic_pointer_cast<SampledCrossEntropyWithSoftmaxNode<double>>(criterion);
+        AllocateSequences({ numTimeSteps, 2 });
+
+        parameters = { weights, bias };
+        RandomInitParameters(/*firstSeed=*/1, /*initValueScale=*/10.0);
+        SetRandomValue(input, 2 * numTimeSteps, 3);
+
+        // the labels are sparse, with empty columns for the gap
+        std::vector<CPUSPARSE_INDEX_TYPE> columnStarts(1, 0), rows;
+        for (size_t j = 0; j < 2 * numTimeSteps; j++)
+        {
+            const bool isGap = j % 2 == 1 && j / 2 >= 2;
+            labels.push_back(isGap ? SIZE_MAX : (j * 7 + 3) % numClasses);
+            if (!isGap)
+                rows.push_back((CPUSPARSE_INDEX_TYPE) labels.back());
+            columnStarts.push_back((CPUSPARSE_INDEX_TYPE) rows.size());
+        }
+        std::vector<double> values(rows.size(), 1);
+        labelsNode->Value().SetMatrixFromCSCFormat(columnStarts.data(), rows.data(), values.data(), rows.size(), numClasses, labels.size());
+    }
+
+    double Evaluate()
+    {
+        sampledSoftmax->SetRandomSeed(randomSeed); // (the same samples for every evaluation)
+        weights->BumpEvalTimeStamp();
+        bias->BumpEvalTimeStamp();
+        input->BumpEvalTimeStamp();
+        net->ForwardProp(criterion);
+        return criterion->Get00Element();
+    }
+
+    // -sum_t log softmax_k(W_k^T x_t + b_k - correction_k)[label_t] over the given classes
+    double ExpectedCriterion(const std::vector<size_t>& classes, const std::function<double(size_t)>& correction)
+    {
+        double criterion = 0;
+        for (size_t j = 0; j < labels.size(); j++)
+        {
+            if (labels[j] == SIZE_MAX)
+                continue;
+            std::vector<double> z;
+            double labelLogit = 0;
+            for (size_t k : classes)
+            {
+                double logit = bias->Value()(k, 0) - correction(k);
+                for (size_t i = 0; i < weights->Value().GetNumRows(); i++)
+                    logit += weights->Value()(i, k) * input->Value()(i, j);
+                z.push_back(logit);
+                if (k == labels[j])
+                    labelLogit = logit;
+            }
+            const double maxLogit = *max_element(z.begin(), z.end());
+            double sum = 0;
+            for (double logit : z)
+                sum += exp(logit - maxLogit);
+            criterion -= labelLogit - maxLogit - log(sum);
+        }
+        return criterion;
+    }
+
+    void CheckGradients()
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+        Evaluate();
+        net->Backprop(criterion);
+        const Matrix<double> biasGradient = bias->Gradient().DeepClone();
+        const Matrix<double> inputGradient = input->Gradient().DeepClone();
+
+        // the gradient of the weights is sparse, with the columns of the candidates
+        BOOST_CHECK(weights->Gradient().GetMatrixType() == SPARSE);
+        BOOST_CHECK_EQUAL(weights->Gradient().GetNumCols(), weights->Value().GetNumCols());
+        Matrix<double> weightsGradient(weights->Value().GetNumRows(), weights->Value().GetNumCols(), CPUDEVICE);
+        weightsGradient.SetValue(0);
+        Matrix<double>::ScaleAndAdd(1, weights->Gradient(), weightsGradient);
+
+        auto evaluate = [&] { return Evaluate(); };
+        CheckGradientNumerically(input, inputGradient, evaluate);
+        CheckGradientNumerically(weights, weightsGradient, evaluate);
+        CheckGradientNumerically(bias, biasGradient, evaluate);
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(SampledSoftmaxSuite)
+
+BOOST_AUTO_TEST_CASE(SampledSoftmaxIsExactWhenNotTraining)
+{
+    SampledSoftmaxNetwork network(/*hiddenDim=*/3, /*numClasses=*/20, /*numSamples=*/5, L"logUniform");
+    std::vector<size_t> allClasses(20);
+    for (size_t k = 0; k < allClasses.size(); k++)
+        allClasses[k] = k;
+
+    ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::inferring);
+    const double expected = network.ExpectedCriterion(allClasses, [](size_t) { return 0.0; });
+    BOOST_CHECK_CLOSE(network.Evaluate(), expected, 1e-10);
+    BOOST_CHECK(network.sampledSoftmax->GetCandidates().empty());
+}
+
+BOOST_AUTO_TEST_CASE(SampledSoftmaxWithAllClassesIsExact)
+{
+    SampledSoftmaxNetwork network(/*hiddenDim=*/3, /*numClasses=*/6, /*numSamples=*/6, L"logUniform");
+    std::vector<size_t> allClasses(6);
+    for (size_t k = 0; k < allClasses.size(); k++)
+        allClasses[k] = k;
+
+    ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::training);
+    const double expected = network.ExpectedCriterion(allClasses, [](size_t) { return 0.0; });
+    BOOST_CHECK_CLOSE(network.Evaluate(), expected, 1e-10);
+    BOOST_CHECK(network.sampledSoftmax->GetCandidates() == allClasses);
+    network.CheckGradients();
+}
+
+BOOST_AUTO_TEST_CASE(SampledSoftmaxCriterion)
+{
+    const size_t numClasses = 50, numSamples = 8;
+    for (const wchar_t* samplingDistribution : { L"logUniform", L"uniform" })
+    {
+        SampledSoftmaxNetwork network(/*hiddenDim=*/3, numClasses, numSamples, samplingDistribution);
+        ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::training);
+        const double criterion = network.Evaluate();
+
+        // the candidates are sorted, unique, include all labels, and are fewer than the classes
+        const std::vector<size_t> candidates = network.sampledSoftmax->GetCandidates();
+        BOOST_CHECK(is_sorted(candidates.begin(), candidates.end()));
+        BOOST_CHECK(adjacent_find(candidates.begin(), candidates.end()) == candidates.end());
+        for (size_t label : network.labels)
+            BOOST_CHECK(label == SIZE_MAX || binary_search(candidates.begin(), candidates.end(), label));
+        BOOST_CHECK_LE(candidates.size(), numSamples + network.labels.size());
+
+        // the logits are corrected by the log probability of each class to be a candidate, which is 1 for the labels
+        const bool uniform = std::wstring(samplingDistribution) == L"uniform";
+        const double expected = network.ExpectedCriterion(candidates, [&](size_t k)
+        {
+            if (find(network.labels.begin(), network.labels.end(), k) != network.labels.end())
+                return 0.0;
+            const double p = uniform ? 1.0 / numClasses : log((k + 2.0) / (k + 1.0)) / log(numClasses + 1.0);
+            return log(1 - pow(1 - p, (double) numSamples));
+        });
+        BOOST_CHECK_CLOSE(criterion, expected, 1e-10);
+
+        // a new minibatch gets new samples
+        network.sampledSoftmax->SetRandomSeed(SampledSoftmaxNetwork::randomSeed + 1);
+        network.weights->BumpEvalTimeStamp();
+        network.net->ForwardProp(network.criterion);
+        BOOST_CHECK(network.sampledSoftmax->GetCandidates() != candidates);
+
+        network.CheckGradients();
+    }
+}
+
+// a node loaded from a checkpoint continues to draw the samples that the saved one would have drawn
+BOOST_AUTO_TEST_CASE(SampledSoftmaxSavesSamplerState)
+{
+    SampledSoftmaxNetwork saved(/*hiddenDim=*/3, /*numClasses=*/50, /*numSamples=*/8, L"logUniform");
+    SampledSoftmaxNetwork loaded(/*hiddenDim=*/3, /*numClasses=*/50, /*numSamples=*/8, L"logUniform");
+    ScopedNetworkOperationMode savedModeGuard(saved.net, NetworkOperationMode::training);
+    ScopedNetworkOperationMode loadedModeGuard(loaded.net, NetworkOperationMode::training);
+    saved.Evaluate(); // (advances the sample counter)
+    loaded.sampledSoftmax->SetRandomSeed(SampledSoftmaxNetwork::randomSeed + 1);
+
+    const std::wstring fileName = L"SampledSoftmaxSavesSamplerState.tmp";
+    {
+        File file(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        saved.sampledSoftmax->Save(file);
+    }
+    {
+        File file(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        loaded.sampledSoftmax->Load(file, CURRENT_CNTK_MODEL_VERSION);
+    }
+    _wunlink(fileName.c_str());
+
+    for (auto network : { &saved, &loaded })
+    {
+        network->weights->BumpEvalTimeStamp();
+        network->net->ForwardProp(network->criterion);
+    }
+    BOOST_CHECK(loaded.sampledSoftmax->GetCandidates() == saved.sampledSoftmax->GetCandidates());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
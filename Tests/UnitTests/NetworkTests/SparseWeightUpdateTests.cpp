@@ -0,0 +1,71 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SparseWeightUpdateTests.cpp -- checks that SGD updates from sparse gradients, with the lazy catch-up of untouched
+// columns at the end of the epoch, give the same parameters as updates from the equivalent dense gradients
+//
+#include "stdafx.h"
+#include "SGD.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(SparseWeightUpdateSuite)
+
+BOOST_AUTO_TEST_CASE(SparseWeightUpdateMatchesDense)
+{
+    // gradient of a lookup table [hiddenDim x vocabSize] with one-hot inputs, which touches a few columns per minibatch
+    const size_t hiddenDim = 5, vocabSize = 20, mbSize = 4, numMinibatches = 8;
+    const double learnRatePerSample = 0.05;
+    const double momentumPerSample = pow(0.9, 1.0 / mbSize); // 0.9 per minibatch
+    for (const char* gradUpdateType : { "None", "AdaGrad", "RmsProp" })
+    {
+        for (bool useNesterovMomentum : { false, true })
+        {
+            ConfigParameters config;
+            config.Parse(msra::strfun::strprintf("modelPath=unused\nmaxEpochs=1\nlearningRatesPerSample=0.05\ngradUpdateType=%s", gradUpdateType));
+            SGD<float> sgd(config);
+
+            Matrix<float> denseValue = Matrix<float>::RandomUniform(hiddenDim, vocabSize, CPUDEVICE, -1, 1, 1);
+            Matrix<float> sparseValue = denseValue.DeepClone();
+            Matrix<float> denseSmoothedGradient(hiddenDim, vocabSize, CPUDEVICE), sparseSmoothedGradient(hiddenDim, vocabSize, CPUDEVICE);
+            denseSmoothedGradient.SetValue(0);
+            sparseSmoothedGradient.SetValue(0);
+            SparseUpdateHistory history;
+            Matrix<float> sparseGradient(0, 0, CPUDEVICE, MatrixType::SPARSE, matrixFormatSparseBlockCol);
+            for (size_t minibatch = 0; minibatch < numMinibatches; minibatch++)
+            {
+                Matrix<float> outputGradient = Matrix<float>::RandomUniform(hiddenDim, mbSize, CPUDEVICE, -1, 1, 2 + minibatch);
+                Matrix<float> input(vocabSize, mbSize, CPUDEVICE, MatrixType::SPARSE, matrixFormatSparseCSC);
+                Matrix<float> denseGradient(hiddenDim, vocabSize, CPUDEVICE);
+                denseGradient.SetValue(0);
+                for (size_t j = 0; j < mbSize; j++)
+                {
+                    const size_t word = (minibatch * 7 + j * j * 3) % vocabSize; // (some words are not seen for several minibatches)
+                    input.SetValue(word, j, 1);
+                    for (size_t h = 0; h < hiddenDim; h++)
+                        denseGradient(h, word) += outputGradient(h, j);
+                }
+                sparseGradient.Reset();
+                Matrix<float>::MultiplyAndAdd(outputGradient, false, input, true, sparseGradient); // (as in TimesNode::BackpropTo())
+
+                SGD<float>::UpdateWeightsS(&sgd, denseValue, denseGradient, denseSmoothedGradient, learnRatePerSample, momentumPerSample,
+                                           mbSize, /*L2RegWeight=*/0, /*L1RegWeight=*/0, /*needAveMultiplier=*/false, useNesterovMomentum);
+                SGD<float>::UpdateWeightsS(&sgd, sparseValue, sparseGradient, sparseSmoothedGradient, learnRatePerSample, momentumPerSample,
+                                           mbSize, /*L2RegWeight=*/0, /*L1RegWeight=*/0, /*needAveMultiplier=*/false, useNesterovMomentum, &history);
+            }
+            BOOST_CHECK_EQUAL(history.numUpdates, numMinibatches);
+
+            // as done by SGD at the end of an epoch
+            SGD<float>::CatchUpSparseUpdatesS(&sgd, sparseValue, sparseGradient, sparseSmoothedGradient, learnRatePerSample, momentumPerSample,
+                                              mbSize, /*L2RegWeight=*/0, /*L1RegWeight=*/0, /*needAveMultiplier=*/false, useNesterovMomentum, history);
+            BOOST_CHECK(sparseValue.IsEqualTo(denseValue, 1e-4f));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
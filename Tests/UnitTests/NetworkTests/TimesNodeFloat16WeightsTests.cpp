@@ -0,0 +1,98 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TimesNodeFloat16WeightsTests.cpp -- checks that a TimesNode multiplies from the 16-bit copy of its weights
+// (see CPUHalfMatrix and ComputationNetwork::EnableFloat16Weights()) when inferring, and that the copy follows changes of the weights.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "LinearAlgebraNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// criterion = Sum(Sigmoid(W * x)) over a few frames (a sum of positive terms, so that its relative error stays small)
+struct Float16WeightsNetwork : TestNetwork<float>
+{
+    static const size_t inputDim = 256, outputDim = 128, numSamples = 8;
+    shared_ptr<ComputationNode<float>> x;
+    shared_ptr<ComputationNode<float>> weights;
+
+    Float16WeightsNetwork()
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        x = builder.CreateInputNode(L"x", inputDim);
+        weights = builder.CreateLearnableParameter(L"W", outputDim, inputDim);
+        Compile(builder.Sum(builder.Sigmoid(builder.Times(weights, x, /*outputRank=*/1, L"z")), L"criterion"));
+        AllocateFrames(numSamples);
+
+        parameters = { weights };
+        RandomInitParameters(/*firstSeed=*/1);
+        SetRandomValue(x, numSamples, 2);
+    }
+
+    // forward the next minibatch (with the same input), as an evaluation loop would
+    float Forward()
+    {
+        ComputationNetwork::BumpEvalTimeStamp({ x });
+        net->ForwardProp(criterion);
+        return static_cast<ComputationNode<float>&>(*criterion).Value().Get00Element();
+    }
+
+    // the same computation without the network
+    float Expected() const
+    {
+        const float* w = weights->Value().Data(); // (CPU)
+        const float* xValues = x->Value().Data();
+        double sum = 0;
+        for (size_t t = 0; t < numSamples; t++)
+        {
+            for (size_t i = 0; i < outputDim; i++)
+            {
+                double z = 0;
+                for (size_t j = 0; j < inputDim; j++)
+                    z += w[i + j * outputDim] * xValues[j + t * inputDim];
+                sum += 1 / (1 + exp(-z));
+            }
+        }
+        return (float) sum;
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(TimesNodeFloat16WeightsSuite)
+
+BOOST_AUTO_TEST_CASE(TimesNodeFloat16Weights)
+{
+    for (auto format : { Float16Format::Half, Float16Format::BFloat16 })
+    {
+        Float16WeightsNetwork network;
+        const size_t numRows = network.weights->Value().GetNumRows(), numCols = network.weights->Value().GetNumCols();
+        // weights that are representable in 16 bits, so that the product from the 16-bit copy gives the same result
+        CPUHalfMatrix float16Weights(format);
+        float16Weights.AssignValuesOf(network.weights->Value().Data(), numRows, numCols);
+        float16Weights.ConvertBlockTo(0, numRows, 0, numCols, network.weights->Value().Data(), numRows);
+
+        network.net->EnableFloat16Weights(true, format);
+        BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f); // (the products are accumulated in float)
+        auto times = network.net->GetNodeFromName(L"z")->As<TimesNode<float>>();
+        BOOST_CHECK_EQUAL(times->Float16Input0().GetNumElements(), numRows * numCols);
+        BOOST_CHECK(times->Float16Input0().GetFormat() == format);
+
+        // the 16-bit copy follows a change of the weights once their time stamp changes
+        Matrix<float>::Scale(0.5f, network.weights->Value());
+        network.weights->BumpEvalTimeStamp();
+        BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f);
+
+        // it is not used for training
+        times->EnableFloat16Weights(true, format); // (drops the copy)
+        ScopedNetworkOperationMode modeGuard(network.net, NetworkOperationMode::training);
+        network.Forward();
+        BOOST_CHECK(times->Float16Input0().IsEmpty());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
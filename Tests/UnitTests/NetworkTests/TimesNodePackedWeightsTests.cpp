@@ -0,0 +1,109 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TimesNodePackedWeightsTests.cpp -- checks that the packed weights of a TimesNode inside a recurrent loop
+// (see CPUPackedMatrix) follow changes of the weights.
+//
+#include "stdafx.h"
+#include "Common/NetworkTestHelper.h"
+#include "LinearAlgebraNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// h = Tanh(W * RowStack(x, PastValue(h))), criterion = Sum(h), with W large enough to be packed for the one column per time step
+struct PackedWeightsRecurrenceNetwork : TestNetwork<float>
+{
+    static const size_t inputDim = 64, hiddenDim = 1024, numTimeSteps = 4;
+    shared_ptr<ComputationNode<float>> x;
+    shared_ptr<ComputationNode<float>> weights;
+
+    PackedWeightsRecurrenceNetwork()
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        x = builder.CreateInputNode(L"x", inputDim);
+        weights = builder.CreateLearnableParameter(L"W", hiddenDim, inputDim + hiddenDim);
+        auto pastValue = builder.PastValue(nullptr, /*initHiddenActivity=*/0.1f, hiddenDim, /*timeStep=*/1, L"hPrev");
+        auto h = builder.Tanh(builder.Times(weights, builder.RowStack({ x, pastValue }), /*outputRank=*/1, L"z"), L"h");
+        pastValue->AttachInputs({ h });
+        Compile(builder.Sum(h, L"criterion"));
+        AllocateSequences({ numTimeSteps });
+
+        parameters = { weights };
+        RandomInitParameters(/*firstSeed=*/1);
+        SetRandomValue(x, numTimeSteps, 2);
+    }
+
+    // forward the next minibatch (with the same input), as a training or evaluation loop would
+    float Forward()
+    {
+        ComputationNetwork::BumpEvalTimeStamp({ x });
+        net->ForwardProp(criterion);
+        return static_cast<ComputationNode<float>&>(*criterion).Value().Get00Element();
+    }
+
+    // the same computation without the network
+    float Expected() const
+    {
+        const size_t numCols = inputDim + hiddenDim;
+        const float* w = weights->Value().Data(); // (CPU)
+        const float* xValues = x->Value().Data();
+        vector<double> h(hiddenDim, 0.1), hNext(hiddenDim);
+        double sum = 0;
+        for (size_t t = 0; t < numTimeSteps; t++)
+        {
+            for (size_t i = 0; i < hiddenDim; i++)
+            {
+                double z = 0;
+                for (size_t j = 0; j < numCols; j++)
+                    z += w[i + j * hiddenDim] * (j < inputDim ? xValues[j + t * inputDim] : h[j - inputDim]);
+                hNext[i] = tanh(z);
+                sum += hNext[i];
+            }
+            h.swap(hNext);
+        }
+        return (float) sum;
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(TimesNodePackedWeightsSuite)
+
+BOOST_AUTO_TEST_CASE(TimesNodePackedWeightsFollowUpdates)
+{
+    PackedWeightsRecurrenceNetwork network;
+    auto times = network.net->GetNodeFromName(L"z")->As<TimesNode<float>>();
+    const auto& packedWeights = times->PackedInput0();
+    auto& w = network.weights->Value();
+    const size_t numRows = w.GetNumRows(), numCols = w.GetNumCols();
+    BOOST_REQUIRE(CPUPackedMatrix<float>::IsBeneficial(numRows, numCols, 1));
+    BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f); // (the products are accumulated in float)
+    // the product inside the loop was computed from the packed weights
+    BOOST_REQUIRE(!packedWeights.IsEmpty());
+    BOOST_CHECK_EQUAL(packedWeights.GetNumRows(), numRows);
+    BOOST_CHECK_EQUAL(packedWeights.GetNumCols(), numCols);
+    BOOST_CHECK_EQUAL(packedWeights.Panel(0)[0], w(0, 0));
+
+    // parameters that are being trained are packed again for each minibatch, even if an in-place update does not bump their time stamp
+    Matrix<float>::Scale(0.5f, w);
+    BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f);
+    BOOST_CHECK_EQUAL(packedWeights.Panel(0)[0], w(0, 0));
+
+    // fixed parameters keep their packed copy across minibatches until their time stamp changes
+    network.weights->SetLearningRateMultiplier(0);
+    BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f);
+    const float packedValue = w(0, 0);
+    w(0, 0) = packedValue + 1; // (without bumping the time stamp, so that the packed copy is used again)
+    network.Forward();
+    BOOST_CHECK_EQUAL(packedWeights.Panel(0)[0], packedValue);
+    w(0, 0) = packedValue;
+    Matrix<float>::Scale(2.0f, w);
+    network.weights->BumpEvalTimeStamp();
+    BOOST_CHECK_CLOSE(network.Forward(), network.Expected(), 1e-2f);
+    BOOST_CHECK_EQUAL(packedWeights.Panel(0)[0], w(0, 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -26,15 +26,15 @@ private:
     size_t m_chunkBegin;
     size_t m_chunkEnd;
     TensorShapePtr m_sampleLayout;
-    uint32_t m_sequenceLength;
+    const vector<uint32_t>& m_sequenceLengths;
     vector<vector<float>>& m_sequenceData;
 
 public:
-    MockChunk(size_t chunkBegin, size_t chunkEnd, vector<vector<float>>& sequenceData, uint32_t sequenceLength)
+    MockChunk(size_t chunkBegin, size_t chunkEnd, vector<vector<float>>& sequenceData, const vector<uint32_t>& sequenceLengths)
         : m_chunkBegin(chunkBegin),
           m_chunkEnd(chunkEnd),
           m_sampleLayout(make_shared<TensorShape>(1)),
-          m_sequenceLength(sequenceLength),
+          m_sequenceLengths(sequenceLengths),
           m_sequenceData(sequenceData)
     {
         assert(chunkBegin <= chunkEnd);
@@ -48,7 +48,7 @@ public:
 
         auto data = make_shared<DenseSequenceData>();
         data->m_data = &m_sequenceData[sequenceId][0];
-        data->m_numberOfSamples = m_sequenceLength;
+        data->m_numberOfSamples = m_sequenceLengths[sequenceId];
         data->m_sampleLayout = m_sampleLayout;
         result.push_back(data);
     }
@@ -59,7 +59,7 @@ public:
 class MockDeserializer : public IDataDeserializer
 {
 private:
-    uint32_t m_sequenceLength;
+    vector<uint32_t> m_sequenceLengths;
     size_t m_numChunks;
     size_t m_numSequencesPerChunk;
     vector<SequenceDescription> m_descriptions;
@@ -70,15 +70,22 @@ private:
 
 public:
     MockDeserializer(size_t numChunks, size_t numSequencesPerChunks, vector<float>& data, uint32_t sequenceLength = 1)
+        : MockDeserializer(numChunks, numSequencesPerChunks, data, vector<uint32_t>(data.size(), sequenceLength))
+    {
+    }
+
+    // sequences of different lengths
+    MockDeserializer(size_t numChunks, size_t numSequencesPerChunks, vector<float>& data, const vector<uint32_t>& sequenceLengths)
         : m_numChunks(numChunks),
           m_numSequencesPerChunk(numSequencesPerChunks),
           m_sampleLayout(make_shared<TensorShape>(1)),
-          m_sequenceLength(sequenceLength)
+          m_sequenceLengths(sequenceLengths)
     {
+        assert(data.size() == sequenceLengths.size());
         m_sequenceData.reserve(data.size());
-        for (float d : data)
+        for (size_t i = 0; i < data.size(); i++)
         {
-            m_sequenceData.push_back(vector<float>(m_sequenceLength, d));
+            m_sequenceData.push_back(vector<float>(m_sequenceLengths[i], data[i]));
         }
 
         size_t numSequences = numChunks * numSequencesPerChunks;
@@ -89,7 +96,7 @@ public:
         {
             m_descriptions.push_back(SequenceDescription {
                 i,
-                m_sequenceLength,
+                m_sequenceLengths[i],
                 (ChunkIdType) (i / m_numSequencesPerChunk),
                 { 0, i }
             });
@@ -99,7 +106,7 @@ public:
         {
             m_chunkDescriptions.push_back(make_shared<ChunkDescription>(ChunkDescription {
                 i,
-                m_numSequencesPerChunk * m_sequenceLength,
+                accumulate(m_sequenceLengths.begin() + i * m_numSequencesPerChunk, m_sequenceLengths.begin() + (i + 1) * m_numSequencesPerChunk, (size_t)0),
                 m_numSequencesPerChunk
             }));
         }
@@ -125,7 +132,7 @@ public:
         assert(chunkId < m_numChunks);
         size_t chunkBegin = chunkId * m_numSequencesPerChunk;
         size_t chunkEnd = chunkBegin + m_numSequencesPerChunk;
-        shared_ptr<Chunk> chunk = make_shared<MockChunk>(chunkBegin, chunkEnd, m_sequenceData, m_sequenceLength);
+        shared_ptr<Chunk> chunk = make_shared<MockChunk>(chunkBegin, chunkEnd, m_sequenceData, m_sequenceLengths);
         return chunk;
     }
 
@@ -145,7 +152,7 @@ public:
         {
             descriptions.push_back(SequenceDescription{
                 i,
-                m_sequenceLength,
+                m_sequenceLengths[i],
                 chunkId,
                 { 0, i }
             });
@@ -403,6 +410,78 @@ BOOST_AUTO_TEST_CASE(BlockRandomizerOneEpochLegacyRandomization)
     BlockRandomizerOneEpochLegacyRandomizationTest(true);
 }
 
+// Minibatches of sequences of random lengths, with and without grouping by length;
+// returns the sequence values seen in one sweep, and the number of samples of padding.
+static vector<float> BlockRandomizerLengthBucketingSweep(size_t lengthBucketSize, size_t minibatchSize, size_t& numPaddingSamples)
+{
+    const int numChunks = 5;
+    const int numSequencesPerChunk = 100;
+    vector<float> data(numChunks * numSequencesPerChunk);
+    iota(data.begin(), data.end(), 0.0f);
+    mt19937 rng(7);
+    uniform_int_distribution<uint32_t> distr(1, 20);
+    vector<uint32_t> sequenceLengths(data.size());
+    for (auto& length : sequenceLengths)
+    {
+        length = distr(rng);
+    }
+    size_t numSamples = accumulate(sequenceLengths.begin(), sequenceLengths.end(), (size_t)0);
+
+    auto mockDeserializer = make_shared<MockDeserializer>(numChunks, numSequencesPerChunk, data, sequenceLengths);
+    auto randomizer = make_shared<BlockRandomizer>(0, 2000, mockDeserializer, false, BlockRandomizer::DecimationMode::chunk, false, false, lengthBucketSize);
+
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 1;
+    epochConfiguration.m_workerRank = 0;
+    epochConfiguration.m_minibatchSizeInSamples = minibatchSize;
+    epochConfiguration.m_totalEpochSizeInSamples = numSamples;
+    epochConfiguration.m_epochIndex = 0;
+    randomizer->StartEpoch(epochConfiguration);
+
+    vector<float> actual;
+    numPaddingSamples = 0;
+    for (;;)
+    {
+        Sequences sequences = randomizer->GetNextSequences(minibatchSize);
+        if (sequences.m_data.empty())
+        {
+            BOOST_CHECK(sequences.m_endOfEpoch);
+            break;
+        }
+
+        // the sequences of a minibatch are padded to the longest one
+        size_t maxLength = 0;
+        for (const auto& sequence : sequences.m_data.front())
+        {
+            maxLength = max(maxLength, (size_t)sequence->m_numberOfSamples);
+        }
+        for (const auto& sequence : sequences.m_data.front())
+        {
+            numPaddingSamples += maxLength - sequence->m_numberOfSamples;
+            actual.push_back(*((float*)reinterpret_cast<DenseSequenceData&>(*sequence).m_data));
+        }
+    }
+    return actual;
+}
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerLengthBucketing)
+{
+    size_t numPaddingSamples, numBucketedPaddingSamples;
+    auto actual = BlockRandomizerLengthBucketingSweep(0, 100, numPaddingSamples);
+    auto bucketed = BlockRandomizerLengthBucketingSweep(400, 100, numBucketedPaddingSamples);
+
+    // all sequences are returned once, in a different order
+    BOOST_CHECK(actual != bucketed);
+    sort(actual.begin(), actual.end());
+    sort(bucketed.begin(), bucketed.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), bucketed.begin(), bucketed.end());
+    BOOST_CHECK_EQUAL(bucketed.size(), 500u);
+
+    // with much less padding
+    BOOST_TEST_MESSAGE("Padding " << numPaddingSamples << " samples without and " << numBucketedPaddingSamples << " samples with length bucketing");
+    BOOST_CHECK_LT(3 * numBucketedPaddingSamples, numPaddingSamples);
+}
+
 BOOST_AUTO_TEST_CASE(NoRandomizerOneEpoch)
 {
     vector<float> data(10);